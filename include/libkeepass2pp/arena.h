@@ -0,0 +1,114 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef KDBXARENA_H
+#define KDBXARENA_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace Kdbx{
+
+/** @brief Arena is a region allocator for objects of a database tree.
+ *
+ * Groups, entries and versions allocate their memory with Arena::allocate().
+ * While an arena is made current in a thread with an Arena::Scope object,
+ * those objects are placed one after another in large chunks of memory owned
+ * by the arena, instead of being allocated separately. Otherwise they are
+ * allocated on the heap.
+ *
+ * Each chunk counts objects that are placed in it. Objects can outlive the
+ * arena and can be destroyed in any order and in any thread; a chunk is
+ * zeroed and released when its last object is destroyed and the arena moved
+ * on to another chunk (or was destroyed). Memory of destroyed objects is not
+ * reused before that, so arenas are meant for objects that are created
+ * together and destroyed together, like a tree of a deserialized database.
+ */
+class Arena{
+public:
+    /** @brief Scope makes an arena current in a thread for as long as
+     *         Scope object lives.
+     *
+     * Scopes can be nested; destroying a scope makes previously current
+     * arena current again.
+     */
+    class Scope{
+    public:
+        /** @brief Makes \p arena current in calling thread.
+         * @param arena Arena to be made current, or nullptr if objects are to
+         *        be allocated on the heap.
+         */
+        explicit Scope(Arena* arena) noexcept;
+        ~Scope() noexcept;
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena* fprevious;
+    };
+
+    /** @brief Constructs an arena that allocates chunks of \p chunkSize
+     *         bytes.
+     */
+    explicit Arena(std::size_t chunkSize = 64 * 1024) noexcept;
+
+    /** @brief Releases chunks that hold no objects. Remaining chunks are
+     *         released when their last object is destroyed.
+     */
+    ~Arena() noexcept;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /** @brief Allocates \p size bytes in an arena that is current in calling
+     *         thread, or on the heap if there is no such arena.
+     *
+     * Returned memory is aligned as memory returned by malloc(). Objects
+     * larger than a quarter of a chunk are always allocated on the heap.
+     */
+    static void* allocate(std::size_t size);
+
+    /** @brief Releases memory returned by allocate().
+     *
+     * It can be called in any thread, not just the one that allocated
+     * \p ptr. Memory released to the heap is zeroed first.
+     */
+    static void deallocate(void* ptr) noexcept;
+
+    /** @brief Returns number of chunks allocated by this arena so far.*/
+    inline std::size_t chunks() const noexcept{
+        return fchunks;
+    }
+
+private:
+    struct Chunk;
+    struct Header;
+
+    Chunk* newChunk();
+    static void release(Chunk* chunk) noexcept;
+
+    std::size_t fchunkSize;
+    Chunk* fcurrent;
+    char* fnext;
+    char* fend;
+    std::size_t fchunks;
+};
+
+}
+
+#endif // KDBXARENA_H
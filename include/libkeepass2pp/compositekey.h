@@ -19,6 +19,8 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 #define COMPOSITEKEY_H
 
 #include <vector>
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <memory>
@@ -138,9 +140,26 @@ public:
     SafeVector<uint8_t> getCompositeKey(const std::array<uint8_t, 32>& transformSeed,
                                         uint64_t encryptionRounds) const;
 
+    /** @brief Creates a composite key buffer, unless \p cancel is set in the
+     *         meantime.
+     *
+     * Key transformation can take seconds with a large number of encryption
+     * rounds. This overload checks \p cancel periodically while encrypting,
+     * so that other threads can abort it.
+     * @return Transformed key, or an empty vector if key transformation was
+     *         cancelled.
+     */
+    SafeVector<uint8_t> getCompositeKey(const std::array<uint8_t, 32>& transformSeed,
+                                        uint64_t encryptionRounds,
+                                        const std::atomic<bool>& cancel) const;
+
 
 private:
 
+    SafeVector<uint8_t> transformKey(const std::array<uint8_t, 32>& transformSeed,
+                                     uint64_t encryptionRounds,
+                                     const std::atomic<bool>* cancel) const;
+
     std::vector<Key::Ptr> keys;
 };
 
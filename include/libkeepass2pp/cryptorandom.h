@@ -75,6 +75,47 @@ public:
      */
     virtual SafeVector<uint8_t> read(std::size_t size) =0;
 
+    /** @brief Returns current stream position, that is a number of bytes read
+     *         from the stream so far.
+     */
+    virtual uint64_t position() const noexcept =0;
+
+    /** @brief Checks whether the stream supports random access.
+     *
+     * Seekable streams can be moved to any position with seek(), and their
+     * bytes can be generated at any offset with keystreamAt(). Streams that
+     * are not seekable can only be moved forward, and keystreamAt() throws
+     * std::runtime_error.
+     */
+    virtual bool seekable() const noexcept =0;
+
+    /** @brief Moves stream position to \p offset bytes from the beginning of
+     *         the stream.
+     *
+     * Next read returns the same bytes it would return if exactly \p offset
+     * bytes were read from the stream since it was constructed. It throws
+     * std::runtime_error if the stream is not seekable and \p offset is
+     * before current position.
+     */
+    virtual void seek(uint64_t offset) =0;
+
+    /** @brief Generates bytes of the stream at a given offset into a buffer.
+     * @param offset Offset of the first generated byte from the beginning of
+     *        the stream;
+     * @param begin Pointer to the begining of the buffer;
+     * @param end Pointer to a first byte after the end of the buffer;
+     *
+     * It does not change stream position, so it can be used concurrently by
+     * many threads to unmask values stored at known offsets.
+     */
+    virtual void keystreamAtRaw(uint64_t offset, uint8_t* begin, uint8_t* end) const =0;
+
+    /** @brief Returns \p size bytes of the stream at a given \p offset.
+     *
+     * It does not change stream position.
+     */
+    SafeVector<uint8_t> keystreamAt(uint64_t offset, std::size_t size) const;
+
     /** @brief Constructs new RandomStream and returns an owning pointer to it.
      * @param algorithm Algorithm used to generate pseudo-random stream;
      * @param key Buffer used as key to initialize pseudo-random stream;
@@ -87,30 +128,58 @@ public:
  * Ignores initialization key, and returns only zeros.
  */
 class Null: public RandomStream{
+private:
+    uint64_t fposition;
+
 public:
 
     inline Null() noexcept
+        :fposition(0)
     {}
 
     inline Null(const SafeVector<uint8_t>&) noexcept
+        :fposition(0)
     {}
 
     /** @brief Implemetation of RandomStream::readRaw. */
     inline void readRaw(uint8_t* dataBegin, uint8_t* dataEnd) noexcept override{
         memset(dataBegin, 0, dataEnd - dataBegin);
+        fposition += dataEnd - dataBegin;
     }
 
     /** @brief Implemetation of RandomStream::read. */
     inline SafeVector<uint8_t> read(std::size_t size) override{
+        fposition += size;
         return SafeVector<uint8_t>(size);
     }
 
     /** @brief Returns a fixed-size array of pseudo-random bytes. */
     template <std::size_t size>
     std::array<uint8_t, size> readFixed() noexcept{
+        fposition += size;
         return std::array<uint8_t, size>();
     }
 
+    /** @brief Implemetation of RandomStream::position. */
+    inline uint64_t position() const noexcept override{
+        return fposition;
+    }
+
+    /** @brief Implemetation of RandomStream::seekable. */
+    inline bool seekable() const noexcept override{
+        return true;
+    }
+
+    /** @brief Implemetation of RandomStream::seek. */
+    inline void seek(uint64_t offset) noexcept override{
+        fposition = offset;
+    }
+
+    /** @brief Implemetation of RandomStream::keystreamAtRaw. */
+    inline void keystreamAtRaw(uint64_t, uint8_t* dataBegin, uint8_t* dataEnd) const noexcept override{
+        memset(dataBegin, 0, dataEnd - dataBegin);
+    }
+
 };
 
 /** @brief Implementation of a Sals20 algorithm. */
@@ -136,6 +205,22 @@ public:
     /** @brief Implemetation of RandomStream::read. */
     SafeVector<uint8_t> read(std::size_t size) override;
 
+    /** @brief Implemetation of RandomStream::position. */
+    uint64_t position() const noexcept override;
+
+    /** @brief Implemetation of RandomStream::seekable. */
+    bool seekable() const noexcept override;
+
+    /** @brief Implemetation of RandomStream::seek.
+     *
+     * Salsa20 generates its stream in 64-byte blocks numbered by a counter,
+     * so seeking only sets the counter and generates a single block.
+     */
+    void seek(uint64_t offset) noexcept override;
+
+    /** @brief Implemetation of RandomStream::keystreamAtRaw. */
+    void keystreamAtRaw(uint64_t offset, uint8_t* dataBegin, uint8_t* dataEnd) const noexcept override;
+
 };
 
 /** @brief A modified version of RC4 algorythm.
@@ -150,6 +235,7 @@ private:
 	std::array<uint8_t, 256> state;
 	uint8_t m_i;
 	uint8_t m_j;
+	uint64_t fposition;
 
 public:
     /** @brief Initializes ArcFourVariant with provided key. */
@@ -164,6 +250,25 @@ public:
     /** @brief Implemetation of RandomStream::read. */
     SafeVector<uint8_t> read(std::size_t size) override;
 
+    /** @brief Implemetation of RandomStream::position. */
+    uint64_t position() const noexcept override;
+
+    /** @brief Implemetation of RandomStream::seekable. */
+    bool seekable() const noexcept override;
+
+    /** @brief Implemetation of RandomStream::seek.
+     *
+     * ArcFourVariant can only be moved forward, by discarding bytes up to
+     * \p offset.
+     */
+    void seek(uint64_t offset) override;
+
+    /** @brief Implemetation of RandomStream::keystreamAtRaw.
+     *
+     * It always throws std::runtime_error, as ArcFourVariant is not seekable.
+     */
+    void keystreamAtRaw(uint64_t offset, uint8_t* begin, uint8_t* end) const override;
+
 };
 
 }
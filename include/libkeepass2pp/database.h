@@ -17,6 +17,7 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef KDBXDATABASE_H
 #define KDBXDATABASE_H
 
+#include <algorithm>
 #include <vector>
 #include <list>
 #include <string>
@@ -27,20 +28,27 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 #include <bitset>
 #include <cstring>
 #include <future>
+#include <mutex>
 #include <type_traits>
 #include <set>
+#include <unordered_map>
 #include <istream>
 
+#include "arena.h"
 #include "util.h"
 #include "icon.h"
 #include "cryptorandom.h"
 #include "compositekey.h"
 
+class Pipeline;
+
 namespace Kdbx{
 
 namespace Internal{
 template <typename T>
 class Parser;
+class XmlReaderLink;
+class Snapshot;
 }
 
 /**
@@ -137,6 +145,8 @@ public:
     typedef std::unique_ptr<Database> Ptr;
 
     class Settings;
+    class Binary;
+    class BinaryPool;
     class Version;
     class Entry;
     class Group;
@@ -217,6 +227,83 @@ public:
 
         };
 
+        /** @brief Visitor is an interface used to read a database file
+         *         without building a complete Database object.
+         *
+         * Visitor methods are called by visit() as groups and entries are
+         * parsed, in document order. Every group and entry object is destroyed
+         * right after its visitor method returns, so memory use does not depend
+         * on the size of the database. Group objects passed to the visitor have
+         * no subgroups nor entries, and Entry objects belong to such groups.
+         *
+         * @note Visitor methods are called from a parser thread, not from a
+         *       thread that called visit().
+         */
+        class Visitor{
+        public:
+            /** @brief Parts of a database that are skipped without being
+             *         decoded.
+             *
+             * Flags can be or-ed together and passed to visit().
+             */
+            enum Skip: unsigned{
+                /// Entries contain only their latest version.
+                SkipHistory = 1,
+                /// Versions contain no attachments, and attachment pool in
+                /// database metadata is not decoded.
+                SkipBinaries = 2,
+                /// Custom icons in database metadata are counted but not
+                /// decoded, and groups and entries that use them get their
+                /// standard icons.
+                SkipCustomIcons = 4
+            };
+
+            virtual ~Visitor();
+
+            /** @brief Called when a group is entered, before any of its
+             *         entries or subgroups is visited.
+             * @param group Group with all of its properties set. Its parent()
+             *        is a group passed to enclosing enterGroup() call.
+             * @return \p false if entire subtree of \p group is to be skipped.
+             *
+             * Default implementation returns \p true.
+             */
+            virtual bool enterGroup(const Group& group);
+
+            /** @brief Called when all entries and subgroups of a group were
+             *         visited (or skipped).
+             *
+             * Default implementation does nothing.
+             */
+            virtual void leaveGroup(const Group& group);
+
+            /** @brief Called for each entry of a visited group.
+             * @param entry Entry whose parent() is the group that contains it.
+             */
+            virtual void entry(const Entry& entry) =0;
+        };
+
+        /** @brief Database properties that are stored in front of groups
+         *         and entries, as returned by getMetadata().
+         */
+        struct Metadata{
+            std::string name; //! Database name.
+            std::string description; //! Database description.
+            std::string defaultUsername; //! Default user name of new entries.
+            bool recycleBinEnabled; //! Whether deleted items are moved to
+                                    //! the recycle bin.
+            Uuid recycleBin; //! UUID of the recycle bin group, or a nil UUID.
+            std::size_t customIconCount; //! Number of custom icons.
+            std::vector<CustomIcon::Ptr> customIcons; //! Custom icons, unless
+                                                      //! they were skipped.
+
+            inline Metadata() noexcept
+                :recycleBinEnabled(false),
+                  recycleBin(Uuid::nil()),
+                  customIconCount(0)
+            {}
+        };
+
     private:
         std::unique_ptr<std::istream> ffile;
 
@@ -234,6 +321,38 @@ public:
          */
         Settings settings;
 
+        /** @brief Sets up \p pipeline to read the payload, decrypt it and
+         *         check its hashed blocks.
+         * @param compositeKey Key used to decrypt the file, or nullptr if no
+         *        key was provided.
+         * @param transformedKey \p compositeKey already transformed by
+         *        verifyKey(), or an empty vector if it is yet to be transformed.
+         *
+         * Payload is passed on still compressed, if it is compressed.
+         */
+        void readPayload(Pipeline& pipeline, const CompositeKey* compositeKey, const SafeVector<uint8_t>& transformedKey);
+
+        /** @brief Builds decryption pipeline that feeds XML parser \p finish
+         *         and starts it.
+         * @param useKey Whether composite key held by \p finish is to be used
+         *        to decrypt a file.
+         * @param transformedKey Composite key held by \p finish, already
+         *        transformed by verifyKey(), or an empty vector if it is yet
+         *        to be transformed.
+         */
+        void startReading(std::unique_ptr<Internal::XmlReaderLink> finish, bool useKey,
+                          const SafeVector<uint8_t>& transformedKey = SafeVector<uint8_t>());
+
+        /** @brief Reads first 32 bytes of the payload, and seeks the stream
+         *         back to where it was.
+         */
+        std::array<uint8_t, 32> payloadStart();
+
+        /** @brief Checks whether a payload starting with \p payload bytes is
+         *         decrypted into stream start bytes with \p transformedKey.
+         */
+        bool decrypts(std::array<uint8_t, 32> payload, const SafeVector<uint8_t>& transformedKey) const;
+
     public:
         /** @brief Returns \p true if a proper composite key is required in order to
          *         properly deserialize a database.
@@ -272,6 +391,58 @@ public:
          */
         std::future<Database::Ptr> getDatabase(CompositeKey compositeKey);
 
+        /** @brief Checks whether \p compositeKey decrypts the file.
+         * @param compositeKey CompositeKey to be checked.
+         * @return \p compositeKey transformed with file's seed and rounds; it
+         *         can be passed to getDatabase() along with \p compositeKey, so
+         *         that the key is not transformed again. For a file that is not
+         *         encrypted, the key is not used and an empty vector is
+         *         returned.
+         *
+         * Only the first two cipher blocks of the payload are decrypted and
+         * compared with stream start bytes from the header, so a wrong key
+         * costs no more than the key transformation itself. If the key is
+         * wrong, an std::runtime_error is thrown.
+         *
+         * Unlike getDatabase(), this method leaves \p File object valid. It
+         * reads from the stream the file was loaded from, and then seeks it
+         * back, so the stream must be seekable (like streams opened by
+         * loadFromFile()).
+         */
+        SafeVector<uint8_t> verifyKey(const CompositeKey& compositeKey);
+
+        /** @brief Initializes deserialization process with a composite key
+         *         that was checked with verifyKey().
+         * @param compositeKey CompositeKey that is used in order to decrypt
+         *        database, and that is assigned to it.
+         * @param transformedKey Transformed key returned by verifyKey() for
+         *        \p compositeKey.
+         *
+         * This is an overload of getDatabase() that skips key transformation.
+         */
+        std::future<Database::Ptr> getDatabase(CompositeKey compositeKey, const SafeVector<uint8_t>& transformedKey);
+
+        /** @brief Initializes deserialization process with whichever of
+         *         several composite keys decrypts the file.
+         * @param candidates Composite keys to be tried. The one that decrypts
+         *        the file is assigned to the database.
+         * @param threads Maximum number of keys that are transformed at the
+         *        same time, or 0 to use one thread per hardware core.
+         *
+         * Keys are transformed on worker threads, and each is checked as in
+         * verifyKey(). As soon as one of them matches, transformations of the
+         * remaining keys are cancelled and the database is loaded with the
+         * matching key, as in getDatabase(). This method blocks until a key
+         * is found, which takes about as long as a single key transformation
+         * if there are enough cores.
+         *
+         * If none of the keys decrypts the file, an std::runtime_error is
+         * thrown and \p File object stays valid, as in verifyKey(). If the
+         * file is not encrypted, the first candidate is used. The stream must
+         * be seekable.
+         */
+        std::future<Database::Ptr> getDatabase(std::vector<CompositeKey> candidates, unsigned threads = 0);
+
         /** @brief Initializes deserialization process.
          * @return std::future object that gets an owning pointer to database
          *         as its value.
@@ -295,6 +466,110 @@ public:
          */
         std::future<Database::Ptr> getDatabase();
 
+        /** @brief Initializes deserialization process that parses a database
+         *         on several threads.
+         * @param compositeKey CompositeKey that is used in order to decrypt
+         *        database; see getDatabase().
+         * @param threads Number of threads that parse groups, or 0 to use as
+         *        many threads as there are processor cores.
+         * @return std::future object that gets an owning pointer to database
+         *         as its value.
+         *
+         * Decrypted and decompressed XML document is read into memory first.
+         * Subgroups of the root group are then parsed concurrently, each
+         * with protected values unmasked from its own offset of the random
+         * stream. Resulting database is the same as the one returned by
+         * getDatabase(); this method just trades memory for load time of
+         * large databases with several top-level groups. Documents that
+         * cannot be split this way, including those that use
+         * RandomStream::Algorithm::ArcFourVariant, are parsed by a single
+         * thread.
+         *
+         * Errors are reported in the same way as in getDatabase(), and this
+         * call renders \p File object invalid as well.
+         */
+        std::future<Database::Ptr> getDatabaseParallel(CompositeKey compositeKey, unsigned threads = 0);
+
+        /** @brief Initializes deserialization process that parses a database
+         *         on several threads.
+         *
+         * This is an overload that doesn't use composite key, and can only be
+         * used if database is not encrypted; see getDatabase().
+         */
+        std::future<Database::Ptr> getDatabaseParallel(unsigned threads = 0);
+
+        /** @brief Initializes streaming deserialization process.
+         * @param key CompositeKey that is used in order to decrypt datbase.
+         * @param visitor Visitor object that is handed groups and entries as
+         *        they are parsed. It must remain valid until returned future
+         *        is ready.
+         * @param skip Or-ed Visitor::Skip flags.
+         * @return std::future object that becomes ready once entire file was
+         *         read.
+         *
+         * Unlike getDatabase(), this method never builds a Database object;
+         * see Visitor for details. Errors are reported in the same way as in
+         * getDatabase(), and this call renders \p File object invalid as well.
+         */
+        std::future<void> visit(CompositeKey compositeKey, Visitor& visitor, unsigned skip = 0);
+
+        /** @brief Initializes streaming deserialization process.
+         *
+         * This is an overload that doesn't use composite key, and can only be
+         * used if database is not encrypted; see getDatabase().
+         */
+        std::future<void> visit(Visitor& visitor, unsigned skip = 0);
+
+        /** @brief Reads database metadata only.
+         * @param compositeKey CompositeKey that is used in order to decrypt
+         *        database; see getDatabase().
+         * @param skip Or-ed Visitor::SkipBinaries and
+         *        Visitor::SkipCustomIcons flags. Parts that are not skipped
+         *        are decoded, so that errors in them are reported.
+         * @return std::future object that gets metadata as its value.
+         *
+         * The file is only decrypted and decompressed until Meta element of
+         * the document is parsed; reading is then stopped, and groups and
+         * entries are never parsed. Errors are reported in the same way as in
+         * getDatabase(), and this call renders \p File object invalid as well.
+         */
+        std::future<Metadata> getMetadata(CompositeKey compositeKey, unsigned skip = Visitor::SkipBinaries | Visitor::SkipCustomIcons);
+
+        /** @brief Reads database metadata only.
+         *
+         * This is an overload that doesn't use composite key, and can only be
+         * used if database is not encrypted; see getDatabase().
+         */
+        std::future<Metadata> getMetadata(unsigned skip = Visitor::SkipBinaries | Visitor::SkipCustomIcons);
+
+        /** @brief Writes the database to \p file encrypted with another
+         *         composite key, without deserializing it.
+         * @param compositeKey CompositeKey that is used in order to decrypt
+         *        the database; see getDatabase().
+         * @param newKey CompositeKey the database is to be encrypted with.
+         * @param transformRounds Number of key transformation rounds to be
+         *        used with \p newKey.
+         * @param file Output stream to write the database to.
+         * @return std::future object that receives \p file when the database
+         *         was written, or throws an exception if the payload turns out
+         *         to be corrupted.
+         *
+         * Payload is decrypted and encrypted again block by block, and the XML
+         * document in it is not parsed, so this is much faster than loading a
+         * database and saving it with a new key, and it takes little memory
+         * regardless of the size of the database. New header gets new random
+         * seeds; compression and protected stream key are kept, so protected
+         * values stay valid. Compressed payload is only inflated to update
+         * the header hash it stores, and compressed again.
+         *
+         * \p compositeKey is checked with verifyKey() first. If it is wrong,
+         * an exception is thrown before anything is written to \p file, and
+         * \p File object stays valid. Otherwise this method renders \p File
+         * object invalid, as getDatabase() does.
+         */
+        std::future<std::unique_ptr<std::ostream>> rekey(CompositeKey compositeKey, const CompositeKey& newKey,
+                                                         uint64_t transformRounds, std::unique_ptr<std::ostream> file);
+
 
         friend class Database;
     };
@@ -400,9 +675,125 @@ public:
 
         friend class Internal::Parser<Database::Meta>;
         friend class Internal::Parser<Database>;
+        friend class Internal::Snapshot;
         friend class Database;
     };
 
+    class TagNames;
+
+    /** @brief Interned tag name.
+     *
+     * Tags convert implicitly from and to std::string, so they can be used
+     * wherever tag names were used, while every distinct name is stored once,
+     * no matter how many versions carry it. Tag ids can be used as keys of tag
+     * indexes.
+     */
+    typedef InternedString<TagNames> Tag;
+
+    /** @brief Contents of an attachment.
+     *
+     * Binary objects are immutable, so a single object can be shared by many
+     * versions (and threads). Attachments read from a KDBX file are kept
+     * gzip-compressed, the way they were stored, until data() is called for
+     * the first time, so that attachments that are never accessed cost
+     * neither decompression time nor memory.
+     */
+    class Binary{
+    public:
+        /** @brief Shared pointer to a Binary object.*/
+        typedef std::shared_ptr<Binary> Ptr;
+
+        /** @brief SHA-256 digest identifying contents of a Binary object.*/
+        typedef std::array<uint8_t, 32> Hash;
+
+        /** @brief Constructs a Binary object holding \p data.*/
+        inline Binary(SafeVector<uint8_t> data = SafeVector<uint8_t>()) noexcept
+            :fdata(std::move(data))
+        {}
+
+        Binary(const Binary&) = delete;
+        Binary& operator=(const Binary&) = delete;
+
+        /** @brief Creates a Binary object from gzip-compressed data.
+         * @param data gzip stream. Decompression is deferred until the first
+         *        call to data().
+         */
+        static Ptr fromCompressed(SafeVector<uint8_t> data);
+
+        /** @brief Returns attachment contents, decompressing them first if
+         * necessary.
+         *
+         * It throws std::runtime_error if compressed data is corrupted.
+         */
+        const SafeVector<uint8_t>& data() const;
+
+        /** @brief Returns attachment size. It needs data() to be decompressed.*/
+        inline std::size_t size() const{
+            return data().size();
+        }
+
+        /** @brief Returns gzip-compressed form of attachment contents, or
+         * nullptr if they were never compressed.
+         */
+        inline const SafeVector<uint8_t>* compressed() const noexcept{
+            return fcompressed.empty() ? nullptr : &fcompressed;
+        }
+
+        /** @brief Returns SHA-256 digest of attachment contents.
+         *
+         * The digest is computed once. Computing it for an attachment that is
+         * still compressed decompresses it into a temporary buffer, without
+         * keeping decompressed data around.
+         */
+        const Hash& hash() const;
+
+    private:
+        SafeVector<uint8_t> fcompressed;
+        mutable SafeVector<uint8_t> fdata;
+        mutable std::once_flag fdecompressed;
+        mutable Hash fhash;
+        mutable std::once_flag fhashed;
+    };
+
+    /** @brief Content-addressed set of attachments.
+     *
+     * BinaryPool maps digests of attachments to Binary objects, so that
+     * identical attachments are kept in memory once, no matter how they
+     * reached a database. The pool doesn't own attachments: an attachment is
+     * dropped once the last version referencing it is gone.
+     *
+     * Uncompressed attachments are keyed by Binary::hash(). Compressed ones
+     * are keyed by SHA-256 of their gzip streams, so that loading a database
+     * doesn't decompress attachments just to index them. An attachment that
+     * is compressed and an equal one that is not (or is compressed
+     * differently) are kept apart; they are matched by Binary::hash() only
+     * when the database is saved, and share one Binary after it is loaded
+     * again.
+     */
+    class BinaryPool{
+    public:
+        inline BinaryPool() noexcept
+            :fpurgeSize(16)
+        {}
+
+        /** @brief Adds an attachment to the pool.
+         * @param binary Attachment to be added. This pointer cannot be
+         *        nullptr.
+         * @return An attachment from the pool with the same contents as \p
+         *         binary, or \p binary itself if there was no such attachment.
+         */
+        Binary::Ptr insert(Binary::Ptr binary);
+
+    private:
+        typedef std::map<Binary::Hash, std::weak_ptr<Binary>> Binaries;
+
+        void purge();
+
+        Binaries fbinaries;
+        Binaries fcompressed;
+        std::size_t fpurgeSize;
+    };
+
     /** @brief The Version class represents a version of a database entry.
      *
      * A version can be owned by at most one entry at a time.
@@ -416,6 +807,17 @@ public:
          */
         typedef std::unique_ptr<Version> Ptr;
 
+        /** @brief Allocates version objects in an Arena that is current in calling
+         *         thread, if there is one.
+         */
+        inline static void* operator new(std::size_t size){
+            return Arena::allocate(size);
+        }
+
+        inline static void operator delete(void* ptr) noexcept{
+            Arena::deallocate(ptr);
+        }
+
         class Binary;
 
         /**
@@ -429,7 +831,8 @@ public:
         inline Version() noexcept
             :icon(StandardIcon::Key),
               times(Times::nowTimes()),
-              fparent(nullptr)
+              fparent(nullptr),
+              findex(0)
         {}
 
         /**
@@ -451,10 +854,27 @@ public:
               strings(v.strings),
               binaries(v.binaries),
               autoType(v.autoType),
-              fparent(nullptr)
+              fparent(nullptr),
+              findex(0)
 
         {}
 
+        /**
+         * @brief Makes string fields equal to fields of \p other share their
+         *        contents with those fields.
+         * @param other Version whose fields are compared with fields of this
+         *        version; usually the previous version of the same entry.
+         *
+         * Values of string fields are shared between copies of a version, so
+         * history versions created by copying latest version don't duplicate
+         * fields that were not changed. Versions created separately (for
+         * example when deserializing a database) don't share anything until
+         * this method is called. Fields are compared by their plain contents,
+         * so that a protected field is shared even if it was masked with a
+         * different mask.
+         */
+        void share(const Version& other) noexcept;
+
         /**
          * @brief Returns an entry object that a Version object belongs to.
          *
@@ -513,7 +933,10 @@ public:
          *
          * @return Index of a version in it's parent entry.
          */
-        size_t index() const noexcept;
+        inline size_t index() const noexcept{
+            assert(parent());
+            return findex;
+        }
 
         /**
          * @brief Removes a version from it's parent entry.
@@ -569,15 +992,146 @@ public:
             bool enabled;
         };
 
+        class FieldNames;
+
+        /** @brief Interned name of a string field.*/
+        typedef InternedString<FieldNames> FieldName;
+
+        /** @brief String fields of a version.
+         *
+         * Fields are kept in a single vector sorted by name, with interned
+         * names as keys, instead of a tree of separately allocated nodes each
+         * holding its own copy of a name. Interface is the subset of std::map
+         * interface that is useful for string fields. Lookups by name don't
+         * intern the name, only inserting a new field does.
+         *
+         * Keys must not be modified through iterators. Inserting or erasing
+         * fields invalidates iterators and references to field values.
+         */
+        class Strings{
+        public:
+            typedef std::pair<FieldName, XorredBuffer> value_type;
+            typedef std::vector<value_type>::iterator iterator;
+            typedef std::vector<value_type>::const_iterator const_iterator;
+
+            inline iterator begin() noexcept{
+                return fitems.begin();
+            }
+
+            inline iterator end() noexcept{
+                return fitems.end();
+            }
+
+            inline const_iterator begin() const noexcept{
+                return fitems.begin();
+            }
+
+            inline const_iterator end() const noexcept{
+                return fitems.end();
+            }
+
+            inline std::size_t size() const noexcept{
+                return fitems.size();
+            }
+
+            inline bool empty() const noexcept{
+                return fitems.empty();
+            }
+
+            inline void clear() noexcept{
+                fitems.clear();
+            }
+
+            /** @brief Returns iterator to a field named \p name, or end()
+             *         if there is no such field.
+             */
+            inline iterator find(const std::string& name) noexcept{
+                return find(name.data(), name.size());
+            }
+
+            inline const_iterator find(const std::string& name) const noexcept{
+                return const_cast<Strings*>(this)->find(name.data(), name.size());
+            }
+
+            inline iterator find(const char* name) noexcept{
+                return find(name, std::strlen(name));
+            }
+
+            inline const_iterator find(const char* name) const noexcept{
+                return const_cast<Strings*>(this)->find(name, std::strlen(name));
+            }
+
+            inline iterator find(const FieldName& name) noexcept{
+                return std::find_if(fitems.begin(), fitems.end(), [&name](const value_type& item){
+                    return item.first == name;
+                });
+            }
+
+            inline const_iterator find(const FieldName& name) const noexcept{
+                return const_cast<Strings*>(this)->find(name);
+            }
+
+            template <typename Key>
+            inline std::size_t count(const Key& name) const noexcept{
+                return find(name) != end();
+            }
+
+            /** @brief Returns value of a field named \p name, inserting an
+             *         empty field first if there is no such field.
+             */
+            XorredBuffer& operator[](const std::string& name);
+
+            inline XorredBuffer& operator[](const char* name){
+                return (*this)[std::string(name)];
+            }
+
+            inline XorredBuffer& operator[](const FieldName& name){
+                return (*this)[name.name()];
+            }
+
+            /** @brief Inserts a field unless a field with the same name
+             *         already exists.
+             * @return Pair of an iterator to the field with given name and a
+             *         flag telling whether it was inserted.
+             */
+            std::pair<iterator, bool> insert(value_type item);
+
+            inline std::pair<iterator, bool> insert(std::pair<std::string, XorredBuffer> item){
+                return insert(value_type(std::move(item.first), std::move(item.second)));
+            }
+
+            /** @brief Erases a field named \p name.
+             * @return Number of erased fields.
+             */
+            template <typename Key>
+            inline std::size_t erase(const Key& name) noexcept{
+                iterator it = find(name);
+                if (it == end())
+                    return 0;
+                fitems.erase(it);
+                return 1;
+            }
+
+            inline iterator erase(const_iterator it) noexcept{
+                return fitems.erase(it);
+            }
+
+        private:
+            iterator lowerBound(const char* name, std::size_t size) noexcept;
+            iterator find(const char* name, std::size_t size) noexcept;
+            iterator emplace(iterator position, value_type item);
+
+            std::vector<value_type> fitems;
+        };
+
         Icon icon;
         std::string fgColor;
         std::string bgColor;
         std::string overrideUrl;
-        std::vector<std::string> tags;
+        std::vector<Tag> tags;
         Times times;
-        std::map<std::string, XorredBuffer> strings;
-        // ToDo: XorredBuffer, SafeVector, or even something else?
-        std::map<std::string, std::shared_ptr<SafeVector<uint8_t>>> binaries;
+        Strings strings;
+        std::map<std::string, Database::Binary::Ptr> binaries;
         AutoType autoType;
 
         static const char* const titleString; /// Name of title field in strings array
@@ -593,7 +1147,8 @@ public:
          *        This pointer cannot be nullptr.
          */
         inline Version(Entry* parent) noexcept
-            :fparent(parent)
+            :fparent(parent),
+              findex(0)
         {}
 
         /** @brief Updates database metadata after a new version object was
@@ -620,10 +1175,12 @@ public:
 
 
         Entry* fparent;
+        std::size_t findex;
 
         friend class Entry;
         friend class Database;
         friend class Internal::Parser<Version>;
+        friend class Internal::Snapshot;
         friend class DatabaseModel;
 
     };
@@ -648,6 +1205,17 @@ public:
          */
         typedef std::unique_ptr<Entry> Ptr;
 
+        /** @brief Allocates entry objects in an Arena that is current in calling
+         *         thread, if there is one.
+         */
+        inline static void* operator new(std::size_t size){
+            return Arena::allocate(size);
+        }
+
+        inline static void operator delete(void* ptr) noexcept{
+            Arena::deallocate(ptr);
+        }
+
 
         /**
          * @brief Constructs a new Entry object that takes ownership of a
@@ -660,7 +1228,8 @@ public:
          */
         inline Entry(Version::Ptr current)
             :fuuid(Uuid::generate()),
-              fparent(nullptr)
+              fparent(nullptr),
+              findex(0)
         {
             current->fparent = this;
             fversions.push_back(std::move(current));
@@ -678,7 +1247,8 @@ public:
          */
         inline Entry(Uuid uuid, Version::Ptr current)
             :fuuid(std::move(uuid)),
-              fparent(nullptr)
+              fparent(nullptr),
+              findex(0)
         {
             current->fparent = this;
             fversions.push_back(std::move(current));
@@ -737,14 +1307,8 @@ public:
          * @return Index of an entry in it's parent group.
          */
         size_t index() const noexcept{
-            const Group* p = parent();
-            assert(p);
-            for (size_t i=0; i<p->entries(); ++i){
-                if (p->entry(i) == this)
-                    return i;
-            }
-            assert("Internal error." == nullptr);
-            return 0;
+            assert(parent());
+            return findex;
         }
 
         /**
@@ -786,12 +1350,8 @@ public:
          * @return Index of \p v in current entry.
          */
         size_t index(const Version* v) const noexcept{
-            for (size_t i=0; i<versions(); ++i){
-                if (version(i) == v)
-                    return i;
-            }
-            assert("Version not in current entry." == nullptr);
-            return 0;
+            assert(v->parent() == this);
+            return v->findex;
         }
 
         /**
@@ -916,7 +1476,8 @@ public:
          */
         inline Entry(Group* parent) noexcept
             :fuuid(DoNotInit),
-              fparent(parent)
+              fparent(parent),
+              findex(0)
         {}
 
         /**
@@ -928,7 +1489,8 @@ public:
          * code before passing created object to the library user.
          */
         inline Entry(Group* parent, Version::Ptr current) noexcept
-            :fparent(parent)
+            :fparent(parent),
+              findex(0)
         {
             current->fparent = this;
             fversions.push_back(std::move(current));
@@ -942,7 +1504,8 @@ public:
          */
         inline Entry(Group* parent, Uuid uuid, Version::Ptr current)
             :fuuid(uuid),
-              fparent(parent)
+              fparent(parent),
+              findex(0)
         {
             current->fparent = this;
             fversions.push_back(std::move(current));
@@ -983,9 +1546,11 @@ public:
 
         Uuid fuuid;
         Group* fparent;
+        std::size_t findex;
         std::vector<Version::Ptr> fversions;
 
         friend class Internal::Parser<Entry>;
+        friend class Internal::Snapshot;
         friend class Group;
         friend class Database;
         friend class DatabaseModel;
@@ -1008,6 +1573,17 @@ public:
          */
         typedef std::unique_ptr<Group> Ptr;
 
+        /** @brief Allocates group objects in an Arena that is current in calling
+         *         thread, if there is one.
+         */
+        inline static void* operator new(std::size_t size){
+            return Arena::allocate(size);
+        }
+
+        inline static void operator delete(void* ptr) noexcept{
+            Arena::deallocate(ptr);
+        }
+
         /** @brief Group properties.
          *
          * This structure is used to describe user-visible properties of a group.
@@ -1068,6 +1644,7 @@ public:
         inline Group(Uuid uuid = Uuid::generate()) noexcept
             :fparent(nullptr),
               fdatabase(nullptr),
+              findex(0),
               fuuid(std::move(uuid)),
               fproperties(new Properties())
         {}
@@ -1240,7 +1817,9 @@ public:
          * @return Group with specified UUID or nullptr if no such group exists.
          *
          * This method searches through entire subtree rooted at this group, not just
-         * groups owned directly by it.
+         * groups owned directly by it. For groups that belong to a database it
+         * uses database's UUID index and takes time proportional to the
+         * depth of the group.
          */
         inline Group* group(const Uuid& uuid) noexcept{
             return groupLookup(uuid);
@@ -1253,7 +1832,9 @@ public:
          * @return Group with specified UUID or nullptr if no such group exists.
          *
          * This method searches through entire subtree rooted at this group, not just
-         * groups owned directly by it.
+         * groups owned directly by it. For groups that belong to a database it
+         * uses database's UUID index and takes time proportional to the
+         * depth of the group.
          */
         inline const Group* group(const Uuid& uuid) const noexcept{
             return groupLookup(uuid);
@@ -1386,7 +1967,9 @@ public:
          *         entry exists.
          *
          * This method searches through entire subtree rooted at this group, not just
-         * entries owned directly by it.
+         * entries owned directly by it. For groups that belong to a database it
+         * uses database's UUID index and takes time proportional to the
+         * depth of the entry.
          */
         inline Entry* entry(const Uuid& uuid) noexcept{
             return entryLookup(uuid);
@@ -1400,7 +1983,9 @@ public:
          *         entry exists.
          *
          * This method searches through entire subtree rooted at this group, not just
-         * entries owned directly by it.
+         * entries owned directly by it. For groups that belong to a database it
+         * uses database's UUID index and takes time proportional to the
+         * depth of the entry.
          */
         inline const Entry* entry(const Uuid& uuid) const noexcept{
             return entryLookup(uuid);
@@ -1500,6 +2085,7 @@ public:
         inline Group(Group* parent) noexcept
             :fparent(parent),
               fdatabase(parent->fdatabase),
+              findex(0),
               fuuid(DoNotInit),
               fproperties(new Properties())
         {}
@@ -1513,6 +2099,7 @@ public:
         inline Group(Database* database) noexcept
             :fparent(nullptr),
               fdatabase(database),
+              findex(0),
               fuuid(DoNotInit),
               fproperties(new Properties())
         {}
@@ -1591,6 +2178,7 @@ public:
 
         Group* fparent;
         Database* fdatabase;
+        std::size_t findex;
 
         Uuid fuuid;
         Properties::Ptr fproperties;
@@ -1599,6 +2187,7 @@ public:
         std::vector<Entry::Ptr> fentries;
 
         friend class Internal::Parser<Group>;
+        friend class Internal::Snapshot;
         friend class Database;
         friend class DatabaseModel;
     };
@@ -1644,44 +2233,48 @@ public:
      * @param uuid UUID of a group object to retrieve.
      * @return Group with specified UUID or nullptr if no such group exists.
      *
-     * This method searches through entire database tree.
+     * It takes constant time on average. If several groups share the UUID,
+     * any of them is returned.
      */
     inline Group* group(const Uuid& uuid) noexcept{
-        if (froot->fuuid == uuid)
-            return froot.get();
-        return froot->groupLookup(uuid);
+        auto it = fgroupIndex.find(uuid);
+        return it != fgroupIndex.end() ? it->second : nullptr;
     }
 
     /** @brief Returns non-owning pointer to the group with specified UUID.
      * @param uuid UUID of a group object to retrieve.
      * @return Group with specified UUID or nullptr if no such group exists.
      *
-     * This method searches through entire database tree.
+     * It takes constant time on average. If several groups share the UUID,
+     * any of them is returned.
      */
     inline const Group* group(const Uuid& uuid) const noexcept{
-        if (froot->fuuid == uuid)
-            return froot.get();
-        return froot->groupLookup(uuid);
+        auto it = fgroupIndex.find(uuid);
+        return it != fgroupIndex.end() ? it->second : nullptr;
     }
 
     /** @brief Returns non-owning pointer to the entry with specified UUID.
      * @param uuid UUID of an entry object to retrieve.
      * @return Entry with specified UUID or nullptr if no such entry exists.
      *
-     * This method searches through entire database tree.
+     * It takes constant time on average. If several entries share the UUID,
+     * any of them is returned.
      */
     inline Entry* entry(const Uuid& uuid) noexcept{
-        return froot->entryLookup(uuid);
+        auto it = fentryIndex.find(uuid);
+        return it != fentryIndex.end() ? it->second : nullptr;
     }
 
     /** @brief Returns non-owning pointer to the entry with specified UUID.
      * @param uuid UUID of an entry object to retrieve.
      * @return Entry with specified UUID or nullptr if no such entry exists.
      *
-     * This method searches through entire database tree.
+     * It takes constant time on average. If several entries share the UUID,
+     * any of them is returned.
      */
     inline const Entry* entry(const Uuid& uuid) const noexcept{
-        return froot->entryLookup(uuid);
+        auto it = fentryIndex.find(uuid);
+        return it != fentryIndex.end() ? it->second : nullptr;
     }
 
     // -------------- database settings related ------------------
@@ -1929,6 +2522,30 @@ public:
      */
     void saveToFile(const std::string& filename) const;
 
+    /** @brief Serializes a database into an ostream object, serializing
+     *         subgroups of the root group concurrently.
+     * @param file An owning pointer to an ostream object that is used to store
+     *        serialized data.
+     * @param threads Number of threads that serialize subgroups of the root
+     *        group. 0 means as many threads as there are processor cores.
+     * @return an owning pointer to \p ostream \p object.
+     *
+     * Output is the same as that of saveToFile(), except for random salts
+     * and keys. Subgroups are serialized in parallel only if the inner random
+     * stream algorithm allows to start it at any offset; otherwise the
+     * database is serialized by a single thread.
+     */
+    std::unique_ptr<std::ostream> saveToFileParallel(std::unique_ptr<std::ostream> file, unsigned threads = 0) const;
+
+    /** @brief Serializes a database into a file, serializing subgroups of the
+     *         root group concurrently.
+     * @param filename Filenae to save the data under. Any data that already
+     *        exist in that file is erased.
+     * @param threads Number of threads that serialize subgroups of the root
+     *        group. 0 means as many threads as there are processor cores.
+     */
+    void saveToFileParallel(const std::string& filename, unsigned threads = 0) const;
+
 //    /** @brief Serializes a database into an ostream object *** USING PLAIN XML FORMAT***.
 //     * @param file An owning pointer to an ostream object that is used to
 //     *        to store serialized data.
@@ -1960,6 +2577,72 @@ public:
      */
     static File loadFromStream(std::unique_ptr<std::istream> file);
 
+    // ------------- Snapshot methods -----------------
+
+    /** @brief Fingerprint identifies contents of a KDBX file that a snapshot
+     *         was made from. It is a SHA-256 digest of the whole file.*/
+    typedef std::array<uint8_t, 32> Fingerprint;
+
+    /** @brief Computes fingerprint of data remaining in \p file.*/
+    static Fingerprint fingerprint(std::istream& file);
+
+    /** @brief Computes fingerprint of a KDBX file.
+     * @param filename Name of file to be fingerprinted.
+     */
+    static Fingerprint fingerprint(const std::string& filename);
+
+    /** @brief Writes an encrypted snapshot of a database.
+     * @param file Stream that snapshot is written to.
+     * @param fingerprint Fingerprint of a KDBX file that this database was
+     *        loaded from (or saved to).
+     * @param transformedKey Transformed key of that file, as returned by
+     *        Database::File::verifyKey(). It cannot be empty, so snapshots
+     *        can only be made for encrypted files.
+     *
+     * A snapshot is a flat binary image of the whole database, including
+     * history, binaries and custom icons. It can be read back with
+     * loadSnapshot() without parsing XML, decoding base64 or decompressing
+     * data. The image is encrypted and authenticated with keys derived from
+     * \p transformedKey and \p fingerprint, so it is only usable with the
+     * same key and an unchanged KDBX file.
+     */
+    void saveSnapshot(std::ostream& file, const Fingerprint& fingerprint, const SafeVector<uint8_t>& transformedKey) const;
+
+    /** @brief Reads a database from a snapshot written by saveSnapshot().
+     * @param file Stream that snapshot is read from.
+     * @param fingerprint Fingerprint of a KDBX file that the database is
+     *        to be loaded from.
+     * @param compositeKey Composite key of that file. It is moved into
+     *        returned database; if nullptr is returned, it is left untouched,
+     *        so that it can still be used to load the KDBX file.
+     * @param transformedKey Transformed key of that file, as returned by
+     *        Database::File::verifyKey() for \p compositeKey.
+     * @return Database object, or nullptr if the snapshot was made from
+     *         a different file or with a different key, was written by
+     *         another version of the snapshot format, or was damaged. In such
+     *         case the database is to be loaded from the KDBX file.
+     */
+    static Database::Ptr loadSnapshot(std::istream& file, const Fingerprint& fingerprint, CompositeKey&& compositeKey,
+                                      const SafeVector<uint8_t>& transformedKey);
+
+    /** @brief Loads a database from a KDBX file, using a snapshot file as
+     *         a cache.
+     * @param filename Name of KDBX file to be loaded.
+     * @param snapshotFilename Name of snapshot file. It doesn't need to exist.
+     * @param compositeKey Composite key of the KDBX file.
+     *
+     * The composite key is always checked against the KDBX file first, so key
+     * transformation still takes place. If the snapshot matches the file and
+     * the key, database is read from it; otherwise the KDBX file is loaded as
+     * usual and a new snapshot is written (errors writing it are ignored).
+     * Applications that keep transformed key in memory can call
+     * loadSnapshot() directly to skip transformation as well.
+     *
+     * Unencrypted files are always loaded without a snapshot.
+     */
+    static Database::Ptr loadFromFileCached(const std::string& filename, const std::string& snapshotFilename,
+                                            CompositeKey compositeKey);
+
     /** @brief This method is necesary to initialize some external libraries used
                When serializing and deserializing datbases.
         It should be called at least once before saveToFile, saveToXmlFile or
@@ -1967,6 +2650,8 @@ public:
     static void init() noexcept;
 private:
 
+    std::unique_ptr<std::ostream> serialize(std::unique_ptr<std::ostream> file, unsigned threads) const;
+
     Icon addIcon(CustomIcon::Ptr icon, DatabaseModel* model);
     bool removeIcon(size_t index, DatabaseModel* model);
 
@@ -1976,10 +2661,29 @@ private:
     void refIcon(const CustomIcon::Ptr& icon);
     void unrefIcon(const CustomIcon::Ptr& icon);
 
+    /** @brief Stores positions of \p items in range [\p from, \p to) in
+     * the items themselves, so that index() methods don't need to search for
+     * them. Called whenever a list of versions, entries or groups changes.*/
+    template <typename T>
+    static inline void updateIndexes(std::vector<std::unique_ptr<T>>& items, std::size_t from = 0, std::size_t to = std::size_t(-1)) noexcept{
+        to = std::min(to, items.size());
+        for (; from < to; ++from)
+            items[from]->findex = from;
+    }
+
+    /** @brief Adds \p group and all groups and entries it owns to the UUID
+     * index. Used when a group tree is built without setDatabase() calls.*/
+    void indexTree(Group* group);
+
     Group::Ptr froot;
     std::map<Uuid, time_t> fdeletedObjects;
     Settings::Ptr fsettings;
-    std::vector<std::pair<CustomIcon::Ptr, size_t>> fcustomIcons;
+    CustomIcons fcustomIcons;
+    BinaryPool fbinaries;
+    // Multimaps, so that a node sharing its UUID with a removed one remains
+    // reachable.
+    std::unordered_multimap<Uuid, Group*> fgroupIndex;
+    std::unordered_multimap<Uuid, Entry*> fentryIndex;
     CompositeKey fcompositeKey;
 
     Group* frecycleBin;
@@ -1994,6 +2698,9 @@ private:
     friend class DatabaseModel;
     friend class Internal::Parser<Database>;
     friend class Internal::Parser<Meta>;
+    friend class Internal::Parser<Group>;
+    friend class Internal::Parser<Entry>;
+    friend class Internal::Snapshot;
     friend class Group;
     friend class Entry;
 };
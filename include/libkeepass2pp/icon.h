@@ -19,7 +19,11 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 #define LIBKEEPASS2PP_ICON_H
 
 #include "platform.h"
+#include <cassert>
 #include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace Kdbx {
 
@@ -110,6 +114,8 @@ enum class StandardIcon{
  * describes icon's content. Currently, KeePass2 seems to use PNG format
  * exclusively when saving database files, but it is unknown what format it is
  * able to process.
+ *
+ * Data buffer is immutable, and can be shared by icons with different UUIDs.
  */
 class CustomIcon{
 public:
@@ -118,9 +124,16 @@ public:
 
     /** @brief Constructs a custom icon object with specified UUID and buffer
      *         as it's contents.*/
-    inline CustomIcon(Uuid uuid, std::vector<uint8_t> data) noexcept
+    inline CustomIcon(Uuid uuid, std::vector<uint8_t> data)
+        :fuuid(std::move(uuid)),
+          fdata(std::make_shared<const std::vector<uint8_t>>(std::move(data)))
+    {}
+
+    /** @brief Constructs a custom icon object with specified UUID, that
+     *         shares data buffer of \p icon.*/
+    inline CustomIcon(Uuid uuid, const CustomIcon& icon) noexcept
         :fuuid(std::move(uuid)),
-          fdata(std::move(data))
+          fdata(icon.fdata)
     {}
 
     CustomIcon(CustomIcon&& icon) = default;
@@ -135,12 +148,18 @@ public:
 
     /** @brief Returns a reference to CustomIcon's data buffer. */
     inline const std::vector<uint8_t>& data() const noexcept{
-        return fdata;
+        static const std::vector<uint8_t> empty;
+        return fdata ? *fdata : empty;
+    }
+
+    /** @brief Checks whether two icons share the same data buffer.*/
+    inline bool sharesData(const CustomIcon& icon) const noexcept{
+        return fdata == icon.fdata;
     }
 
 private:
     Uuid fuuid;
-    std::vector<uint8_t> fdata;
+    std::shared_ptr<const std::vector<uint8_t>> fdata;
 };
 
 class Icon{
@@ -304,6 +323,78 @@ public:
 
 };
 
+/** @brief CustomIcons is a registry of custom icons of a database.
+ *
+ * Icons are kept in insertion order, which is the order in which they are
+ * serialized, together with number of references to each icon from groups
+ * and versions of a database. Icons are indexed by UUID, so that finding an
+ * icon, or an index of an icon, takes constant time.
+ *
+ * When an icon is inserted, and the registry already holds an icon with the
+ * same data but a different UUID, the inserted icon is replaced with a copy
+ * that shares data buffer of the icon in the registry.
+ */
+class CustomIcons{
+public:
+    /** @brief Custom icon and number of its references.*/
+    typedef std::pair<CustomIcon::Ptr, std::size_t> value_type;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    inline std::size_t size() const noexcept{
+        return ficons.size();
+    }
+
+    inline bool empty() const noexcept{
+        return ficons.empty();
+    }
+
+    inline const value_type& operator[](std::size_t index) const noexcept{
+        return ficons[index];
+    }
+
+    inline const_iterator begin() const noexcept{
+        return ficons.begin();
+    }
+
+    inline const_iterator end() const noexcept{
+        return ficons.end();
+    }
+
+    /** @brief Returns index of an icon with specified UUID, or -1 if there
+     *         is no such icon.*/
+    int index(const Uuid& uuid) const noexcept;
+
+    /** @brief Inserts \p icon unless an icon with the same UUID is already
+     *         present.
+     * @return Pair of an index of icon with UUID of \p icon and a flag
+     *         telling whether it was inserted.
+     */
+    std::pair<std::size_t, bool> insert(CustomIcon::Ptr icon);
+
+    /** @brief Removes icon at position \p index.
+     *
+     * Indexes of following icons are decremented.
+     */
+    void erase(std::size_t index);
+
+    inline void ref(std::size_t index) noexcept{
+        ++ficons[index].second;
+    }
+
+    inline void unref(std::size_t index) noexcept{
+        assert(ficons[index].second > 0);
+        --ficons[index].second;
+    }
+
+private:
+    static std::size_t contentsHash(const std::vector<uint8_t>& data) noexcept;
+
+    std::vector<value_type> ficons;
+    std::unordered_map<Uuid, std::size_t> findexes;
+    // Maps hash of contents to index of an icon with such contents.
+    std::unordered_multimap<std::size_t, std::size_t> fcontents;
+};
+
 }
 
 #endif // LIBKEEPASS2PP_ICON_H
@@ -23,6 +23,8 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 #include <array>
 #include <stdexcept>
 #include <ctime>
+#include <cstring>
+#include <functional>
 
 #ifdef _WIN32
     #include <windows.h>
@@ -54,30 +56,42 @@ enum DoNotInitEnum{
     DoNotInit
 };
 
-// For now just a malloc/free combo - someday there should be a full manager here.
+/** @brief Allocator of memory for sensitive data.
+ *
+ * Small allocations are served from size-classed slabs of pages that are
+ * locked in memory (so they are never swapped out), excluded from core
+ * dumps and surrounded with inaccessible guard pages. Each thread keeps a
+ * cache of free blocks, and exchanges them with a shared pool in batches.
+ * Large allocations get their own locked mapping with guard pages.
+ *
+ * Memory is zeroed when it is released, so that blocks in the pool (and
+ * blocks returned by allocate()) never hold old data. Locking pages is done
+ * on a best-effort basis; if process exceeds its locked memory limit, pages
+ * are used unlocked.
+ *
+ * On Windows the pool is not used: every block comes from calloc() and is
+ * wiped with SecureZeroMemory() when released, but it is neither locked nor
+ * guarded.
+ */
 class SafeMemoryManager{
 public:
 
-    static void* allocate(std::size_t size){
-        void* result = malloc(size);
-        if (!result)
-            throw std::bad_alloc();
-        return result;
-    }
+    /** @brief Allocates \p size bytes of zeroed memory.
+     *
+     * Returned memory is aligned as memory returned by malloc().
+     */
+    static void* allocate(std::size_t size);
 
     static void zero(void* ptr, std::size_t size) noexcept;
 
-    static void deallocate(void* ptr, std::size_t size) noexcept{
-        zero(ptr, size);
-        free(ptr);
-    }
+    /** @brief Zeroes and releases memory returned by allocate().
+     * @param size Size passed to allocate() call that returned \p ptr.
+     */
+    static void deallocate(void* ptr, std::size_t size) noexcept;
 
 };
 
 
-// ToDo: since meory locking is page-based, the entire concept here is fundamentally flawed.
-//       In order to get this right writing full memory allocator might be required.
-
 template <typename T>
 class SafeAllocator;
 
@@ -94,7 +108,7 @@ public:
 
 
 	inline void deallocate( typename std::allocator<T>::pointer p, typename std::allocator<T>::size_type n ){
-        SafeMemoryManager::deallocate(p, n);
+        SafeMemoryManager::deallocate(p, sizeof(T)*n);
         //SafeAllocator<void>::zero(p, sizeof(T)*n);
 		//SafeAllocator<void>::unlock(p, sizeof(T)*n);
         //std::allocator<T>::deallocate(p, n);
@@ -162,6 +176,15 @@ public:
 
     std::array<uint8_t, 16> raw() const noexcept;
 
+    /** @brief Returns a hash value of the UUID, suitable for unordered
+     * containers. */
+    inline std::size_t hash() const noexcept{
+        static_assert(sizeof(UUIDType) == 2*sizeof(uint64_t), "Unexpected UUID size.");
+        uint64_t h[2];
+        std::memcpy(h, &fuid, sizeof(h));
+        return std::size_t(h[0] ^ (h[1] * 0x9E3779B97F4A7C15ull));
+    }
+
 	explicit operator std::string() const;
 	explicit operator std::wstring() const;
 
@@ -191,6 +214,17 @@ public:
 
 }
 
+namespace std{
+
+template <>
+struct hash<Kdbx::Uuid>{
+    inline std::size_t operator()(const Kdbx::Uuid& uuid) const noexcept{
+        return uuid.hash();
+    }
+};
+
+}
+
 
 
 
@@ -0,0 +1,589 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef KDBXSEARCH_H
+#define KDBXSEARCH_H
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "databasemodel.h"
+
+namespace Kdbx{
+
+/** @brief Substring index over searchable entry fields.
+ *
+ * Index covers Title, UserName, URL and Notes strings of the latest version
+ * of each entry, together with its tags. Protected strings are never copied
+ * into the index. Entries placed in a group which (or any of whose ancestors)
+ * has Database::Group::Properties::enableSearching set to false are not
+ * indexed.
+ *
+ * Every indexed entry gets a document holding lower-cased copy of its
+ * searchable text, and every distinct trigram of that text maps to a sorted
+ * list of documents containing it. A query is answered by intersecting
+ * posting lists of its trigrams and verifying the remaining candidates, so
+ * its cost depends on the number of matches rather than on the size of the
+ * database. Case folding is done for ASCII characters only.
+ *
+ * Documents are only ever appended, so that posting lists stay sorted without
+ * moving their contents. Removing or changing an entry leaves a dead document
+ * behind, and ids of dead documents are left in posting lists until dead
+ * documents outnumber live ones; the index is then rebuilt from live
+ * documents.
+ *
+ * Index holds raw pointers to entries, and it must be informed about every
+ * change that affects them. SearchableModel does it automatically.
+ */
+class SearchIndex{
+public:
+
+    inline SearchIndex() noexcept
+    {}
+
+    /** @brief Constructs index of all searchable entries in a \p group subtree.*/
+    explicit SearchIndex(const Database::Group* group);
+
+    SearchIndex(const SearchIndex&) = delete;
+    SearchIndex(SearchIndex&&) = default;
+    SearchIndex& operator=(const SearchIndex&) = delete;
+    SearchIndex& operator=(SearchIndex&&) = default;
+
+    /** @brief (Re)indexes an entry.
+     *
+     * If entry is already indexed, its document is rebuilt from the latest
+     * version; unchanged documents are left intact. If entry is not
+     * searchable, it is removed from the index.
+     */
+    void addEntry(const Database::Entry* entry);
+
+    /** @brief Removes an entry from the index. Does nothing if an entry was
+     *         not indexed.
+     */
+    void removeEntry(const Database::Entry* entry);
+
+    /** @brief Calls addEntry() for every entry in a \p group subtree.*/
+    void addGroup(const Database::Group* group);
+
+    /** @brief Calls removeEntry() for every entry in a \p group subtree.*/
+    void removeGroup(const Database::Group* group);
+
+    /** @brief Removes all entries from the index.*/
+    void clear() noexcept;
+
+    /** @brief Returns entries containing all whitespace separated terms of
+     *         \p query.
+     *
+     * Terms are matched case-insensitively as substrings of any indexed
+     * field. Terms shorter than three characters cannot be looked up in the
+     * trigram index; if all terms are that short, all documents are scanned.
+     * Empty query matches nothing. Order of returned entries is
+     * unspecified.
+     */
+    std::vector<const Database::Entry*> search(const std::string& query) const;
+
+    /** @brief Returns number of indexed entries.*/
+    inline std::size_t size() const noexcept{
+        return fids.size();
+    }
+
+    /** @brief Returns true if an entry is placed in a group with searching
+     *         enabled in it and all of its ancestors.
+     */
+    static bool searchable(const Database::Entry* entry) noexcept;
+
+private:
+
+    struct Document{
+        const Database::Entry* entry;
+        std::string text;
+    };
+
+    std::vector<uint32_t> trigrams(const std::string& text) const;
+    void insertPostings(uint32_t id);
+    void compact();
+
+    std::vector<Document> fdocuments;
+    std::unordered_map<const Database::Entry*, uint32_t> fids;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> fpostings;
+};
+
+/** @brief Index of entries by host and registrable domain of their URLs.
+ *
+ * Hosts are taken from the URL string and overrideUrl of the latest version
+ * of each entry, and from domain names found in its auto-type window
+ * patterns. Protected URL strings are skipped. Every host is indexed under
+ * itself and under its registrable domain, so that lookups need a single
+ * hash table probe.
+ *
+ * Registrable domain is guessed without a public suffix list: it is made of
+ * last two labels of a host name, or last three if the host ends with a
+ * two-letter country code preceded by a short generic label (like co.uk or
+ * com.au). IP addresses are their own registrable domains.
+ */
+class DomainIndex{
+public:
+    typedef std::vector<const Database::Entry*> Entries;
+
+    inline DomainIndex() noexcept
+    {}
+
+    /** @brief Constructs index of all entries in a \p group subtree.*/
+    explicit DomainIndex(const Database::Group* group);
+
+    DomainIndex(const DomainIndex&) = delete;
+    DomainIndex(DomainIndex&&) = default;
+    DomainIndex& operator=(const DomainIndex&) = delete;
+    DomainIndex& operator=(DomainIndex&&) = default;
+
+    /** @brief (Re)indexes an entry using its latest version.*/
+    void addEntry(const Database::Entry* entry);
+
+    /** @brief Removes an entry from the index. Does nothing if an entry was
+     *         not indexed.
+     */
+    void removeEntry(const Database::Entry* entry);
+
+    /** @brief Calls addEntry() for every entry in a \p group subtree.*/
+    void addGroup(const Database::Group* group);
+
+    /** @brief Calls removeEntry() for every entry in a \p group subtree.*/
+    void removeGroup(const Database::Group* group);
+
+    /** @brief Removes all entries from the index.*/
+    void clear() noexcept;
+
+    /** @brief Returns entries with an URL on exactly given \p host.
+     * @param host Lower-case host name, as returned by hostOf().
+     */
+    const Entries& host(const std::string& host) const noexcept;
+
+    /** @brief Returns entries with an URL anywhere within given \p domain.
+     * @param domain Lower-case registrable domain, as returned by domainOf().
+     */
+    const Entries& domain(const std::string& domain) const noexcept;
+
+    /** @brief Returns entries matching host of an \p url.
+     *
+     * Entries that share registrable domain with an \p url are returned,
+     * with entries matching its host exactly placed first. Each entry is
+     * returned once.
+     */
+    Entries lookup(const std::string& url) const;
+
+    /** @brief Returns number of indexed entries.*/
+    inline std::size_t size() const noexcept{
+        return fkeys.size();
+    }
+
+    /** @brief Extracts lower-case host name from an \p url.
+     *
+     * Scheme, user info, port, path, query and fragment are stripped. URLs
+     * without scheme are accepted. Empty string is returned if \p url
+     * doesn't contain a valid host name.
+     */
+    static std::string hostOf(const std::string& url);
+
+    /** @brief Returns registrable domain of a lower-case \p host name.*/
+    static std::string domainOf(const std::string& host);
+
+private:
+
+    struct Keys{
+        std::vector<std::string> hosts;
+        std::vector<std::string> domains;
+    };
+
+    static void insert(std::unordered_map<std::string, Entries>& map, const std::vector<std::string>& keys, const Database::Entry* entry);
+    static void erase(std::unordered_map<std::string, Entries>& map, const std::vector<std::string>& keys, const Database::Entry* entry);
+
+    std::unordered_map<const Database::Entry*, Keys> fkeys;
+    std::unordered_map<std::string, Entries> fhosts;
+    std::unordered_map<std::string, Entries> fdomains;
+};
+
+/** @brief Index of expiring entries ordered by their expiry time.
+ *
+ * Entries are indexed if the latest version has Times::expires set, and are
+ * kept in the order of Times::expiry of that version.
+ */
+class ExpiryIndex{
+public:
+    typedef std::vector<const Database::Entry*> Entries;
+
+    inline ExpiryIndex() noexcept
+    {}
+
+    /** @brief Constructs index of all entries in a \p group subtree.*/
+    explicit ExpiryIndex(const Database::Group* group);
+
+    ExpiryIndex(const ExpiryIndex&) = delete;
+    ExpiryIndex(ExpiryIndex&&) = default;
+    ExpiryIndex& operator=(const ExpiryIndex&) = delete;
+    ExpiryIndex& operator=(ExpiryIndex&&) = default;
+
+    /** @brief (Re)indexes an entry using its latest version.*/
+    void addEntry(const Database::Entry* entry);
+
+    /** @brief Removes an entry from the index. Does nothing if an entry was
+     *         not indexed.
+     */
+    void removeEntry(const Database::Entry* entry);
+
+    /** @brief Calls addEntry() for every entry in a \p group subtree.*/
+    void addGroup(const Database::Group* group);
+
+    /** @brief Calls removeEntry() for every entry in a \p group subtree.*/
+    void removeGroup(const Database::Group* group);
+
+    /** @brief Removes all entries from the index.*/
+    void clear() noexcept;
+
+    /** @brief Returns entries with expiry time earlier than \p time, ordered
+     *         by expiry time.
+     *
+     * Entries that are already expired at the moment \p now are returned by
+     * expiringBefore(now + 1).
+     */
+    Entries expiringBefore(std::time_t time) const;
+
+    /** @brief Returns entries with expiry time in range [\p from, \p to),
+     *         ordered by expiry time.
+     */
+    Entries expiringBetween(std::time_t from, std::time_t to) const;
+
+    /** @brief Returns entry that expires first or nullptr if no entry
+     *         expires.
+     */
+    const Database::Entry* nextExpiring() const noexcept;
+
+    /** @brief Returns expiry time of nextExpiring() entry, or the maximum
+     *         std::time_t value if no entry expires.
+     */
+    std::time_t nextExpiry() const noexcept;
+
+    /** @brief Returns number of indexed entries.*/
+    inline std::size_t size() const noexcept{
+        return fentries.size();
+    }
+
+private:
+    typedef std::multimap<std::time_t, const Database::Entry*> Expiries;
+
+    Expiries fexpiries;
+    std::unordered_map<const Database::Entry*, Expiries::iterator> fentries;
+};
+
+/** @brief Inverted index of entries by tags of their latest versions.
+ *
+ * Every entry gets a sequence number when it is first indexed, and its number
+ * is kept in a list of each of its tags, sorted, so that tag queries reduce to
+ * merging sorted lists. Lists are indexed by Database::Tag::id() and can be
+ * found without hashing tag names.
+ *
+ * New entries get growing numbers and are appended to the lists, so that an
+ * index of a group subtree is built in linear time and returns entries in
+ * the order of the tree. Removed entries leave gaps in the numbering, which
+ * are closed once they outnumber indexed entries.
+ */
+class TagIndex{
+public:
+    typedef std::vector<const Database::Entry*> Entries;
+    typedef std::vector<Database::Tag> Tags;
+    typedef std::vector<uint32_t> Ids;
+
+    inline TagIndex() noexcept
+    {}
+
+    /** @brief Constructs index of all entries in a \p group subtree.*/
+    explicit TagIndex(const Database::Group* group);
+
+    TagIndex(const TagIndex&) = delete;
+    TagIndex(TagIndex&&) = default;
+    TagIndex& operator=(const TagIndex&) = delete;
+    TagIndex& operator=(TagIndex&&) = default;
+
+    /** @brief (Re)indexes an entry using its latest version.*/
+    void addEntry(const Database::Entry* entry);
+
+    /** @brief Removes an entry from the index. Does nothing if an entry was
+     *         not indexed.
+     */
+    void removeEntry(const Database::Entry* entry);
+
+    /** @brief Calls addEntry() for every entry in a \p group subtree.*/
+    void addGroup(const Database::Group* group);
+
+    /** @brief Calls removeEntry() for every entry in a \p group subtree.*/
+    void removeGroup(const Database::Group* group);
+
+    /** @brief Removes all entries from the index.*/
+    void clear() noexcept;
+
+    /** @brief Returns entries tagged with \p tag, in the order they were
+     *         indexed.
+     */
+    Entries entries(const Database::Tag& tag) const;
+
+    /** @brief Returns entries matching a tag expression, in the order they
+     *         were indexed.
+     *
+     * @param all Entries have to be tagged with every one of these tags
+     *        (AND).
+     * @param any Entries have to be tagged with at least one of these tags
+     *        (OR). Ignored if empty.
+     * @param none Entries cannot be tagged with any of these tags (NOT).
+     *
+     * If both \p all and \p any are empty, the expression is applied to all
+     * indexed entries, including untagged ones.
+     */
+    Entries query(const Tags& all, const Tags& any = Tags(), const Tags& none = Tags()) const;
+
+    /** @brief Returns number of indexed entries.*/
+    inline std::size_t size() const noexcept{
+        return fentries.size();
+    }
+
+private:
+    struct Item{
+        uint32_t id;
+        Tags tags;
+    };
+
+    void unlink(const Item& item) noexcept;
+    Entries resolve(const Ids& ids) const;
+    void compact();
+
+    std::vector<const Database::Entry*> fsequence;
+    std::unordered_map<const Database::Entry*, Item> fentries;
+    std::vector<Ids> ftags;
+};
+
+/** @brief Database model mix-in keeping a SearchIndex, a DomainIndex, an
+ *         ExpiryIndex and a TagIndex up to date.
+ *
+ * \p Model is any concrete DatabaseModel subclass. All modifications made
+ * through the model are forwarded to \p Model and then reflected in the
+ * indexes. Each index is built by the first call that needs it, changes made
+ * before that are not tracked.
+ */
+template <typename Model>
+class SearchableModel: public Model{
+public:
+
+    template <typename ...Args>
+    inline SearchableModel(Args&&... args)
+        :Model(std::forward<Args>(args)...),
+          fsearchIndexed(false),
+          fdomainIndexed(false),
+          fexpiryIndexed(false),
+          ftagIndexed(false)
+    {}
+
+    /** @copydoc SearchIndex::search() */
+    std::vector<const Database::Entry*> search(const std::string& query){
+        return searchIndex().search(query);
+    }
+
+    /** @copydoc DomainIndex::lookup() */
+    DomainIndex::Entries lookupUrl(const std::string& url){
+        return domainIndex().lookup(url);
+    }
+
+    /** @copydoc ExpiryIndex::expiringBefore() */
+    ExpiryIndex::Entries expiringBefore(std::time_t time){
+        return expiryIndex().expiringBefore(time);
+    }
+
+    /** @copydoc TagIndex::query() */
+    TagIndex::Entries queryTags(const TagIndex::Tags& all, const TagIndex::Tags& any = TagIndex::Tags(), const TagIndex::Tags& none = TagIndex::Tags()){
+        return tagIndex().query(all, any, none);
+    }
+
+    /** @brief Returns search index, building it first if necessary.*/
+    const SearchIndex& searchIndex(){
+        if (!fsearchIndexed){
+            fsearchIndex = SearchIndex(this->getDatabase()->root());
+            fsearchIndexed = true;
+        }
+        return fsearchIndex;
+    }
+
+    /** @brief Returns domain index, building it first if necessary.*/
+    const DomainIndex& domainIndex(){
+        if (!fdomainIndexed){
+            fdomainIndex = DomainIndex(this->getDatabase()->root());
+            fdomainIndexed = true;
+        }
+        return fdomainIndex;
+    }
+
+    /** @brief Returns expiry index, building it first if necessary.*/
+    const ExpiryIndex& expiryIndex(){
+        if (!fexpiryIndexed){
+            fexpiryIndex = ExpiryIndex(this->getDatabase()->root());
+            fexpiryIndexed = true;
+        }
+        return fexpiryIndex;
+    }
+
+    /** @brief Returns tag index, building it first if necessary.*/
+    const TagIndex& tagIndex(){
+        if (!ftagIndexed){
+            ftagIndex = TagIndex(this->getDatabase()->root());
+            ftagIndexed = true;
+        }
+        return ftagIndex;
+    }
+
+    inline void setProperties(const Database::Group* group, Database::Group::Properties::Ptr properties) override{
+        bool enableSearching = group->properties().enableSearching;
+        Model::setProperties(group, std::move(properties));
+        if (fsearchIndexed && group->properties().enableSearching != enableSearching){
+            fsearchIndex.removeGroup(group);
+            fsearchIndex.addGroup(group);
+        }
+    }
+
+protected:
+
+    inline Database::Version* addVersion(Database::Entry* entry, Database::Version::Ptr version, size_t index) override{
+        Database::Version* result = Model::addVersion(entry, std::move(version), index);
+        indexEntry(entry);
+        return result;
+    }
+
+    inline void removeVersion(Database::Entry* entry, size_t index) override{
+        Model::removeVersion(entry, index);
+        indexEntry(entry);
+    }
+
+    inline Database::Version::Ptr takeVersion(Database::Entry* entry, size_t index) override{
+        Database::Version::Ptr result = Model::takeVersion(entry, index);
+        indexEntry(entry);
+        return result;
+    }
+
+    inline Database::Entry* addEntry(Database::Group* group, Database::Entry::Ptr entry, size_t index) override{
+        Database::Entry* result = Model::addEntry(group, std::move(entry), index);
+        indexEntry(result);
+        return result;
+    }
+
+    inline void removeEntry(Database::Group* group, size_t index) override{
+        unindexEntry(group->entry(index));
+        Model::removeEntry(group, index);
+    }
+
+    inline Database::Entry::Ptr takeEntry(Database::Group* group, size_t index) override{
+        unindexEntry(group->entry(index));
+        return Model::takeEntry(group, index);
+    }
+
+    inline void moveEntry(Database::Group* oldParent, size_t oldIndex, Database::Group* newParent, size_t newIndex) override{
+        const Database::Entry* entry = oldParent->entry(oldIndex);
+        Model::moveEntry(oldParent, oldIndex, newParent, newIndex);
+        // Only searchability depends on entry placement.
+        if (fsearchIndexed)
+            fsearchIndex.addEntry(entry);
+    }
+
+    inline Database::Group* addGroup(Database::Group* parent, Database::Group::Ptr group, size_t index) override{
+        Database::Group* result = Model::addGroup(parent, std::move(group), index);
+        indexGroup(result);
+        return result;
+    }
+
+    inline void removeGroup(Database::Group* parent, size_t index) override{
+        unindexGroup(parent->group(index));
+        Model::removeGroup(parent, index);
+    }
+
+    inline Database::Group::Ptr takeGroup(Database::Group* parent, size_t index) override{
+        unindexGroup(parent->group(index));
+        return Model::takeGroup(parent, index);
+    }
+
+    inline void moveGroup(Database::Group* oldParent, size_t oldIndex, Database::Group* newParent, size_t newIndex) override{
+        const Database::Group* group = oldParent->group(oldIndex);
+        Model::moveGroup(oldParent, oldIndex, newParent, newIndex);
+        if (fsearchIndexed)
+            fsearchIndex.addGroup(group);
+    }
+
+private:
+
+    inline void indexEntry(const Database::Entry* entry){
+        if (fsearchIndexed)
+            fsearchIndex.addEntry(entry);
+        if (fdomainIndexed)
+            fdomainIndex.addEntry(entry);
+        if (fexpiryIndexed)
+            fexpiryIndex.addEntry(entry);
+        if (ftagIndexed)
+            ftagIndex.addEntry(entry);
+    }
+
+    inline void unindexEntry(const Database::Entry* entry){
+        if (fsearchIndexed)
+            fsearchIndex.removeEntry(entry);
+        if (fdomainIndexed)
+            fdomainIndex.removeEntry(entry);
+        if (fexpiryIndexed)
+            fexpiryIndex.removeEntry(entry);
+        if (ftagIndexed)
+            ftagIndex.removeEntry(entry);
+    }
+
+    inline void indexGroup(const Database::Group* group){
+        if (fsearchIndexed)
+            fsearchIndex.addGroup(group);
+        if (fdomainIndexed)
+            fdomainIndex.addGroup(group);
+        if (fexpiryIndexed)
+            fexpiryIndex.addGroup(group);
+        if (ftagIndexed)
+            ftagIndex.addGroup(group);
+    }
+
+    inline void unindexGroup(const Database::Group* group){
+        if (fsearchIndexed)
+            fsearchIndex.removeGroup(group);
+        if (fdomainIndexed)
+            fdomainIndex.removeGroup(group);
+        if (fexpiryIndexed)
+            fexpiryIndex.removeGroup(group);
+        if (ftagIndexed)
+            ftagIndex.removeGroup(group);
+    }
+
+    SearchIndex fsearchIndex;
+    DomainIndex fdomainIndex;
+    ExpiryIndex fexpiryIndex;
+    TagIndex ftagIndex;
+    bool fsearchIndexed;
+    bool fdomainIndexed;
+    bool fexpiryIndexed;
+    bool ftagIndexed;
+};
+
+}
+
+#endif // KDBXSEARCH_H
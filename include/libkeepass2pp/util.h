@@ -30,7 +30,12 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 #include <bitset>
 #include <cstring>
 #include <limits>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
+#include "arena.h"
 #include "platform.h"
 
 namespace Kdbx{
@@ -88,6 +93,122 @@ inline void trim(std::string &s) {
 
 //------------------------------------------------------------------------------
 
+/** @brief String kept in a process-wide dictionary.
+ *
+ * An InternedString object is just a pointer to a dictionary record, so every
+ * distinct string is stored once, and copying or comparing interned strings
+ * for equality costs no more than it does for pointers. Each string gets a
+ * small sequential id(), unique within the dictionary, that can be used to
+ * index arrays.
+ *
+ * Strings are never removed from a dictionary, so that records can be
+ * referenced without counting. A dictionary grows with every distinct string
+ * interned during the life of a process, including field names and tags of
+ * every database that was loaded and closed since; a process that opens
+ * untrusted files keeps whatever names they carry.
+ *
+ * Dictionary is shared by all threads and guarded by a mutex. Every thread
+ * also keeps a small cache of records it has looked up, so that common names,
+ * like standard field names, are found without locking.
+ *
+ * Interned strings convert implicitly from and to std::string.
+ *
+ * @tparam Domain Type that selects a dictionary. Interned strings with
+ *         different domains have separate dictionaries and id ranges.
+ */
+template <typename Domain>
+class InternedString{
+public:
+    /** @brief Constructs an empty string.*/
+    inline InternedString()
+        :frecord(intern(std::string()))
+    {}
+
+    /** @brief Constructs an interned copy of \p name, adding it to the
+     *         dictionary if necessary.
+     */
+    inline InternedString(const std::string& name)
+        :frecord(intern(name))
+    {}
+
+    /** @brief Constructs an interned copy of \p name, adding it to the
+     *         dictionary if necessary.
+     */
+    inline InternedString(const char* name)
+        :frecord(intern(std::string(name)))
+    {}
+
+    inline const std::string& name() const noexcept{
+        return frecord->name;
+    }
+
+    inline operator const std::string&() const noexcept{
+        return frecord->name;
+    }
+
+    /** @brief Returns dictionary id of the string. Ids are assigned in order
+     *         in which strings are added to the dictionary, starting from 0.
+     */
+    inline uint32_t id() const noexcept{
+        return frecord->id;
+    }
+
+    inline bool operator==(const InternedString& other) const noexcept{
+        return frecord == other.frecord;
+    }
+
+    inline bool operator!=(const InternedString& other) const noexcept{
+        return frecord != other.frecord;
+    }
+
+    /** @brief Orders interned strings by id.*/
+    inline bool operator<(const InternedString& other) const noexcept{
+        return frecord->id < other.frecord->id;
+    }
+
+    friend inline std::ostream& operator<<(std::ostream& o, const InternedString& string){
+        return o << string.name();
+    }
+
+private:
+    struct Record{
+        std::string name;
+        uint32_t id;
+    };
+
+    static constexpr std::size_t cacheSize = 64;
+
+    // Records are never removed, so cached pointers never dangle. A cache
+    // slot is picked by hash of a name and holds the record looked up last.
+    static const Record* intern(const std::string& name){
+        static thread_local std::array<const Record*, cacheSize> cache{};
+        const Record*& cached = cache[std::hash<std::string>()(name) % cacheSize];
+        if (!cached || cached->name != name)
+            cached = lookup(name);
+        return cached;
+    }
+
+    // Records live in a deque, so that pointers to them stay valid as the
+    // dictionary grows.
+    static const Record* lookup(const std::string& name){
+        static std::mutex mutex;
+        static std::deque<Record> records;
+        static std::unordered_map<std::string, const Record*> names;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = names.find(name);
+        if (it != names.end())
+            return it->second;
+        records.push_back(Record{name, uint32_t(records.size())});
+        names.emplace(name, &records.back());
+        return &records.back();
+    }
+
+    const Record* frecord;
+};
+
+//------------------------------------------------------------------------------
+
 void outHex(std::ostream& o, uint8_t c);
 void outHex(std::ostream& o, const uint8_t* begin, const uint8_t* end);
 
@@ -116,6 +237,16 @@ inline void inHex(std::istream& s, std::array<uint8_t, size>& as){
 std::vector<uint8_t> decodeBase64(std::string data);
 SafeVector<uint8_t> safeDecodeBase64(SafeString<char> data);
 
+/** @brief Returns the length of base64 encoding of \p size bytes. */
+constexpr std::size_t encodedBase64Size(std::size_t size) noexcept{
+    return (size+2)/3*4;
+}
+
+/** @brief Encodes \p size bytes as base64 into \p out, which must have room
+ * for encodedBase64Size(size) characters. No terminating null is written.
+ * @return Pointer just past the last character written.
+ */
+char* encodeBase64(const uint8_t* data, std::size_t size, char* out) noexcept;
 std::string encodeBase64(const uint8_t* data, std::size_t size);
 inline std::string encodeBase64(const std::vector<uint8_t>& data){
     return encodeBase64(data.data(), data.size());
@@ -125,6 +256,88 @@ inline std::string safeEncodeBase64(const SafeVector<uint8_t>& data){
     return encodeBase64(data.data(), data.size());
 }
 
+//-----------------------------------------------------------------------------
+
+/** @brief Length of a timestamp in "YYYY-MM-DDTHH:MM:SSZ" format, without the
+ *         terminating null character.*/
+constexpr std::size_t isoTimeLength = 20;
+
+/** @brief Number of seconds between 0001-01-01T00:00:00Z and the Unix epoch.
+ *
+ * KDBX 4 files store timestamps as seconds elapsed since the beginning of year
+ * 1 instead of the Unix epoch.
+ */
+constexpr int64_t kdbx4TimeOffset = 62135596800;
+
+/** @brief Returns the number of days between 1970-01-01 and a given date of
+ *         the proleptic Gregorian calendar.
+ * @param year Year (can be zero or negative);
+ * @param month Month in range 1 to 12;
+ * @param day Day of month in range 1 to 31.
+ */
+inline int64_t daysFromCivil(int64_t year, unsigned int month, unsigned int day) noexcept{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned int yoe = static_cast<unsigned int>(year - era * 400);
+    const unsigned int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2)/5 + day - 1;
+    const unsigned int doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+/** @brief Performs operation inverse to daysFromCivil().
+ * @param days Number of days since 1970-01-01;
+ * @param year Receives the year;
+ * @param month Receives the month (1 to 12);
+ * @param day Receives the day of month (1 to 31).
+ */
+inline void civilFromDays(int64_t days, int64_t& year, unsigned int& month, unsigned int& day) noexcept{
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned int doe = static_cast<unsigned int>(days - era * 146097);
+    const unsigned int yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    const unsigned int doy = doe - (365*yoe + yoe/4 - yoe/100);
+    const unsigned int mp = (5*doy + 2)/153;
+    day = doy - (153*mp+2)/5 + 1;
+    month = mp < 10 ? mp+3 : mp-9;
+    year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2);
+}
+
+/** @brief Parses a UTC timestamp in fixed "YYYY-MM-DDTHH:MM:SSZ" format.
+ *
+ * The parser does not depend on C library time functions nor the current
+ * locale. If the range [begin, end) doesn't contain a valid timestamp,
+ * std::runtime_error is thrown.
+ */
+std::time_t parseIsoTime(const char* begin, const char* end);
+
+/** @brief Parses a null-terminated UTC timestamp in fixed
+ *         "YYYY-MM-DDTHH:MM:SSZ" format.*/
+inline std::time_t parseIsoTime(const char* description){
+    return parseIsoTime(description, description + strlen(description));
+}
+
+/** @brief Formats a UTC timestamp in fixed "YYYY-MM-DDTHH:MM:SSZ" format.
+ * @param time Time to format. Times outside of years 1 to 9999 are clamped to
+ *        that range.
+ * @param buffer Buffer that receives isoTimeLength characters followed by a
+ *        null character.
+ * @return Pointer to the null character written to the buffer.
+ */
+char* formatIsoTime(std::time_t time, char (&buffer)[isoTimeLength+1]) noexcept;
+
+/** @brief Formats a UTC timestamp in fixed "YYYY-MM-DDTHH:MM:SSZ" format.*/
+inline std::string formatIsoTime(std::time_t time){
+    char buffer[isoTimeLength+1];
+    return std::string(buffer, formatIsoTime(time, buffer));
+}
+
+/** @brief Decodes KDBX 4 timestamp - base64 encoded 64-bit little endian
+ *         number of seconds since 0001-01-01T00:00:00Z.*/
+std::time_t decodeKdbx4Time(const std::string& data);
+
+/** @brief Encodes a timestamp the way KDBX 4 files store it. */
+std::string encodeKdbx4Time(std::time_t time);
+
 
 // This is correct independednt of machine endian, but might be inefficient
 // if compiler doesn't optimize well.
@@ -269,10 +482,44 @@ private:
 
 // ToDo: make distinction between buffer and string into C++.
 //       maybe XorredString class?
+/** @brief Buffer of sensitive data, optionaly xor-ed with a mask.
+ *
+ * Contents of a buffer are immutable and shared between copies, so copying
+ * a buffer (and a Version object that holds it) doesn't copy the data.
+ * reXor() copies the data first if it is shared with other buffers.
+ */
 class XorredBuffer{
 private:
-    SafeVector<uint8_t> fmask;
-	SafeVector<uint8_t> fbuffer;
+	struct Data{
+		SafeVector<uint8_t> mask;
+		SafeVector<uint8_t> buffer;
+
+		inline static void* operator new(std::size_t size){
+			return Arena::allocate(size);
+		}
+
+		inline static void operator delete(void* ptr) noexcept{
+			Arena::deallocate(ptr);
+		}
+	};
+
+	std::shared_ptr<Data> fdata;
+
+	inline static const Data& emptyData() noexcept{
+		static const Data empty;
+		return empty;
+	}
+
+	inline const Data& data() const noexcept{
+		return fdata ? *fdata : emptyData();
+	}
+
+	inline void setData(SafeVector<uint8_t> mask, SafeVector<uint8_t> buffer){
+		if (mask.empty() && buffer.empty())
+			fdata.reset();
+		else
+			fdata.reset(new Data{std::move(mask), std::move(buffer)});
+	}
 
 public:
 
@@ -281,81 +528,110 @@ public:
 
 	template <typename It>
 	inline XorredBuffer(It plaintextBeg, It plaintextEnd)
-		:fbuffer(plaintextBeg, plaintextEnd)
-	{}
+	{
+		setData(SafeVector<uint8_t>(), SafeVector<uint8_t>(plaintextBeg, plaintextEnd));
+	}
 
 	template <typename It1, typename It2>
 	inline XorredBuffer(It1 xoredBeg, It1 xoredEnd, It2 maskBeg, It2 maskEnd)
-		:fmask(maskBeg, maskEnd),
-		  fbuffer(xoredBeg, xoredEnd)
-    {
+	{
+		setData(SafeVector<uint8_t>(maskBeg, maskEnd), SafeVector<uint8_t>(xoredBeg, xoredEnd));
 #ifndef KEEPASS2PP_NDEBUG
-            assert(fmask.size() >= fbuffer.size());
+            assert(mask().size() >= size());
  #endif
     }
 
-	inline XorredBuffer(SafeVector<uint8_t> plaintextBuffer) noexcept
-		:fbuffer(std::move(plaintextBuffer))
-	{}
+	inline XorredBuffer(SafeVector<uint8_t> plaintextBuffer)
+	{
+		setData(SafeVector<uint8_t>(), std::move(plaintextBuffer));
+	}
 
-    inline XorredBuffer(SafeVector<uint8_t> xoredBuffer, SafeVector<uint8_t> xorMask) noexcept
-		:fmask(std::move(xorMask)),
-		  fbuffer(std::move(xoredBuffer))
+    inline XorredBuffer(SafeVector<uint8_t> xoredBuffer, SafeVector<uint8_t> xorMask)
     {
+		setData(std::move(xorMask), std::move(xoredBuffer));
 #ifndef KEEPASS2PP_NDEBUG
-            assert(fmask.size() >= fbuffer.size());
+            assert(mask().size() >= size());
  #endif
     }
 
-    inline void reXor(SafeVector<uint8_t> xorMask) noexcept{
+    inline void reXor(SafeVector<uint8_t> xorMask){
+		SafeVector<uint8_t> buffer;
+		if (fdata.use_count() == 1)
+			buffer = std::move(fdata->buffer);
+		else
+			buffer = data().buffer;
         if (xorMask.size()){
 #ifndef KEEPASS2PP_NDEBUG
-            assert(xorMask.size() >= fbuffer.size());
+            assert(xorMask.size() >= buffer.size());
  #endif
-			std::transform(fbuffer.begin(), fbuffer.end(), xorMask.begin(), fbuffer.begin(), std::bit_xor<uint8_t>());
+			std::transform(buffer.begin(), buffer.end(), xorMask.begin(), buffer.begin(), std::bit_xor<uint8_t>());
         }
-        if (fmask.size()){
-			std::transform(fbuffer.begin(), fbuffer.end(), fmask.begin(), fbuffer.begin(), std::bit_xor<uint8_t>());
+        if (hasMask()){
+			std::transform(buffer.begin(), buffer.end(), mask().begin(), buffer.begin(), std::bit_xor<uint8_t>());
         }
-
-		using std::swap;
-		swap(fmask, xorMask);
+		setData(std::move(xorMask), std::move(buffer));
 	}
 
 	inline bool hasMask() const noexcept{
-		return fmask.size();
+		return data().mask.size();
 	}
 
 	inline std::size_t size() const noexcept{
-		return fbuffer.size();
+		return data().buffer.size();
 	}
 
     inline const SafeVector<uint8_t>& mask() const noexcept{
-		return fmask;
+		return data().mask;
 	}
 
 	inline  const SafeVector<uint8_t>& buffer() const noexcept{
-		return fbuffer;
+		return data().buffer;
+	}
+
+	/** @brief Checks whether two buffers hold the same plain data.
+	 *
+	 * Buffers are compared without unmasking them into temporary buffers.
+	 */
+	bool operator==(const XorredBuffer& other) const noexcept{
+		if (fdata == other.fdata)
+			return true;
+		const Data& a = data();
+		const Data& b = other.data();
+		if (a.buffer.size() != b.buffer.size())
+			return false;
+		uint8_t diff = 0;
+		for (std::size_t i = 0; i < a.buffer.size(); ++i){
+			uint8_t x = a.mask.size() ? a.buffer[i] ^ a.mask[i] : a.buffer[i];
+			uint8_t y = b.mask.size() ? b.buffer[i] ^ b.mask[i] : b.buffer[i];
+			diff |= x ^ y;
+		}
+		return diff == 0;
+	}
+
+	inline bool operator!=(const XorredBuffer& other) const noexcept{
+		return !(*this == other);
 	}
 
 	SafeVector<uint8_t> plainBuffer() const{
-		if (fmask.size()){
+		const Data& d = data();
+		if (d.mask.size()){
 			SafeVector<uint8_t> result;
-			result.reserve(fbuffer.size());
-			std::transform(fbuffer.begin(), fbuffer.end(), fmask.begin(), back_inserter(result), std::bit_xor<uint8_t>());
+			result.reserve(d.buffer.size());
+			std::transform(d.buffer.begin(), d.buffer.end(), d.mask.begin(), back_inserter(result), std::bit_xor<uint8_t>());
 			return result;
 		}
-		return SafeVector<uint8_t>(fbuffer);
+		return SafeVector<uint8_t>(d.buffer);
 	}
 
 	SafeString<char> plainString() const{
-		if (fmask.size()){
+		const Data& d = data();
+		if (d.mask.size()){
 			SafeString<char> result;
-			result.reserve(fbuffer.size());
-			std::transform(fbuffer.begin(), fbuffer.end(), fmask.begin(), back_inserter(result), std::bit_xor<uint8_t>());
+			result.reserve(d.buffer.size());
+			std::transform(d.buffer.begin(), d.buffer.end(), d.mask.begin(), back_inserter(result), std::bit_xor<uint8_t>());
 			return result;
 		}
-		return SafeString<char>(fbuffer.begin(), fbuffer.end());
+		return SafeString<char>(d.buffer.begin(), d.buffer.end());
 	}
 
     inline static XorredBuffer fromRaw(SafeVector<uint8_t> rawBuffer, SafeVector<uint8_t> xorMask){
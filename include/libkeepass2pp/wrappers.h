@@ -862,6 +862,23 @@ public:
     /** @brief Returns local name of current XML node.*/
     String xlocalName() const;
 
+    /** @brief Returns local name of current XML node.
+     *
+     * Returned string is owned by the reader and is only valid until the
+     * next read() or next() call. Element names are interned in reader's
+     * dictionary, so the same name yields the same pointer as constString()
+     * returns for it.
+     */
+    inline const xmlChar* constLocalName() const noexcept{
+        return xmlTextReaderConstLocalName(ftextReader.get());
+    }
+
+    /** @brief Interns a string in reader's dictionary.
+     *
+     * Returned pointer remains valid for the reader's lifetime.
+     */
+    const xmlChar* constString(const char* str);
+
     /** @brief Returns current node type (as sepcified by libXml). */
     inline xmlReaderTypes nodeType() const{
         return xmlReaderTypes(xmlTextReaderNodeType(ftextReader.get()));
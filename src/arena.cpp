@@ -0,0 +1,133 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/arena.h"
+#include "../include/libkeepass2pp/platform.h"
+#include <cstdlib>
+#include <new>
+
+namespace Kdbx{
+
+//------------------------------------------------------------------------------
+
+struct alignas(alignof(std::max_align_t)) Arena::Chunk{
+    std::atomic<std::size_t> references;
+    std::size_t size;
+};
+
+// Precedes every allocation. Chunk is nullptr for allocations made on the heap.
+struct alignas(alignof(std::max_align_t)) Arena::Header{
+    Chunk* chunk;
+    std::size_t size;
+};
+
+static thread_local Arena* currentArena = nullptr;
+
+// Objects of a database tree are not sensitive enough to use locked memory
+// of SafeMemoryManager, which is limited, but they are still zeroed.
+static void* allocateMemory(std::size_t size){
+    void* result = std::malloc(size);
+    if (!result)
+        throw std::bad_alloc();
+    return result;
+}
+
+static void releaseMemory(void* ptr, std::size_t size) noexcept{
+    SafeMemoryManager::zero(ptr, size);
+    std::free(ptr);
+}
+
+Arena::Scope::Scope(Arena* arena) noexcept
+    :fprevious(currentArena)
+{
+    currentArena = arena;
+}
+
+Arena::Scope::~Scope() noexcept{
+    currentArena = fprevious;
+}
+
+Arena::Arena(std::size_t chunkSize) noexcept
+    :fchunkSize(chunkSize),
+      fcurrent(nullptr),
+      fnext(nullptr),
+      fend(nullptr),
+      fchunks(0)
+{}
+
+Arena::~Arena() noexcept{
+    if (fcurrent)
+        release(fcurrent);
+}
+
+Arena::Chunk* Arena::newChunk(){
+    Chunk* chunk = new (allocateMemory(fchunkSize)) Chunk();
+    // Arena holds a reference to its current chunk, so that the chunk is not
+    // released while it is still being filled.
+    chunk->references.store(1, std::memory_order_relaxed);
+    chunk->size = fchunkSize;
+    if (fcurrent)
+        release(fcurrent);
+    fcurrent = chunk;
+    fnext = reinterpret_cast<char*>(chunk + 1);
+    fend = reinterpret_cast<char*>(chunk) + fchunkSize;
+    ++fchunks;
+    return chunk;
+}
+
+void Arena::release(Chunk* chunk) noexcept{
+    if (chunk->references.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        std::size_t size = chunk->size;
+        chunk->~Chunk();
+        releaseMemory(chunk, size);
+    }
+}
+
+void* Arena::allocate(std::size_t size){
+    const std::size_t alignment = alignof(Header);
+    size = (size + alignment - 1) / alignment * alignment;
+    std::size_t total = sizeof(Header) + size;
+
+    Arena* arena = currentArena;
+    Header* header;
+    if (arena && total <= arena->fchunkSize / 4){
+        if (std::size_t(arena->fend - arena->fnext) < total)
+            arena->newChunk();
+        header = reinterpret_cast<Header*>(arena->fnext);
+        arena->fnext += total;
+        header->chunk = arena->fcurrent;
+        header->chunk->references.fetch_add(1, std::memory_order_relaxed);
+    }else{
+        header = static_cast<Header*>(allocateMemory(total));
+        header->chunk = nullptr;
+    }
+    header->size = size;
+    return header + 1;
+}
+
+void Arena::deallocate(void* ptr) noexcept{
+    if (!ptr)
+        return;
+    Header* header = static_cast<Header*>(ptr) - 1;
+    if (header->chunk){
+        release(header->chunk);
+    }else{
+        releaseMemory(header, sizeof(Header) + header->size);
+    }
+}
+
+}
@@ -214,6 +214,16 @@ CompositeKey::Key::Ptr CompositeKey::Key::fromBuffer(SafeVector<uint8_t> data){
 
 
 SafeVector<uint8_t> CompositeKey::getCompositeKey(const std::array<uint8_t, 32>& transformSeed, uint64_t encryptionRounds) const{
+    return transformKey(transformSeed, encryptionRounds, nullptr);
+}
+
+SafeVector<uint8_t> CompositeKey::getCompositeKey(const std::array<uint8_t, 32>& transformSeed, uint64_t encryptionRounds,
+                                                  const std::atomic<bool>& cancel) const{
+    return transformKey(transformSeed, encryptionRounds, &cancel);
+}
+
+SafeVector<uint8_t> CompositeKey::transformKey(const std::array<uint8_t, 32>& transformSeed, uint64_t encryptionRounds,
+                                               const std::atomic<bool>* cancel) const{
 
     SafeVector<uint8_t> hash(32);
     OSSL::Digest d(EVP_sha256());
@@ -253,7 +263,13 @@ SafeVector<uint8_t> CompositeKey::getCompositeKey(const std::array<uint8_t, 32>&
 
         SafeVector<uint8_t> encryptedHash(32);
 
+        // Cancellation flag is checked once per this many rounds, so that
+        // checking it does not slow down the transformation.
+        const uint64_t cancelCheckRounds = 1024;
+
         for (uint64_t i=0; i<encryptionRounds; i++){
+            if (cancel && i % cancelCheckRounds == 0 && cancel->load(std::memory_order_relaxed))
+                return SafeVector<uint8_t>();
             int out = aes_cipher.update(encryptedHash.data(), hash.data(), 32);
             unused(out);
             assert(out == 32);
@@ -35,6 +35,12 @@ RandomStream::Ptr RandomStream::randomStream(Algorithm algorithm, const SafeVect
 	}
 }
 
+SafeVector<uint8_t> RandomStream::keystreamAt(uint64_t offset, std::size_t size) const{
+    SafeVector<uint8_t> result(size);
+    keystreamAtRaw(offset, result.data(), result.data() + size);
+    return result;
+}
+
 
 //-------------------------------------------------------------------------------------------
 
@@ -42,7 +48,8 @@ static constexpr uint32_t sigma[] = {
 	0x61707865, 0x3320646E, 0x79622D32, 0x6B206574
 };
 
-void Salsa20::reload() noexcept{
+// Generates a block of the stream for a state with the block counter already set.
+static void salsa20Block(const std::array<uint32_t, 16>& state, uint8_t* block) noexcept{
 	std::array<uint32_t, 16> current = state;
 
 	for (unsigned int i=0; i<10; i++){
@@ -85,9 +92,14 @@ void Salsa20::reload() noexcept{
 	}
 
 	for (unsigned int i=0; i<16; i++){
-		toLittleEndian(current[i], &buffer[i*4]);
+		toLittleEndian(current[i], &block[i*4]);
 	}
 
+	SafeMemoryManager::zero(current.data(), sizeof(current));
+}
+
+void Salsa20::reload() noexcept{
+	salsa20Block(state, buffer.data());
 	if (++state[8] == 0) state[9]++;
 }
 
@@ -163,11 +175,53 @@ SafeVector<uint8_t> Salsa20::read(std::size_t size){
 	return result;
 }
 
+uint64_t Salsa20::position() const noexcept{
+	// The counter points at the block following the one in the buffer.
+	uint64_t block = state[8] | (uint64_t(state[9]) << 32);
+	return block * buffer.size() - (buffer.end() - bufferPos);
+}
+
+bool Salsa20::seekable() const noexcept{
+	return true;
+}
+
+void Salsa20::seek(uint64_t offset) noexcept{
+	uint64_t block = offset / buffer.size();
+	state[8] = uint32_t(block);
+	state[9] = uint32_t(block >> 32);
+	bufferPos = buffer.end();
+	if (offset % buffer.size()){
+		reload();
+		bufferPos = buffer.begin() + offset % buffer.size();
+	}
+}
+
+void Salsa20::keystreamAtRaw(uint64_t offset, uint8_t* dataBegin, uint8_t* dataEnd) const noexcept{
+	std::array<uint32_t, 16> current = state;
+	std::array<uint8_t, 64> block;
+	uint64_t counter = offset / block.size();
+	std::size_t skip = offset % block.size();
+
+	while (dataBegin < dataEnd){
+		current[8] = uint32_t(counter);
+		current[9] = uint32_t(counter >> 32);
+		salsa20Block(current, block.data());
+		auto copyEnd = block.begin() + std::min<std::ptrdiff_t>(block.size(), skip + (dataEnd - dataBegin));
+		dataBegin = std::copy(block.begin() + skip, copyEnd, dataBegin);
+		skip = 0;
+		++counter;
+	}
+
+	SafeMemoryManager::zero(current.data(), sizeof(current));
+	SafeMemoryManager::zero(block.data(), block.size());
+}
+
 //--------------------------------------------------------------------------------------------
 
 ArcFourVariant::ArcFourVariant(const SafeVector<uint8_t>& key)
 	:m_i(0),
-	   m_j(0)
+	   m_j(0),
+	   fposition(0)
 {
 	for (unsigned int i=0; i<256; i++) state[i] = i;
 
@@ -183,6 +237,7 @@ ArcFourVariant::ArcFourVariant(const SafeVector<uint8_t>& key)
 	}
 
     read(512);
+    fposition = 0;
 }
 
 ArcFourVariant::~ArcFourVariant(){
@@ -193,6 +248,7 @@ ArcFourVariant::~ArcFourVariant(){
 void ArcFourVariant::readRaw(uint8_t* begin, uint8_t* end) noexcept{
 	using std::swap;
 
+	fposition += end - begin;
 	for (; begin<end; ++begin){
 		m_j += state[++m_i];
 		swap(state[m_i], state[m_j]);
@@ -203,6 +259,7 @@ void ArcFourVariant::readRaw(uint8_t* begin, uint8_t* end) noexcept{
 SafeVector<uint8_t> ArcFourVariant::read(std::size_t size){
     SafeVector<uint8_t> result;
 	result.reserve(size);
+	fposition += size;
 	using std::swap;
 
 	while (size-- > 0){
@@ -213,4 +270,28 @@ SafeVector<uint8_t> ArcFourVariant::read(std::size_t size){
 	return result;
 }
 
+uint64_t ArcFourVariant::position() const noexcept{
+	return fposition;
+}
+
+bool ArcFourVariant::seekable() const noexcept{
+	return false;
+}
+
+void ArcFourVariant::seek(uint64_t offset){
+	if (offset < fposition)
+		throw std::runtime_error("ArcFourVariant random stream can not be moved backwards.");
+
+	std::array<uint8_t, 64> discarded;
+	while (fposition < offset){
+		uint8_t* end = discarded.data() + std::min<uint64_t>(discarded.size(), offset - fposition);
+		readRaw(discarded.data(), end);
+	}
+	SafeMemoryManager::zero(discarded.data(), discarded.size());
+}
+
+void ArcFourVariant::keystreamAtRaw(uint64_t, uint8_t*, uint8_t*) const{
+	throw std::runtime_error("ArcFourVariant random stream is not seekable.");
+}
+
 }
@@ -54,6 +54,19 @@ static inline void dropGroups(Kdbx::Database::Group* group,
         model->setTemplates(nullptr);
 }
 
+// Removes a node from a UUID index. Other nodes with the same UUID stay
+// indexed.
+template <typename T>
+static inline void unindex(std::unordered_multimap<Uuid, T*>& index, const Uuid& uuid, T* node) noexcept{
+    auto range = index.equal_range(uuid);
+    for (auto it = range.first; it != range.second; ++it){
+        if (it->second == node){
+            index.erase(it);
+            return;
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 
 void Database::Settings::setName(std::string name) noexcept{
@@ -89,6 +102,10 @@ void Database::Version::setDatabase(Args... args){
         icon = db->addIcon(icon.custom(), args...);
         db->refIcon(icon.custom());
     }
+    for (auto& item: binaries){
+        if (item.second)
+            item.second = db->fbinaries.insert(std::move(item.second));
+    }
 }
 
 void Database::Version::clearDatabase(){
@@ -97,27 +114,89 @@ void Database::Version::clearDatabase(){
     }
 }
 
-size_t Database::Version::index() const noexcept{
-    const Entry* p = parent();
-    assert(p);
-    for (size_t i=0; i<p->versions(); ++i){
-        if (p->version(i) == this)
-            return i;
+//------------------------------------------------------------------------------
+
+void Database::Version::share(const Version& other) noexcept{
+    // Both field lists are sorted by name, so they can be walked together.
+    Strings::iterator it = strings.begin();
+    Strings::const_iterator otherIt = other.strings.begin();
+    while (it != strings.end() && otherIt != other.strings.end()){
+        if (it->first == otherIt->first){
+            if (it->second == otherIt->second)
+                it->second = otherIt->second;
+            ++it;
+            ++otherIt;
+        }else if (it->first.name() < otherIt->first.name()){
+            ++it;
+        }else{
+            ++otherIt;
+        }
+    }
+}
+
+Database::Version::Strings::iterator Database::Version::Strings::lowerBound(const char* name, std::size_t size) noexcept{
+    return std::lower_bound(fitems.begin(), fitems.end(), std::make_pair(name, size),
+                            [](const value_type& item, const std::pair<const char*, std::size_t>& key){
+        return item.first.name().compare(0, std::string::npos, key.first, key.second) < 0;
+    });
+}
+
+Database::Version::Strings::iterator Database::Version::Strings::find(const char* name, std::size_t size) noexcept{
+    // Versions usually have just a few fields, comparing lengths first
+    // rejects most of them without looking at their names.
+    if (fitems.size() <= 8){
+        for (iterator it = fitems.begin(); it != fitems.end(); ++it){
+            const std::string& itemName = it->first.name();
+            if (itemName.size() == size && std::memcmp(itemName.data(), name, size) == 0)
+                return it;
+        }
+        return fitems.end();
+    }
+
+    iterator it = lowerBound(name, size);
+    if (it != fitems.end() && it->first.name().compare(0, std::string::npos, name, size) == 0)
+        return it;
+    return fitems.end();
+}
+
+Database::Version::Strings::iterator Database::Version::Strings::emplace(iterator position, value_type item){
+    // Grow by single items while there are few of them, so that small
+    // versions don't carry unused capacity.
+    if (fitems.size() == fitems.capacity() && fitems.size() < 8){
+        std::size_t index = position - fitems.begin();
+        fitems.reserve(fitems.size() + 1);
+        position = fitems.begin() + index;
     }
-    assert("Internal error." == nullptr);
-    return -1;
+    return fitems.emplace(position, std::move(item));
+}
+
+XorredBuffer& Database::Version::Strings::operator[](const std::string& name){
+    iterator it = lowerBound(name.data(), name.size());
+    if (it == fitems.end() || it->first.name() != name)
+        it = emplace(it, value_type(FieldName(name), XorredBuffer()));
+    return it->second;
+}
+
+std::pair<Database::Version::Strings::iterator, bool> Database::Version::Strings::insert(value_type item){
+    const std::string& name = item.first.name();
+    iterator it = lowerBound(name.data(), name.size());
+    if (it != fitems.end() && it->first == item.first)
+        return std::make_pair(it, false);
+    return std::make_pair(emplace(it, std::move(item)), true);
 }
 
 //--------------------------------------------------------------------------------------
 
 Database::Entry::Entry(const Entry& entry)
     :fuuid(Uuid::generate()),
-      fparent(nullptr)
+      fparent(nullptr),
+      findex(0)
 {
     fversions.reserve(entry.fversions.size());
     for (const Version::Ptr& version: entry.fversions){
         Version* v = new Version(*version);
         v->fparent = this;
+        v->findex = fversions.size();
         fversions.emplace_back(v);
     }
 }
@@ -126,6 +205,7 @@ void Database::Entry::addVersion(Version::Ptr version, size_t index){
     Version* tmp = version.get();
     version->fparent = this;
     fversions.insert(fversions.begin()+index, std::move(version));
+    Database::updateIndexes(fversions, index);
     if (fparent && fparent->database())
         tmp->setDatabase();
 }
@@ -134,6 +214,7 @@ void Database::Entry::addVersion(Version::Ptr version, size_t index, DatabaseMod
     Version* tmp = version.get();
     version->fparent = this;
     fversions.insert(fversions.begin()+index, std::move(version));
+    Database::updateIndexes(fversions, index);
     tmp->setDatabase(model);
 }
 
@@ -145,6 +226,7 @@ Database::Version::Ptr Database::Entry::takeVersion(size_t index) noexcept{
 
     Version::Ptr result = std::move(fversions[index]);
     fversions.erase(fversions.begin() + index);
+    Database::updateIndexes(fversions, index);
     result->fparent = 0;
     return result;
 }
@@ -157,6 +239,7 @@ void Database::Entry::setDatabase(Args... args){
     if (del != db->fdeletedObjects.end()){
         db->fdeletedObjects.erase(del);
     }
+    db->fentryIndex.emplace(fuuid, this);
 
     for (const Version::Ptr& v: fversions){
         v->setDatabase(args...);
@@ -168,6 +251,7 @@ void Database::Entry::clearDatabase(){
     for (const Version::Ptr& v: fversions){
         v->clearDatabase();
     }
+    unindex(fparent->fdatabase->fentryIndex, fuuid, this);
     fparent->fdatabase->fdeletedObjects[fuuid] = time(nullptr);
 }
 
@@ -176,6 +260,7 @@ void Database::Entry::clearDatabase(){
 Database::Group::Group(const Group& group)
     :fparent(nullptr),
       fdatabase(nullptr),
+      findex(0),
       fuuid(Uuid::generate()),
       fproperties(new Properties(*group.fproperties))
 {
@@ -183,6 +268,7 @@ Database::Group::Group(const Group& group)
     for (const Entry::Ptr& entry: group.fentries){
         Entry* e = new Entry(*entry);
         e->fparent = this;
+        e->findex = fentries.size();
         fentries.emplace_back(e);
     }
 
@@ -191,6 +277,7 @@ Database::Group::Group(const Group& group)
         Group* g = new Group(*gr);
         g->fparent = this;
         g->fdatabase = nullptr;
+        g->findex = fgroups.size();
         fgroups.emplace_back(g);
     }
 }
@@ -223,21 +310,13 @@ bool Database::Group::ancestor(const Group* group) const noexcept{
 }
 
 size_t Database::Group::index(const Group* g) const noexcept{
-    for (size_t i=0; i<groups(); ++i){
-        if (group(i) == g)
-            return i;
-    }
-    assert("Subgroup not present." == nullptr);
-    return 0;
+    assert(g->parent() == this);
+    return g->findex;
 }
 
 size_t Database::Group::index(const Entry* e) const noexcept{
-    for (size_t i=0; i<entries(); ++i){
-        if (entry(i) == e)
-            return i;
-    }
-    assert("Entry not present." == nullptr);
-    return 0;
+    assert(e->parent() == this);
+    return e->findex;
 }
 
 void Database::Group::addGroup(Group::Ptr group, size_t index){
@@ -246,6 +325,7 @@ void Database::Group::addGroup(Group::Ptr group, size_t index){
 
     group->fparent = this;
     fgroups.insert(fgroups.begin()+index, std::move(group));
+    Database::updateIndexes(fgroups, index);
 
     if (fdatabase)
         fgroups[index]->setDatabase();
@@ -258,6 +338,7 @@ Database::Group::Ptr Database::Group::takeGroup(size_t index) noexcept{
 
     Group::Ptr result(std::move(fgroups[index]));
     fgroups.erase(fgroups.begin()+index);
+    Database::updateIndexes(fgroups, index);
     result->fparent = nullptr;
     return result;
 }
@@ -270,19 +351,31 @@ void Database::Group::moveGroup(size_t index, Group* newParent, size_t newIndex)
     assert(newIndex <= newParent->groups());
     assert(this != newParent || (newIndex != index && newIndex != index+1));
 
+    if (newParent == this){
+        // Only items between old and new position change their places.
+        if (newIndex > index){
+            std::rotate(fgroups.begin()+index, fgroups.begin()+index+1, fgroups.begin()+newIndex);
+            Database::updateIndexes(fgroups, index, newIndex);
+        }else{
+            std::rotate(fgroups.begin()+newIndex, fgroups.begin()+index, fgroups.begin()+index+1);
+            Database::updateIndexes(fgroups, newIndex, index+1);
+        }
+        return;
+    }
+
     Group::Ptr group(std::move(fgroups.at(index)));
     fgroups.erase(fgroups.begin()+index);
-
-    if (newParent == this && newIndex > index)
-        newIndex--;
+    Database::updateIndexes(fgroups, index);
 
     group->fparent = newParent;
     newParent->fgroups.insert(newParent->fgroups.begin()+newIndex, std::move(group));
+    Database::updateIndexes(newParent->fgroups, newIndex);
 }
 
 void Database::Group::addEntry(Entry::Ptr entry, size_t index){
     entry->fparent = this;
     fentries.insert(fentries.begin()+index, std::move(entry));
+    Database::updateIndexes(fentries, index);
     if (fdatabase)
         fentries[index]->setDatabase();
 }
@@ -293,6 +386,7 @@ Database::Entry::Ptr Database::Group::takeEntry(size_t index) noexcept{
         fentries[index]->clearDatabase();
     Entry::Ptr result(std::move(fentries[index]));
     fentries.erase(fentries.begin()+ index);
+    Database::updateIndexes(fentries, index);
     result->fparent = nullptr;
     return result;
 }
@@ -304,14 +398,25 @@ void Database::Group::moveEntry(size_t index, Group* newParent, size_t newIndex)
     assert(newIndex <= newParent->entries());
     assert(this != newParent || (newIndex != index && newIndex != index+1));
 
+    if (newParent == this){
+        // Only items between old and new position change their places.
+        if (newIndex > index){
+            std::rotate(fentries.begin()+index, fentries.begin()+index+1, fentries.begin()+newIndex);
+            Database::updateIndexes(fentries, index, newIndex);
+        }else{
+            std::rotate(fentries.begin()+newIndex, fentries.begin()+index, fentries.begin()+index+1);
+            Database::updateIndexes(fentries, newIndex, index+1);
+        }
+        return;
+    }
+
     Entry::Ptr entry(std::move(fentries.at(index)));
     fentries.erase(fentries.begin()+index);
-
-    if (newParent == this && newIndex > index)
-        newIndex--;
+    Database::updateIndexes(fentries, index);
 
     entry->fparent = newParent;
     newParent->fentries.insert(newParent->fentries.begin()+newIndex, std::move(entry));
+    Database::updateIndexes(newParent->fentries, newIndex);
 }
 
 template <typename ...Args>
@@ -325,6 +430,7 @@ void Database::Group::setDatabase(Args... args){
     if (del != fdatabase->fdeletedObjects.end()){
         fdatabase->fdeletedObjects.erase(del);
     }
+    fdatabase->fgroupIndex.emplace(fuuid, this);
 
     if (fproperties->icon.type() == Icon::Type::Custom){
         fproperties->icon = fdatabase->addIcon(fproperties->icon.custom(), args...);
@@ -355,6 +461,7 @@ void Database::Group::clearDatabase(Args... args) noexcept{
     if (fproperties->icon.type() == Icon::Type::Custom){
         fdatabase->unrefIcon(fproperties->icon.custom());
     }
+    unindex(fdatabase->fgroupIndex, fuuid, this);
     fdatabase->fdeletedObjects[fuuid] = time(nullptr);
     fdatabase = nullptr;
 }
@@ -362,6 +469,13 @@ void Database::Group::clearDatabase(Args... args) noexcept{
 
 
 Database::Group* Database::Group::groupLookup(const Uuid& uuid) const noexcept{
+    if (fdatabase){
+        Group* result = fdatabase->group(uuid);
+        if (result && result != this && result->ancestor(this))
+            return result;
+        return nullptr;
+    }
+
     for (const Ptr& group: fgroups){
         if (group->fuuid == uuid)
             return group.get();
@@ -373,6 +487,13 @@ Database::Group* Database::Group::groupLookup(const Uuid& uuid) const noexcept{
 }
 
 Database::Entry* Database::Group::entryLookup(const Uuid& uuid) const noexcept{
+    if (fdatabase){
+        Entry* result = fdatabase->entry(uuid);
+        if (result && result->ancestor(this))
+            return result;
+        return nullptr;
+    }
+
     for (const Entry::Ptr& entry: fentries){
         if (entry->uuid() == uuid)
             return entry.get();
@@ -393,6 +514,7 @@ void Database::Group::addGroup(Group::Ptr group, size_t index, DatabaseModel* mo
     Group* tmp = group.get();
     group->fparent = this;
     fgroups.insert(fgroups.begin()+index, std::move(group));
+    Database::updateIndexes(fgroups, index);
     tmp->setDatabase(model);
 }
 
@@ -402,6 +524,7 @@ Database::Group::Ptr Database::Group::takeGroup(size_t index, DatabaseModel* mod
     fgroups[index]->clearDatabase(model);
     Group::Ptr result(std::move(fgroups[index]));
     fgroups.erase(fgroups.begin()+index);
+    Database::updateIndexes(fgroups, index);
     result->fparent = nullptr;
     return result;
 }
@@ -412,6 +535,7 @@ void Database::Group::addEntry(Entry::Ptr entry, size_t index, DatabaseModel* mo
     Entry* tmp = entry.get();
     entry->fparent = this;
     fentries.insert(fentries.begin()+index, std::move(entry));
+    Database::updateIndexes(fentries, index);
     tmp->setDatabase(model);
 }
 
@@ -444,6 +568,9 @@ Database::Database(CompositeKey key)
       frecycleBin(nullptr),
       ftemplates(nullptr)
 {
+    froot->fuuid = Uuid::generate();
+    fgroupIndex.emplace(froot->fuuid, froot.get());
+
     std::time_t currentTime=time(nullptr);
     fsettings->fnameChanged = currentTime;
     fsettings->fdescriptionChanged = currentTime;
@@ -453,6 +580,14 @@ Database::Database(CompositeKey key)
     fcompositeKeyChanged = currentTime;
 }
 
+void Database::indexTree(Group* group){
+    fgroupIndex.emplace(group->fuuid, group);
+    for (const Entry::Ptr& entry: group->fentries)
+        fentryIndex.emplace(entry->fuuid, entry.get());
+    for (const Group::Ptr& g: group->fgroups)
+        indexTree(g.get());
+}
+
 void Database::setRecycleBin(const Group* bin, std::time_t changed) noexcept{
     assert(!bin || bin->database() == this);
     if (frecycleBin != bin){
@@ -487,27 +622,18 @@ CustomIcon::Ptr Database::icon(const Uuid& uuid) const noexcept{
 }
 
 int Database::iconIndex(const Uuid& uuid) const noexcept{
-    for (size_t i=0; i<fcustomIcons.size(); ++i){
-        if (fcustomIcons[i].first->uuid() == uuid)
-            return i;
-    }
-    return -1;
+    return fcustomIcons.index(uuid);
 }
 
 int Database::iconIndex(const CustomIcon::Ptr& icon) const noexcept{
-    for (size_t i=0; i<fcustomIcons.size(); ++i){
-        if (fcustomIcons[i].first == icon ||
-            fcustomIcons[i].first->uuid() == icon->uuid())
-            return i;
-    }
-    return -1;
+    return fcustomIcons.index(icon->uuid());
 }
 
 Icon Database::addIcon(CustomIcon::Ptr icon){
     int index = iconIndex(icon);
     if (index < 0){
         insertIcon(icon);
-        return Icon(std::move(icon));
+        index = iconIndex(icon);
     }
     return Icon(fcustomIcons[index].first);
 }
@@ -552,13 +678,13 @@ Icon Database::addIcon(CustomIcon::Ptr icon, DatabaseModel* model){
     int index = iconIndex(icon);
     if (index < 0){
         model->insertIcon(icon);
-        return Icon(std::move(icon));
+        index = iconIndex(icon);
     }
     return Icon(fcustomIcons[index].first);
 }
 
 bool Database::removeIcon(size_t index, DatabaseModel* model){
-    if (fcustomIcons[index].second == 0)
+    if (fcustomIcons[index].second != 0)
         return false;
     model->eraseIcon(index);
     return true;
@@ -566,25 +692,25 @@ bool Database::removeIcon(size_t index, DatabaseModel* model){
 
 void Database::insertIcon(CustomIcon::Ptr icon){
     assert(iconIndex(icon) < 0);
-    fcustomIcons.emplace_back(std::pair<CustomIcon::Ptr, size_t>(icon, 0));
+    fcustomIcons.insert(std::move(icon));
 }
 
 void Database::eraseIcon(size_t index){
     assert(index < fcustomIcons.size());
     assert(fcustomIcons[index].second == 0);
-    fcustomIcons.erase(fcustomIcons.begin()+index);
+    fcustomIcons.erase(index);
 }
 
 void Database::refIcon(const CustomIcon::Ptr& icon){
     int index = iconIndex(icon);
     assert(index >= 0);
-    fcustomIcons[index].second++;
+    fcustomIcons.ref(index);
 }
 
 void Database::unrefIcon(const CustomIcon::Ptr& icon){
     int index = iconIndex(icon);
     assert(index >= 0);
-    fcustomIcons[index].second--;
+    fcustomIcons.unref(index);
 }
 
 //-------------------------------------------------------------------------------------
@@ -15,10 +15,15 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <atomic>
 #include <bitset>
+#include <cstring>
 #include <functional>
+#include <mutex>
 #include <utility>
 #include <fstream>
+#include <thread>
+#include <unordered_map>
 
 #include <openssl/sha.h>
 #include <openssl/evp.h>
@@ -45,17 +50,84 @@ const char* const Database::Version::notesString = "Notes";
 
 //------------------------------------------------------------------------------
 
+Database::Binary::Ptr Database::Binary::fromCompressed(SafeVector<uint8_t> data){
+    Ptr result = std::make_shared<Binary>();
+    result->fcompressed = std::move(data);
+    return result;
+}
+
+const SafeVector<uint8_t>& Database::Binary::data() const{
+    if (!fcompressed.empty()){
+        std::call_once(fdecompressed, [this](){
+            fdata = Zlib::Inflater::oneShot(fcompressed, MAX_WBITS | 16);
+        });
+    }
+    return fdata;
+}
+
+const Database::Binary::Hash& Database::Binary::hash() const{
+    std::call_once(fhashed, [this](){
+        OSSL::Digest d(EVP_sha256());
+        if (fcompressed.empty())
+            d.update(fdata);
+        else
+            d.update(Zlib::Inflater::oneShot(fcompressed, MAX_WBITS | 16));
+        d.final(fhash);
+    });
+    return fhash;
+}
+
+Database::Binary::Ptr Database::BinaryPool::insert(Binary::Ptr binary){
+    Binary::Hash hash;
+    Binaries* binaries;
+    if (const SafeVector<uint8_t>* compressed = binary->compressed()){
+        OSSL::Digest::oneShot(EVP_sha256(), hash, *compressed);
+        binaries = &fcompressed;
+    }else{
+        hash = binary->hash();
+        binaries = &fbinaries;
+    }
+
+    std::weak_ptr<Binary>& pooled = (*binaries)[hash];
+    if (Binary::Ptr result = pooled.lock())
+        return result;
+    pooled = binary;
+
+    if (fbinaries.size() + fcompressed.size() >= fpurgeSize)
+        purge();
+    return binary;
+}
+
+// Drops entries of attachments that are already gone.
+void Database::BinaryPool::purge(){
+    for (Binaries* binaries: {&fbinaries, &fcompressed}){
+        for (auto it = binaries->begin(); it != binaries->end();){
+            if (it->second.expired())
+                it = binaries->erase(it);
+            else
+                ++it;
+        }
+    }
+    fpurgeSize = std::max<std::size_t>(16, (fbinaries.size() + fcompressed.size()) * 2);
+}
+
+//------------------------------------------------------------------------------
+
 struct Database::Meta{
 public:
     class Binary;
     class Binaries;
 
     inline Meta()
-        :settings(new Database::Settings())
+        :settings(new Database::Settings()),
+          customIconCount(0),
+          mutex(new std::mutex())
     {}
 
     inline Meta(const Database::File::Settings& settings)
-        :settings(new Database::Settings(settings))
+        :settings(new Database::Settings(settings)),
+          customIconCount(0),
+          mutex(new std::mutex())
     {}
 
     Database::Settings::Ptr settings;
@@ -65,9 +137,18 @@ public:
     std::time_t templatesChanged;
     std::time_t compositeKeyChanged;
     std::array<uint8_t, 32> headerHash; // ToDo: make use of this field...
-    std::vector<std::pair<CustomIcon::Ptr, size_t>> customIcons;
+    // Icons are referenced while groups and entries are parsed, where Meta
+    // is const.
+    mutable CustomIcons customIcons;
+    // Number of custom icons in the document, including skipped ones.
+    std::size_t customIconCount;
     std::map<std::string, std::string> customData;
-    std::map<std::string, std::shared_ptr<SafeVector<uint8_t>>> binaries;
+    std::map<std::string, Database::Binary::Ptr> binaries;
+    // Attachments are pooled while entries are parsed, where Meta is const.
+    mutable Database::BinaryPool binaryPool;
+    // Guards customIcons and binaryPool, as subtrees of the root group can be
+    // parsed by several threads at once.
+    std::unique_ptr<std::mutex> mutex;
 };
 
 class Database::Version::Binary{
@@ -231,6 +312,172 @@ static constexpr char TagSeparators[] = ",;:";
 
 }
 
+/** @brief Identifiers of XML elements known to KDBX parser.
+ *
+ * Element names are interned by XmlReader, so parsers can dispatch on those
+ * instead of comparing names of each node against all known tag strings.
+ */
+enum class Tag: uint8_t{
+    DocNode,
+    Meta,
+    Root,
+    Group,
+    Entry,
+    Generator,
+    HeaderHash,
+    DbName,
+    DbNameChanged,
+    DbDesc,
+    DbDescChanged,
+    DbDefaultUser,
+    DbDefaultUserChanged,
+    DbMntncHistoryDays,
+    DbColor,
+    DbKeyChanged,
+    DbKeyChangeRec,
+    DbKeyChangeForce,
+    RecycleBinEnabled,
+    RecycleBinUuid,
+    RecycleBinChanged,
+    EntryTemplatesGroup,
+    EntryTemplatesGroupChanged,
+    HistoryMaxItems,
+    HistoryMaxSize,
+    LastSelectedGroup,
+    LastTopVisibleGroup,
+    MemoryProt,
+    ProtTitle,
+    ProtUserName,
+    ProtPassword,
+    ProtUrl,
+    ProtNotes,
+    ProtAutoHide,
+    CustomIcons,
+    CustomIconItem,
+    Uuid,
+    CustomIconItemData,
+    AutoType,
+    History,
+    Name,
+    Notes,
+    Icon,
+    CustomIconID,
+    FgColor,
+    BgColor,
+    OverrideUrl,
+    Times,
+    Tags,
+    CreationTime,
+    LastModTime,
+    LastAccessTime,
+    ExpiryTime,
+    Expires,
+    UsageCount,
+    LocationChanged,
+    GroupDefaultAutoTypeSeq,
+    EnableAutoType,
+    EnableSearching,
+    String,
+    Binary,
+    Key,
+    Value,
+    AutoTypeEnabled,
+    AutoTypeObfuscation,
+    AutoTypeDefaultSeq,
+    AutoTypeItem,
+    Window,
+    KeystrokeSequence,
+    Binaries,
+    IsExpanded,
+    LastTopVisibleEntry,
+    DeletedObjects,
+    DeletedObject,
+    DeletionTime,
+    CustomData,
+    StringDictExItem,
+    Unknown
+};
+
+static const std::pair<Tag, const char*> TagNames[] = {
+    {Tag::DocNode, String::DocNode},
+    {Tag::Meta, String::Meta},
+    {Tag::Root, String::Root},
+    {Tag::Group, String::Group},
+    {Tag::Entry, String::Entry},
+    {Tag::Generator, String::Generator},
+    {Tag::HeaderHash, String::HeaderHash},
+    {Tag::DbName, String::DbName},
+    {Tag::DbNameChanged, String::DbNameChanged},
+    {Tag::DbDesc, String::DbDesc},
+    {Tag::DbDescChanged, String::DbDescChanged},
+    {Tag::DbDefaultUser, String::DbDefaultUser},
+    {Tag::DbDefaultUserChanged, String::DbDefaultUserChanged},
+    {Tag::DbMntncHistoryDays, String::DbMntncHistoryDays},
+    {Tag::DbColor, String::DbColor},
+    {Tag::DbKeyChanged, String::DbKeyChanged},
+    {Tag::DbKeyChangeRec, String::DbKeyChangeRec},
+    {Tag::DbKeyChangeForce, String::DbKeyChangeForce},
+    {Tag::RecycleBinEnabled, String::RecycleBinEnabled},
+    {Tag::RecycleBinUuid, String::RecycleBinUuid},
+    {Tag::RecycleBinChanged, String::RecycleBinChanged},
+    {Tag::EntryTemplatesGroup, String::EntryTemplatesGroup},
+    {Tag::EntryTemplatesGroupChanged, String::EntryTemplatesGroupChanged},
+    {Tag::HistoryMaxItems, String::HistoryMaxItems},
+    {Tag::HistoryMaxSize, String::HistoryMaxSize},
+    {Tag::LastSelectedGroup, String::LastSelectedGroup},
+    {Tag::LastTopVisibleGroup, String::LastTopVisibleGroup},
+    {Tag::MemoryProt, String::MemoryProt},
+    {Tag::ProtTitle, String::ProtTitle},
+    {Tag::ProtUserName, String::ProtUserName},
+    {Tag::ProtPassword, String::ProtPassword},
+    {Tag::ProtUrl, String::ProtUrl},
+    {Tag::ProtNotes, String::ProtNotes},
+    {Tag::ProtAutoHide, String::ProtAutoHide},
+    {Tag::CustomIcons, String::CustomIcons},
+    {Tag::CustomIconItem, String::CustomIconItem},
+    {Tag::Uuid, String::Uuid},
+    {Tag::CustomIconItemData, String::CustomIconItemData},
+    {Tag::AutoType, String::AutoType},
+    {Tag::History, String::History},
+    {Tag::Name, String::Name},
+    {Tag::Notes, String::Notes},
+    {Tag::Icon, String::Icon},
+    {Tag::CustomIconID, String::CustomIconID},
+    {Tag::FgColor, String::FgColor},
+    {Tag::BgColor, String::BgColor},
+    {Tag::OverrideUrl, String::OverrideUrl},
+    {Tag::Times, String::Times},
+    {Tag::Tags, String::Tags},
+    {Tag::CreationTime, String::CreationTime},
+    {Tag::LastModTime, String::LastModTime},
+    {Tag::LastAccessTime, String::LastAccessTime},
+    {Tag::ExpiryTime, String::ExpiryTime},
+    {Tag::Expires, String::Expires},
+    {Tag::UsageCount, String::UsageCount},
+    {Tag::LocationChanged, String::LocationChanged},
+    {Tag::GroupDefaultAutoTypeSeq, String::GroupDefaultAutoTypeSeq},
+    {Tag::EnableAutoType, String::EnableAutoType},
+    {Tag::EnableSearching, String::EnableSearching},
+    {Tag::String, String::String},
+    {Tag::Binary, String::Binary},
+    {Tag::Key, String::Key},
+    {Tag::Value, String::Value},
+    {Tag::AutoTypeEnabled, String::AutoTypeEnabled},
+    {Tag::AutoTypeObfuscation, String::AutoTypeObfuscation},
+    {Tag::AutoTypeDefaultSeq, String::AutoTypeDefaultSeq},
+    {Tag::AutoTypeItem, String::AutoTypeItem},
+    {Tag::Window, String::Window},
+    {Tag::KeystrokeSequence, String::KeystrokeSequence},
+    {Tag::Binaries, String::Binaries},
+    {Tag::IsExpanded, String::IsExpanded},
+    {Tag::LastTopVisibleEntry, String::LastTopVisibleEntry},
+    {Tag::DeletedObjects, String::DeletedObjects},
+    {Tag::DeletedObject, String::DeletedObject},
+    {Tag::DeletionTime, String::DeletionTime},
+    {Tag::CustomData, String::CustomData},
+    {Tag::StringDictExItem, String::StringDictExItem},
+};
+
 //ToDo: move or even unite it with XmlReader?
 //class DatabaseFile{
 //public:
@@ -244,16 +491,59 @@ static constexpr char TagSeparators[] = ",;:";
 
 //-------------------------------------------------------------------------------
 
+class Subtrees;
+
 class XmlReader: public XML::InputBufferTextReader{
 private:
     RandomStream::Ptr cryptoRandomStream;
+    mutable std::unordered_map<const xmlChar*, Tag> tags;
+    Database::File::Visitor* fvisitor;
+    unsigned fskip;
+    Subtrees* fsubtrees;
 
 public:
 
-    XmlReader(Input* input, xmlCharEncoding encoding, RandomStream::Ptr cryptoRandomStream)
+    XmlReader(Input* input, xmlCharEncoding encoding, RandomStream::Ptr cryptoRandomStream,
+              Database::File::Visitor* visitor = nullptr, unsigned skip = 0, Subtrees* subtrees = nullptr)
         :InputBufferTextReader(input, encoding),
-          cryptoRandomStream(std::move(cryptoRandomStream))
-    {}
+          cryptoRandomStream(std::move(cryptoRandomStream)),
+          fvisitor(visitor),
+          fskip(skip),
+          fsubtrees(subtrees)
+    {
+        tags.reserve(std::extent<decltype(TagNames)>::value);
+        for (const std::pair<Tag, const char*>& tag: TagNames){
+            tags.emplace(constString(tag.second), tag.first);
+        }
+    }
+
+    /** @brief Returns an identifier of current element's name.
+     *
+     * Names not known to KDBX parser are reported as Tag::Unknown.
+     */
+    Tag tagId() const{
+        const xmlChar* name = constLocalName();
+        if (!name)
+            return Tag::Unknown;
+
+        auto pos = tags.find(name);
+        if (pos != tags.end())
+            return pos->second;
+
+        // A miss is an element unknown to this parser (plugin data, KDBX 4
+        // elements). Its name is interned in reader's dictionary as well, so
+        // the name is resolved once and the result is cached by pointer;
+        // later occurrences are found by the lookup above.
+        Tag result = Tag::Unknown;
+        for (const std::pair<Tag, const char*>& tag: TagNames){
+            if (strcmp(reinterpret_cast<const char*>(name), tag.second) == 0){
+                result = tag.first;
+                break;
+            }
+        }
+        tags.emplace(name, result);
+        return result;
+    }
 
     inline RandomStream* randomStream() const noexcept{
         return cryptoRandomStream.get();
@@ -263,27 +553,358 @@ public:
         return std::move(cryptoRandomStream);
     }
 
+    /** @brief Returns visitor that parsed groups and entries are handed to,
+     * or nullptr if a complete database is being built. */
+    inline Database::File::Visitor* visitor() const noexcept{
+        return fvisitor;
+    }
+
+    /** @brief Checks whether a part of a database described by
+     * Database::File::Visitor::Skip flag is to be skipped. */
+    inline bool skipping(unsigned part) const noexcept{
+        return fskip & part;
+    }
+
+    /** @brief Returns subtrees of the root group that are parsed by other
+     * threads, or nullptr if the whole document is parsed by this reader. */
+    inline Subtrees* subtrees() const noexcept{
+        return fsubtrees;
+    }
+
+};
+
+/** @brief An XmlReader input that reads a document held in memory.
+ *
+ * The document can be split into several segments, which are read one after
+ * another.
+ */
+class MemoryInput: public XML::InputBufferTextReader::Input{
+public:
+    typedef std::pair<const char*, const char*> Segment;
+
+private:
+    std::vector<Segment> fsegments;
+    std::size_t fsegment;
+    const char* fpos;
+
+public:
+    inline MemoryInput(std::vector<Segment> segments) noexcept
+        :fsegments(std::move(segments)),
+          fsegment(0),
+          fpos(fsegments.empty() ? nullptr : fsegments.front().first)
+    {}
+
+    int read(char* buffer, int len) override{
+        int result = 0;
+        while (len && fsegment < fsegments.size()){
+            std::size_t toCopy = std::min(std::size_t(fsegments[fsegment].second - fpos), std::size_t(len));
+            std::memcpy(buffer + result, fpos, toCopy);
+            fpos += toCopy;
+            result += toCopy;
+            len -= toCopy;
+            if (fpos == fsegments[fsegment].second && ++fsegment < fsegments.size())
+                fpos = fsegments[fsegment].first;
+        }
+        return result;
+    }
+
+    void close() override{}
+};
+
+/** @brief Subgroups of the root group that are parsed concurrently.
+ *
+ * Subtrees scans a KDBX document held in memory for subgroups of the root
+ * group, and for the offset of protected-value random stream at both ends of
+ * each of them. Once the parser reaches Root element, worker threads parse
+ * those subtrees, each with its own XmlReader and a random stream moved to
+ * the offset of its subtree. The rest of the document, with every subtree
+ * replaced by an empty Group element, is parsed by the calling thread, and
+ * root group parser takes parsed subtrees in document order.
+ *
+ * Stream offsets are verified as subtrees are taken, so the result is the same
+ * as if the document was parsed serially. If it is not, or if a subtree could
+ * not be parsed, take() throws Mismatch and the document is to be parsed
+ * again by a single reader.
+ */
+class Subtrees{
+public:
+    /** @brief Thrown if subtrees cannot be used in place of a serial parse.*/
+    class Mismatch: public std::runtime_error{
+    public:
+        inline Mismatch()
+            :std::runtime_error("Subtree does not match the document.")
+        {}
+    };
+
+    /** @brief Scans document [begin, end).
+     *
+     * If the document uses XML features that the scanner does not handle,
+     * like document type declarations, no subtrees are found.
+     */
+    Subtrees(const char* begin, const char* end, RandomStream::Algorithm algorithm,
+             const SafeVector<uint8_t>& protectedStreamKey, unsigned threads);
+
+    /** @brief Stops worker threads.*/
+    ~Subtrees() noexcept;
+
+    Subtrees(const Subtrees&) = delete;
+    Subtrees& operator=(const Subtrees&) = delete;
+
+    /** @brief Returns number of subtrees found in the document.*/
+    inline std::size_t size() const noexcept{
+        return fsubtrees.size();
+    }
+
+    /** @brief Returns the document with subtrees replaced by empty elements.*/
+    inline const std::vector<MemoryInput::Segment>& document() const noexcept{
+        return fdocument;
+    }
+
+    /** @brief Starts worker threads that parse subtrees.
+     * @param meta Database metadata used by subtrees. It has to remain valid
+     *        until finish() or stop() is called.
+     * @param database Database that parsed groups belong to.
+     */
+    void start(const Database::Meta& meta, Database* database);
+
+    /** @brief Returns next parsed subtree.
+     * @param reader Reader of the document returned by document(),
+     *        positioned at an element that replaced the subtree.
+     *
+     * It moves random stream of \p reader past the subtree.
+     */
+    Database::Group::Ptr take(XmlReader& reader);
+
+    /** @brief Checks that all subtrees were taken and stops worker threads.*/
+    void finish();
+
+    /** @brief Stops worker threads, waiting for subtrees that are being
+     *         parsed.*/
+    void stop() noexcept;
+
+private:
+    struct Subtree{
+        const char* begin;
+        const char* end;
+        uint64_t streamBegin;
+        uint64_t streamEnd;
+        std::promise<Database::Group::Ptr> promise;
+    };
+
+    bool scan(const char* begin, const char* end);
+    void work(const Database::Meta& meta, Database* database) noexcept;
+
+    std::vector<Subtree> fsubtrees;
+    std::vector<std::future<Database::Group::Ptr>> fresults;
+    std::vector<MemoryInput::Segment> fdocument;
+    RandomStream::Algorithm falgorithm;
+    SafeVector<uint8_t> fprotectedStreamKey;
+    unsigned fthreads;
+    std::vector<std::thread> fworkers;
+    std::atomic<std::size_t> fnextParsed;
+    std::atomic<bool> fstopped;
+    std::size_t fnextTaken;
 };
 
-class XmlWriter: public XML::OutputBufferTextWriter{
+class WrittenSubtrees;
+
+/** @brief Streaming XML writer specialized for KDBX documents.
+ *
+ * KDBX documents use a very small subset of XML: elements, attributes and
+ * text content, with no namespaces, comments or mixed content. XmlWriter
+ * serializes that subset straight into Pipeline buffers, escaping text as it
+ * is copied, instead of going through xmlTextWriter and its intermediate
+ * output buffers. Output is byte for byte identical to what xmlTextWriter
+ * produces for the same sequence of calls.
+ */
+class XmlWriter{
+public:
+
+    /** @brief Interface of an object that consumes buffers filled by
+     * XmlWriter. */
+    class Output{
+    public:
+        /** @brief Called with a completely filled buffer.
+         * @return An empty buffer that XmlWriter continues to write to.
+         */
+        virtual Pipeline::Buffer::Ptr write(Pipeline::Buffer::Ptr buffer) =0;
+        /** @brief Called with the last, possibly partially filled buffer once
+         * the document is finished. */
+        virtual void close(Pipeline::Buffer::Ptr buffer) =0;
+    };
+
 private:
+
+    struct Element{
+        const char* name;
+        std::size_t size;
+    };
+
+    Output* foutput;
+    Pipeline::Buffer::Ptr fbuffer;
+    uint8_t* fpos;
+    uint8_t* fend;
+
+    std::vector<Element> felements;
+    bool fstartTagOpen;
+    bool fdoIndent;
+    bool findent;
+
     RandomStream::Ptr cryptoRandomStream;
+    std::map<Database::Binary::Hash, std::size_t> fbinaryIds;
+    WrittenSubtrees* fsubtrees;
+
+    void nextBuffer();
+
+    inline void put(char c){
+        if (fpos == fend)
+            nextBuffer();
+        *fpos++ = c;
+    }
+
+    inline void put(const char* data, std::size_t size){
+        while (size > std::size_t(fend - fpos)){
+            std::size_t chunk = fend - fpos;
+            std::memcpy(fpos, data, chunk);
+            data += chunk;
+            size -= chunk;
+            nextBuffer();
+        }
+        std::memcpy(fpos, data, size);
+        fpos += size;
+    }
+
+    template <std::size_t size>
+    inline void put(const char (&literal)[size]){
+        put(literal, size-1);
+    }
+
+    void putIndent(std::size_t depth);
+    void putText(const char* text);
+    void putAttributeValue(const char* value);
+    void putBase64(const uint8_t* data, std::size_t size);
+    void beginContent();
 
 public:
 
-    XmlWriter(Output* output, RandomStream::Ptr cryptoRandomStream)
-        :OutputBufferTextWriter(output),
-          cryptoRandomStream(std::move(cryptoRandomStream))
+    XmlWriter(Output* output, RandomStream::Ptr cryptoRandomStream, WrittenSubtrees* subtrees = nullptr)
+        :foutput(output),
+          fbuffer(new Pipeline::Buffer()),
+          fpos(fbuffer->data().data()),
+          fend(fpos + Pipeline::Buffer::maxSize),
+          fstartTagOpen(false),
+          fdoIndent(false),
+          findent(false),
+          cryptoRandomStream(std::move(cryptoRandomStream)),
+          fsubtrees(subtrees)
     {}
 
+    /** @brief Constructs a writer of a fragment of the document written by
+     * \p document.
+     *
+     * The fragment is indented as if it was nested in \p depth elements, and
+     * it shares attachment ids with \p document. Elements it is nested in
+     * cannot be closed by this writer.
+     */
+    XmlWriter(Output* output, RandomStream::Ptr cryptoRandomStream, const XmlWriter& document, std::size_t depth)
+        :XmlWriter(output, std::move(cryptoRandomStream))
+    {
+        felements.resize(depth, Element{"", 0});
+        findent = document.findent;
+        fbinaryIds = document.fbinaryIds;
+    }
+
+    XmlWriter(const XmlWriter&) = delete;
+    XmlWriter& operator=(const XmlWriter&) = delete;
+
     inline RandomStream* randomStream() const noexcept{
         return cryptoRandomStream.get();
     }
 
+    inline WrittenSubtrees* subtrees() const noexcept{
+        return fsubtrees;
+    }
+
+    /** @brief Returns number of elements that are currently open.*/
+    inline std::size_t depth() const noexcept{
+        return felements.size();
+    }
+
     inline RandomStream::Ptr takeRandomStream() noexcept{
         return std::move(cryptoRandomStream);
     }
 
+    /** @brief Assigns an id to an attachment stored in Meta/Binaries.
+     * @return Id of the attachment, and true if the attachment had no id yet
+     *         and needs to be written.
+     *
+     * Attachments with equal contents share an id. Ids are consecutive
+     * numbers starting from 0, assigned in order of first appearance.
+     */
+    inline std::pair<std::size_t, bool> addBinary(const Database::Binary& binary){
+        auto result = fbinaryIds.emplace(binary.hash(), fbinaryIds.size());
+        return std::make_pair(result.first->second, result.second);
+    }
+
+    /** @brief Returns an id previously assigned to an attachment with
+     * addBinary().*/
+    inline std::size_t binaryId(const Database::Binary& binary) const{
+        return fbinaryIds.at(binary.hash());
+    }
+
+    /** @brief Turns indentation on (nonzero value) or off. */
+    inline void setIndent(int indent) noexcept{
+        findent = indent != 0;
+    }
+
+    /** @brief Writes an XML declaration. Only utf-8 documents are supported. */
+    void writeStartDocument(const char * version = "1.0",
+                            const char * encoding = "utf-8",
+                            const char * standalone = "yes");
+
+    /** @brief Closes all open elements and passes the last buffer on to the
+     * output. */
+    void writeEndDocument();
+
+    /** @brief Passes the last buffer of a fragment on to the output.
+     *
+     * Elements opened by the fragment must already be closed.
+     */
+    void writeEndFragment();
+
+    /** @brief Copies complete elements written by a fragment writer into
+     * the document.
+     *
+     * \p buffers have to come from a writer constructed for the current
+     * depth of this one.
+     */
+    void writeFragment(const std::vector<Pipeline::Buffer::Ptr>& buffers);
+
+    void writeStartElement(const char* name);
+    void writeEndElement();
+    void writeAttribute(const char* name, const char* value);
+
+    /** @brief Writes escaped text content. Empty strings are ignored. */
+    void writeString(const char* content);
+
+    inline void writeString(const std::string& s){
+        writeString(s.c_str());
+    }
+
+    /** @brief Writes a binary buffer as base64 encoded text content. Empty
+     * buffers are ignored. */
+    void writeBase64(const uint8_t* content, std::size_t len);
+
+    template <typename Allocator>
+    inline void writeBase64(const std::vector<uint8_t, Allocator>& content){
+        writeBase64(content.data(), content.size());
+    }
+
+    template <std::size_t size>
+    inline void writeBase64(const std::array<uint8_t, size>& content){
+        writeBase64(content.data(), content.size());
+    }
+
     template <typename T, typename ...Args>
     void write(const T& t, Args&& ...args);
 
@@ -309,6 +930,97 @@ public:
 
 };
 
+/** @brief Subgroups of the root group that are serialized concurrently.
+ *
+ * Protected values consume the random stream in document order, so
+ * WrittenSubtrees first adds up sizes of protected values of each subgroup of
+ * the root group to find offsets of the stream at which their serialization
+ * starts. Once the writer of the document reaches Root element, worker
+ * threads serialize those subgroups into separate buffers, each with its own
+ * random stream moved to the offset of its subtree. The writer of the
+ * document copies those buffers in place of the subgroups, in document order.
+ */
+class WrittenSubtrees{
+public:
+    /** @brief Prepares serialization of subgroups of \p root.
+     *
+     * Database must not change until the document is written.
+     */
+    WrittenSubtrees(const Database::Group* root, RandomStream::Algorithm algorithm,
+                    const SafeVector<uint8_t>& protectedStreamKey, unsigned threads);
+
+    /** @brief Stops worker threads.*/
+    ~WrittenSubtrees() noexcept;
+
+    WrittenSubtrees(const WrittenSubtrees&) = delete;
+    WrittenSubtrees& operator=(const WrittenSubtrees&) = delete;
+
+    /** @brief Returns the group whose subgroups are serialized concurrently.*/
+    inline const Database::Group* parent() const noexcept{
+        return fparent;
+    }
+
+    /** @brief Starts worker threads.
+     * @param writer Writer of the document, positioned at Root element.
+     *        Attachment ids have to be assigned already.
+     */
+    void start(const XmlWriter& writer);
+
+    /** @brief Writes next subgroup of the root group into \p writer.
+     *
+     * It waits until the subgroup is serialized, and moves random stream of
+     * \p writer past it.
+     */
+    void put(XmlWriter& writer, const Database::Group* group);
+
+    /** @brief Checks that all subgroups were written and stops worker
+     *         threads.*/
+    void finish();
+
+    /** @brief Stops worker threads, waiting for subtrees that are being
+     *         serialized.*/
+    void stop() noexcept;
+
+private:
+    class Output: public XmlWriter::Output{
+    public:
+        std::vector<Pipeline::Buffer::Ptr> buffers;
+
+        Pipeline::Buffer::Ptr write(Pipeline::Buffer::Ptr buffer) override{
+            buffers.push_back(std::move(buffer));
+            return Pipeline::Buffer::Ptr(new Pipeline::Buffer());
+        }
+
+        void close(Pipeline::Buffer::Ptr buffer) override{
+            if (buffer->size())
+                buffers.push_back(std::move(buffer));
+        }
+    };
+
+    struct Subtree{
+        const Database::Group* group;
+        uint64_t streamBegin;
+        uint64_t streamEnd;
+        std::promise<std::vector<Pipeline::Buffer::Ptr>> promise;
+    };
+
+    static uint64_t protectedSize(const Database::Group* group) noexcept;
+    void work() noexcept;
+
+    const Database::Group* fparent;
+    const XmlWriter* fdocument;
+    uint64_t fbase;
+    std::vector<Subtree> fsubtrees;
+    std::vector<std::future<std::vector<Pipeline::Buffer::Ptr>>> fresults;
+    RandomStream::Algorithm falgorithm;
+    SafeVector<uint8_t> fprotectedStreamKey;
+    unsigned fthreads;
+    std::vector<std::thread> fworkers;
+    std::atomic<std::size_t> fnextWritten;
+    std::atomic<bool> fstopped;
+    std::size_t fnextPut;
+};
+
 //-------------------------------------------------------------------------------
 
 class XmlReaderLink: public Pipeline::InLink, public XML::InputBufferTextReader::Input{
@@ -323,49 +1035,125 @@ private:
     Database::File::Settings fileSettings;
     CompositeKey fcompositeKey;
     SafeVector<uint8_t> fprotectedStreamKey;
+    Database::File::Visitor* fvisitor;
+    unsigned fskip;
+    unsigned fthreads;
+    bool fmetadataOnly;
 
     std::promise<Database::Ptr> finishedPromise;
+    std::promise<void> visitedPromise;
+    std::promise<Database::File::Metadata> metadataPromise;
+
+    // Thrown to stop the pipeline once metadata is read.
+    class Cancelled: public std::exception{};
+
+    void setException(std::exception_ptr e);
+    Database::Ptr parseDocument(XmlReader& reader, CompositeKey compositeKey);
+    Database::Ptr parseInMemory();
+    Database::File::Metadata parseMetadata(XmlReader& reader);
 public:
 
+    /** @brief Constructor tag of a link that only reads database metadata.*/
+    struct MetadataOnly{};
+
     inline XmlReaderLink(const Database::File::Settings& settings, const SafeVector<uint8_t>& protectedStreamKey, CompositeKey compositeKey = CompositeKey()) noexcept
         :currentPos(0),
           fileSettings(settings),
           fcompositeKey(std::move(compositeKey)),
-          fprotectedStreamKey(std::move(protectedStreamKey))
+          fprotectedStreamKey(std::move(protectedStreamKey)),
+          fvisitor(nullptr),
+          fskip(0),
+          fthreads(0),
+          fmetadataOnly(false)
+    {}
+
+    /** @brief Constructs a link that reads the whole document into memory,
+     * and parses subgroups of the root group on \p threads threads (0 means
+     * as many as there are processor cores). */
+    inline XmlReaderLink(const Database::File::Settings& settings, const SafeVector<uint8_t>& protectedStreamKey, unsigned threads, CompositeKey compositeKey = CompositeKey())
+        :currentPos(0),
+          fileSettings(settings),
+          fcompositeKey(std::move(compositeKey)),
+          fprotectedStreamKey(std::move(protectedStreamKey)),
+          fvisitor(nullptr),
+          fskip(0),
+          fthreads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())),
+          fmetadataOnly(false)
+    {}
+
+    /** @brief Constructs a link that hands parsed groups and entries to
+     * \p visitor instead of building a database. */
+    inline XmlReaderLink(const Database::File::Settings& settings, const SafeVector<uint8_t>& protectedStreamKey, Database::File::Visitor* visitor, unsigned skip, CompositeKey compositeKey = CompositeKey()) noexcept
+        :currentPos(0),
+          fileSettings(settings),
+          fcompositeKey(std::move(compositeKey)),
+          fprotectedStreamKey(std::move(protectedStreamKey)),
+          fvisitor(visitor),
+          fskip(skip),
+          fthreads(0),
+          fmetadataOnly(false)
+    {}
+
+    /** @brief Constructs a link that only parses Meta element of the
+     * document, and then stops the pipeline. */
+    inline XmlReaderLink(const Database::File::Settings& settings, const SafeVector<uint8_t>& protectedStreamKey, MetadataOnly, unsigned skip, CompositeKey compositeKey = CompositeKey()) noexcept
+        :currentPos(0),
+          fileSettings(settings),
+          fcompositeKey(std::move(compositeKey)),
+          fprotectedStreamKey(std::move(protectedStreamKey)),
+          fvisitor(nullptr),
+          fskip(skip),
+          fthreads(0),
+          fmetadataOnly(true)
     {}
 
+    inline const CompositeKey& compositeKey() const noexcept{
+        return fcompositeKey;
+    }
+
     inline std::future<Database::Ptr> getFuture(){
         return finishedPromise.get_future();
     }
 
+    inline std::future<void> getVisitedFuture(){
+        return visitedPromise.get_future();
+    }
+
+    inline std::future<Database::File::Metadata> getMetadataFuture(){
+        return metadataPromise.get_future();
+    }
+
     virtual void runThread() override;
 
 };
 
 //--------------------------------------------------------------------------------
 
-class XmlWriterLink: public Pipeline::OutLink, public XML::OutputBufferTextWriter::Output{
+class XmlWriterLink: public Pipeline::OutLink, public XmlWriter::Output{
 private:
 
-    int write(const char* buffer, int len) override;
-    void close() override;
-
-    Pipeline::Buffer::Ptr current;
-    std::size_t currentPos;
+    Pipeline::Buffer::Ptr write(Pipeline::Buffer::Ptr buffer) override;
+    void close(Pipeline::Buffer::Ptr buffer) override;
 
     const Database* database;
     SafeVector<uint8_t> fprotectedStreamKey;
     std::promise<void> finishedPromise;
 
     int findent;
+    unsigned fthreads;
     std::array<uint8_t, 32> fheaderHash;
 public:
 
-    inline XmlWriterLink(const Database* database, SafeVector<uint8_t> protectedStreamKey) noexcept
-        :currentPos(0),
-          database(database),
+    /** @brief Constructs a link that serializes \p database.
+     * @param threads Number of threads that serialize subgroups of the root
+     *        group, or 0 if the whole document is serialized by the link's
+     *        own thread.
+     */
+    inline XmlWriterLink(const Database* database, SafeVector<uint8_t> protectedStreamKey, unsigned threads = 0) noexcept
+        :database(database),
           fprotectedStreamKey(std::move(protectedStreamKey)),
-          findent(0)
+          findent(0),
+          fthreads(threads)
     {
         memset(fheaderHash.data(), 0, fheaderHash.size());
     }
@@ -404,33 +1192,234 @@ int XmlReaderLink::read(char* buffer, int len){
 }
 
 void XmlReaderLink::close(){
+    if (fmetadataOnly)
+        return; // The rest of the file is not read at all.
     while(InLink::read()); // Just skip all following data...
 }
 
-int XmlWriterLink::write(const char* buffer, int len){
+Pipeline::Buffer::Ptr XmlWriterLink::write(Pipeline::Buffer::Ptr buffer){
+    OutLink::write(std::move(buffer));
+    return Pipeline::Buffer::Ptr(new Pipeline::Buffer());
+}
+
+void XmlWriterLink::close(Pipeline::Buffer::Ptr buffer){
+    if (buffer->size())
+        OutLink::write(std::move(buffer));
+}
 
-    int written = 0;
-    while (written < len){
-        std::size_t copySize = std::min(len - written, int(maxSize() - currentPos));
-        std::copy(buffer, buffer+copySize, current->data().data() + currentPos);
-        written += copySize;
-        buffer += copySize;
-        currentPos += copySize;
-        if (currentPos == maxSize()){
-            OutLink::write(std::move(current));
-            current = Pipeline::Buffer::Ptr(new Pipeline::Buffer(maxSize()));
-            currentPos = 0;
-        }
+//--------------------------------------------------------------------------------
+
+/* Escaping classes of characters. Characters of class 3 are replaced by
+ * entities both in text and in attribute values, characters of class 2 only
+ * in attribute values. Terminating null stops both scans. Everything else,
+ * including non-ASCII UTF-8 sequences, is copied verbatim. */
+constexpr uint8_t xmlEscapeClass(unsigned c) noexcept{
+    return (c == 0 || c == '<' || c == '>' || c == '&' || c == '"' || c == '\r') ? 3 :
+           (c == '\n' || c == '\t') ? 2 : 0;
+}
+
+struct XmlEscapeTable{
+    uint8_t value[256];
+
+    constexpr XmlEscapeTable() noexcept
+        :value()
+    {
+        for (unsigned i = 0; i < 256; ++i)
+            value[i] = xmlEscapeClass(i);
+    }
+};
+
+static constexpr XmlEscapeTable xmlEscapeTable{};
+
+static const char* xmlEscapeEntity(char c) noexcept{
+    switch (c){
+    case '<': return "&lt;";
+    case '>': return "&gt;";
+    case '&': return "&amp;";
+    case '"': return "&quot;";
+    case '\r': return "&#13;";
+    case '\n': return "&#10;";
+    case '\t': return "&#9;";
+    default: return nullptr;
+    }
+}
+
+void XmlWriter::nextBuffer(){
+    fbuffer = foutput->write(std::move(fbuffer));
+    fpos = fbuffer->data().data();
+    fend = fpos + Pipeline::Buffer::maxSize;
+}
+
+void XmlWriter::putIndent(std::size_t depth){
+    for (; depth; --depth)
+        put(' ');
+}
+
+void XmlWriter::putText(const char* text){
+    while (true){
+        const char* run = text;
+        while (!(xmlEscapeTable.value[uint8_t(*text)] & 1))
+            ++text;
+        put(run, text - run);
+        if (!*text)
+            return;
+        const char* entity = xmlEscapeEntity(*text);
+        put(entity, strlen(entity));
+        ++text;
     }
+}
+
+void XmlWriter::putAttributeValue(const char* value){
+    while (true){
+        const char* run = value;
+        while (!xmlEscapeTable.value[uint8_t(*value)])
+            ++value;
+        put(run, value - run);
+        if (!*value)
+            return;
+        const char* entity = xmlEscapeEntity(*value);
+        put(entity, strlen(entity));
+        ++value;
+    }
+}
 
-    return written;
+void XmlWriter::putBase64(const uint8_t* data, std::size_t size){
+    while (size){
+        std::size_t blocks = std::size_t(fend - fpos) / 4;
+        if (!blocks){
+            // Not enough room for a complete quadruple, so encode it aside.
+            char quad[4];
+            std::size_t chunk = std::min(size, std::size_t(3));
+            encodeBase64(data, chunk, quad);
+            put(quad, 4);
+            data += chunk;
+            size -= chunk;
+            continue;
+        }
+        std::size_t chunk = std::min(size, blocks * 3);
+        fpos = reinterpret_cast<uint8_t*>(encodeBase64(data, chunk, reinterpret_cast<char*>(fpos)));
+        data += chunk;
+        size -= chunk;
+    }
 }
 
-void XmlWriterLink::close(){
-    if (currentPos){
-        current->setSize(currentPos);
-        OutLink::write(std::move(current));
+void XmlWriter::beginContent(){
+    if (fstartTagOpen){
+        put('>');
+        fstartTagOpen = false;
     }
+    fdoIndent = false;
+}
+
+void XmlWriter::writeStartDocument(const char* version, const char* encoding, const char* standalone){
+    if (encoding && strcasecmp(encoding, "utf-8") != 0 && strcasecmp(encoding, "utf8") != 0)
+        throw std::runtime_error("Unsupported XML document encoding.");
+
+    put("<?xml version=\"");
+    put(version, strlen(version));
+    put('"');
+    if (encoding)
+        put(" encoding=\"UTF-8\"");
+    if (standalone){
+        put(" standalone=\"");
+        put(standalone, strlen(standalone));
+        put('"');
+    }
+    put("?>\n");
+}
+
+void XmlWriter::writeEndDocument(){
+    while (!felements.empty())
+        writeEndElement();
+    if (!findent)
+        put('\n');
+
+    fbuffer->setSize(fpos - fbuffer->data().data());
+    fpos = fend = nullptr;
+    foutput->close(std::move(fbuffer));
+}
+
+void XmlWriter::writeEndFragment(){
+    fbuffer->setSize(fpos - fbuffer->data().data());
+    fpos = fend = nullptr;
+    foutput->close(std::move(fbuffer));
+}
+
+void XmlWriter::writeFragment(const std::vector<Pipeline::Buffer::Ptr>& buffers){
+    if (fstartTagOpen){
+        put('>');
+        if (findent)
+            put('\n');
+        fstartTagOpen = false;
+    }
+    for (const Pipeline::Buffer::Ptr& buffer: buffers)
+        put(reinterpret_cast<const char*>(buffer->data().data()), buffer->size());
+    // Fragment ends with an end tag, just like writeEndElement() leaves it.
+    fdoIndent = true;
+}
+
+void XmlWriter::writeStartElement(const char* name){
+    if (fstartTagOpen){
+        put('>');
+        if (findent)
+            put('\n');
+        fstartTagOpen = false;
+    }
+
+    Element element = {name, strlen(name)};
+    felements.push_back(element);
+    if (findent)
+        putIndent(felements.size() - 1);
+    put('<');
+    put(element.name, element.size);
+    fstartTagOpen = true;
+}
+
+void XmlWriter::writeEndElement(){
+    if (felements.empty())
+        throw std::runtime_error("XML writer: no element to close.");
+
+    const Element& element = felements.back();
+    if (fstartTagOpen){
+        put("/>");
+        fstartTagOpen = false;
+        if (findent)
+            fdoIndent = true;
+    }else{
+        if (findent && fdoIndent)
+            putIndent(felements.size() - 1);
+        fdoIndent = true;
+        put("</");
+        put(element.name, element.size);
+        put('>');
+    }
+    if (findent)
+        put('\n');
+    felements.pop_back();
+}
+
+void XmlWriter::writeAttribute(const char* name, const char* value){
+    if (!fstartTagOpen)
+        throw std::runtime_error("XML writer: attribute written outside of a start tag.");
+    put(' ');
+    put(name, strlen(name));
+    put("=\"");
+    putAttributeValue(value);
+    put('"');
+}
+
+void XmlWriter::writeString(const char* content){
+    if (!*content)
+        return;
+    beginContent();
+    putText(content);
+}
+
+void XmlWriter::writeBase64(const uint8_t* content, std::size_t len){
+    if (!len)
+        return;
+    beginContent();
+    putBase64(content, len);
 }
 
 template <typename T>
@@ -457,7 +1446,9 @@ template <> class Parser<Time>;
 class Tags;
 template <> class Parser<Tags>;
 template <> class Parser<CustomIcon>;
-template <> class Parser<std::vector<std::pair<CustomIcon::Ptr, size_t>>>;
+template <> class Parser<CustomIcons>;
+class CustomIconCount;
+template <> class Parser<CustomIconCount>;
 template <> class Parser<MemoryProtectionFlags>;
 template <> class Parser<Database::Meta::Binary>;
 template <> class Parser<Database::Meta::Binaries>;
@@ -524,6 +1515,13 @@ public:
 
     static void parseNew(XmlReader& reader){
 
+        XML::String attr = reader.attribute(String::AttrProtected);
+        if (attr && strcmp(attr.c_str(), String::True) == 0){
+            XML::String result = reader.readString();
+            if (result)
+                reader.randomStream()->read(safeDecodeBase64(result.c_str()).size());
+        }
+
         if (!reader.isEmpty()){
             reader.expectRead();
 
@@ -578,8 +1576,7 @@ public:
     {}
 
     bool tag(XmlReader& reader){
-        std::string localName = reader.localName();
-        if (localName == Parser::itemTagName){
+        if (reader.tagId() == Parser::itemTag){
             value.push_back(invokeParse(reader, std::index_sequence_for<Args...>()));
         }else{
             return false;
@@ -623,8 +1620,7 @@ public:
     {}
 
     bool tag(XmlReader& reader){
-        std::string localName = reader.localName();
-        if (localName == Parser::itemTagName){
+        if (reader.tagId() == Parser::itemTag){
             value.push_back(invokeParse(reader, std::index_sequence_for<Args...>()));
         }else{
             return false;
@@ -967,7 +1963,6 @@ public:
 class Time;
 
 // ToDo: some time wrapper perhaps?
-// ToDo: This is terrible, is there really no portable way to do this?
 template <>
 class Parser<Time>{
 public:
@@ -977,11 +1972,18 @@ public:
         XML::String s(reader.readString());
         if (!s.get())
             return 0;
-        return formatTime(reinterpret_cast<const char*>(s.get()));
+        const char* text = reinterpret_cast<const char*>(s.get());
+        std::size_t size = strlen(text);
+        // KDBX 4 stores base64 encoded number of seconds instead.
+        if (size != isoTimeLength)
+            return decodeKdbx4Time(std::string(text, size));
+        return parseIsoTime(text, text + size);
     }
 
     static void writeOld(XmlWriter& writer, std::time_t value){
-        writer.write(unformatTime(value));
+        char buffer[isoTimeLength+1];
+        formatIsoTime(value, buffer);
+        writer.writeString(buffer);
     }
 };
 
@@ -991,14 +1993,15 @@ template <>
 class Parser<Tags>{
 public:
 
-    typedef const std::vector<std::string>& WrittenType;
+    typedef const std::vector<Database::Tag>& WrittenType;
 
-    static std::vector<std::string> parseNew(XmlReader& reader){
-        return explode(parse<std::string>(reader), String::TagSeparators);
+    static std::vector<Database::Tag> parseNew(XmlReader& reader){
+        std::vector<std::string> names = explode(parse<std::string>(reader), String::TagSeparators);
+        return std::vector<Database::Tag>(names.begin(), names.end());
     }
 
-    static void writeOld(XmlWriter& writer, const std::vector<std::string>& value){
-        writer.write(implode(value, String::TagSeparators[0]));
+    static void writeOld(XmlWriter& writer, const std::vector<Database::Tag>& value){
+        writer.write(implode(std::vector<std::string>(value.begin(), value.end()), String::TagSeparators[0]));
     }
 };
 
@@ -1019,14 +2022,16 @@ public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Uuid){
+        switch (reader.tagId()){
+        case Tag::Uuid:
             uuid = parse<Uuid>(reader);
             haveUuid = true;
-        } else if (localName == String::CustomIconItemData){
+            break;
+        case Tag::CustomIconItemData:
             data = parse<std::vector<uint8_t>>(reader);
             haveData = true;
-        }else{
+            break;
+        default:
             return false;
         }
         return true;
@@ -1048,16 +2053,15 @@ public:
 };
 
 template <>
-class Parser<std::vector<std::pair<CustomIcon::Ptr, size_t>>>: public TagParser<Parser<std::vector<std::pair<CustomIcon::Ptr, size_t>>>, std::vector<std::pair<CustomIcon::Ptr, size_t>>>{
+class Parser<CustomIcons>: public TagParser<Parser<CustomIcons>, CustomIcons>{
 private:
-    std::vector<std::pair<CustomIcon::Ptr, size_t>> data;
+    CustomIcons data;
 public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::CustomIconItem){
-            data.emplace_back(parse<CustomIcon>(reader), 0);
+        if (reader.tagId() == Tag::CustomIconItem){
+            data.insert(parse<CustomIcon>(reader));
         }else{
             return false;
         }
@@ -1065,45 +2069,86 @@ public:
 
     }
 
-    inline std::vector<std::pair<CustomIcon::Ptr, size_t>> takeResult(){
+    inline CustomIcons takeResult(){
         return std::move(data);
     }
 
-    static void writeOld(XmlWriter& writer, const std::vector<std::pair<CustomIcon::Ptr, size_t>>& value){
-        for (const std::pair<CustomIcon::Ptr, size_t>& item: value){
+    static void writeOld(XmlWriter& writer, const CustomIcons& value){
+        for (const CustomIcons::value_type& item: value){
             writer.writeElement<CustomIcon>(String::CustomIconItem, item.first);
         }
     }
 
 };
 
-
-
+// Counts custom icons without decoding them.
 template <>
-class Parser<MemoryProtectionFlags>: public TagParser<Parser<MemoryProtectionFlags>, MemoryProtectionFlags>{
+class Parser<CustomIconCount>: public TagParser<Parser<CustomIconCount>, std::size_t>{
 private:
-    MemoryProtectionFlags data;
+    std::size_t count;
 public:
-    inline Parser() noexcept{
-        data.set(MemoryProtection::Password);
-    }
+    inline Parser() noexcept
+        :count(0)
+    {}
 
     bool tag(XmlReader& reader){
+        if (reader.tagId() == Tag::CustomIconItem){
+            TagParser<void, void>::parseNew(reader);
+            ++count;
+            return true;
+        }
+        return false;
+    }
 
-        std::string localName = reader.localName();
-        if (localName == String::ProtTitle){
-            data.set(MemoryProtection::Title, parse<bool>(reader));
-        } else if (localName == String::ProtUserName){
-            data.set(MemoryProtection::UserName, parse<bool>(reader));
-        } else if (localName == String::ProtPassword){
-            data.set(MemoryProtection::Password, parse<bool>(reader));
-        } else if (localName == String::ProtUrl){
+    inline std::size_t takeResult() noexcept{
+        return count;
+    }
+};
+
+// Returns custom icon with UUID \p uuid, counting a reference to it, or
+// nullptr if there is no such icon.
+static CustomIcon::Ptr referenceIcon(const Database::Meta& meta, const Uuid& uuid){
+    std::lock_guard<std::mutex> lock(*meta.mutex);
+    int index = meta.customIcons.index(uuid);
+    if (index < 0)
+        return nullptr;
+    meta.customIcons.ref(index);
+    return meta.customIcons[index].first;
+}
+
+
+
+template <>
+class Parser<MemoryProtectionFlags>: public TagParser<Parser<MemoryProtectionFlags>, MemoryProtectionFlags>{
+private:
+    MemoryProtectionFlags data;
+public:
+    inline Parser() noexcept{
+        data.set(MemoryProtection::Password);
+    }
+
+    bool tag(XmlReader& reader){
+
+        switch (reader.tagId()){
+        case Tag::ProtTitle:
+            data.set(MemoryProtection::Title, parse<bool>(reader));
+            break;
+        case Tag::ProtUserName:
+            data.set(MemoryProtection::UserName, parse<bool>(reader));
+            break;
+        case Tag::ProtPassword:
+            data.set(MemoryProtection::Password, parse<bool>(reader));
+            break;
+        case Tag::ProtUrl:
             data.set(MemoryProtection::Url, parse<bool>(reader));
-        } else if (localName == String::ProtNotes){
+            break;
+        case Tag::ProtNotes:
             data.set(MemoryProtection::Notes, parse<bool>(reader));
-        } else if (localName == String::ProtAutoHide){
+            break;
+        case Tag::ProtAutoHide:
             data.set(MemoryProtection::AutoHide, parse<bool>(reader));
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1130,26 +2175,28 @@ template <>
 class Parser<Database::Meta::Binary>{
 public:
 
-    typedef const SafeVector<uint8_t>& WrittenType;
+    typedef const Database::Binary& WrittenType;
 
-    static std::shared_ptr<SafeVector<uint8_t>> parseNew(XmlReader& reader){
+    static Database::Binary::Ptr parseNew(XmlReader& reader){
 
         XML::String compressed = reader.attribute(String::AttrCompressed);
         SafeVector<uint8_t> result = parse<SafeVector<uint8_t>>(reader);
 
         if (compressed && strcmp(compressed.c_str(), String::True) == 0) // ToDo: is this correct? Check original keepass2 source.
-            return std::make_shared<SafeVector<uint8_t>>(Zlib::Inflater::oneShot(result, MAX_WBITS | 16));
-        return std::make_shared<SafeVector<uint8_t>>(std::move(result));
+            return Database::Binary::fromCompressed(std::move(result));
+        return std::make_shared<Database::Binary>(std::move(result));
     }
 
-    static void writeOld(XmlWriter& writer, const SafeVector<uint8_t>& data, bool compress = true){
-        SafeVector<uint8_t> tmp;
+    static void writeOld(XmlWriter& writer, const Database::Binary& data, bool compress = true){
         if (compress){
-            tmp = Zlib::Deflater::oneShot(data, MAX_WBITS | 16);
             writer.writeAttribute(String::AttrCompressed, String::True);
-            writer.writeBase64(tmp);
+            // Attachments that were never accessed are still compressed.
+            if (const SafeVector<uint8_t>* compressed = data.compressed())
+                writer.writeBase64(*compressed);
+            else
+                writer.writeBase64(Zlib::Deflater::oneShot(data.data(), Z_DEFAULT_COMPRESSION, MAX_WBITS | 16));
         }else{
-            writer.writeBase64(data);
+            writer.writeBase64(data.data());
         }
     }
 
@@ -1158,12 +2205,11 @@ public:
 };
 
 template <>
-class Parser<Database::Meta::Binaries>: public TagParser<Parser<Database::Meta::Binaries>, std::map<std::string, std::shared_ptr<SafeVector<uint8_t>>>>{
+class Parser<Database::Meta::Binaries>: public TagParser<Parser<Database::Meta::Binaries>, std::map<std::string, Database::Binary::Ptr>>{
 private:
 
     class Writer{
     private:
-        std::set<const SafeVector<uint8_t>*> written;
         XmlWriter& writer;
         bool compress;
 
@@ -1189,30 +2235,26 @@ private:
         }
 
         void write(const Database::Version* version){
-            for (const std::pair<std::string, std::shared_ptr<SafeVector<uint8_t>>>& item: version->binaries){
-                const SafeVector<uint8_t>* ptr = item.second.get();
-                if (written.find(ptr) == written.end()){
+            for (const std::pair<std::string, Database::Binary::Ptr>& item: version->binaries){
+                std::pair<std::size_t, bool> id = writer.addBinary(*item.second);
+                if (id.second){
                     writer.writeStartElement(String::Binary);
-                    std::stringstream s;
-                    s << ptr;
-                    writer.writeAttribute(String::AttrId, s.str().c_str());
+                    writer.writeAttribute(String::AttrId, std::to_string(id.first).c_str());
                     writer.write<Database::Meta::Binary>(*item.second, compress);
                     writer.writeEndElement();
-                    written.insert(ptr);
                 }
             }
         }
     };
 
 
-    std::map<std::string, std::shared_ptr<SafeVector<uint8_t>>> data;
+    std::map<std::string, Database::Binary::Ptr> data;
 public:
     typedef const Database::Group* WrittenType;
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Binary){
+        if (reader.tagId() == Tag::Binary){
             XML::String id = reader.attribute(String::AttrId);
             if (id){ //Apparently KeePassLib is ignoring binaries without id...
                 std::string sid(id.c_str());
@@ -1231,7 +2273,7 @@ public:
 
     }
 
-    inline std::map<std::string, std::shared_ptr<SafeVector<uint8_t>>> takeResult(){
+    inline std::map<std::string, Database::Binary::Ptr> takeResult(){
         return std::move(data);
     }
 
@@ -1250,16 +2292,18 @@ private:
     std::pair<std::string, XorredBuffer> data;
 public:
 
-    typedef const std::pair<std::string, XorredBuffer>& WrittenType;
+    typedef const Database::Version::Strings::value_type& WrittenType;
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Key){
+        switch (reader.tagId()){
+        case Tag::Key:
             data.first = parse<std::string>(reader);
-        } else if (localName == String::Value){
+            break;
+        case Tag::Value:
             data.second = parse<XorredBuffer>(reader);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1270,8 +2314,8 @@ public:
         return std::move(data);
     }
 
-    static void writeOld(XmlWriter& writer, const std::pair<std::string, XorredBuffer>& data){
-        writer.writeElement(String::Key, data.first);
+    static void writeOld(XmlWriter& writer, const Database::Version::Strings::value_type& data){
+        writer.writeElement(String::Key, data.first.name());
         writer.writeElement(String::Value, data.second);
     }
 
@@ -1289,12 +2333,14 @@ public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Key){
+        switch (reader.tagId()){
+        case Tag::Key:
             data.first = parse<std::string>(reader);
-        } else if (localName == String::Value){
+            break;
+        case Tag::Value:
             data.second = parse<std::string>(reader);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1323,8 +2369,7 @@ public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::StringDictExItem){
+        if (reader.tagId() == Tag::StringDictExItem){
             data.insert(parse<CustomDataItemTag>(reader));
         } else {
             return false;
@@ -1358,59 +2403,93 @@ public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
         // ToDo: headerHash field!!!
-        if (localName == String::DbName){
+        switch (reader.tagId()){
+        case Tag::DbName:
             data.settings->fname = parse<std::string>(reader);
-        }else if (localName == String::DbNameChanged){
+            break;
+        case Tag::DbNameChanged:
             data.settings->fnameChanged = parse<Time>(reader);
-        }else if (localName == String::DbDesc){
+            break;
+        case Tag::DbDesc:
             data.settings->fdescription = parse<std::string>(reader);
-        }else if (localName == String::DbDescChanged){
+            break;
+        case Tag::DbDescChanged:
             data.settings->fdescriptionChanged = parse<Time>(reader);
-        }else if (localName == String::DbDefaultUser){
+            break;
+        case Tag::DbDefaultUser:
             data.settings->fdefaultUsername = parse<std::string>(reader);
-        }else if (localName == String::DbDefaultUserChanged){
+            break;
+        case Tag::DbDefaultUserChanged:
             data.settings->fdefaultUsernameChanged = parse<Time>(reader);
-        }else if (localName == String::DbMntncHistoryDays){
+            break;
+        case Tag::DbMntncHistoryDays:
             data.settings->maintenanceHistoryDays = parse<int>(reader);
-        }else if (localName == String::DbColor){
+            break;
+        case Tag::DbColor:
             data.settings->color = parse<std::string>(reader);
-        }else if (localName == String::DbKeyChanged){
+            break;
+        case Tag::DbKeyChanged:
             data.compositeKeyChanged = parse<Time>(reader);
-        }else if (localName == String::DbKeyChangeRec){
+            break;
+        case Tag::DbKeyChangeRec:
             data.settings->masterKeyChangeRec = parse<int64_t>(reader);
-        }else if (localName == String::DbKeyChangeForce){
+            break;
+        case Tag::DbKeyChangeForce:
             data.settings->masterKeyChangeForce = parse<int64_t>(reader);
-        }else if (localName == String::MemoryProt){
+            break;
+        case Tag::MemoryProt:
             data.settings->memoryProtection = parse<MemoryProtectionFlags>(reader);
-        }else if (localName == String::CustomIcons){
-            data.customIcons = parse<std::vector<std::pair<CustomIcon::Ptr, size_t>>>(reader);
-        }else if (localName == String::RecycleBinEnabled){
+            break;
+        case Tag::CustomIcons:
+            if (reader.skipping(Database::File::Visitor::SkipCustomIcons)){
+                data.customIconCount = parse<CustomIconCount>(reader);
+            }else{
+                data.customIcons = parse<CustomIcons>(reader);
+                data.customIconCount = data.customIcons.size();
+            }
+            break;
+        case Tag::RecycleBinEnabled:
             data.settings->recycleBinEnabled = parse<bool>(reader);
-        }else if (localName == String::RecycleBinUuid){
+            break;
+        case Tag::RecycleBinUuid:
             data.recycleBinUUID = parse<Uuid>(reader);
-        }else if (localName == String::RecycleBinChanged){
+            break;
+        case Tag::RecycleBinChanged:
             data.recycleBinChanged = parse<Time>(reader);
-        }else if (localName == String::EntryTemplatesGroup){
+            break;
+        case Tag::EntryTemplatesGroup:
             data.templatesUUID = parse<Uuid>(reader);
-        }else if (localName == String::EntryTemplatesGroupChanged){
+            break;
+        case Tag::EntryTemplatesGroupChanged:
             data.templatesChanged = parse<Time>(reader);
-        }else if (localName == String::HistoryMaxItems){
+            break;
+        case Tag::HistoryMaxItems:
             data.settings->historyMaxItems = parse<int>(reader);
-        }else if (localName == String::HistoryMaxSize){
+            break;
+        case Tag::HistoryMaxSize:
             data.settings->historyMaxSize = parse<int64_t>(reader);
-        }else if (localName == String::LastSelectedGroup){
+            break;
+        case Tag::LastSelectedGroup:
             data.settings->lastSelectedGroup = parse<Uuid>(reader);
-        }else if (localName == String::LastTopVisibleGroup){
+            break;
+        case Tag::LastTopVisibleGroup:
             data.settings->lastTopVisibleGroup = parse<Uuid>(reader);
-        }else if (localName == String::Binaries){
+            break;
+        case Tag::Binaries:{
+            if (reader.skipping(Database::File::Visitor::SkipBinaries))
+                return false;
             auto tmp = parse<Database::Meta::Binaries>(reader);
+            for (auto& item: tmp)
+                item.second = data.binaryPool.insert(std::move(item.second));
             using std::swap;
             swap(tmp, data.binaries);
-        }else if (localName == String::CustomData){
+            break;
+        }
+        case Tag::CustomData:
             data.customData = parse<CustomDataTag>(reader);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1469,12 +2548,14 @@ private:
 public:
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Window){
+        switch (reader.tagId()){
+        case Tag::Window:
             data.window = parse<std::string>(reader);
-        } else if (localName == String::KeystrokeSequence){
+            break;
+        case Tag::KeystrokeSequence:
             data.sequence = parse<std::string>(reader);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1499,16 +2580,20 @@ private:
 public:
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::AutoTypeEnabled){
+        switch (reader.tagId()){
+        case Tag::AutoTypeEnabled:
             data.enabled = parse<bool>(reader);
-        } else if (localName == String::AutoTypeObfuscation){
+            break;
+        case Tag::AutoTypeObfuscation:
             data.obfuscationOptions = Database::Version::AutoType::ObfuscationOptions(parse<int>(reader));
-        } else if (localName == String::AutoTypeDefaultSeq){
+            break;
+        case Tag::AutoTypeDefaultSeq:
             data.defaultSequence = parse<std::string>(reader);
-        } else if (localName == String::AutoTypeItem){
+            break;
+        case Tag::AutoTypeItem:
             data.items.push_back(parse<Database::Version::AutoType::Association>(reader));
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1537,22 +2622,29 @@ private:
 public:
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::CreationTime){
+        switch (reader.tagId()){
+        case Tag::CreationTime:
             data.creation = parse<Time>(reader);
-        } else if (localName == String::LastModTime){
+            break;
+        case Tag::LastModTime:
             data.lastModification = parse<Time>(reader);
-        } else if (localName == String::LastAccessTime){
+            break;
+        case Tag::LastAccessTime:
             data.lastAccess = parse<Time>(reader);
-        } else if (localName == String::ExpiryTime){
+            break;
+        case Tag::ExpiryTime:
             data.expiry = parse<Time>(reader);
-        } else if (localName == String::Expires){
+            break;
+        case Tag::Expires:
             data.expires = parse<bool>(reader);
-        } else if (localName == String::UsageCount){
+            break;
+        case Tag::UsageCount:
             data.usageCount = parse<uint64_t>(reader);
-        } else if (localName == String::LocationChanged){
+            break;
+        case Tag::LocationChanged:
             data.locationChanged = parse<Time>(reader);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1580,9 +2672,9 @@ template <>
 class Parser<Database::Version::Binary::Value>{
 public:
 
-    typedef const SafeVector<uint8_t>& WrittenType;
+    typedef const Database::Binary& WrittenType;
 
-    static std::shared_ptr<SafeVector<uint8_t>> parseNew(XmlReader& reader, const Database::Meta& meta){
+    static Database::Binary::Ptr parseNew(XmlReader& reader, const Database::Meta& meta){
         XML::String id = reader.attribute(String::AttrRef);
         auto idpos = meta.binaries.find(id?id.c_str():"");
         if (idpos != meta.binaries.end()){
@@ -1590,10 +2682,12 @@ public:
             return idpos->second;
         }
 
-        return parse<Database::Meta::Binary>(reader);
+        Database::Binary::Ptr binary = parse<Database::Meta::Binary>(reader);
+        std::lock_guard<std::mutex> lock(*meta.mutex);
+        return meta.binaryPool.insert(std::move(binary));
     }
 
-    static void writeOld(XmlWriter& writer, const SafeVector<uint8_t>& data){
+    static void writeOld(XmlWriter& writer, const Database::Binary& data){
          writer.write<Database::Meta::Binary>(data);
     }
 
@@ -1601,13 +2695,13 @@ public:
 };
 
 template <>
-class Parser<Database::Version::Binary>: public TagParser<Parser<Database::Version::Binary>, std::pair<std::string, std::shared_ptr<SafeVector<uint8_t>>>>{
+class Parser<Database::Version::Binary>: public TagParser<Parser<Database::Version::Binary>, std::pair<std::string, Database::Binary::Ptr>>{
 private:
     const Database::Meta& meta;
-    std::pair<std::string, std::shared_ptr<SafeVector<uint8_t>>> data;
+    std::pair<std::string, Database::Binary::Ptr> data;
 
 public:
-    typedef const std::pair<std::string, std::shared_ptr<SafeVector<uint8_t>>>& WrittenType;
+    typedef const std::pair<std::string, Database::Binary::Ptr>& WrittenType;
 
     inline Parser(const Database::Meta& meta)
         :meta(meta)
@@ -1615,28 +2709,28 @@ public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Key){
+        switch (reader.tagId()){
+        case Tag::Key:
             data.first = parse<std::string>(reader);
-        } else if (localName == String::Value){
+            break;
+        case Tag::Value:
             data.second = parse<Database::Version::Binary::Value>(reader, meta);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
 
     }
 
-    inline std::pair<std::string, std::shared_ptr<SafeVector<uint8_t>>> takeResult(){
+    inline std::pair<std::string, Database::Binary::Ptr> takeResult(){
         return std::move(data);
     }
 
-    static void writeOld(XmlWriter& writer, const std::pair<std::string, std::shared_ptr<SafeVector<uint8_t>>>& data){
+    static void writeOld(XmlWriter& writer, const std::pair<std::string, Database::Binary::Ptr>& data){
         writer.writeElement(String::Key, data.first);
-        std::stringstream s;
-        s << data.second.get();
         writer.writeStartElement(String::Value);
-        writer.writeAttribute(String::AttrRef, s.str().c_str());
+        writer.writeAttribute(String::AttrRef, std::to_string(writer.binaryId(*data.second)).c_str());
         writer.writeEndElement();
     }
 
@@ -1661,37 +2755,51 @@ public:
     {}
 
     inline bool tag(XmlReader& reader){
-        return tag(reader, reader.localName());
+        return tag(reader, reader.tagId());
     }
 
-    bool tag(XmlReader& reader, std::string localName){
+    bool tag(XmlReader& reader, Tag id){
 
-        //                if (localName == String::Uuid){
-        //                        parse<XML::String>(reader); // Just ignore uuid here...
-        //                } else
-        if (localName == String::Icon){
+        switch (id){
+        //        case Tag::Uuid:
+        //            parse<XML::String>(reader); // Just ignore uuid here...
+        //            break;
+        case Tag::Icon:
             standardIcon = StandardIcon(parse<int>(reader));
-        } else if (localName == String::CustomIconID){
+            break;
+        case Tag::CustomIconID:
             customIcon = parse<Uuid>(reader);
-        } else if (localName == String::FgColor){
+            break;
+        case Tag::FgColor:
             version->fgColor = parse<std::string>(reader);
-        } else if (localName == String::BgColor){
+            break;
+        case Tag::BgColor:
             version->bgColor = parse<std::string>(reader);
-        } else if (localName == String::OverrideUrl){
+            break;
+        case Tag::OverrideUrl:
             version->overrideUrl = parse<std::string>(reader);
-        } else if (localName == String::Tags){
+            break;
+        case Tag::Tags:
             version->tags = parse<Tags>(reader);
-        } else if (localName == String::Times){
+            break;
+        case Tag::Times:
             version->times = parse<Times>(reader);
-        } else if (localName == String::String){
+            break;
+        case Tag::String:
             version->strings.insert(parse<StringTag>(reader));
-        } else if (localName == String::Binary){
+            break;
+        case Tag::Binary:{
+            if (reader.skipping(Database::File::Visitor::SkipBinaries))
+                return false;
             auto binaryItem = parse<Database::Version::Binary>(reader, meta);
             if (binaryItem.second)
                 version->binaries.insert(std::move(binaryItem));
-        } else if (localName == String::AutoType){
+            break;
+        }
+        case Tag::AutoType:
             version->autoType = parse<Database::Version::AutoType>(reader);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1700,13 +2808,7 @@ public:
 
     inline Database::Version::Ptr takeResult(){
 
-        CustomIcon::Ptr icon;
-        for (auto& ic: meta.customIcons){
-            if (ic.first->uuid() == customIcon){
-                icon = ic.first;
-                break;
-            }
-        }
+        CustomIcon::Ptr icon = referenceIcon(meta, customIcon);
 
         if (icon){
             version->icon = Icon(std::move(icon));
@@ -1733,10 +2835,10 @@ public:
         writer.writeElement<Tags>(String::Tags, data->tags);
         writer.writeElement(String::Times, data->times);
 
-        for (const std::pair<std::string, XorredBuffer>& item: data->strings){
+        for (const Database::Version::Strings::value_type& item: data->strings){
             writer.writeElement<StringTag>(String::String, item);
         }
-        for(const std::pair<std::string, std::shared_ptr<SafeVector<uint8_t>>>& item: data->binaries){
+        for(const std::pair<std::string, Database::Binary::Ptr>& item: data->binaries){
             writer.writeElement<Database::Version::Binary>(String::Binary, item);
         }
 
@@ -1752,6 +2854,7 @@ public:
     using VectorTagParser::VectorTagParser;
 
     static constexpr const char* itemTagName = String::Entry;
+    static constexpr Tag itemTag = Tag::Entry;
 
 };
 
@@ -1772,14 +2875,20 @@ public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Uuid){
+        Tag id = reader.tagId();
+        switch (id){
+        case Tag::Uuid:
             entry->fuuid = parse<Uuid>(reader);
-        }else if (localName == String::History){
+            break;
+        case Tag::History:{
+            if (reader.skipping(Database::File::Visitor::SkipHistory))
+                return false;
             std::vector<Database::Version::Ptr> tmp = parse<std::vector<Database::Version::Ptr>>(reader, meta, entry.get());
             entry->fversions.insert(entry->fversions.end(), std::make_move_iterator(tmp.begin()), std::make_move_iterator(tmp.end()));
-        } else{
-            return currentVersionParser.tag(reader, localName);
+            break;
+        }
+        default:
+            return currentVersionParser.tag(reader, id);
         }
         return true;
 
@@ -1787,6 +2896,9 @@ public:
 
     inline Database::Entry::Ptr takeResult(){
         entry->fversions.push_back(currentVersionParser.takeResult());
+        for (size_t i = 1; i < entry->fversions.size(); ++i)
+            entry->fversions[i]->share(*entry->fversions[i-1]);
+        Database::updateIndexes(entry->fversions);
         return std::move(entry);
     }
 
@@ -1812,56 +2924,122 @@ private:
     Uuid customIcon;
     StandardIcon standardIcon;
     bool haveUuid;
+    Database::File::Visitor* visitor;
+    bool entered;
+    bool visitChildren;
+
+    void completeProperties(){
+        if (!haveUuid){
+            data->fuuid = Uuid::generate();
+            haveUuid = true;
+        }
+
+        CustomIcon::Ptr icon = referenceIcon(meta, customIcon);
+
+        if (icon){
+            data->fproperties->icon = Icon(std::move(icon));
+        }else{
+            data->fproperties->icon = Icon(standardIcon);
+        }
+    }
+
+    // Called in visitor mode before first child is parsed. Group properties
+    // precede children in KDBX files, so they are complete at this point.
+    bool enter(){
+        if (!entered){
+            entered = true;
+            completeProperties();
+            visitChildren = visitor->enterGroup(*data);
+        }
+        return visitChildren;
+    }
+
 public:
 
     typedef const Database::Group* WrittenType;
 
-    inline Parser(const Database::Meta& meta, Database* database)
+    inline Parser(const Database::Meta& meta, Database* database, Database::File::Visitor* visitor = nullptr)
         :meta(meta),
           data(new Database::Group(database)),
           customIcon(Uuid::nil()),
           standardIcon(StandardIcon::Folder),
-          haveUuid(false)
+          haveUuid(false),
+          visitor(visitor),
+          entered(false),
+          visitChildren(false)
     {}
 
-    inline Parser(const Database::Meta& meta, Database::Group* parent)
+    inline Parser(const Database::Meta& meta, Database::Group* parent, Database::File::Visitor* visitor = nullptr)
         :meta(meta),
           data(new Database::Group(parent)),
           customIcon(Uuid::nil()),
-          standardIcon(StandardIcon::Folder)
+          standardIcon(StandardIcon::Folder),
+          haveUuid(false),
+          visitor(visitor),
+          entered(false),
+          visitChildren(false)
     {}
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Uuid){
+        switch (reader.tagId()){
+        case Tag::Uuid:
             data->fuuid = parse<Uuid>(reader);
             haveUuid = true;
-        } else if (localName == String::Name){
+            break;
+        case Tag::Name:
             data->fproperties->name = parse<std::string>(reader);
-        } else if (localName == String::Notes){
+            break;
+        case Tag::Notes:
             data->fproperties->notes = parse<std::string>(reader);
-        } else if (localName == String::Icon){
+            break;
+        case Tag::Icon:
             standardIcon = StandardIcon(parse<int>(reader));
-        } else if (localName == String::CustomIconID){
+            break;
+        case Tag::CustomIconID:
             customIcon = parse<Uuid>(reader);
-        } else if (localName == String::Times){
+            break;
+        case Tag::Times:
             data->fproperties->times = parse<Times>(reader);
-        } else if (localName == String::IsExpanded){
+            break;
+        case Tag::IsExpanded:
             data->fproperties->isExpanded = parse<bool>(reader);
-        } else if (localName == String::GroupDefaultAutoTypeSeq){
+            break;
+        case Tag::GroupDefaultAutoTypeSeq:
             data->fproperties->defaultAutoTypeSequence = parse<std::string>(reader);
-        } else if (localName == String::EnableAutoType){
+            break;
+        case Tag::EnableAutoType:
             data->fproperties->enableAutoType = parse<bool>(reader);
-        } else if (localName == String::EnableSearching){
+            break;
+        case Tag::EnableSearching:
             data->fproperties->enableSearching = parse<bool>(reader);
-        } else if (localName == String::LastTopVisibleEntry){
+            break;
+        case Tag::LastTopVisibleEntry:
             data->fproperties->lastTopVisibleEntry = parse<Uuid>(reader);
-        } else if (localName == String::Group){
-            data->fgroups.push_back(parse<Database::Group>(reader, meta, data.get()));
-        } else if (localName == String::Entry){
-            data->fentries.push_back(parse<Database::Entry>(reader, meta, data.get()));
-        } else {
+            break;
+        case Tag::Group:
+            if (reader.subtrees()){
+                // Subgroups of the root group are parsed by other threads.
+                data->fgroups.push_back(reader.subtrees()->take(reader));
+                data->fgroups.back()->fparent = data.get();
+            }else if (!visitor){
+                data->fgroups.push_back(parse<Database::Group>(reader, meta, data.get()));
+            }else if (enter()){
+                parse<Database::Group>(reader, meta, data.get(), visitor);
+            }else{
+                return false;
+            }
+            break;
+        case Tag::Entry:
+            if (!visitor){
+                data->fentries.push_back(parse<Database::Entry>(reader, meta, data.get()));
+            }else if (enter()){
+                visitor->entry(*parse<Database::Entry>(reader, meta, data.get()));
+            }else{
+                return false;
+            }
+            break;
+        default:
             return false;
         }
         return true;
@@ -1869,23 +3047,14 @@ public:
     }
 
     inline Database::Group::Ptr takeResult(){
-        if (!haveUuid)
-            data->fuuid = Uuid::generate();
-
-        CustomIcon::Ptr icon;
-        for (auto& ic: meta.customIcons){
-            if (ic.first->uuid() == customIcon){
-                icon = ic.first;
-                break;
-            }
-        }
-
-        if (icon){
-            data->fproperties->icon = Icon(std::move(icon));
+        if (visitor){
+            enter();
+            visitor->leaveGroup(*data);
         }else{
-            data->fproperties->icon = Icon(standardIcon);
+            completeProperties();
+            Database::updateIndexes(data->fgroups);
+            Database::updateIndexes(data->fentries);
         }
-
         return std::move(data);
     }
 
@@ -1909,7 +3078,10 @@ public:
         writer.writeElement(String::EnableSearching, data->fproperties->enableSearching);
         writer.writeElement(String::LastTopVisibleEntry, data->fproperties->lastTopVisibleEntry);
         for (const Database::Group::Ptr& item: data->fgroups){
-            writer.writeElement<Database::Group>(String::Group, item.get());
+            if (writer.subtrees() && writer.subtrees()->parent() == data)
+                writer.subtrees()->put(writer, item.get());
+            else
+                writer.writeElement<Database::Group>(String::Group, item.get());
         }
         for (const Database::Entry::Ptr& item: data->fentries){
             writer.writeElement<Database::Entry>(String::Entry, item.get());
@@ -1932,12 +3104,14 @@ public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Uuid){
+        switch (reader.tagId()){
+        case Tag::Uuid:
             uuid = parse<Uuid>(reader);
-        }else if (localName == String::DeletionTime){
+            break;
+        case Tag::DeletionTime:
             deletionTime = parse<Time>(reader);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -1960,10 +3134,10 @@ template <>
 class Parser<std::map<Uuid, time_t>>: public TagParser<Parser<std::map<Uuid, time_t>>, std::map<Uuid, time_t>>{
 public:
     static constexpr const char* itemTagName = String::DeletedObject;
+    static constexpr Tag itemTag = Tag::DeletedObject;
 
     bool tag(XmlReader& reader){
-        std::string localName = reader.localName();
-        if (localName == Parser::itemTagName){
+        if (reader.tagId() == Parser::itemTag){
             data.emplace(parse<std::pair<Uuid, time_t>>(reader));
         }else{
             return false;
@@ -2005,12 +3179,14 @@ public:
 
     bool tag(XmlReader& reader){
 
-        std::string localName = reader.localName();
-        if (localName == String::Group){
-            rootGroup = parse<Database::Group>(reader, meta, fdatabase);
-        } else if (localName == String::DeletedObjects){
+        switch (reader.tagId()){
+        case Tag::Group:
+            rootGroup = parse<Database::Group>(reader, meta, fdatabase, reader.visitor());
+            break;
+        case Tag::DeletedObjects:
             deletedObjects = parse<std::map<Uuid, time_t>>(reader);
-        } else {
+            break;
+        default:
             return false;
         }
         return true;
@@ -2023,7 +3199,18 @@ public:
     }
 
     static void writeOld(XmlWriter& writer, WrittenType data){
-        writer.writeElement<Database::Group>(String::Group, data.first);
+        if (WrittenSubtrees* subtrees = writer.subtrees()){
+            try{
+                subtrees->start(writer);
+                writer.writeElement<Database::Group>(String::Group, data.first);
+                subtrees->finish();
+            }catch(...){
+                subtrees->stop();
+                throw;
+            }
+        }else{
+            writer.writeElement<Database::Group>(String::Group, data.first);
+        }
         writer.writeElement(String::DeletedObjects, data.second);
     }
 };
@@ -2046,14 +3233,32 @@ public:
     bool tag(XmlReader& reader){
 
         //ToDo: check if meta is populated before root maybe?
-        std::string localName = reader.localName();
-        if (localName == String::Meta){
+        switch (reader.tagId()){
+        case Tag::Meta:
             meta = parse<Database::Meta>(reader, settings);
-        } else if (localName == String::Root){
-            auto result = parse<RootTag>(reader, meta, database.get());
+            break;
+        case Tag::Root:{
+            std::pair<Database::Group::Ptr, std::map<Uuid, time_t>> result;
+            if (Subtrees* subtrees = reader.subtrees()){
+                try{
+                    subtrees->start(meta, database.get());
+                    result = parse<RootTag>(reader, meta, database.get());
+                    subtrees->finish();
+                }catch(...){
+                    subtrees->stop();
+                    throw;
+                }
+            }else{
+                result = parse<RootTag>(reader, meta, database.get());
+            }
             database->froot = std::move(result.first);
             database->fdeletedObjects = std::move(result.second);
-        } else {
+            database->fgroupIndex.clear();
+            database->fentryIndex.clear();
+            database->indexTree(database->froot.get());
+            break;
+        }
+        default:
             return false;
         }
         return true;
@@ -2069,6 +3274,7 @@ public:
         database->fsettings = std::move(meta.settings);
         database->customData = std::move(meta.customData);
         database->fcustomIcons = std::move(meta.customIcons);
+        database->fbinaries = std::move(meta.binaryPool);
         return std::move(database);
     }
 
@@ -2081,6 +3287,436 @@ public:
 
 };
 
+//------------------------------------------------------------------------------
+
+static bool isXmlSpace(char c) noexcept{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static const char* xmlNameEnd(const char* pos, const char* end) noexcept{
+    while (pos < end && !isXmlSpace(*pos) && *pos != '/' && *pos != '>' && *pos != '=')
+        ++pos;
+    return pos;
+}
+
+static bool startsWith(const char* pos, const char* end, const char* prefix) noexcept{
+    std::size_t size = strlen(prefix);
+    return std::size_t(end - pos) >= size && memcmp(pos, prefix, size) == 0;
+}
+
+static const char* findText(const char* pos, const char* end, const char* text) noexcept{
+    const char* result = std::search(pos, end, text, text + strlen(text));
+    return result == end ? nullptr : result;
+}
+
+static bool isName(const std::pair<const char*, const char*>& name, const char* expected) noexcept{
+    std::size_t size = strlen(expected);
+    return std::size_t(name.second - name.first) == size && memcmp(name.first, expected, size) == 0;
+}
+
+Subtrees::Subtrees(const char* begin, const char* end, RandomStream::Algorithm algorithm,
+                   const SafeVector<uint8_t>& protectedStreamKey, unsigned threads)
+    :falgorithm(algorithm),
+      fprotectedStreamKey(protectedStreamKey),
+      fthreads(threads),
+      fnextParsed(0),
+      fstopped(false),
+      fnextTaken(0)
+{
+    if (!scan(begin, end)){
+        fsubtrees.clear();
+        fdocument.clear();
+    }
+    for (Subtree& subtree: fsubtrees)
+        fresults.push_back(subtree.promise.get_future());
+}
+
+Subtrees::~Subtrees() noexcept{
+    stop();
+}
+
+// This is not a complete XML parser. It only tracks elements, and skips
+// comments, processing instructions and CDATA sections, where '<' and '>'
+// are not markup. Documents that it cannot split safely are rejected. Values
+// of protected elements take as many random stream bytes as there are bytes
+// in their base64 decoded text, just like in Parser<XML::String>.
+bool Subtrees::scan(const char* begin, const char* end){
+    static const char emptyGroup[] = "<Group/>";
+    typedef std::pair<const char*, const char*> Name;
+    std::vector<Name> open;
+    uint64_t offset = 0;
+    const char* copied = begin;
+    bool haveRoot = false;
+    bool inSubtree = false;
+
+    auto endSubtree = [&](const char* pos){
+        inSubtree = false;
+        fsubtrees.back().end = pos;
+        fsubtrees.back().streamEnd = offset;
+        copied = pos;
+    };
+
+    const char* pos = begin;
+    while ((pos = static_cast<const char*>(memchr(pos, '<', end - pos)))){
+        char next = pos + 1 < end ? pos[1] : '\0';
+        if (next == '!'){
+            if (startsWith(pos, end, "<!--")){
+                if (!(pos = findText(pos + 4, end, "-->")))
+                    return false;
+                pos += 3;
+            }else if (startsWith(pos, end, "<![CDATA[")){
+                if (!(pos = findText(pos + 9, end, "]]>")))
+                    return false;
+                pos += 3;
+            }else{
+                // Document type declarations can define entities.
+                return false;
+            }
+            continue;
+        }
+
+        if (next == '?'){
+            const char* declEnd = findText(pos + 2, end, "?>");
+            if (!declEnd)
+                return false;
+            // XmlReader always reads utf-8; other encodings are rejected.
+            const char* encoding = findText(pos, declEnd, "encoding");
+            if (startsWith(pos, end, "<?xml ") && encoding
+                    && !findText(encoding, declEnd, "utf-8") && !findText(encoding, declEnd, "UTF-8"))
+                return false;
+            pos = declEnd + 2;
+            continue;
+        }
+
+        if (next == '/'){
+            Name name(pos + 2, xmlNameEnd(pos + 2, end));
+            if (open.empty() || open.back().second - open.back().first != name.second - name.first
+                    || memcmp(open.back().first, name.first, name.second - name.first) != 0)
+                return false;
+            open.pop_back();
+            pos = name.second;
+            while (pos < end && isXmlSpace(*pos))
+                ++pos;
+            if (pos == end || *pos != '>')
+                return false;
+            ++pos;
+            if (inSubtree && open.size() == 3)
+                endSubtree(pos);
+            continue;
+        }
+
+        const char* start = pos;
+        Name name(pos + 1, xmlNameEnd(pos + 1, end));
+        if (name.first == name.second || std::find(name.first, name.second, ':') != name.second)
+            return false;
+
+        bool isProtected = false;
+        pos = name.second;
+        while (true){
+            while (pos < end && isXmlSpace(*pos))
+                ++pos;
+            if (pos == end)
+                return false;
+            if (*pos == '>' || *pos == '/')
+                break;
+            Name attribute(pos, xmlNameEnd(pos, end));
+            pos = attribute.second;
+            while (pos < end && isXmlSpace(*pos))
+                ++pos;
+            if (attribute.first == attribute.second || pos == end || *pos != '=')
+                return false;
+            ++pos;
+            while (pos < end && isXmlSpace(*pos))
+                ++pos;
+            if (pos == end || (*pos != '"' && *pos != '\''))
+                return false;
+            const char* value = pos + 1;
+            const char* valueEnd = static_cast<const char*>(memchr(value, *pos, end - value));
+            if (!valueEnd)
+                return false;
+            if (isName(attribute, String::AttrProtected)){
+                if (memchr(value, '&', valueEnd - value))
+                    return false;
+                isProtected = isName(Name(value, valueEnd), String::True);
+            }
+            pos = valueEnd + 1;
+        }
+        bool empty = *pos == '/';
+        if (empty && (++pos == end || *pos != '>'))
+            return false;
+        ++pos;
+
+        if (open.size() == 1 && isName(name, String::Root)){
+            if (haveRoot)
+                return false;
+            haveRoot = true;
+        }
+        // Subtrees need complete metadata.
+        if (open.size() == 1 && isName(name, String::Meta) && haveRoot)
+            return false;
+
+        if (open.size() == 3 && isName(name, String::Group) && isName(open[1], String::Root) && isName(open[2], String::Group)){
+            fdocument.emplace_back(copied, start);
+            fdocument.emplace_back(emptyGroup, emptyGroup + sizeof(emptyGroup) - 1);
+            fsubtrees.emplace_back();
+            fsubtrees.back().begin = start;
+            fsubtrees.back().streamBegin = offset;
+            inSubtree = true;
+            if (empty)
+                endSubtree(pos);
+        }
+
+        if (isProtected && !empty){
+            const char* textEnd = static_cast<const char*>(memchr(pos, '<', end - pos));
+            // Entities and line breaks would change the size of decoded text.
+            if (!textEnd || !startsWith(textEnd, end, "</") || memchr(pos, '&', textEnd - pos) || memchr(pos, '\r', textEnd - pos))
+                return false;
+            std::size_t size = textEnd - pos;
+            if (size && pos[size-1] == '=') --size;
+            if (size && pos[size-1] == '=') --size;
+            if (size % 4 == 1)
+                return false;
+            offset += size / 4 * 3 + (size % 4 ? size % 4 - 1 : 0);
+            pos = textEnd;
+        }
+
+        if (!empty)
+            open.push_back(name);
+    }
+
+    if (!open.empty())
+        return false;
+    fdocument.emplace_back(copied, end);
+    return true;
+}
+
+void Subtrees::start(const Database::Meta& meta, Database* database){
+    unsigned count = std::min<std::size_t>(fthreads, fsubtrees.size());
+    for (unsigned i = 0; i < count; ++i)
+        fworkers.emplace_back(&Subtrees::work, this, std::cref(meta), database);
+}
+
+void Subtrees::work(const Database::Meta& meta, Database* database) noexcept{
+    Arena arena;
+    Arena::Scope arenaScope(&arena);
+
+    std::size_t index;
+    while (!fstopped && (index = fnextParsed++) < fsubtrees.size()){
+        Subtree& subtree = fsubtrees[index];
+        try{
+            MemoryInput input({MemoryInput::Segment(subtree.begin, subtree.end)});
+            RandomStream::Ptr stream = RandomStream::randomStream(falgorithm, fprotectedStreamKey);
+            stream->seek(subtree.streamBegin);
+            XmlReader reader(&input, XML_CHAR_ENCODING_UTF8, std::move(stream));
+            reader.expectNext();
+            Database::Group::Ptr group = parse<Database::Group>(reader, meta, database);
+            if (reader.randomStream()->position() != subtree.streamEnd)
+                throw Mismatch();
+            subtree.promise.set_value(std::move(group));
+        }catch(...){
+            subtree.promise.set_exception(std::current_exception());
+        }
+    }
+}
+
+Database::Group::Ptr Subtrees::take(XmlReader& reader){
+    if (fnextTaken >= fsubtrees.size() || !reader.isEmpty())
+        throw Mismatch();
+    Subtree& subtree = fsubtrees[fnextTaken];
+    if (reader.randomStream()->position() != subtree.streamBegin)
+        throw Mismatch();
+
+    Database::Group::Ptr result;
+    try{
+        result = fresults[fnextTaken++].get();
+    }catch(...){
+        // Errors are reported by a serial parser, so that they are the same
+        // as if the document was not split.
+        throw Mismatch();
+    }
+    reader.randomStream()->seek(subtree.streamEnd);
+    return result;
+}
+
+void Subtrees::finish(){
+    if (fnextTaken != fsubtrees.size())
+        throw Mismatch();
+    stop();
+}
+
+void Subtrees::stop() noexcept{
+    fstopped = true;
+    for (std::thread& worker: fworkers)
+        worker.join();
+    fworkers.clear();
+}
+
+//------------------------------------------------------------------------------
+
+WrittenSubtrees::WrittenSubtrees(const Database::Group* root, RandomStream::Algorithm algorithm,
+                                 const SafeVector<uint8_t>& protectedStreamKey, unsigned threads)
+    :fparent(root),
+      fdocument(nullptr),
+      fbase(0),
+      fsubtrees(root->groups()),
+      falgorithm(algorithm),
+      fprotectedStreamKey(protectedStreamKey),
+      fthreads(threads),
+      fnextWritten(0),
+      fstopped(false),
+      fnextPut(0)
+{
+    uint64_t offset = 0;
+    for (std::size_t i = 0; i < fsubtrees.size(); ++i){
+        Subtree& subtree = fsubtrees[i];
+        subtree.group = root->group(i);
+        subtree.streamBegin = offset;
+        offset += protectedSize(subtree.group);
+        subtree.streamEnd = offset;
+        fresults.push_back(subtree.promise.get_future());
+    }
+}
+
+WrittenSubtrees::~WrittenSubtrees() noexcept{
+    stop();
+}
+
+// Adds up sizes of values that Parser<XorredBuffer> writes as protected, and
+// that take as many bytes of the random stream.
+uint64_t WrittenSubtrees::protectedSize(const Database::Group* group) noexcept{
+    uint64_t result = 0;
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        result += protectedSize(group->group(i));
+    for (std::size_t i = 0; i < group->entries(); ++i){
+        const Database::Entry* entry = group->entry(i);
+        for (std::size_t j = 0; j < entry->versions(); ++j){
+            for (const Database::Version::Strings::value_type& item: entry->version(j)->strings){
+                if (item.second.mask().size())
+                    result += item.second.size();
+            }
+        }
+    }
+    return result;
+}
+
+void WrittenSubtrees::start(const XmlWriter& writer){
+    fdocument = &writer;
+    fbase = writer.randomStream()->position();
+    unsigned count = std::min<std::size_t>(fthreads, fsubtrees.size());
+    for (unsigned i = 0; i < count; ++i)
+        fworkers.emplace_back(&WrittenSubtrees::work, this);
+}
+
+void WrittenSubtrees::work() noexcept{
+    std::size_t index;
+    while (!fstopped && (index = fnextWritten++) < fsubtrees.size()){
+        Subtree& subtree = fsubtrees[index];
+        try{
+            Output output;
+            RandomStream::Ptr stream = RandomStream::randomStream(falgorithm, fprotectedStreamKey);
+            stream->seek(fbase + subtree.streamBegin);
+            // Subgroups of the root group are nested in KeePassFile, Root and
+            // the root Group elements.
+            XmlWriter writer(&output, std::move(stream), *fdocument, 3);
+            writer.writeElement<Database::Group>(String::Group, subtree.group);
+            writer.writeEndFragment();
+            if (writer.randomStream()->position() != fbase + subtree.streamEnd)
+                throw std::logic_error("Protected values of a group take unexpected part of the random stream.");
+            subtree.promise.set_value(std::move(output.buffers));
+        }catch(...){
+            subtree.promise.set_exception(std::current_exception());
+        }
+    }
+}
+
+void WrittenSubtrees::put(XmlWriter& writer, const Database::Group* group){
+    if (fnextPut >= fsubtrees.size() || fsubtrees[fnextPut].group != group || writer.depth() != 3)
+        throw std::logic_error("Groups are written in unexpected order.");
+    Subtree& subtree = fsubtrees[fnextPut];
+    if (writer.randomStream()->position() != fbase + subtree.streamBegin)
+        throw std::logic_error("Protected values of a group take unexpected part of the random stream.");
+
+    writer.writeFragment(fresults[fnextPut++].get());
+    writer.randomStream()->seek(fbase + subtree.streamEnd);
+}
+
+void WrittenSubtrees::finish(){
+    if (fnextPut != fsubtrees.size())
+        throw std::logic_error("Not all groups were written.");
+    stop();
+}
+
+void WrittenSubtrees::stop() noexcept{
+    fstopped = true;
+    for (std::thread& worker: fworkers)
+        worker.join();
+    fworkers.clear();
+}
+
+//------------------------------------------------------------------------------
+
+Database::Ptr XmlReaderLink::parseDocument(XmlReader& reader, CompositeKey compositeKey){
+    reader.expectNext();
+    xmlReaderTypes type = reader.nodeType();
+    if (type != XML_READER_TYPE_ELEMENT || reader.tagId() != Tag::DocNode)
+        throw std::runtime_error("Bad stream format.");
+
+    // Objects of a loaded tree are placed together in an arena. Visited
+    // objects are destroyed one by one, so they are allocated separately.
+    Arena arena;
+    Arena::Scope arenaScope(fvisitor ? nullptr : &arena);
+    return parse<Database>(reader, fileSettings, std::move(compositeKey));
+}
+
+// Subtrees are only parsed concurrently if the random stream is seekable.
+// If they cannot be, the document already read into memory is parsed
+// serially.
+Database::Ptr XmlReaderLink::parseInMemory(){
+    struct Zero{
+        std::vector<char>& data;
+        ~Zero(){
+            SafeMemoryManager::zero(data.data(), data.size());
+        }
+    };
+
+    // Decrypted document is grown by hand, so that no copy of it is left
+    // in memory released by the vector.
+    std::vector<char> document;
+    Zero zero{document};
+    do{
+        std::size_t size = document.size();
+        if (size + current->size() > document.capacity()){
+            std::vector<char> grown;
+            grown.reserve(std::max(2 * document.capacity(), size + current->size()));
+            grown.assign(document.begin(), document.end());
+            Zero zeroPrevious{grown};
+            document.swap(grown);
+        }
+        document.insert(document.end(), current->data().begin(), current->data().begin() + current->size());
+    }while ((current = InLink::read()));
+
+    const char* begin = document.data();
+    const char* end = begin + document.size();
+    if (RandomStream::randomStream(fileSettings.crsAlgorithm, fprotectedStreamKey)->seekable()){
+        Subtrees subtrees(begin, end, fileSettings.crsAlgorithm, fprotectedStreamKey, fthreads);
+        if (subtrees.size() > 1){
+            try{
+                MemoryInput input(subtrees.document());
+                XmlReader reader(&input, XML_CHAR_ENCODING_UTF8, RandomStream::randomStream(fileSettings.crsAlgorithm, fprotectedStreamKey),
+                                 nullptr, 0, &subtrees);
+                Database::Ptr database = parseDocument(reader, CompositeKey());
+                database->setCompositeKey(std::move(fcompositeKey), database->compositeKeyChanged());
+                return database;
+            }catch(...){
+            }
+        }
+    }
+
+    MemoryInput input({MemoryInput::Segment(begin, end)});
+    XmlReader reader(&input, XML_CHAR_ENCODING_UTF8, RandomStream::randomStream(fileSettings.crsAlgorithm, fprotectedStreamKey));
+    return parseDocument(reader, std::move(fcompositeKey));
+}
+
 //ToDo: reader shoul probably verify header hash as well...
 void XmlReaderLink::runThread(){
 
@@ -2090,33 +3726,186 @@ void XmlReaderLink::runThread(){
             throw std::runtime_error("Unexpected end of stream.");
         currentPos = 0;
 
-        XmlReader reader(this, XML_CHAR_ENCODING_UTF8, RandomStream::randomStream(fileSettings.crsAlgorithm, fprotectedStreamKey));
-
-        reader.expectNext();
-        xmlReaderTypes type = reader.nodeType();
-        if (type != XML_READER_TYPE_ELEMENT || reader.localName() != String::DocNode)
-            throw std::runtime_error("Bad stream format.");
+        if (fmetadataOnly){
+            Database::File::Metadata metadata;
+            {
+                XmlReader reader(this, XML_CHAR_ENCODING_UTF8, RandomStream::randomStream(fileSettings.crsAlgorithm, fprotectedStreamKey), nullptr, fskip);
+                metadata = parseMetadata(reader);
+            }
+            metadataPromise.set_value(std::move(metadata));
+            throw Cancelled();
+        }
 
-        finishedPromise.set_value(parse<Database>(reader, fileSettings, std::move(fcompositeKey)));
+        Database::Ptr database;
+        if (fthreads){
+            database = parseInMemory();
+        }else{
+            XmlReader reader(this, XML_CHAR_ENCODING_UTF8, RandomStream::randomStream(fileSettings.crsAlgorithm, fprotectedStreamKey), fvisitor, fskip);
+            database = parseDocument(reader, std::move(fcompositeKey));
+        }
+        if (fvisitor){
+            visitedPromise.set_value();
+        }else{
+            finishedPromise.set_value(std::move(database));
+        }
+    }catch(Cancelled&){
+        throw;
     }catch(UnhashStreamLink::BadHeader&){
-        finishedPromise.set_exception(std::make_exception_ptr(std::runtime_error("Incorrect composed key.")));
+        setException(std::make_exception_ptr(std::runtime_error("Incorrect composed key.")));
         throw;
     }catch(...){
-        finishedPromise.set_exception(std::current_exception());
+        setException(std::current_exception());
         throw;
     }
 }
 
+void XmlReaderLink::setException(std::exception_ptr e){
+    if (fmetadataOnly){
+        metadataPromise.set_exception(e);
+    }else if (fvisitor){
+        visitedPromise.set_exception(e);
+    }else{
+        finishedPromise.set_exception(e);
+    }
+}
+
+// Meta element precedes Root, so parsing stops at whichever of them comes
+// first.
+Database::File::Metadata XmlReaderLink::parseMetadata(XmlReader& reader){
+    reader.expectNext();
+    if (reader.nodeType() != XML_READER_TYPE_ELEMENT || reader.tagId() != Tag::DocNode)
+        throw std::runtime_error("Bad stream format.");
+
+    Database::Meta meta(fileSettings);
+    if (!reader.isEmpty()){
+        reader.expectRead();
+        xmlReaderTypes type;
+        while ((type = reader.nodeType()) != XML_READER_TYPE_END_ELEMENT){
+            if (type == XML_READER_TYPE_ELEMENT){
+                if (reader.tagId() == Tag::Meta){
+                    meta = parse<Database::Meta>(reader, fileSettings);
+                    break;
+                }
+                if (reader.tagId() == Tag::Root)
+                    break;
+                TagParser<void, void>::parseNew(reader);
+            }
+            reader.expectNext();
+        }
+    }
+
+    Database::File::Metadata result;
+    result.name = meta.settings->name();
+    result.description = meta.settings->description();
+    result.defaultUsername = meta.settings->defaultUsername();
+    result.recycleBinEnabled = meta.settings->recycleBinEnabled;
+    result.recycleBin = meta.recycleBinUUID;
+    result.customIconCount = meta.customIconCount;
+    for (const CustomIcons::value_type& item: meta.customIcons)
+        result.customIcons.push_back(item.first);
+    return result;
+}
+
+// Subgroups of the root group are only serialized concurrently if the random
+// stream can be moved to their offsets.
 void XmlWriterLink::runThread(){
-        current = Pipeline::Buffer::Ptr(new Pipeline::Buffer(Pipeline::Buffer::maxSize));
-        currentPos = 0;
-        XmlWriter writer(this, RandomStream::randomStream(database->settings().fileSettings.crsAlgorithm, fprotectedStreamKey));
+        RandomStream::Algorithm algorithm = database->settings().fileSettings.crsAlgorithm;
+        RandomStream::Ptr stream = RandomStream::randomStream(algorithm, fprotectedStreamKey);
+        std::unique_ptr<WrittenSubtrees> subtrees;
+        if (fthreads && stream->seekable() && database->root()->groups() > 1)
+            subtrees.reset(new WrittenSubtrees(database->root(), algorithm, fprotectedStreamKey, fthreads));
+        XmlWriter writer(this, std::move(stream), subtrees.get());
         writer.setIndent(findent);
         writer.writeStartDocument();
         writer.writeElement<Database>(String::DocNode, database, fheaderHash);
         writer.writeEndDocument();
 }
 
+/** @brief Pipeline link that replaces value of HeaderHash element in a
+ *         serialized database, and passes the rest of the XML through.
+ *
+ * HeaderHash holds a hash of the file header, so it has to be updated when
+ * a new header is written for an existing payload. The value is replaced in
+ * place, so a new value must be as long as the old one. Streams without
+ * HeaderHash element are passed through unchanged.
+ */
+class HeaderHashLink: public Pipeline::InOutLink{
+private:
+    std::string fvalue;
+
+    void runThread() override;
+
+public:
+    inline HeaderHashLink(const std::array<uint8_t, 32>& headerHash)
+        :fvalue(encodeBase64(headerHash.data(), headerHash.size()))
+    {}
+};
+
+void HeaderHashLink::runThread(){
+    const std::string startTag = std::string("<") + String::HeaderHash + ">";
+    std::size_t matched = 0;
+    std::size_t replaced = 0;
+    bool done = false;
+
+    Pipeline::Buffer::Ptr buffer;
+    while ((buffer = read())){
+        uint8_t* at = buffer->data().data();
+        uint8_t* end = at + buffer->size();
+        while (!done && at != end){
+            if (matched == 0){
+                at = std::find(at, end, uint8_t('<'));
+                if (at == end)
+                    break;
+            }
+            if (matched < startTag.size()){
+                matched = *at == startTag[matched] ? matched + 1 : (*at == '<' ? 1 : 0);
+            }else if (replaced < fvalue.size()){
+                if (*at == '<')
+                    throw std::runtime_error("HeaderHash element has unexpected size.");
+                *at = fvalue[replaced++];
+            }else{
+                if (*at != '<')
+                    throw std::runtime_error("HeaderHash element has unexpected size.");
+                done = true;
+            }
+            ++at;
+        }
+        write(std::move(buffer));
+    }
+    finish();
+}
+
+/** @brief Pipeline link that writes data to an output stream, like
+ *         OStreamLink, but passes errors of the pipeline to its future.
+ */
+class ReportingOStreamLink: public Pipeline::InLink{
+private:
+    std::unique_ptr<std::ostream> ffile;
+    std::promise<std::unique_ptr<std::ostream>> finished;
+
+    void runThread() override{
+        try{
+            Pipeline::Buffer::Ptr inBuffer;
+            while ((inBuffer = read()))
+                ffile->write(reinterpret_cast<const char*>(inBuffer->data().data()), inBuffer->size());
+            ffile->flush();
+        }catch(...){
+            finished.set_exception(std::current_exception());
+            throw;
+        }
+        finished.set_value(std::move(ffile));
+    }
+
+public:
+    inline ReportingOStreamLink(std::unique_ptr<std::ostream> file) noexcept
+        :ffile(std::move(file))
+    {}
+
+    inline std::future<std::unique_ptr<std::ostream>> getFuture(){
+        return finished.get_future();
+    }
+};
+
 }
 
 //--------------------------------------------------------------------------------
@@ -2148,18 +3937,89 @@ static void writeHeader(OSSL::Digest& d, std::ostream* file, Internal::HeaderFie
     d.update(data, size);
 }
 
-std::unique_ptr<std::ostream> Database::saveToFile(std::unique_ptr<std::ostream> file) const{
-    using namespace Internal;
-    file->exceptions ( std::istream::failbit | std::istream::badbit | std::istream::eofbit );
-
-    OSSL::Digest d(EVP_sha256());
+// Returns key of the payload cipher, derived from a transformed composite key.
+static SafeVector<uint8_t> cipherKey(const std::array<uint8_t, 32>& masterSeed, const SafeVector<uint8_t>& transformedKey){
+    OSSL::Digest keyHash(EVP_sha256());
+    keyHash.update(masterSeed);
+    keyHash.update(transformedKey);
+    SafeVector<uint8_t> hash(keyHash.size());
+    keyHash.final(hash);
+    return hash;
+}
 
+static void writeSignature(OSSL::Digest& d, std::ostream* file){
+    using namespace Internal;
     uint8_t h[3*4];
     toLittleEndian(FileSignature1, &h[0]);
     toLittleEndian(FileSignature2, &h[4]);
     toLittleEndian(FileVersion32, &h[8]);
     file->write(reinterpret_cast<char*>(h), 3*4);
     d.update(&h[0], 3*4);
+}
+
+// Writes header fields of the payload cipher with new random seeds, and
+// returns a link that encrypts the payload with \p compositeKey.
+static std::unique_ptr<Pipeline::InOutLink> writeCipherHeader(OSSL::Digest& d, std::ostream* file, const Database::File::Settings& settings,
+                                                              const CompositeKey& compositeKey){
+    using namespace Internal;
+    auto match = std::mismatch(settings.cipherId.begin(), settings.cipherId.end(), Database::File::AES_CBC_256_UUID.begin());
+    if (match != std::make_pair(settings.cipherId.end(), Database::File::AES_CBC_256_UUID.end())){
+        std::ostringstream s;
+        s << "Unsupported cipher UUID: ";
+        outHex(s, settings.cipherId);
+        throw std::runtime_error(s.str());
+    }
+
+
+    // Figure out total size of necesary random data and dump it all at once.
+    std::array<uint8_t,32> masterSeed = OSSL::rand<std::array<uint8_t,32>>();
+    std::array<uint8_t,32> transformSeed = OSSL::rand<std::array<uint8_t,32>>();
+    std::array<uint8_t,16> encryptionIV = OSSL::rand<std::array<uint8_t,16>>();
+
+
+    // ToDo: some arrays here should be safe!!!
+
+    SafeVector<uint8_t> hash = compositeKey.getCompositeKey(transformSeed, settings.transformRounds);
+    if (hash.size() != 32){
+        std::ostringstream s;
+        s << "Composed key has wrong size: " << hash.size() << "\nThis should not have happened.";
+        throw std::runtime_error(s.str());
+    }
+    hash = cipherKey(masterSeed, hash);
+
+    OSSL::EvpCipher cipher(EVP_aes_256_cbc(),
+                           nullptr,
+                           hash.data(),
+                           encryptionIV.data(),
+                           1);
+
+    cipher.set_padding(true);
+
+    writeHeader(d, file, HeaderFieldId::CipherID, settings.cipherId.size(), settings.cipherId.data());
+    writeHeader(d, file, HeaderFieldId::MasterSeed, masterSeed.size(), masterSeed.data());
+    writeHeader(d, file, HeaderFieldId::TransformSeed, transformSeed.size(), transformSeed.data());
+    std::array<uint8_t, sizeof(settings.transformRounds)> transformRounds;
+    toLittleEndian(settings.transformRounds, transformRounds.data());
+    writeHeader(d, file, HeaderFieldId::TransformRounds, transformRounds.size(), transformRounds.data());
+    writeHeader(d, file, HeaderFieldId::EncryptionIV, encryptionIV.size(), encryptionIV.data());
+
+    return std::unique_ptr<Pipeline::InOutLink>(new EvpCipher(std::move(cipher)));
+}
+
+std::unique_ptr<std::ostream> Database::saveToFile(std::unique_ptr<std::ostream> file) const{
+    return serialize(std::move(file), 0);
+}
+
+std::unique_ptr<std::ostream> Database::saveToFileParallel(std::unique_ptr<std::ostream> file, unsigned threads) const{
+    return serialize(std::move(file), threads ? threads : std::max(1u, std::thread::hardware_concurrency()));
+}
+
+std::unique_ptr<std::ostream> Database::serialize(std::unique_ptr<std::ostream> file, unsigned threads) const{
+    using namespace Internal;
+    file->exceptions ( std::istream::failbit | std::istream::badbit | std::istream::eofbit );
+
+    OSSL::Digest d(EVP_sha256());
+    writeSignature(d, file.get());
 
     const File::Settings& settings = fsettings->fileSettings;
 
@@ -2169,7 +4029,7 @@ std::unique_ptr<std::ostream> Database::saveToFile(std::unique_ptr<std::ostream>
         SafeVector<uint8_t> data = OSSL::rand<SafeVector<uint8_t>>(128);
         std::array<uint8_t, 4> innerRandomStreamId;
         toLittleEndian(uint32_t(settings.crsAlgorithm), innerRandomStreamId.data());
-        writer = std::unique_ptr<XmlWriterLink>(new XmlWriterLink(this, data));
+        writer = std::unique_ptr<XmlWriterLink>(new XmlWriterLink(this, data, threads));
         writeHeader(d, file.get(), HeaderFieldId::InnerRandomStreamID, innerRandomStreamId.size(), innerRandomStreamId.data());
         writeHeader(d, file.get(), HeaderFieldId::ProtectedStreamKey, data.size(), data.data());
     }
@@ -2187,52 +4047,8 @@ std::unique_ptr<std::ostream> Database::saveToFile(std::unique_ptr<std::ostream>
         writeHeader(d, file.get(), HeaderFieldId::StreamStartBytes, initBytes.size(), initBytes.data());
     }
 
-    if (settings.encrypt){
-        auto match = std::mismatch(settings.cipherId.begin(), settings.cipherId.end(), File::AES_CBC_256_UUID.begin());
-        if (match != std::make_pair(settings.cipherId.end(), File::AES_CBC_256_UUID.end())){
-            std::ostringstream s;
-            s << "Unsupported cipher UUID: ";
-            outHex(s, settings.cipherId);
-            throw std::runtime_error(s.str());
-        }
-
-
-        // Figure out total size of necesary random data and dump it all at once.
-        std::array<uint8_t,32> masterSeed = OSSL::rand<std::array<uint8_t,32>>();
-        std::array<uint8_t,32> transformSeed = OSSL::rand<std::array<uint8_t,32>>();
-        std::array<uint8_t,16> encryptionIV = OSSL::rand<std::array<uint8_t,16>>();
-
-
-        // ToDo: some arrays here should be safe!!!
-
-        OSSL::Digest keyHash(EVP_sha256());
-        keyHash.update(masterSeed.data(), masterSeed.size());
-        SafeVector<uint8_t> hash = fcompositeKey.getCompositeKey(transformSeed, settings.transformRounds);
-        if (hash.size() != 32){
-            std::ostringstream s;
-            s << "Composed key has wrong size: " << hash.size() << "\nThis should not have happened.";
-            throw std::runtime_error(s.str());
-        }
-        keyHash.update(hash);
-        keyHash.final(hash);
-
-        OSSL::EvpCipher cipher(EVP_aes_256_cbc(),
-                               nullptr,
-                               hash.data(),
-                               encryptionIV.data(),
-                               1);
-
-        cipher.set_padding(true);
-        pipeline.appendLink(std::unique_ptr<Pipeline::InOutLink>(new EvpCipher(std::move(cipher))));
-
-        writeHeader(d, file.get(), HeaderFieldId::CipherID, settings.cipherId.size(), settings.cipherId.data());
-        writeHeader(d, file.get(), HeaderFieldId::MasterSeed, masterSeed.size(), masterSeed.data());
-        writeHeader(d, file.get(), HeaderFieldId::TransformSeed, transformSeed.size(), transformSeed.data());
-        std::array<uint8_t, sizeof(settings.transformRounds)> transformRounds;
-        toLittleEndian(settings.transformRounds, transformRounds.data());
-        writeHeader(d, file.get(), HeaderFieldId::TransformRounds, transformRounds.size(), transformRounds.data());
-        writeHeader(d, file.get(), HeaderFieldId::EncryptionIV, encryptionIV.size(), encryptionIV.data());
-    }
+    if (settings.encrypt)
+        pipeline.appendLink(writeCipherHeader(d, file.get(), settings, fcompositeKey));
 
     const std::array<uint8_t,4> endOfHeader = {0x0D, 0x0A, 0x0D, 0x0A};
     writeHeader(d, file.get(), HeaderFieldId::EndOfHeader, 4, endOfHeader.data());
@@ -2258,6 +4074,13 @@ void Database::saveToFile(const std::string& filename) const{
     saveToFile(std::move(file));
 }
 
+void Database::saveToFileParallel(const std::string& filename, unsigned threads) const{
+    std::unique_ptr<std::ofstream> file(new std::ofstream());
+    file->exceptions ( std::ios::failbit | std::ios::badbit | std::ios::eofbit );
+    file->open(filename, std::ios::out | std::ios::trunc );
+    saveToFileParallel(std::move(file), threads);
+}
+
 
 /*std::future<std::unique_ptr<std::ostream>> Database::saveToXmlFile(std::unique_ptr<std::ostream> file) const{
     using namespace Internal;
@@ -2404,6 +4227,11 @@ Database::File Database::loadFromStream(std::unique_ptr<std::istream> file){
 
     std::cout << "Header: " << uint32_t(hf[0]) << ", size: " << fromLittleEndian<uint16_t>(&hf[1]) << ", no content.\n";
 
+    // Those flags only tell whether their header fields were found, so they
+    // must not keep default values of Settings.
+    result.settings.encrypt = haveField.test(int(HeaderFieldId::CipherID));
+    result.settings.compress = haveField.test(int(HeaderFieldId::CompressionFlags));
+
     // ToDo: describe those headers better and decide if checks are necesary.
     if (!haveField.test(int(HeaderFieldId::StreamStartBytes)) ||
             !haveField.test(int(HeaderFieldId::ProtectedStreamKey)) ||
@@ -2440,21 +4268,17 @@ bool Database::File::needsKey(){
     return settings.needsKey();
 }
 
-std::future<Database::Ptr> Database::File::getDatabase(CompositeKey compositeKey){
-
-    using namespace Internal;
-
-    Pipeline pipeline;
+void Database::File::readPayload(Pipeline& pipeline, const CompositeKey* compositeKey, const SafeVector<uint8_t>& transformedKey){
     pipeline.setStart(std::unique_ptr<Pipeline::OutLink>(new IStreamLink(std::move(ffile))));
     ffile = std::unique_ptr<std::istream>();
 
     if (settings.encrypt){
-        OSSL::Digest keyHash(EVP_sha256());
-        keyHash.update(masterSeed);
-        SafeVector<uint8_t> hash = compositeKey.getCompositeKey(transformSeed, settings.transformRounds);
-        keyHash.update(hash);
-        keyHash.final(hash);
+        if (!compositeKey)
+            throw std::runtime_error("Database is compressed but no keys were provided.");
 
+        SafeVector<uint8_t> hash = cipherKey(masterSeed, transformedKey.empty()
+                                             ? compositeKey->getCompositeKey(transformSeed, settings.transformRounds)
+                                             : transformedKey);
 
         OSSL::EvpCipher cipher(EVP_aes_256_cbc(),
                                nullptr,
@@ -2466,6 +4290,14 @@ std::future<Database::Ptr> Database::File::getDatabase(CompositeKey compositeKey
     }
 
     pipeline.appendLink(std::unique_ptr<Pipeline::InOutLink>(new UnhashStreamLink(streamStartBytes, true)));
+}
+
+void Database::File::startReading(std::unique_ptr<Internal::XmlReaderLink> finish, bool useKey, const SafeVector<uint8_t>& transformedKey){
+
+    using namespace Internal;
+
+    Pipeline pipeline;
+    readPayload(pipeline, useKey ? &finish->compositeKey() : nullptr, transformedKey);
 
     if (settings.compress){
         switch(settings.compression){
@@ -2479,13 +4311,120 @@ std::future<Database::Ptr> Database::File::getDatabase(CompositeKey compositeKey
 
     //pipeline.appendLink(std::unique_ptr<Pipeline::InOutLink>(new OStreamTeeLink("outfile.xml")));
 
-    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, std::move(compositeKey)));
-    std::future<Database::Ptr> result(finish->getFuture());
     pipeline.setFinish(std::move(finish));
     pipeline.run();
+}
 
+std::future<Database::Ptr> Database::File::getDatabase(CompositeKey compositeKey){
+    using namespace Internal;
+
+    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, std::move(compositeKey)));
+    std::future<Database::Ptr> result(finish->getFuture());
+    startReading(std::move(finish), true);
     return result;
+}
+
+std::array<uint8_t, 32> Database::File::payloadStart(){
+    std::array<uint8_t, 32> payload;
+    std::istream::pos_type start = ffile->tellg();
+    // Stream throws on failbit and eofbit; a short payload is reported
+    // below instead, after the stream is usable for reading again.
+    std::ios_base::iostate exceptions = ffile->exceptions();
+    ffile->exceptions(std::ios_base::goodbit);
+    ffile->read(reinterpret_cast<char*>(payload.data()), payload.size());
+    bool complete = ffile->gcount() == std::streamsize(payload.size());
+    ffile->clear();
+    ffile->seekg(start);
+    ffile->exceptions(exceptions);
+    if (!complete)
+        throw std::runtime_error("Unexpected end of file.");
+    return payload;
+}
 
+bool Database::File::decrypts(std::array<uint8_t, 32> payload, const SafeVector<uint8_t>& transformedKey) const{
+    if (!settings.encrypt)
+        return payload == streamStartBytes;
+
+    SafeVector<uint8_t> key = cipherKey(masterSeed, transformedKey);
+    OSSL::EvpCipher cipher(EVP_aes_256_cbc(), nullptr, key.data(), encryptionIV.data(), 0);
+    // Stream start bytes fill two whole blocks, so there is no padding.
+    cipher.set_padding(false);
+    std::array<uint8_t, 32> decrypted;
+    cipher.update(decrypted.data(), payload.data(), payload.size());
+    return decrypted == streamStartBytes;
+}
+
+SafeVector<uint8_t> Database::File::verifyKey(const CompositeKey& compositeKey){
+    SafeVector<uint8_t> transformedKey;
+    if (settings.encrypt)
+        transformedKey = compositeKey.getCompositeKey(transformSeed, settings.transformRounds);
+
+    if (!decrypts(payloadStart(), transformedKey))
+        throw std::runtime_error("Incorrect composed key.");
+    return transformedKey;
+}
+
+std::future<Database::Ptr> Database::File::getDatabase(CompositeKey compositeKey, const SafeVector<uint8_t>& transformedKey){
+    using namespace Internal;
+
+    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, std::move(compositeKey)));
+    std::future<Database::Ptr> result(finish->getFuture());
+    startReading(std::move(finish), true, transformedKey);
+    return result;
+}
+
+std::future<Database::Ptr> Database::File::getDatabase(std::vector<CompositeKey> candidates, unsigned threads){
+    if (candidates.empty())
+        throw std::runtime_error("No composite keys were provided.");
+    if (!settings.encrypt)
+        return getDatabase(std::move(candidates.front()));
+
+    std::array<uint8_t, 32> payload = payloadStart();
+
+    if (!threads)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = unsigned(std::min(std::size_t(threads), candidates.size()));
+
+    std::atomic<std::size_t> next(0);
+    // Set when a matching key is found; it cancels remaining transformations.
+    std::atomic<bool> found(false);
+    std::mutex mutex;
+    std::size_t match = candidates.size();
+    SafeVector<uint8_t> transformedKey;
+    std::exception_ptr error;
+
+    auto transform = [&](){
+        for (std::size_t i = next++; i < candidates.size() && !found; i = next++){
+            try{
+                SafeVector<uint8_t> key = candidates[i].getCompositeKey(transformSeed, settings.transformRounds, found);
+                if (key.empty() || !decrypts(payload, key))
+                    continue;
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!found.exchange(true)){
+                    match = i;
+                    transformedKey = std::move(key);
+                }
+            }catch(...){
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+        workers.emplace_back(transform);
+    transform();
+    for (std::thread& worker: workers)
+        worker.join();
+
+    if (match == candidates.size()){
+        if (error)
+            std::rethrow_exception(error);
+        throw std::runtime_error("Incorrect composed key.");
+    }
+    return getDatabase(std::move(candidates[match]), transformedKey);
 }
 
 std::future<Database::Ptr> Database::File::getDatabase(){
@@ -2493,33 +4432,141 @@ std::future<Database::Ptr> Database::File::getDatabase(){
 
     std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey));
     std::future<Database::Ptr> result(finish->getFuture());
+    startReading(std::move(finish), false);
+    return result;
+}
+
+std::future<Database::Ptr> Database::File::getDatabaseParallel(CompositeKey compositeKey, unsigned threads){
+    using namespace Internal;
+
+    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, threads, std::move(compositeKey)));
+    std::future<Database::Ptr> result(finish->getFuture());
+    startReading(std::move(finish), true);
+    return result;
+}
+
+std::future<Database::Ptr> Database::File::getDatabaseParallel(unsigned threads){
+    using namespace Internal;
+
+    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, threads));
+    std::future<Database::Ptr> result(finish->getFuture());
+    startReading(std::move(finish), false);
+    return result;
+}
+
+std::future<void> Database::File::visit(CompositeKey compositeKey, Visitor& visitor, unsigned skip){
+    using namespace Internal;
+
+    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, &visitor, skip, std::move(compositeKey)));
+    std::future<void> result(finish->getVisitedFuture());
+    startReading(std::move(finish), true);
+    return result;
+}
+
+std::future<void> Database::File::visit(Visitor& visitor, unsigned skip){
+    using namespace Internal;
+
+    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, &visitor, skip));
+    std::future<void> result(finish->getVisitedFuture());
+    startReading(std::move(finish), false);
+    return result;
+}
+
+std::future<Database::File::Metadata> Database::File::getMetadata(CompositeKey compositeKey, unsigned skip){
+    using namespace Internal;
+
+    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, XmlReaderLink::MetadataOnly(), skip, std::move(compositeKey)));
+    std::future<Metadata> result(finish->getMetadataFuture());
+    startReading(std::move(finish), true);
+    return result;
+}
+
+std::future<Database::File::Metadata> Database::File::getMetadata(unsigned skip){
+    using namespace Internal;
+
+    std::unique_ptr<XmlReaderLink> finish(new XmlReaderLink(settings, protectedStreamKey, XmlReaderLink::MetadataOnly(), skip));
+    std::future<Metadata> result(finish->getMetadataFuture());
+    startReading(std::move(finish), false);
+    return result;
+}
+
+std::future<std::unique_ptr<std::ostream>> Database::File::rekey(CompositeKey compositeKey, const CompositeKey& newKey,
+                                                                  uint64_t transformRounds, std::unique_ptr<std::ostream> file){
+    using namespace Internal;
+    // Key is checked before anything is written, so that a wrong key leaves
+    // both the file and this object intact.
+    SafeVector<uint8_t> transformedKey = verifyKey(compositeKey);
+    file->exceptions ( std::istream::failbit | std::istream::badbit | std::istream::eofbit );
 
     Pipeline pipeline;
-    pipeline.setStart(std::unique_ptr<Pipeline::OutLink>(new IStreamLink(std::move(ffile))));
-    ffile = std::unique_ptr<std::istream>();
+    readPayload(pipeline, &compositeKey, transformedKey);
 
-    if (settings.encrypt){
-        throw std::runtime_error("Database is compressed but no keys were provided.");
+    OSSL::Digest d(EVP_sha256());
+    writeSignature(d, file.get());
+    {
+        std::array<uint8_t, 4> innerRandomStreamId;
+        toLittleEndian(uint32_t(settings.crsAlgorithm), innerRandomStreamId.data());
+        writeHeader(d, file.get(), HeaderFieldId::InnerRandomStreamID, innerRandomStreamId.size(), innerRandomStreamId.data());
+        writeHeader(d, file.get(), HeaderFieldId::ProtectedStreamKey, protectedStreamKey.size(), protectedStreamKey.data());
     }
 
-    pipeline.appendLink(std::unique_ptr<Pipeline::InOutLink>(new UnhashStreamLink(streamStartBytes, true)));
+    if (settings.compress){
+        std::array<uint8_t, 4> compression;
+        toLittleEndian(uint32_t(settings.compression), compression.data());
+        writeHeader(d, file.get(), HeaderFieldId::CompressionFlags, 4, compression.data());
+    }
+
+    std::array<uint8_t,32> initBytes = OSSL::rand<std::array<uint8_t,32>>();
+    writeHeader(d, file.get(), HeaderFieldId::StreamStartBytes, initBytes.size(), initBytes.data());
+
+    Settings newSettings = settings;
+    if (!newSettings.encrypt){
+        newSettings.encrypt = true;
+        newSettings.cipherId = AES_CBC_256_UUID;
+    }
+    newSettings.transformRounds = transformRounds;
+    std::unique_ptr<Pipeline::InOutLink> cipher = writeCipherHeader(d, file.get(), newSettings, newKey);
 
+    const std::array<uint8_t,4> endOfHeader = {0x0D, 0x0A, 0x0D, 0x0A};
+    writeHeader(d, file.get(), HeaderFieldId::EndOfHeader, 4, endOfHeader.data());
+    std::array<uint8_t, 32> headerHash;
+    d.final(headerHash);
+
+    // Payload is only inflated because HeaderHash element has to be updated;
+    // it is compressed again with the same algorithm.
+    bool deflate = false;
     if (settings.compress){
         switch(settings.compression){
         default:
             throw std::runtime_error("Unknown copression algorythm.");
         case CompressionAlgorithm::GZip:
             pipeline.appendLink(std::unique_ptr<Pipeline::InOutLink>(new InflateLink()));
+            deflate = true;
         case CompressionAlgorithm::None:;
         }
     }
+    pipeline.appendLink(std::unique_ptr<Pipeline::InOutLink>(new HeaderHashLink(headerHash)));
+    if (deflate)
+        pipeline.appendLink(std::unique_ptr<Pipeline::InOutLink>(new DeflateLink()));
 
+    pipeline.appendLink(std::unique_ptr<Pipeline::InOutLink>(new HashStreamLink(initBytes)));
+    pipeline.appendLink(std::move(cipher));
+
+    std::unique_ptr<ReportingOStreamLink> finish(new ReportingOStreamLink(std::move(file)));
+    std::future<std::unique_ptr<std::ostream>> result = finish->getFuture();
     pipeline.setFinish(std::move(finish));
     pipeline.run();
-
     return result;
 }
 
+Database::File::Visitor::~Visitor(){}
+
+bool Database::File::Visitor::enterGroup(const Group&){
+    return true;
+}
+
+void Database::File::Visitor::leaveGroup(const Group&){}
+
 void Database::init() noexcept{
     xmlInitParser();
 }
@@ -0,0 +1,76 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/icon.h"
+
+namespace Kdbx{
+
+//------------------------------------------------------------------------------
+
+std::size_t CustomIcons::contentsHash(const std::vector<uint8_t>& data) noexcept{
+    // FNV-1a
+    uint64_t result = 14695981039346656037ull;
+    for (uint8_t c: data){
+        result ^= c;
+        result *= 1099511628211ull;
+    }
+    return std::size_t(result);
+}
+
+int CustomIcons::index(const Uuid& uuid) const noexcept{
+    auto it = findexes.find(uuid);
+    if (it == findexes.end())
+        return -1;
+    return it->second;
+}
+
+std::pair<std::size_t, bool> CustomIcons::insert(CustomIcon::Ptr icon){
+    auto it = findexes.find(icon->uuid());
+    if (it != findexes.end())
+        return std::make_pair(it->second, false);
+
+    std::size_t hash = contentsHash(icon->data());
+    auto range = fcontents.equal_range(hash);
+    for (auto i = range.first; i != range.second; ++i){
+        const CustomIcon& same = *ficons[i->second].first;
+        if (!same.sharesData(*icon) && same.data() == icon->data()){
+            icon = std::make_shared<const CustomIcon>(icon->uuid(), same);
+            break;
+        }
+    }
+
+    std::size_t index = ficons.size();
+    findexes.emplace(icon->uuid(), index);
+    fcontents.emplace(hash, index);
+    ficons.emplace_back(std::move(icon), 0);
+    return std::make_pair(index, true);
+}
+
+void CustomIcons::erase(std::size_t index){
+    assert(index < ficons.size());
+    ficons.erase(ficons.begin() + index);
+
+    // Icons are rarely removed, so indexes are simply rebuilt.
+    findexes.clear();
+    fcontents.clear();
+    for (std::size_t i = 0; i < ficons.size(); ++i){
+        findexes.emplace(ficons[i].first->uuid(), i);
+        fcontents.emplace(contentsHash(ficons[i].first->data()), i);
+    }
+}
+
+}
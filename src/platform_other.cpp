@@ -24,6 +24,7 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdexcept>
 #include <cassert>
 #include <memory>
+#include <mutex>
 #include <ctime>
 
 #include <unistd.h>
@@ -37,81 +38,14 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 
 namespace Kdbx{
 
-//static const uint64_t t1970 = 0x19db1ded53e8000;
-
-template <unsigned int size>
-static unsigned int toUIntDate(const uint8_t (&str)[size]){
-	unsigned int result = 0;
-	for (unsigned int i=0; i < size; i++){
-		uint8_t val = str[i];
-		if (val < '0' || val > '9')
-			throw std::runtime_error("Bad date format.");
-		result = result*10 + (val - '0');
-	}
-	return result;
-}
-
-std::time_t formatTime( const char* description){
-
-  tm timeval; 
-#ifdef KEEPASS2PP_HAVE_STRPTIME
-  const char* timeEnd = strptime(description, "%Y-%m-%dT%TZ", &timeval);
-  if (!timeEnd || *timeEnd != 0) throw std::runtime_error("Bad date format.");
-  
-#else
-  
-  	struct TimeStruct{
-		uint8_t year[4];
-		uint8_t separator1;
-		uint8_t month[2];
-		uint8_t separator2;
-		uint8_t day[2];
-		uint8_t T;
-		uint8_t hour[2];
-		uint8_t separator3;
-		uint8_t minute[2];
-		uint8_t separator4;
-		uint8_t second[2];
-		uint8_t Z;
-		uint8_t end;
-	};
-	
-	const TimeStruct* timeStruct = reinterpret_cast<const TimeStruct*>(description);
-
-	timeval.tm_year = toUIntDate(timeStruct->year);
-	if (timeStruct->separator1 != '-') throw std::runtime_error("Bad date format.");
-	timeval.tm_mon = toUIntDate(timeStruct->month);
-	if (timeStruct->separator2 != '-') throw std::runtime_error("Bad date format.");
-	timeval.tm_mday = toUIntDate(timeStruct->day);
-	if (timeStruct->T != 'T') throw std::runtime_error("Bad date format.");
-	timeval.tm_hour = toUIntDate(timeStruct->hour);
-	if (timeStruct->separator3 != ':') throw std::runtime_error("Bad date format.");
-	timeval.tm_min = toUIntDate(timeStruct->minute);
-	if (timeStruct->separator4 != ':') throw std::runtime_error("Bad date format.");
-	timeval.tm_sec = toUIntDate(timeStruct->second);
-	if (timeStruct->Z != 'Z') throw std::runtime_error("Bad date format.");
-	if (timeStruct->end != 0) throw std::runtime_error("Bad date format.");
-	timeval.tm_wday = 0;
-	timeval.tm_yday = 0;
-	timeval.tm_isdst = 0;
-#endif
-
-return timegm(&timeval);
-	
+std::time_t formatTime(const char* description){
+    return parseIsoTime(description);
 }
 
 //ToDo: think of some better names here...
 std::string unformatTime(std::time_t time) noexcept{
-#ifdef KEEPASS2PP_HAVE_GMTIME_R
-    std::tm timeval;
-    gmtime_r(&time, &timeval);
-#else
-    std::tm& timeval = *gmtime(&time);
-#endif
-
-    char buffer[30];
-    std::size_t size = strftime(buffer, 30 ,"%Y-%m-%dT%TZ", &timeval);
-    return std::string(buffer, size);
+    char buffer[isoTimeLength+1];
+    return std::string(buffer, formatIsoTime(time, buffer));
 }
 
 //------------------------------------------------------------------------------
@@ -124,6 +58,201 @@ void SafeMemoryManager::zero(void* ptr, std::size_t size) noexcept{
 //	}
 }
 
+namespace{
+
+constexpr std::size_t sizeClasses[] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+constexpr std::size_t classCount = sizeof(sizeClasses) / sizeof(sizeClasses[0]);
+constexpr std::size_t largestClass = sizeClasses[classCount - 1];
+
+// Usable size of a slab; every slab is carved into blocks of one size class.
+const std::size_t slabSize = 64 * 1024;
+// Blocks moved between a thread cache and the shared pool at once.
+const std::size_t batchSize = 32;
+
+// Maps size rounded up to 16 bytes to index of the smallest size class that
+// can hold it. It is constant-initialized, so it can be used by constructors
+// of static objects.
+struct ClassTable{
+    uint8_t classes[largestClass / 16 + 1];
+
+    constexpr ClassTable() noexcept
+        :classes()
+    {
+        std::size_t index = 0;
+        for (std::size_t i = 0; i <= largestClass / 16; ++i){
+            while (sizeClasses[index] < i * 16)
+                ++index;
+            classes[i] = index;
+        }
+    }
+};
+
+constexpr ClassTable classTable;
+
+inline std::size_t sizeClass(std::size_t size) noexcept{
+    return classTable.classes[(size + 15) / 16];
+}
+
+inline std::size_t pageSize() noexcept{
+    static const std::size_t result = sysconf(_SC_PAGESIZE);
+    return result;
+}
+
+// Maps \p size bytes (a multiple of page size) of locked memory, excluded
+// from core dumps, with an inaccessible guard page on each side.
+char* mapLocked(std::size_t size){
+    std::size_t page = pageSize();
+    void* mapping = mmap(nullptr, size + 2 * page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+    char* result = static_cast<char*>(mapping) + page;
+    if (mprotect(result, size, PROT_READ | PROT_WRITE) != 0){
+        munmap(mapping, size + 2 * page);
+        throw std::bad_alloc();
+    }
+    mlock(result, size);
+#ifdef MADV_DONTDUMP
+    madvise(result, size, MADV_DONTDUMP);
+#endif
+    return result;
+}
+
+void unmapLocked(char* ptr, std::size_t size) noexcept{
+    std::size_t page = pageSize();
+    munlock(ptr, size);
+    munmap(ptr - page, size + 2 * page);
+}
+
+inline std::size_t pageAligned(std::size_t size) noexcept{
+    return (size + pageSize() - 1) / pageSize() * pageSize();
+}
+
+// Free blocks are zeroed, except for the link to the next free block.
+struct FreeBlock{
+    FreeBlock* next;
+};
+
+struct FreeList{
+    FreeBlock* head;
+    std::size_t count;
+
+    inline void push(FreeBlock* block) noexcept{
+        block->next = head;
+        head = block;
+        ++count;
+    }
+
+    inline FreeBlock* pop() noexcept{
+        FreeBlock* result = head;
+        head = result->next;
+        result->next = nullptr;
+        --count;
+        return result;
+    }
+};
+
+// Free blocks shared by all threads. Slabs are never unmapped.
+class Pool{
+public:
+    static Pool& instance(){
+        // Never destroyed, so that memory can be released by destructors of
+        // static objects.
+        static Pool* pool = new Pool();
+        return *pool;
+    }
+
+    // Moves a batch of free blocks of class \p index to \p cache.
+    void refill(std::size_t index, FreeList& cache){
+        std::lock_guard<std::mutex> lock(fmutex);
+        FreeList& list = flists[index];
+        if (!list.count){
+            std::size_t size = sizeClasses[index];
+            char* slab = mapLocked(slabSize);
+            for (std::size_t offset = slabSize / size * size; offset; offset -= size)
+                list.push(reinterpret_cast<FreeBlock*>(slab + offset - size));
+        }
+        for (std::size_t i = 0; i < batchSize && list.count; ++i)
+            cache.push(list.pop());
+    }
+
+    // Moves all but \p keep blocks of \p cache back to the pool.
+    void flush(std::size_t index, FreeList& cache, std::size_t keep) noexcept{
+        std::lock_guard<std::mutex> lock(fmutex);
+        while (cache.count > keep)
+            flists[index].push(cache.pop());
+    }
+
+private:
+    Pool() noexcept
+        :flists()
+    {}
+
+    std::mutex fmutex;
+    FreeList flists[classCount];
+};
+
+// Thread cache is a trivial type, so that it can still be used by destructors
+// of other thread-local and static objects after CacheFlusher returned
+// its blocks to the pool.
+struct ThreadCache{
+    FreeList lists[classCount];
+    bool registered;
+    bool disabled;
+};
+
+thread_local ThreadCache threadCache;
+
+struct CacheFlusher{
+    ~CacheFlusher(){
+        for (std::size_t i = 0; i < classCount; ++i)
+            Pool::instance().flush(i, threadCache.lists[i], 0);
+        threadCache.disabled = true;
+    }
+};
+
+thread_local CacheFlusher cacheFlusher;
+
+}
+
+void* SafeMemoryManager::allocate(std::size_t size){
+    if (size > largestClass)
+        return mapLocked(pageAligned(size));
+
+    std::size_t index = sizeClass(size);
+    ThreadCache& thread = threadCache;
+    FreeList& cache = thread.lists[index];
+    if (!cache.count){
+        if (!thread.registered){
+            thread.registered = true;
+            (void)&cacheFlusher;
+        }
+        Pool::instance().refill(index, cache);
+    }
+    void* result = cache.pop();
+    if (thread.disabled)
+        Pool::instance().flush(index, cache, 0);
+    return result;
+}
+
+void SafeMemoryManager::deallocate(void* ptr, std::size_t size) noexcept{
+    if (!ptr)
+        return;
+    zero(ptr, size);
+    if (size > largestClass){
+        unmapLocked(static_cast<char*>(ptr), pageAligned(size));
+        return;
+    }
+
+    std::size_t index = sizeClass(size);
+    ThreadCache& thread = threadCache;
+    FreeList& cache = thread.lists[index];
+    cache.push(static_cast<FreeBlock*>(ptr));
+    if (thread.disabled)
+        Pool::instance().flush(index, cache, 0);
+    else if (cache.count > 2 * batchSize)
+        Pool::instance().flush(index, cache, batchSize);
+}
+
 //-----------------------------------------------------------------------------------------------------
 
 signed int Uuid::compare(const Uuid& uuid) const noexcept{
@@ -27,51 +27,8 @@ along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
 #include "../include/libkeepass2pp/util.h"
 
 
-static const uint64_t t1970 = 0x19db1ded53e8000;
-
-std::time_t formatTime( const char* description){
-  	struct TimeStruct{
-		uint8_t year[4];
-		uint8_t separator1;
-		uint8_t month[2];
-		uint8_t separator2;
-		uint8_t day[2];
-		uint8_t T;
-		uint8_t hour[2];
-		uint8_t separator3;
-		uint8_t minute[2];
-		uint8_t separator4;
-		uint8_t second[2];
-		uint8_t Z;
-		uint8_t end;
-	};
-	
-	const TimeStruct* timeStruct = reinterpret_cast<const TimeStruct*>(description);
-
-	SYSTEMTIME systime;
-
-	systime.wYear = toUIntDate(timeStruct->year);
-	if (timeStruct->separator1 != '-') throw std::runtime_error("Bad date format.");
-	systime.wMonth = toUIntDate(timeStruct->month);
-	if (timeStruct->separator2 != '-') throw std::runtime_error("Bad date format.");
-	systime.wDay = toUIntDate(timeStruct->day);
-	if (timeStruct->T != 'T') throw std::runtime_error("Bad date format.");
-	systime.wHour = toUIntDate(timeStruct->hour);
-	if (timeStruct->separator3 != ':') throw std::runtime_error("Bad date format.");
-	systime.wMinute = toUIntDate(timeStruct->minute);
-	if (timeStruct->separator4 != ':') throw std::runtime_error("Bad date format.");
-	systime.wSecond = toUIntDate(timeStruct->second);
-	if (timeStruct->Z != 'Z') throw std::runtime_error("Bad date format.");
-	if (timeStruct->end != 0) throw std::runtime_error("Bad date format.");
-	systime.wMilliseconds = 0;
-	systime.wDayOfWeek = 0;
-
-	FILETIME ftime;
-	if (SystemTimeToIFileTime(&systime, &ftime) == 0)
-		throw std::runtime_error("Bad date format.");
-
-	uint64_t result = (uint64_t(ftime.dwHighDateTime) << 32) | ftime.dwLowDateTime;
-	return (result - t1970)/1e7;
+std::time_t formatTime(const char* description){
+    return Kdbx::parseIsoTime(description);
 }
 
 //------------------------------------------------------------------------------
@@ -80,6 +37,20 @@ void SafeAllocator<void>::zero(void* ptr, std::size_t size) noexcept{
 	SecureZeroMemory(ptr, size);
 }
 
+void* SafeMemoryManager::allocate(std::size_t size){
+	void* result = calloc(1, size);
+	if (!result)
+		throw std::bad_alloc();
+	return result;
+}
+
+void SafeMemoryManager::deallocate(void* ptr, std::size_t size) noexcept{
+	if (!ptr)
+		return;
+	SecureZeroMemory(ptr, size);
+	free(ptr);
+}
+
 template class SafeAllocator<void>;
 
 //-----------------------------------------------------------------------------------------------------
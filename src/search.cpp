@@ -0,0 +1,749 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/search.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+namespace Kdbx{
+
+//------------------------------------------------------------------------------
+
+// Separates fields in document text, so that no trigram spans two fields.
+static const char fieldSeparator = '\n';
+
+static inline char fold(char c) noexcept{
+    return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+static void appendFolded(std::string& text, const char* data, std::size_t size){
+    text.reserve(text.size() + size + 1);
+    for (std::size_t i = 0; i < size; ++i){
+        char c = data[i];
+        text.push_back(c == fieldSeparator ? ' ' : fold(c));
+    }
+    text.push_back(fieldSeparator);
+}
+
+static inline uint32_t trigram(const char* c) noexcept{
+    return (uint32_t(uint8_t(c[0])) << 16) | (uint32_t(uint8_t(c[1])) << 8) | uint32_t(uint8_t(c[2]));
+}
+
+// Finds first element not less than id in a sorted range, looking at
+// exponentially growing distances from the beginning of the range first.
+static std::vector<uint32_t>::const_iterator gallop(std::vector<uint32_t>::const_iterator first,
+                                                    std::vector<uint32_t>::const_iterator last,
+                                                    uint32_t id){
+    std::size_t step = 1;
+    while (std::size_t(last - first) > step && first[step] < id)
+        step *= 2;
+    return std::lower_bound(first + step / 2, first + std::min(step + 1, std::size_t(last - first)), id);
+}
+
+static std::vector<std::string> terms(const std::string& query){
+    std::vector<std::string> result;
+    std::string term;
+    for (char c: query){
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r'){
+            if (!term.empty())
+                result.push_back(std::move(term));
+            term.clear();
+        }else{
+            term.push_back(fold(c));
+        }
+    }
+    if (!term.empty())
+        result.push_back(std::move(term));
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+SearchIndex::SearchIndex(const Database::Group* group){
+    addGroup(group);
+}
+
+bool SearchIndex::searchable(const Database::Entry* entry) noexcept{
+    if (!entry->versions())
+        return false;
+    for (const Database::Group* group = entry->parent(); group; group = group->parent()){
+        if (!group->properties().enableSearching)
+            return false;
+    }
+    return true;
+}
+
+std::vector<uint32_t> SearchIndex::trigrams(const std::string& text) const{
+    std::vector<uint32_t> result;
+    if (text.size() < 3)
+        return result;
+    result.reserve(text.size() - 2);
+    for (std::size_t i = 0; i + 2 < text.size(); ++i){
+        if (text[i] == fieldSeparator || text[i+1] == fieldSeparator || text[i+2] == fieldSeparator)
+            continue;
+        result.push_back(trigram(text.data() + i));
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+void SearchIndex::insertPostings(uint32_t id){
+    for (uint32_t t: trigrams(fdocuments[id].text))
+        fpostings[t].push_back(id);
+}
+
+void SearchIndex::compact(){
+    std::vector<Document> documents;
+    documents.reserve(fids.size());
+    fpostings.clear();
+    for (Document& document: fdocuments){
+        if (!document.entry)
+            continue;
+        fids[document.entry] = uint32_t(documents.size());
+        documents.push_back(std::move(document));
+    }
+    fdocuments = std::move(documents);
+    for (uint32_t id = 0; id < fdocuments.size(); ++id)
+        insertPostings(id);
+}
+
+void SearchIndex::addEntry(const Database::Entry* entry){
+    if (!searchable(entry)){
+        removeEntry(entry);
+        return;
+    }
+
+    static const char* const fields[] = {
+        Database::Version::titleString,
+        Database::Version::userNameString,
+        Database::Version::urlString,
+        Database::Version::notesString
+    };
+
+    const Database::Version* version = entry->latest();
+    std::string text;
+    for (const char* field: fields){
+        auto it = version->strings.find(field);
+        if (it == version->strings.end() || it->second.hasMask())
+            continue;
+        const SafeVector<uint8_t>& buffer = it->second.buffer();
+        appendFolded(text, reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    }
+    for (const std::string& tag: version->tags)
+        appendFolded(text, tag.data(), tag.size());
+
+    auto it = fids.find(entry);
+    if (it != fids.end()){
+        if (fdocuments[it->second].text == text)
+            return;
+        removeEntry(entry);
+    }
+
+    uint32_t id = uint32_t(fdocuments.size());
+    fdocuments.push_back(Document{entry, std::move(text)});
+    fids.emplace(entry, id);
+    insertPostings(id);
+}
+
+void SearchIndex::removeEntry(const Database::Entry* entry){
+    auto it = fids.find(entry);
+    if (it == fids.end())
+        return;
+    fdocuments[it->second] = Document{nullptr, std::string()};
+    fids.erase(it);
+    if (fdocuments.size() > 2 * fids.size() + 1024)
+        compact();
+}
+
+void SearchIndex::addGroup(const Database::Group* group){
+    for (std::size_t i = 0; i < group->entries(); ++i)
+        addEntry(group->entry(i));
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        addGroup(group->group(i));
+}
+
+void SearchIndex::removeGroup(const Database::Group* group){
+    for (std::size_t i = 0; i < group->entries(); ++i)
+        removeEntry(group->entry(i));
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        removeGroup(group->group(i));
+}
+
+void SearchIndex::clear() noexcept{
+    fdocuments.clear();
+    fids.clear();
+    fpostings.clear();
+}
+
+std::vector<const Database::Entry*> SearchIndex::search(const std::string& query) const{
+    std::vector<const Database::Entry*> result;
+    std::vector<std::string> queryTerms = terms(query);
+    if (queryTerms.empty())
+        return result;
+
+    auto matches = [&queryTerms](const Document& document){
+        if (!document.entry)
+            return false;
+        for (const std::string& term: queryTerms){
+            if (document.text.find(term) == std::string::npos)
+                return false;
+        }
+        return true;
+    };
+
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (const std::string& term: queryTerms){
+        for (std::size_t i = 0; i + 2 < term.size(); ++i){
+            auto it = fpostings.find(trigram(term.data() + i));
+            if (it == fpostings.end())
+                return result;
+            lists.push_back(&it->second);
+        }
+    }
+
+    if (lists.empty()){
+        for (const Document& document: fdocuments){
+            if (matches(document))
+                result.push_back(document.entry);
+        }
+        return result;
+    }
+
+    std::sort(lists.begin(), lists.end());
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+    std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b){
+        return a->size() < b->size();
+    });
+
+    // Lists much longer than the set of candidates cost more to intersect
+    // with than verifying the candidates does.
+    std::vector<uint32_t> candidates(*lists.front());
+    for (std::size_t i = 1; i < lists.size() && !candidates.empty(); ++i){
+        if (lists[i]->size() > 32 * candidates.size())
+            break;
+        std::vector<uint32_t>::const_iterator first = lists[i]->begin();
+        std::vector<uint32_t>::const_iterator last = lists[i]->end();
+        std::size_t size = 0;
+        for (uint32_t id: candidates){
+            first = gallop(first, last, id);
+            if (first == last)
+                break;
+            if (*first == id)
+                candidates[size++] = id;
+        }
+        candidates.resize(size);
+    }
+
+    for (uint32_t id: candidates){
+        if (matches(fdocuments[id]))
+            result.push_back(fdocuments[id].entry);
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+static inline bool hostChar(char c) noexcept{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || (c & 0x80);
+}
+
+static inline bool space(char c) noexcept{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+DomainIndex::DomainIndex(const Database::Group* group){
+    addGroup(group);
+}
+
+std::string DomainIndex::hostOf(const std::string& url){
+    std::size_t begin = 0;
+    std::size_t end = url.size();
+    while (begin < end && space(url[begin]))
+        ++begin;
+    while (end > begin && space(url[end-1]))
+        --end;
+
+    // A scheme separator only counts before the path, query or fragment,
+    // which may embed other URLs.
+    std::size_t scheme = url.find("://", begin);
+    if (scheme < std::min(url.find_first_of("/?#", begin), end))
+        begin = scheme + 3;
+    end = std::min(url.find_first_of("/?#", begin), end);
+    std::size_t at = url.rfind('@', end);
+    if (at != std::string::npos && at >= begin && at < end)
+        begin = at + 1;
+
+    std::string host;
+    if (begin < end && url[begin] == '['){
+        std::size_t close = url.find(']', begin);
+        if (close >= end)
+            return std::string();
+        host = url.substr(begin, close + 1 - begin);
+        for (char& c: host){
+            c = fold(c);
+            if (!((c >= 'a' && c <= 'f') || (c >= '0' && c <= '9') || c == ':' || c == '.' || c == '[' || c == ']'))
+                return std::string();
+        }
+        return host;
+    }
+
+    end = std::min(url.find(':', begin), end);
+    host = url.substr(begin, end - begin);
+    while (!host.empty() && host.back() == '.')
+        host.pop_back();
+    if (host.empty() || host.front() == '.' || host.find("..") != std::string::npos)
+        return std::string();
+    for (char& c: host){
+        c = fold(c);
+        if (!hostChar(c))
+            return std::string();
+    }
+    return host;
+}
+
+std::string DomainIndex::domainOf(const std::string& host){
+    if (host.empty() || host.front() == '[' || host.find_first_not_of("0123456789.") == std::string::npos)
+        return host;
+
+    std::size_t last = host.rfind('.');
+    if (last == std::string::npos || last == 0)
+        return host;
+    std::size_t second = host.rfind('.', last - 1);
+    if (second == std::string::npos)
+        return host;
+
+    static const char* const genericLabels[] = {
+        "ac", "co", "com", "edu", "gov", "ne", "net", "or", "org"
+    };
+
+    if (host.size() - last - 1 == 2){
+        std::string label = host.substr(second + 1, last - second - 1);
+        for (const char* generic: genericLabels){
+            if (label == generic){
+                if (second == 0)
+                    return host;
+                std::size_t third = host.rfind('.', second - 1);
+                return third == std::string::npos ? host : host.substr(third + 1);
+            }
+        }
+    }
+    return host.substr(second + 1);
+}
+
+void DomainIndex::insert(std::unordered_map<std::string, Entries>& map, const std::vector<std::string>& keys, const Database::Entry* entry){
+    for (const std::string& key: keys)
+        map[key].push_back(entry);
+}
+
+void DomainIndex::erase(std::unordered_map<std::string, Entries>& map, const std::vector<std::string>& keys, const Database::Entry* entry){
+    for (const std::string& key: keys){
+        auto it = map.find(key);
+        if (it == map.end())
+            continue;
+        Entries& entries = it->second;
+        auto pos = std::find(entries.begin(), entries.end(), entry);
+        if (pos != entries.end()){
+            *pos = entries.back();
+            entries.pop_back();
+        }
+        if (entries.empty())
+            map.erase(it);
+    }
+}
+
+void DomainIndex::addEntry(const Database::Entry* entry){
+    if (!entry->versions()){
+        removeEntry(entry);
+        return;
+    }
+
+    const Database::Version* version = entry->latest();
+    Keys keys;
+    auto addHost = [&keys](std::string host){
+        if (!host.empty())
+            keys.hosts.push_back(std::move(host));
+    };
+
+    auto url = version->strings.find(Database::Version::urlString);
+    if (url != version->strings.end() && !url->second.hasMask()){
+        const SafeVector<uint8_t>& buffer = url->second.buffer();
+        addHost(hostOf(std::string(buffer.begin(), buffer.end())));
+    }
+    addHost(hostOf(version->overrideUrl));
+
+    // Window patterns are free text; every dotted token that ends with an
+    // alphabetic label is taken for a host name.
+    for (const Database::Version::AutoType::Association& association: version->autoType.items){
+        const std::string& window = association.window;
+        for (std::size_t begin = 0; begin < window.size();){
+            if (!hostChar(fold(window[begin]))){
+                ++begin;
+                continue;
+            }
+            std::size_t end = begin;
+            while (end < window.size() && hostChar(fold(window[end])))
+                ++end;
+            std::string token = hostOf(window.substr(begin, end - begin));
+            std::size_t dot = token.rfind('.');
+            if (dot != std::string::npos && token.size() - dot > 2
+                    && std::all_of(token.begin() + dot + 1, token.end(), [](char c){ return c >= 'a' && c <= 'z'; }))
+                addHost(std::move(token));
+            begin = end;
+        }
+    }
+
+    std::sort(keys.hosts.begin(), keys.hosts.end());
+    keys.hosts.erase(std::unique(keys.hosts.begin(), keys.hosts.end()), keys.hosts.end());
+    for (const std::string& host: keys.hosts)
+        keys.domains.push_back(domainOf(host));
+    std::sort(keys.domains.begin(), keys.domains.end());
+    keys.domains.erase(std::unique(keys.domains.begin(), keys.domains.end()), keys.domains.end());
+
+    auto it = fkeys.find(entry);
+    if (it != fkeys.end()){
+        if (it->second.hosts == keys.hosts)
+            return;
+        removeEntry(entry);
+    }
+    if (keys.hosts.empty())
+        return;
+
+    insert(fhosts, keys.hosts, entry);
+    insert(fdomains, keys.domains, entry);
+    fkeys.emplace(entry, std::move(keys));
+}
+
+void DomainIndex::removeEntry(const Database::Entry* entry){
+    auto it = fkeys.find(entry);
+    if (it == fkeys.end())
+        return;
+    erase(fhosts, it->second.hosts, entry);
+    erase(fdomains, it->second.domains, entry);
+    fkeys.erase(it);
+}
+
+void DomainIndex::addGroup(const Database::Group* group){
+    for (std::size_t i = 0; i < group->entries(); ++i)
+        addEntry(group->entry(i));
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        addGroup(group->group(i));
+}
+
+void DomainIndex::removeGroup(const Database::Group* group){
+    for (std::size_t i = 0; i < group->entries(); ++i)
+        removeEntry(group->entry(i));
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        removeGroup(group->group(i));
+}
+
+void DomainIndex::clear() noexcept{
+    fkeys.clear();
+    fhosts.clear();
+    fdomains.clear();
+}
+
+const DomainIndex::Entries& DomainIndex::host(const std::string& host) const noexcept{
+    static const Entries empty;
+    auto it = fhosts.find(host);
+    return it == fhosts.end() ? empty : it->second;
+}
+
+const DomainIndex::Entries& DomainIndex::domain(const std::string& domain) const noexcept{
+    static const Entries empty;
+    auto it = fdomains.find(domain);
+    return it == fdomains.end() ? empty : it->second;
+}
+
+DomainIndex::Entries DomainIndex::lookup(const std::string& url) const{
+    std::string urlHost = hostOf(url);
+    if (urlHost.empty())
+        return Entries();
+
+    const Entries& exact = host(urlHost);
+    const Entries& all = domain(domainOf(urlHost));
+    Entries result(exact);
+    if (exact.empty()){
+        result = all;
+    }else{
+        std::unordered_set<const Database::Entry*> found(exact.begin(), exact.end());
+        for (const Database::Entry* entry: all){
+            if (!found.count(entry))
+                result.push_back(entry);
+        }
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+ExpiryIndex::ExpiryIndex(const Database::Group* group){
+    addGroup(group);
+}
+
+void ExpiryIndex::addEntry(const Database::Entry* entry){
+    if (!entry->versions() || !entry->latest()->times.expires){
+        removeEntry(entry);
+        return;
+    }
+
+    std::time_t expiry = entry->latest()->times.expiry;
+    auto it = fentries.find(entry);
+    if (it != fentries.end()){
+        if (it->second->first == expiry)
+            return;
+        fexpiries.erase(it->second);
+        it->second = fexpiries.emplace(expiry, entry);
+    }else{
+        fentries.emplace(entry, fexpiries.emplace(expiry, entry));
+    }
+}
+
+void ExpiryIndex::removeEntry(const Database::Entry* entry){
+    auto it = fentries.find(entry);
+    if (it == fentries.end())
+        return;
+    fexpiries.erase(it->second);
+    fentries.erase(it);
+}
+
+void ExpiryIndex::addGroup(const Database::Group* group){
+    for (std::size_t i = 0; i < group->entries(); ++i)
+        addEntry(group->entry(i));
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        addGroup(group->group(i));
+}
+
+void ExpiryIndex::removeGroup(const Database::Group* group){
+    for (std::size_t i = 0; i < group->entries(); ++i)
+        removeEntry(group->entry(i));
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        removeGroup(group->group(i));
+}
+
+void ExpiryIndex::clear() noexcept{
+    fexpiries.clear();
+    fentries.clear();
+}
+
+ExpiryIndex::Entries ExpiryIndex::expiringBefore(std::time_t time) const{
+    Entries result;
+    for (auto it = fexpiries.begin(), end = fexpiries.lower_bound(time); it != end; ++it)
+        result.push_back(it->second);
+    return result;
+}
+
+ExpiryIndex::Entries ExpiryIndex::expiringBetween(std::time_t from, std::time_t to) const{
+    Entries result;
+    if (from >= to)
+        return result;
+    for (auto it = fexpiries.lower_bound(from), end = fexpiries.lower_bound(to); it != end; ++it)
+        result.push_back(it->second);
+    return result;
+}
+
+const Database::Entry* ExpiryIndex::nextExpiring() const noexcept{
+    return fexpiries.empty() ? nullptr : fexpiries.begin()->second;
+}
+
+std::time_t ExpiryIndex::nextExpiry() const noexcept{
+    return fexpiries.empty() ? std::numeric_limits<std::time_t>::max() : fexpiries.begin()->first;
+}
+
+//------------------------------------------------------------------------------
+
+TagIndex::TagIndex(const Database::Group* group){
+    addGroup(group);
+}
+
+void TagIndex::addEntry(const Database::Entry* entry){
+    if (!entry->versions()){
+        removeEntry(entry);
+        return;
+    }
+
+    Tags tags(entry->latest()->tags);
+    std::sort(tags.begin(), tags.end());
+    tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+
+    auto it = fentries.find(entry);
+    if (it != fentries.end()){
+        if (it->second.tags == tags)
+            return;
+        unlink(it->second);
+        it->second.tags = std::move(tags);
+    }else{
+        it = fentries.emplace(entry, Item{uint32_t(fsequence.size()), std::move(tags)}).first;
+        fsequence.push_back(entry);
+    }
+
+    // Ids of new entries are the largest ones; only retagged entries have to
+    // be inserted in the middle of a list.
+    uint32_t id = it->second.id;
+    for (const Database::Tag& tag: it->second.tags){
+        if (ftags.size() <= tag.id())
+            ftags.resize(tag.id() + 1);
+        Ids& ids = ftags[tag.id()];
+        if (ids.empty() || ids.back() < id)
+            ids.push_back(id);
+        else
+            ids.insert(std::lower_bound(ids.begin(), ids.end(), id), id);
+    }
+}
+
+void TagIndex::removeEntry(const Database::Entry* entry){
+    auto it = fentries.find(entry);
+    if (it == fentries.end())
+        return;
+    unlink(it->second);
+    fsequence[it->second.id] = nullptr;
+    fentries.erase(it);
+    if (fsequence.size() > 2 * fentries.size() + 1024)
+        compact();
+}
+
+void TagIndex::unlink(const Item& item) noexcept{
+    for (const Database::Tag& tag: item.tags){
+        Ids& ids = ftags[tag.id()];
+        ids.erase(std::lower_bound(ids.begin(), ids.end(), item.id));
+    }
+}
+
+TagIndex::Entries TagIndex::resolve(const Ids& ids) const{
+    Entries result;
+    result.reserve(ids.size());
+    for (uint32_t id: ids)
+        result.push_back(fsequence[id]);
+    return result;
+}
+
+// Renumbers indexed entries without gaps. Renumbering keeps the order of ids,
+// so lists stay sorted.
+void TagIndex::compact(){
+    Ids renumbered(fsequence.size());
+    std::vector<const Database::Entry*> sequence;
+    sequence.reserve(fentries.size());
+    for (std::size_t id = 0; id < fsequence.size(); ++id){
+        if (!fsequence[id])
+            continue;
+        renumbered[id] = uint32_t(sequence.size());
+        fentries.find(fsequence[id])->second.id = uint32_t(sequence.size());
+        sequence.push_back(fsequence[id]);
+    }
+    for (Ids& ids: ftags)
+        for (uint32_t& id: ids)
+            id = renumbered[id];
+    fsequence = std::move(sequence);
+}
+
+void TagIndex::addGroup(const Database::Group* group){
+    for (std::size_t i = 0; i < group->entries(); ++i)
+        addEntry(group->entry(i));
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        addGroup(group->group(i));
+}
+
+void TagIndex::removeGroup(const Database::Group* group){
+    for (std::size_t i = 0; i < group->entries(); ++i)
+        removeEntry(group->entry(i));
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        removeGroup(group->group(i));
+}
+
+void TagIndex::clear() noexcept{
+    fsequence.clear();
+    fentries.clear();
+    ftags.clear();
+}
+
+TagIndex::Entries TagIndex::entries(const Database::Tag& tag) const{
+    return tag.id() < ftags.size() ? resolve(ftags[tag.id()]) : Entries();
+}
+
+// Keeps (or drops, if keep is false) entries of a sorted result that are
+// present in any of sorted lists. Short results are looked up in long lists
+// instead of merging them.
+static void filter(TagIndex::Ids& result, const std::vector<const TagIndex::Ids*>& lists, bool keep){
+    std::size_t total = 0;
+    for (const TagIndex::Ids* list: lists)
+        total += list->size();
+
+    TagIndex::Ids buffer;
+    if (total > 8 * result.size()){
+        for (uint32_t id: result){
+            bool found = std::any_of(lists.begin(), lists.end(), [id](const TagIndex::Ids* list){
+                return std::binary_search(list->begin(), list->end(), id);
+            });
+            if (found == keep)
+                buffer.push_back(id);
+        }
+    }else{
+        TagIndex::Ids merged;
+        for (const TagIndex::Ids* list: lists){
+            buffer.clear();
+            std::set_union(merged.begin(), merged.end(), list->begin(), list->end(), std::back_inserter(buffer));
+            merged.swap(buffer);
+        }
+        buffer.clear();
+        if (keep)
+            std::set_intersection(result.begin(), result.end(), merged.begin(), merged.end(), std::back_inserter(buffer));
+        else
+            std::set_difference(result.begin(), result.end(), merged.begin(), merged.end(), std::back_inserter(buffer));
+    }
+    result.swap(buffer);
+}
+
+TagIndex::Entries TagIndex::query(const Tags& all, const Tags& any, const Tags& none) const{
+    static const Ids empty;
+    auto lists = [this](const Tags& tags){
+        std::vector<const Ids*> result;
+        for (const Database::Tag& tag: tags)
+            result.push_back(tag.id() < ftags.size() ? &ftags[tag.id()] : &empty);
+        std::sort(result.begin(), result.end(), [](const Ids* a, const Ids* b){
+            return a->size() < b->size();
+        });
+        return result;
+    };
+
+    Ids result;
+    if (!all.empty()){
+        std::vector<const Ids*> allLists = lists(all);
+        result = *allLists.front();
+        for (std::size_t i = 1; i < allLists.size() && !result.empty(); ++i)
+            filter(result, {allLists[i]}, true);
+        if (!any.empty() && !result.empty())
+            filter(result, lists(any), true);
+    }else if (!any.empty()){
+        for (const Ids* list: lists(any)){
+            Ids buffer;
+            std::set_union(result.begin(), result.end(), list->begin(), list->end(), std::back_inserter(buffer));
+            result.swap(buffer);
+        }
+    }else{
+        result.reserve(fentries.size());
+        for (std::size_t id = 0; id < fsequence.size(); ++id)
+            if (fsequence[id])
+                result.push_back(uint32_t(id));
+    }
+
+    if (!none.empty() && !result.empty())
+        filter(result, lists(none), false);
+    return resolve(result);
+}
+
+}
@@ -0,0 +1,754 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "../include/libkeepass2pp/wrappers.h"
+
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+namespace Kdbx{
+
+//------------------------------------------------------------------------------
+// Snapshot file layout:
+//
+//   signature      8 bytes, "KDBXSNAP"
+//   version        uint32, snapshotVersion
+//   fingerprint    32 bytes, SHA-256 of the KDBX file
+//   iv             16 bytes
+//   image          AES-256-CBC encrypted database image
+//   mac            32 bytes, HMAC-SHA-256 of all preceding bytes
+//
+// Image is a flat sequence of little-endian integers and length-prefixed
+// strings, written in the order of Internal::Snapshot methods.
+
+static const char snapshotSignature[8] = {'K', 'D', 'B', 'X', 'S', 'N', 'A', 'P'};
+static const uint32_t snapshotVersion = 1;
+static const std::size_t snapshotIvSize = 16;
+static const std::size_t snapshotMacSize = 32;
+static const std::size_t snapshotHeaderSize = sizeof(snapshotSignature) + 4 + std::tuple_size<Database::Fingerprint>::value + snapshotIvSize;
+
+// Derives snapshot encryption or authentication key. Both depend on the file
+// fingerprint, so that a snapshot of one file can't be passed for another.
+static SafeVector<uint8_t> snapshotKey(const SafeVector<uint8_t>& transformedKey, const Database::Fingerprint& fingerprint, const char* purpose){
+    SafeVector<uint8_t> result(32);
+    OSSL::Digest d(EVP_sha256());
+    d.update(transformedKey);
+    d.update(fingerprint);
+    d.update(purpose, std::strlen(purpose));
+    d.final(result);
+    return result;
+}
+
+static std::array<uint8_t, snapshotMacSize> snapshotMac(const SafeVector<uint8_t>& key, const uint8_t* data, std::size_t size){
+    std::array<uint8_t, snapshotMacSize> result;
+    unsigned int written = 0;
+    if (!HMAC(EVP_sha256(), key.data(), int(key.size()), data, size, result.data(), &written) || written != result.size())
+        throw OSSL::exception();
+    return result;
+}
+
+// Reads all data remaining in a stream, without touching its exception mask.
+static std::string readAll(std::istream& file){
+    const std::size_t chunkSize = 64 * 1024;
+    std::string result;
+    std::streambuf* buffer = file.rdbuf();
+    for (;;){
+        std::size_t size = result.size();
+        result.resize(size + chunkSize);
+        std::size_t read = std::size_t(buffer->sgetn(&result[size], chunkSize));
+        result.resize(size + read);
+        if (read < chunkSize)
+            return result;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+namespace Internal{
+
+class SnapshotWriter{
+public:
+    template <typename T>
+    inline void integer(T value){
+        std::size_t size = fdata.size();
+        fdata.resize(size + sizeof(T));
+        toLittleEndian(value, fdata.data() + size);
+    }
+
+    inline void boolean(bool value){
+        fdata.push_back(value);
+    }
+
+    template <typename It>
+    inline void bytes(It begin, It end){
+        integer(uint32_t(end - begin));
+        fdata.insert(fdata.end(), begin, end);
+    }
+
+    template <typename Container>
+    inline void bytes(const Container& data){
+        bytes(data.begin(), data.end());
+    }
+
+    inline void uuid(const Uuid& uuid){
+        std::array<uint8_t, 16> raw = uuid.raw();
+        fdata.insert(fdata.end(), raw.begin(), raw.end());
+    }
+
+    inline void time(std::time_t time){
+        integer(uint64_t(time));
+    }
+
+    inline SafeVector<uint8_t>& data() noexcept{
+        return fdata;
+    }
+
+private:
+    SafeVector<uint8_t> fdata;
+};
+
+class SnapshotReader{
+public:
+    inline SnapshotReader(const uint8_t* data, std::size_t size) noexcept
+        :fpos(data),
+          fend(data + size)
+    {}
+
+    template <typename T>
+    inline T integer(){
+        return fromLittleEndian<T>(take(sizeof(T)));
+    }
+
+    inline bool boolean(){
+        return *take(1);
+    }
+
+    template <typename Container>
+    inline Container bytes(){
+        uint32_t size = integer<uint32_t>();
+        const uint8_t* data = take(size);
+        return Container(data, data + size);
+    }
+
+    inline std::string string(){
+        return bytes<std::string>();
+    }
+
+    inline Uuid uuid(){
+        std::array<uint8_t, 16> raw;
+        std::memcpy(raw.data(), take(raw.size()), raw.size());
+        return Uuid(raw);
+    }
+
+    inline std::time_t time(){
+        return std::time_t(integer<uint64_t>());
+    }
+
+    // Reads a count of items that take at least one byte each, so that
+    // a malformed count can't make the reader reserve lots of memory.
+    inline std::size_t count(){
+        uint32_t result = integer<uint32_t>();
+        if (result > std::size_t(fend - fpos))
+            throw std::runtime_error("Malformed snapshot.");
+        return result;
+    }
+
+    inline bool atEnd() const noexcept{
+        return fpos == fend;
+    }
+
+private:
+    inline const uint8_t* take(std::size_t size){
+        if (size > std::size_t(fend - fpos))
+            throw std::runtime_error("Malformed snapshot.");
+        const uint8_t* result = fpos;
+        fpos += size;
+        return result;
+    }
+
+    const uint8_t* fpos;
+    const uint8_t* fend;
+};
+
+/** @brief Snapshot writes a database into a flat image and builds it back.
+ *
+ * Binaries shared by versions are stored once, in a table that precedes the
+ * group tree, and are referenced by index. Custom icons are referenced by
+ * their index in database's icon table.
+ */
+class Snapshot{
+public:
+    typedef std::unordered_map<const Database::Binary*, uint32_t> BinaryIndexes;
+
+    static void write(SnapshotWriter& writer, const Database& database){
+        const Database::Settings& settings = *database.fsettings;
+        const Database::File::Settings& fileSettings = settings.fileSettings;
+        writer.boolean(fileSettings.encrypt);
+        writer.boolean(fileSettings.compress);
+        writer.bytes(fileSettings.cipherId);
+        writer.integer(fileSettings.transformRounds);
+        writer.integer(uint32_t(fileSettings.crsAlgorithm));
+        writer.integer(uint32_t(fileSettings.compression));
+
+        writer.bytes(settings.fname);
+        writer.time(settings.fnameChanged);
+        writer.bytes(settings.fdescription);
+        writer.time(settings.fdescriptionChanged);
+        writer.bytes(settings.fdefaultUsername);
+        writer.time(settings.fdefaultUsernameChanged);
+        writer.bytes(settings.color);
+        writer.integer(uint32_t(settings.maintenanceHistoryDays));
+        writer.integer(uint32_t(settings.historyMaxItems));
+        writer.integer(uint64_t(settings.masterKeyChangeRec));
+        writer.integer(uint64_t(settings.masterKeyChangeForce));
+        writer.integer(uint64_t(settings.historyMaxSize));
+        writer.integer(uint64_t(settings.memoryProtection.to_ulong()));
+        writer.uuid(settings.lastSelectedGroup);
+        writer.uuid(settings.lastTopVisibleGroup);
+        writer.boolean(settings.recycleBinEnabled);
+
+        writer.uuid(database.frecycleBin ? database.frecycleBin->uuid() : Uuid::nil());
+        writer.time(database.frecycleBinChanged);
+        writer.uuid(database.ftemplates ? database.ftemplates->uuid() : Uuid::nil());
+        writer.time(database.ftemplatesChanged);
+        writer.time(database.fcompositeKeyChanged);
+
+        writer.integer(uint32_t(database.customData.size()));
+        for (const auto& item: database.customData){
+            writer.bytes(item.first);
+            writer.bytes(item.second);
+        }
+
+        writer.integer(uint32_t(database.fdeletedObjects.size()));
+        for (const auto& item: database.fdeletedObjects){
+            writer.uuid(item.first);
+            writer.time(item.second);
+        }
+
+        writer.integer(uint32_t(database.fcustomIcons.size()));
+        for (const CustomIcons::value_type& icon: database.fcustomIcons){
+            writer.uuid(icon.first->uuid());
+            writer.bytes(icon.first->data());
+        }
+
+        std::vector<const Database::Binary*> binaries;
+        BinaryIndexes indexes;
+        collectBinaries(database.froot.get(), binaries, indexes);
+        writer.integer(uint32_t(binaries.size()));
+        for (const Database::Binary* binary: binaries){
+            // Compressed binaries are stored as they are, so that they don't
+            // need to be decompressed neither now nor when snapshot is read.
+            const SafeVector<uint8_t>* compressed = binary->compressed();
+            writer.boolean(compressed);
+            writer.bytes(compressed ? *compressed : binary->data());
+        }
+
+        writeGroup(writer, database.froot.get(), database.fcustomIcons, indexes);
+    }
+
+    static Database::Ptr read(SnapshotReader& reader){
+        Database::Ptr database(new Database());
+
+        Database::Settings::Ptr settings(new Database::Settings());
+        Database::File::Settings& fileSettings = settings->fileSettings;
+        fileSettings.encrypt = reader.boolean();
+        fileSettings.compress = reader.boolean();
+        std::vector<uint8_t> cipherId = reader.bytes<std::vector<uint8_t>>();
+        if (cipherId.size() != fileSettings.cipherId.size())
+            throw std::runtime_error("Malformed snapshot.");
+        std::copy(cipherId.begin(), cipherId.end(), fileSettings.cipherId.begin());
+        fileSettings.transformRounds = reader.integer<uint64_t>();
+        fileSettings.crsAlgorithm = RandomStream::Algorithm(reader.integer<uint32_t>());
+        fileSettings.compression = Database::File::CompressionAlgorithm(reader.integer<uint32_t>());
+
+        settings->fname = reader.string();
+        settings->fnameChanged = reader.time();
+        settings->fdescription = reader.string();
+        settings->fdescriptionChanged = reader.time();
+        settings->fdefaultUsername = reader.string();
+        settings->fdefaultUsernameChanged = reader.time();
+        settings->color = reader.string();
+        settings->maintenanceHistoryDays = reader.integer<uint32_t>();
+        settings->historyMaxItems = int(reader.integer<uint32_t>());
+        settings->masterKeyChangeRec = int64_t(reader.integer<uint64_t>());
+        settings->masterKeyChangeForce = int64_t(reader.integer<uint64_t>());
+        settings->historyMaxSize = int64_t(reader.integer<uint64_t>());
+        settings->memoryProtection = MemoryProtectionFlags(static_cast<unsigned long>(reader.integer<uint64_t>()));
+        settings->lastSelectedGroup = reader.uuid();
+        settings->lastTopVisibleGroup = reader.uuid();
+        settings->recycleBinEnabled = reader.boolean();
+
+        Uuid recycleBin = reader.uuid();
+        database->frecycleBinChanged = reader.time();
+        Uuid templates = reader.uuid();
+        database->ftemplatesChanged = reader.time();
+        database->fcompositeKeyChanged = reader.time();
+
+        for (std::size_t i = reader.count(); i; --i){
+            std::string name = reader.string();
+            database->customData[std::move(name)] = reader.string();
+        }
+
+        for (std::size_t i = reader.count(); i; --i){
+            Uuid uuid = reader.uuid();
+            database->fdeletedObjects[uuid] = reader.time();
+        }
+
+        for (std::size_t i = reader.count(); i; --i){
+            Uuid uuid = reader.uuid();
+            database->fcustomIcons.insert(std::make_shared<const CustomIcon>(uuid, reader.bytes<std::vector<uint8_t>>()));
+        }
+
+        std::vector<Database::Binary::Ptr> binaries(reader.count());
+        for (Database::Binary::Ptr& binary: binaries){
+            bool compressed = reader.boolean();
+            SafeVector<uint8_t> data = reader.bytes<SafeVector<uint8_t>>();
+            if (compressed){
+                binary = Database::Binary::fromCompressed(std::move(data));
+            }else{
+                binary = std::make_shared<Database::Binary>(std::move(data));
+            }
+            binary = database->fbinaries.insert(std::move(binary));
+        }
+
+        database->froot = readGroup(reader, database.get(), nullptr, binaries);
+        if (!reader.atEnd())
+            throw std::runtime_error("Malformed snapshot.");
+
+        database->fgroupIndex.clear();
+        database->fentryIndex.clear();
+        database->indexTree(database->froot.get());
+        database->frecycleBin = database->group(recycleBin);
+        database->ftemplates = database->group(templates);
+        database->fsettings = std::move(settings);
+        return database;
+    }
+
+private:
+    enum class IconType: uint8_t{
+        Null,
+        Standard,
+        Custom,
+        // Custom icon that is not in database's icon table; its data is
+        // stored inline.
+        UnlistedCustom
+    };
+
+    static void collectBinaries(const Database::Group* group, std::vector<const Database::Binary*>& binaries, BinaryIndexes& indexes){
+        for (const Database::Entry::Ptr& entry: group->fentries){
+            for (const Database::Version::Ptr& version: entry->fversions){
+                for (const auto& item: version->binaries){
+                    if (item.second && indexes.emplace(item.second.get(), uint32_t(binaries.size())).second)
+                        binaries.push_back(item.second.get());
+                }
+            }
+        }
+        for (const Database::Group::Ptr& child: group->fgroups)
+            collectBinaries(child.get(), binaries, indexes);
+    }
+
+    static void writeIcon(SnapshotWriter& writer, const Icon& icon, const CustomIcons& customIcons){
+        switch (icon.type()){
+        case Icon::Type::Standard:
+            writer.integer(uint8_t(IconType::Standard));
+            writer.integer(uint32_t(icon.standard()));
+            break;
+        case Icon::Type::Custom:{
+            int index = customIcons.index(icon.custom()->uuid());
+            if (index >= 0){
+                writer.integer(uint8_t(IconType::Custom));
+                writer.integer(uint32_t(index));
+            }else{
+                writer.integer(uint8_t(IconType::UnlistedCustom));
+                writer.uuid(icon.custom()->uuid());
+                writer.bytes(icon.custom()->data());
+            }
+            break;
+        }
+        default:
+            writer.integer(uint8_t(IconType::Null));
+            break;
+        }
+    }
+
+    static Icon readIcon(SnapshotReader& reader, Database* database){
+        CustomIcons& customIcons = database->fcustomIcons;
+        switch (IconType(reader.integer<uint8_t>())){
+        case IconType::Null:
+            return Icon();
+        case IconType::Standard:
+            return Icon(StandardIcon(reader.integer<uint32_t>()));
+        case IconType::Custom:{
+            uint32_t index = reader.integer<uint32_t>();
+            if (index >= customIcons.size())
+                throw std::runtime_error("Malformed snapshot.");
+            customIcons.ref(index);
+            return Icon(customIcons[index].first);
+        }
+        case IconType::UnlistedCustom:{
+            Uuid uuid = reader.uuid();
+            std::size_t index = customIcons.insert(std::make_shared<const CustomIcon>(uuid, reader.bytes<std::vector<uint8_t>>())).first;
+            customIcons.ref(index);
+            return Icon(customIcons[index].first);
+        }
+        default:
+            throw std::runtime_error("Malformed snapshot.");
+        }
+    }
+
+    static void writeTimes(SnapshotWriter& writer, const Times& times){
+        writer.time(times.creation);
+        writer.time(times.lastModification);
+        writer.time(times.lastAccess);
+        writer.time(times.expiry);
+        writer.boolean(times.expires);
+        writer.integer(times.usageCount);
+        writer.time(times.locationChanged);
+    }
+
+    static Times readTimes(SnapshotReader& reader){
+        Times result(DoNotInit);
+        result.creation = reader.time();
+        result.lastModification = reader.time();
+        result.lastAccess = reader.time();
+        result.expiry = reader.time();
+        result.expires = reader.boolean();
+        result.usageCount = reader.integer<uint64_t>();
+        result.locationChanged = reader.time();
+        return result;
+    }
+
+    static void writeVersion(SnapshotWriter& writer, const Database::Version* version, const CustomIcons& customIcons,
+                             const BinaryIndexes& binaries){
+        writeIcon(writer, version->icon, customIcons);
+        writer.bytes(version->fgColor);
+        writer.bytes(version->bgColor);
+        writer.bytes(version->overrideUrl);
+
+        writer.integer(uint32_t(version->tags.size()));
+        for (const Database::Tag& tag: version->tags)
+            writer.bytes(tag.name());
+
+        writeTimes(writer, version->times);
+
+        // Protected strings are stored with their masks, so that they are
+        // never unprotected while the snapshot is written or read.
+        writer.integer(uint32_t(version->strings.size()));
+        for (const Database::Version::Strings::value_type& item: version->strings){
+            writer.bytes(item.first.name());
+            writer.boolean(item.second.hasMask());
+            writer.bytes(item.second.buffer());
+            if (item.second.hasMask())
+                writer.bytes(item.second.mask());
+        }
+
+        writer.integer(uint32_t(version->binaries.size()));
+        for (const auto& item: version->binaries){
+            writer.bytes(item.first);
+            writer.integer(item.second ? binaries.at(item.second.get()) : uint32_t(-1));
+        }
+
+        const Database::Version::AutoType& autoType = version->autoType;
+        writer.bytes(autoType.defaultSequence);
+        writer.integer(uint32_t(autoType.items.size()));
+        for (const Database::Version::AutoType::Association& item: autoType.items){
+            writer.bytes(item.window);
+            writer.bytes(item.sequence);
+        }
+        writer.integer(uint32_t(autoType.obfuscationOptions));
+        writer.boolean(autoType.enabled);
+    }
+
+    static Database::Version::Ptr readVersion(SnapshotReader& reader, Database* database, Database::Entry* entry,
+                                              const std::vector<Database::Binary::Ptr>& binaries){
+        Database::Version::Ptr version(new Database::Version(entry));
+        version->icon = readIcon(reader, database);
+        version->fgColor = reader.string();
+        version->bgColor = reader.string();
+        version->overrideUrl = reader.string();
+
+        std::size_t tags = reader.count();
+        version->tags.reserve(tags);
+        for (; tags; --tags)
+            version->tags.emplace_back(reader.string());
+
+        version->times = readTimes(reader);
+
+        for (std::size_t i = reader.count(); i; --i){
+            Database::Version::FieldName name(reader.string());
+            bool masked = reader.boolean();
+            SafeVector<uint8_t> buffer = reader.bytes<SafeVector<uint8_t>>();
+            if (masked){
+                SafeVector<uint8_t> mask = reader.bytes<SafeVector<uint8_t>>();
+                if (mask.size() < buffer.size())
+                    throw std::runtime_error("Malformed snapshot.");
+                version->strings.insert(Database::Version::Strings::value_type(std::move(name), XorredBuffer(std::move(buffer), std::move(mask))));
+            }else{
+                version->strings.insert(Database::Version::Strings::value_type(std::move(name), XorredBuffer(std::move(buffer))));
+            }
+        }
+
+        for (std::size_t i = reader.count(); i; --i){
+            std::string name = reader.string();
+            uint32_t index = reader.integer<uint32_t>();
+            if (index != uint32_t(-1) && index >= binaries.size())
+                throw std::runtime_error("Malformed snapshot.");
+            version->binaries.emplace_hint(version->binaries.end(), std::move(name),
+                                           index == uint32_t(-1) ? Database::Binary::Ptr() : binaries[index]);
+        }
+
+        Database::Version::AutoType& autoType = version->autoType;
+        autoType.defaultSequence = reader.string();
+        autoType.items.resize(reader.count());
+        for (Database::Version::AutoType::Association& item: autoType.items){
+            item.window = reader.string();
+            item.sequence = reader.string();
+        }
+        autoType.obfuscationOptions = Database::Version::AutoType::ObfuscationOptions(reader.integer<uint32_t>());
+        autoType.enabled = reader.boolean();
+        return version;
+    }
+
+    static void writeGroup(SnapshotWriter& writer, const Database::Group* group, const CustomIcons& customIcons,
+                           const BinaryIndexes& binaries){
+        writer.uuid(group->fuuid);
+        const Database::Group::Properties& properties = *group->fproperties;
+        writer.bytes(properties.name);
+        writer.bytes(properties.notes);
+        writer.bytes(properties.defaultAutoTypeSequence);
+        writeIcon(writer, properties.icon, customIcons);
+        writeTimes(writer, properties.times);
+        writer.uuid(properties.lastTopVisibleEntry);
+        writer.boolean(properties.isExpanded);
+        writer.boolean(properties.enableAutoType);
+        writer.boolean(properties.enableSearching);
+
+        writer.integer(uint32_t(group->fgroups.size()));
+        for (const Database::Group::Ptr& child: group->fgroups)
+            writeGroup(writer, child.get(), customIcons, binaries);
+
+        writer.integer(uint32_t(group->fentries.size()));
+        for (const Database::Entry::Ptr& entry: group->fentries){
+            writer.uuid(entry->fuuid);
+            writer.integer(uint32_t(entry->fversions.size()));
+            for (const Database::Version::Ptr& version: entry->fversions)
+                writeVersion(writer, version.get(), customIcons, binaries);
+        }
+    }
+
+    static Database::Group::Ptr readGroup(SnapshotReader& reader, Database* database, Database::Group* parent,
+                                          const std::vector<Database::Binary::Ptr>& binaries){
+        Database::Group::Ptr group(parent ? new Database::Group(parent) : new Database::Group(database));
+        group->fuuid = reader.uuid();
+        Database::Group::Properties& properties = *group->fproperties;
+        properties.name = reader.string();
+        properties.notes = reader.string();
+        properties.defaultAutoTypeSequence = reader.string();
+        properties.icon = readIcon(reader, database);
+        properties.times = readTimes(reader);
+        properties.lastTopVisibleEntry = reader.uuid();
+        properties.isExpanded = reader.boolean();
+        properties.enableAutoType = reader.boolean();
+        properties.enableSearching = reader.boolean();
+
+        std::size_t groups = reader.count();
+        group->fgroups.reserve(groups);
+        for (; groups; --groups)
+            group->fgroups.push_back(readGroup(reader, database, group.get(), binaries));
+
+        std::size_t entries = reader.count();
+        group->fentries.reserve(entries);
+        for (; entries; --entries){
+            Database::Entry::Ptr entry(new Database::Entry(group.get()));
+            entry->fuuid = reader.uuid();
+            std::size_t versions = reader.count();
+            if (!versions)
+                throw std::runtime_error("Malformed snapshot.");
+            entry->fversions.reserve(versions);
+            for (; versions; --versions)
+                entry->fversions.push_back(readVersion(reader, database, entry.get(), binaries));
+            for (size_t i = 1; i < entry->fversions.size(); ++i)
+                entry->fversions[i]->share(*entry->fversions[i-1]);
+            Database::updateIndexes(entry->fversions);
+            group->fentries.push_back(std::move(entry));
+        }
+
+        Database::updateIndexes(group->fgroups);
+        Database::updateIndexes(group->fentries);
+        return group;
+    }
+};
+
+}
+
+//------------------------------------------------------------------------------
+
+Database::Fingerprint Database::fingerprint(std::istream& file){
+    Fingerprint result;
+    OSSL::Digest d(EVP_sha256());
+    std::array<char, 64 * 1024> chunk;
+    std::streambuf* buffer = file.rdbuf();
+    std::streamsize read;
+    while ((read = buffer->sgetn(chunk.data(), chunk.size())) > 0)
+        d.update(chunk.data(), std::size_t(read));
+    d.final(result);
+    return result;
+}
+
+Database::Fingerprint Database::fingerprint(const std::string& filename){
+    std::ifstream file;
+    file.exceptions(std::istream::failbit | std::istream::badbit);
+    file.open(filename, std::ios::in | std::ios::binary);
+    return fingerprint(file);
+}
+
+void Database::saveSnapshot(std::ostream& file, const Fingerprint& fingerprint, const SafeVector<uint8_t>& transformedKey) const{
+    using namespace Internal;
+
+    if (transformedKey.empty())
+        throw std::runtime_error("Snapshots can only be made for encrypted databases.");
+
+    SnapshotWriter writer;
+    Snapshot::write(writer, *this);
+    SafeVector<uint8_t>& image = writer.data();
+    if (image.size() > std::size_t(std::numeric_limits<int>::max()) - snapshotIvSize)
+        throw std::runtime_error("Database is too large for a snapshot.");
+
+    std::array<uint8_t, snapshotIvSize> iv = OSSL::rand<std::array<uint8_t, snapshotIvSize>>();
+    std::vector<uint8_t> result;
+    result.reserve(snapshotHeaderSize + image.size() + 2 * snapshotIvSize + snapshotMacSize);
+    result.insert(result.end(), snapshotSignature, snapshotSignature + sizeof(snapshotSignature));
+    result.resize(result.size() + 4);
+    toLittleEndian(snapshotVersion, result.data() + result.size() - 4);
+    result.insert(result.end(), fingerprint.begin(), fingerprint.end());
+    result.insert(result.end(), iv.begin(), iv.end());
+
+    SafeVector<uint8_t> key = snapshotKey(transformedKey, fingerprint, "snapshot encryption");
+    OSSL::EvpCipher cipher(EVP_aes_256_cbc(), nullptr, key.data(), iv.data(), 1);
+    std::size_t size = result.size();
+    result.resize(size + image.size() + cipher.block_size());
+    size += cipher.update(result.data() + size, image.data(), int(image.size()));
+    size += cipher.final(result.data() + size);
+    result.resize(size);
+
+    std::array<uint8_t, snapshotMacSize> mac = snapshotMac(snapshotKey(transformedKey, fingerprint, "snapshot authentication"),
+                                                           result.data(), result.size());
+    result.insert(result.end(), mac.begin(), mac.end());
+
+    file.write(reinterpret_cast<const char*>(result.data()), result.size());
+    file.flush();
+    if (!file)
+        throw std::runtime_error("Error writing snapshot.");
+}
+
+Database::Ptr Database::loadSnapshot(std::istream& file, const Fingerprint& fingerprint, CompositeKey&& compositeKey,
+                                     const SafeVector<uint8_t>& transformedKey){
+    using namespace Internal;
+
+    if (transformedKey.empty())
+        return nullptr;
+
+    std::string data = readAll(file);
+    if (data.size() < snapshotHeaderSize + snapshotMacSize)
+        return nullptr;
+    uint8_t* begin = reinterpret_cast<uint8_t*>(&data[0]);
+    uint8_t* pos = begin;
+    if (std::memcmp(pos, snapshotSignature, sizeof(snapshotSignature)) != 0)
+        return nullptr;
+    pos += sizeof(snapshotSignature);
+    if (fromLittleEndian<uint32_t>(pos) != snapshotVersion)
+        return nullptr;
+    pos += 4;
+    if (!std::equal(fingerprint.begin(), fingerprint.end(), pos))
+        return nullptr;
+    pos += fingerprint.size();
+    const uint8_t* iv = pos;
+    pos += snapshotIvSize;
+
+    uint8_t* end = begin + data.size() - snapshotMacSize;
+    std::array<uint8_t, snapshotMacSize> mac = snapshotMac(snapshotKey(transformedKey, fingerprint, "snapshot authentication"),
+                                                           begin, end - begin);
+    if (CRYPTO_memcmp(mac.data(), end, mac.size()) != 0)
+        return nullptr;
+
+    // An image that can't be decoded is treated as a damaged snapshot. The
+    // key is only taken once the whole image was decoded.
+    Database::Ptr database;
+    try{
+        SafeVector<uint8_t> key = snapshotKey(transformedKey, fingerprint, "snapshot encryption");
+        OSSL::EvpCipher cipher(EVP_aes_256_cbc(), nullptr, key.data(), iv, 0);
+        SafeVector<uint8_t> image(end - pos + cipher.block_size());
+        std::size_t size = cipher.update(image.data(), pos, int(end - pos));
+        size += cipher.final(image.data() + size);
+
+        Arena arena;
+        Arena::Scope scope(&arena);
+        SnapshotReader reader(image.data(), size);
+        database = Snapshot::read(reader);
+    }catch(std::exception&){
+        return nullptr;
+    }
+    database->fcompositeKey = std::move(compositeKey);
+    return database;
+}
+
+Database::Ptr Database::loadFromFileCached(const std::string& filename, const std::string& snapshotFilename, CompositeKey compositeKey){
+    std::string data;
+    {
+        std::ifstream file;
+        file.exceptions(std::istream::failbit | std::istream::badbit);
+        file.open(filename, std::ios::in | std::ios::binary);
+        data = readAll(file);
+    }
+    // The file is read only once, so that the fingerprint describes exactly
+    // the data that is loaded.
+    Fingerprint print;
+    OSSL::Digest::oneShot(EVP_sha256(), print, data.data(), data.size());
+    File file = loadFromStream(std::unique_ptr<std::istream>(new std::istringstream(std::move(data))));
+    SafeVector<uint8_t> transformedKey = file.verifyKey(compositeKey);
+    if (transformedKey.empty())
+        return file.getDatabase(std::move(compositeKey)).get();
+
+    {
+        std::ifstream snapshot(snapshotFilename, std::ios::in | std::ios::binary);
+        if (snapshot){
+            Database::Ptr result = loadSnapshot(snapshot, print, std::move(compositeKey), transformedKey);
+            if (result)
+                return result;
+        }
+    }
+
+    Database::Ptr result = file.getDatabase(std::move(compositeKey), transformedKey).get();
+    // The snapshot is only a cache; failing to write it doesn't affect
+    // the loaded database.
+    try{
+        std::ofstream snapshot(snapshotFilename, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (snapshot)
+            result->saveSnapshot(snapshot, print, transformedKey);
+    }catch(std::exception&){
+    }
+    return result;
+}
+
+}
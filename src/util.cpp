@@ -33,6 +33,8 @@ std::vector<std::string> explode(const std::string& s, const char* separators){
 			result.emplace_back(s, bpos, epos-bpos);
 		bpos = epos+1;
 	}
+	if (bpos < s.size())
+		result.emplace_back(s, bpos);
 
 	return result;
 }
@@ -206,36 +208,131 @@ SafeVector<uint8_t> safeDecodeBase64(SafeString<char> data){
 	return result;
 }
 
-std::string encodeBase64(const uint8_t* data, std::size_t size){
-    int fullBlocks = size / 3;
-    std::string result;
-    result.reserve(((size+2)/3)*4);
-
-    for (int i=0; i< fullBlocks; ++i){
-        result.push_back(encodeBase64Byte(data[i*3] >> 2));
-        result.push_back(encodeBase64Byte((data[i*3] << 4 | data[i*3+1] >> 4)& 0x3f));
-        result.push_back(encodeBase64Byte((data[i*3+1] << 2 | data[i*3+2] >> 6) &0x3f));
-        result.push_back(encodeBase64Byte(data[i*3+2] &0x3f));
+char* encodeBase64(const uint8_t* data, std::size_t size, char* out) noexcept{
+    std::size_t fullBlocks = size / 3;
+
+    for (std::size_t i=0; i< fullBlocks; ++i){
+        *out++ = encodeBase64Byte(data[i*3] >> 2);
+        *out++ = encodeBase64Byte((data[i*3] << 4 | data[i*3+1] >> 4)& 0x3f);
+        *out++ = encodeBase64Byte((data[i*3+1] << 2 | data[i*3+2] >> 6) &0x3f);
+        *out++ = encodeBase64Byte(data[i*3+2] &0x3f);
     }
     switch (size %3){
     case 2:
-        result.push_back(encodeBase64Byte(data[size - 2] >> 2));
-        result.push_back(encodeBase64Byte((data[size - 2] << 4 | data[size - 1] >> 4) & 0x3f));
-        result.push_back(encodeBase64Byte((data[size - 1] << 2) &0x3f));
-        result.push_back('=');
+        *out++ = encodeBase64Byte(data[size - 2] >> 2);
+        *out++ = encodeBase64Byte((data[size - 2] << 4 | data[size - 1] >> 4) & 0x3f);
+        *out++ = encodeBase64Byte((data[size - 1] << 2) &0x3f);
+        *out++ = '=';
         break;
     case 1:
-        result.push_back(encodeBase64Byte(data[size - 1] >> 2));
-        result.push_back(encodeBase64Byte((data[size - 1] << 4) & 0x3f));
-        result.push_back('=');
-        result.push_back('=');
+        *out++ = encodeBase64Byte(data[size - 1] >> 2);
+        *out++ = encodeBase64Byte((data[size - 1] << 4) & 0x3f);
+        *out++ = '=';
+        *out++ = '=';
         break;
     default:;
     }
 
+    return out;
+}
+
+std::string encodeBase64(const uint8_t* data, std::size_t size){
+    std::string result(encodedBase64Size(size), '\0');
+    encodeBase64(data, size, &result[0]);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+static constexpr int64_t minIsoTime = -62135596800; // 0001-01-01T00:00:00Z
+static constexpr int64_t maxIsoTime = 253402300799; // 9999-12-31T23:59:59Z
+
+static inline unsigned int isoTimeField(const char* c, std::size_t size){
+    unsigned int result = 0;
+    for (const char* end = c + size; c != end; ++c){
+        unsigned int digit = static_cast<unsigned char>(*c) - '0';
+        if (digit > 9)
+            throw std::runtime_error("Bad date format.");
+        result = result*10 + digit;
+    }
     return result;
 }
 
+static inline char* isoTimeDigits(char* c, unsigned int value, std::size_t size) noexcept{
+    for (char* i = c + size; i != c;){
+        *--i = '0' + value % 10;
+        value /= 10;
+    }
+    return c + size;
+}
+
+std::time_t parseIsoTime(const char* begin, const char* end){
+    if (end - begin != std::ptrdiff_t(isoTimeLength)
+            || begin[4] != '-' || begin[7] != '-' || begin[10] != 'T'
+            || begin[13] != ':' || begin[16] != ':' || begin[19] != 'Z')
+        throw std::runtime_error("Bad date format.");
+
+    unsigned int year = isoTimeField(begin, 4);
+    unsigned int month = isoTimeField(begin + 5, 2);
+    unsigned int day = isoTimeField(begin + 8, 2);
+    unsigned int hour = isoTimeField(begin + 11, 2);
+    unsigned int minute = isoTimeField(begin + 14, 2);
+    unsigned int second = isoTimeField(begin + 17, 2);
+
+    static const unsigned char monthDays[] = {31,29,31,30,31,30,31,31,30,31,30,31};
+    if (month < 1 || month > 12 || day < 1 || day > monthDays[month-1]
+            || hour > 23 || minute > 59 || second > 60)
+        throw std::runtime_error("Bad date format.");
+    if (month == 2 && day == 29 && (year % 4 || (year % 100 == 0 && year % 400)))
+        throw std::runtime_error("Bad date format.");
+
+    int64_t days = daysFromCivil(year, month, day);
+    return std::time_t(days * 86400 + hour * 3600 + minute * 60 + second);
+}
+
+char* formatIsoTime(std::time_t time, char (&buffer)[isoTimeLength+1]) noexcept{
+    int64_t t = std::min(std::max(int64_t(time), minIsoTime), maxIsoTime);
+    int64_t days = t / 86400;
+    int64_t secs = t % 86400;
+    if (secs < 0){
+        secs += 86400;
+        --days;
+    }
+
+    int64_t year;
+    unsigned int month;
+    unsigned int day;
+    civilFromDays(days, year, month, day);
+
+    char* c = isoTimeDigits(buffer, unsigned(year), 4);
+    *c++ = '-';
+    c = isoTimeDigits(c, month, 2);
+    *c++ = '-';
+    c = isoTimeDigits(c, day, 2);
+    *c++ = 'T';
+    c = isoTimeDigits(c, unsigned(secs / 3600), 2);
+    *c++ = ':';
+    c = isoTimeDigits(c, unsigned(secs / 60 % 60), 2);
+    *c++ = ':';
+    c = isoTimeDigits(c, unsigned(secs % 60), 2);
+    *c++ = 'Z';
+    *c = 0;
+    return c;
+}
+
+std::time_t decodeKdbx4Time(const std::string& data){
+    std::vector<uint8_t> raw = decodeBase64(data);
+    if (raw.size() != sizeof(int64_t))
+        throw std::runtime_error("Bad date format.");
+    return std::time_t(int64_t(fromLittleEndian<uint64_t>(raw.data())) - kdbx4TimeOffset);
+}
+
+std::string encodeKdbx4Time(std::time_t time){
+    uint8_t raw[sizeof(int64_t)];
+    toLittleEndian<uint64_t>(uint64_t(int64_t(time) + kdbx4TimeOffset), raw);
+    return encodeBase64(raw, sizeof(raw));
+}
+
 }
 
 
@@ -1224,6 +1224,13 @@ XML::String InputBufferTextReader::xlocalName() const{
     return XML::String(xmlTextReaderLocalName(ftextReader.get()));
 }
 
+const xmlChar* InputBufferTextReader::constString(const char* str){
+    const xmlChar* result = xmlTextReaderConstString(ftextReader.get(), reinterpret_cast<const xmlChar*>(str));
+    if (!result)
+        throw std::bad_alloc();
+    return result;
+}
+
 
 ParserInputBuffer InputBufferTextReader::createBuffer(xmlCharEncoding encoding){
     // ToDo: is it really necesary here?
@@ -1395,8 +1402,9 @@ namespace Zlib{
 voidpf Inflater::allocFunc(voidpf opaque, uInt items, uInt size) noexcept{
     unused(opaque);
     try{
-        std::size_t* result = reinterpret_cast<std::size_t*>(SafeMemoryManager::allocate(items*size + sizeof(std::size_t)));
-        *result = size;
+        std::size_t total = std::size_t(items)*size + sizeof(std::size_t);
+        std::size_t* result = reinterpret_cast<std::size_t*>(SafeMemoryManager::allocate(total));
+        *result = total;
         return result+1;
     }catch(std::bad_alloc&){
         return 0;
@@ -1405,7 +1413,9 @@ voidpf Inflater::allocFunc(voidpf opaque, uInt items, uInt size) noexcept{
 
 void Inflater::freeFunc(voidpf opaque, voidpf address) noexcept{
     unused(opaque);
-    std::size_t* ptr = reinterpret_cast<std::size_t*>(address);
+    if (!address)
+        return;
+    std::size_t* ptr = reinterpret_cast<std::size_t*>(address) - 1;
     SafeMemoryManager::deallocate(ptr, *ptr);
 }
 
@@ -1426,7 +1436,7 @@ std::vector<uint8_t> Inflater::oneShot(const std::vector<uint8_t>& input,
                                        int windowBits,
                                        AllocType type){
     std::vector<uint8_t> result;
-    std::vector<uint8_t> output(0, input.size());
+    std::vector<uint8_t> output(input.size());
 
     Inflater strm(windowBits, type);
     strm->next_in = input.data();
@@ -1553,9 +1563,9 @@ std::vector<uint8_t> Deflater::oneShot(const std::vector<uint8_t>& input,
                                        int strategy,
                                        AllocType type){
     std::vector<uint8_t> result;
-    std::vector<uint8_t> output(0, input.size());
-
     Deflater strm(level, windowBits, memLevel, strategy, type);
+    std::vector<uint8_t> output(deflateBound(strm, input.size()));
+
     strm->next_in = input.data();
     strm->avail_in = input.size();
     strm->next_out = output.data();
@@ -1596,9 +1606,9 @@ SafeVector<uint8_t> Deflater::oneShot(const SafeVector<uint8_t>& input,
                                       int strategy,
                                       AllocType type){
     SafeVector<uint8_t> result;
-    SafeVector<uint8_t> output(0, input.size());
-
     Deflater strm(level, windowBits, memLevel, strategy, type);
+    SafeVector<uint8_t> output(deflateBound(strm, input.size()));
+
     strm->next_in = input.data();
     strm->avail_in = input.size();
     strm->next_out = output.data();
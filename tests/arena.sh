@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: arena allocation of database objects"
+./arena check || exit 1
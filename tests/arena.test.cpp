@@ -0,0 +1,155 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace Kdbx;
+
+static Database::Version::Ptr newVersion(const std::string& title){
+    Database::Version::Ptr version(new Database::Version());
+    version->strings[Database::Version::titleString] = XorredBuffer(title.begin(), title.end());
+    return version;
+}
+
+// Builds a group with \p groups subgroups, each holding \p entries entries
+// with \p history versions.
+static Database::Group::Ptr newTree(std::size_t groups, std::size_t entries, std::size_t history){
+    Database::Group::Ptr root(new Database::Group());
+    for (std::size_t i = 0; i < groups; ++i){
+        root->addGroup(Database::Group::Ptr(new Database::Group()), root->groups());
+        Database::Group* group = root->group(i);
+        for (std::size_t j = 0; j < entries; ++j){
+            group->addEntry(Database::Entry::Ptr(new Database::Entry(newVersion("0"))), group->entries());
+            Database::Entry* entry = group->entry(j);
+            for (std::size_t k = 1; k < history; ++k)
+                entry->addVersion(newVersion(std::to_string(k)), entry->versions());
+        }
+    }
+    return root;
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    Database::Entry::Ptr outlived;
+    Database::Group::Ptr other;
+    {
+        Arena arena(4096);
+        Arena::Scope scope(&arena);
+        Database::Version::Ptr a = newVersion("a");
+        Database::Version::Ptr b = newVersion("b");
+        expect(arena.chunks() == 1, "objects are placed in a chunk");
+        expect(std::uintptr_t(a.get()) % alignof(std::max_align_t) == 0
+               && std::uintptr_t(b.get()) % alignof(std::max_align_t) == 0, "objects are aligned");
+        expect(reinterpret_cast<char*>(b.get()) > reinterpret_cast<char*>(a.get())
+               && reinterpret_cast<char*>(b.get()) < reinterpret_cast<char*>(a.get()) + 1024,
+               "objects are placed next to each other");
+
+        Database::Group::Ptr tree = newTree(4, 10, 3);
+        expect(arena.chunks() > 1, "arena allocates new chunks");
+
+        {
+            Arena::Scope heap(nullptr);
+            std::size_t chunks = arena.chunks();
+            other = newTree(1, 10, 1);
+            expect(arena.chunks() == chunks, "nested scope without an arena");
+        }
+
+        outlived = tree->group(0)->takeEntry(std::size_t(0));
+        b.reset();
+        void* large = Arena::allocate(2000);
+        expect(arena.chunks() == 2 || arena.chunks() > 2, "large allocations");
+        Arena::deallocate(large);
+    }
+
+    expect(outlived->latest()->strings.find(Database::Version::titleString)->second.plainString() == "2",
+           "objects outlive their arena");
+    std::thread([&outlived](){
+        outlived.reset();
+    }).join();
+    expect(!outlived, "objects are destroyed in another thread");
+    expect(other->group(0)->entries() == 10, "objects allocated on the heap");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Measures building and destroying a large tree with and without an arena.
+static int measure(const char* name, Arena* arena, std::size_t entries){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    Clock::time_point start = Clock::now();
+    Database::Group::Ptr tree;
+    {
+        Arena::Scope scope(arena);
+        tree = newTree(entries / 100, 100, 10);
+    }
+    Clock::duration build = Clock::now() - start;
+
+    start = Clock::now();
+    tree.reset();
+    Clock::duration destroy = Clock::now() - start;
+
+    std::cout << name << ": building " << ms(build) << " ms, destroying " << ms(destroy) << " ms" << std::endl;
+    return 0;
+}
+
+static int benchmark(std::size_t entries){
+    // First tree makes the process map all memory that is needed, so that
+    // later measurements don't depend on order.
+    newTree(entries / 100, 100, 10);
+    Arena arena;
+    return measure("Heap", nullptr, entries)
+            | measure("Arena", &arena, entries)
+            | measure("Heap", nullptr, entries);
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Checks placing database objects in an Arena, or measures building and\n"
+    "destroying a tree of entries with 10 versions each, with and without an\n"
+    "arena (100000 entries by default).\n"
+    << std::endl;
+    return 2;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: compressed attachments"
+./binaries check || exit 1
@@ -0,0 +1,241 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "../include/libkeepass2pp/wrappers.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static Database::Binary::Hash sha256(const SafeVector<uint8_t>& data){
+    Database::Binary::Hash result;
+    OSSL::Digest::oneShot(EVP_sha256(), result, data);
+    return result;
+}
+
+static SafeVector<uint8_t> pattern(std::size_t size, std::size_t seed){
+    SafeVector<uint8_t> result(size);
+    for (std::size_t i = 0; i < size; ++i)
+        result[i] = uint8_t('a' + (i * 7 + seed) % 26);
+    return result;
+}
+
+// Returns an unencrypted and uncompressed file in which each of \p attachments
+// is attached to its own entry.
+static std::string newFile(const std::vector<SafeVector<uint8_t>>& attachments){
+    Database database;
+    Database::File::Settings& settings = database.settings().fileSettings;
+    settings.encrypt = false;
+    settings.compress = false;
+    settings.crsAlgorithm = RandomStream::Algorithm::Null;
+    Database::Group* root = database.root();
+    for (const SafeVector<uint8_t>& attachment: attachments){
+        Database::Version::Ptr version(new Database::Version());
+        version->binaries["file"] = std::make_shared<Database::Binary>(attachment);
+        root->addEntry(Database::Entry::Ptr(new Database::Entry(std::move(version))), root->entries());
+    }
+    return save(database);
+}
+
+// Stores attachments in Meta/Binaries of a file gzip-compressed, as KeePass
+// does. Each compressed stream is passed to \p edit first.
+static std::string compressBinaries(const std::string& data, std::function<void(std::vector<uint8_t>&)> edit = nullptr){
+    std::pair<std::string, std::string> file = splitFile(data);
+    const std::string& document = file.second;
+    std::string result;
+    std::size_t at = 0;
+    std::size_t end = document.find("</Binaries>");
+    for (std::size_t begin; (begin = document.find("<Binary ID=\"", at)) < end;){
+        std::size_t close = document.find('>', begin);
+        std::size_t contentEnd = document.find('<', close);
+        std::vector<uint8_t> compressed = Zlib::Deflater::oneShot(decodeBase64(document.substr(close + 1, contentEnd - close - 1)),
+                                                                  Z_DEFAULT_COMPRESSION, MAX_WBITS | 16);
+        if (edit)
+            edit(compressed);
+        result.append(document, at, close - at);
+        result += " Compressed=\"True\">" + encodeBase64(compressed);
+        at = contentEnd;
+    }
+    result.append(document, at, std::string::npos);
+    return joinFile(file.first, result);
+}
+
+static const Database::Binary::Ptr& attachment(const Database& database, std::size_t entry){
+    return database.root()->entry(entry)->latest()->binaries.at("file");
+}
+
+static void addAttachment(Database& database, Database::Binary::Ptr binary){
+    Database::Version::Ptr version(new Database::Version());
+    version->binaries["file"] = std::move(binary);
+    Database::Group* root = database.root();
+    root->addEntry(Database::Entry::Ptr(new Database::Entry(std::move(version))), root->entries());
+}
+
+// Stores the attachment of the first entry also in place of attachments of
+// all other entries, as separate but identical compressed streams.
+static std::string duplicateBinaries(const std::string& data, bool damaged){
+    std::vector<uint8_t> first;
+    return compressBinaries(data, [&first, damaged](std::vector<uint8_t>& compressed){
+        if (first.empty()){
+            if (damaged)
+                compressed[compressed.size() - 8] ^= 0xff;
+            first = compressed;
+        }
+        compressed = first;
+    });
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    auto throws = [](std::function<void()> f){
+        try{
+            f();
+        }catch(std::exception&){
+            return true;
+        }
+        return false;
+    };
+
+    std::vector<SafeVector<uint8_t>> contents = {pattern(100000, 0), pattern(10, 1), SafeVector<uint8_t>{'x'}};
+    std::string data = compressBinaries(newFile(contents));
+    Database::Ptr database = open(data).getDatabase(CompositeKey()).get();
+
+    for (std::size_t i = 0; i < contents.size(); ++i){
+        std::string suffix = " (attachment " + std::to_string(i) + ")";
+        const Database::Binary::Ptr& binary = attachment(*database, i);
+        expect(binary->compressed() != nullptr, "attachment is loaded compressed" + suffix);
+        if (!binary->compressed())
+            continue;
+        SafeVector<uint8_t> eager = Zlib::Inflater::oneShot(*binary->compressed(), MAX_WBITS | 16);
+        expect(eager == contents[i], "compressed stream holds attachment" + suffix);
+        // Half of the attachments are hashed before they are decompressed.
+        if (i % 2)
+            expect(binary->hash() == sha256(eager), "hash of compressed attachment" + suffix);
+        expect(binary->data() == eager, "decompressed attachment" + suffix);
+        expect(binary->hash() == sha256(binary->data()) && binary->size() == contents[i].size(), "hash agrees with data" + suffix);
+    }
+
+    // Attachments with damaged streams are loaded, since they are not
+    // decompressed, and only fail once they are accessed.
+    std::string damaged = compressBinaries(newFile(contents), [](std::vector<uint8_t>& compressed){
+        compressed[compressed.size() - 8] ^= 0xff;
+    });
+    expect(!throws([&](){ database = open(damaged).getDatabase(CompositeKey()).get(); }), "damaged attachments are not decompressed on load");
+    expect(throws([&](){ attachment(*database, 0)->data(); }), "damaged attachment is reported on access");
+    expect(!throws([&](){ addAttachment(*database, std::make_shared<Database::Binary>(contents[0])); }),
+           "inserting an attachment doesn't decompress pooled ones");
+
+    // Identical compressed streams are pooled without decompressing them.
+    for (bool damaged: {false, true}){
+        std::string suffix = damaged ? " (damaged)" : "";
+        database = open(duplicateBinaries(newFile({contents[0], contents[1], contents[2]}), damaged)).getDatabase(CompositeKey()).get();
+        expect(attachment(*database, 0) == attachment(*database, 1) && attachment(*database, 0) == attachment(*database, 2),
+               "identical attachments share one Binary after load" + suffix);
+    }
+
+    database = open(data).getDatabase(CompositeKey()).get();
+    const SafeVector<uint8_t> compressed = *attachment(*database, 0)->compressed();
+    addAttachment(*database, Database::Binary::fromCompressed(compressed));
+    addAttachment(*database, std::make_shared<Database::Binary>(contents[1]));
+    addAttachment(*database, std::make_shared<Database::Binary>(contents[1]));
+    addAttachment(*database, std::make_shared<Database::Binary>(contents[0]));
+    expect(attachment(*database, 3) == attachment(*database, 0), "identical compressed attachments share one Binary after insert");
+    expect(attachment(*database, 4) == attachment(*database, 5), "identical attachments share one Binary after insert");
+    expect(attachment(*database, 6)->compressed() == nullptr && attachment(*database, 6)->hash() == attachment(*database, 0)->hash(),
+           "uncompressed copy of a compressed attachment is inserted as is");
+
+    std::string saved = save(*database);
+    std::string document = splitFile(saved).second;
+    std::size_t written = 0;
+    for (std::size_t at = 0; (at = document.find("<Binary ID=", at)) != std::string::npos; ++at)
+        ++written;
+    expect(written == contents.size(), "identical attachments are saved once");
+    database = open(saved).getDatabase(CompositeKey()).get();
+    expect(attachment(*database, 0) == attachment(*database, 3) && attachment(*database, 0) == attachment(*database, 6)
+           && attachment(*database, 1) == attachment(*database, 4) && attachment(*database, 1) == attachment(*database, 5),
+           "identical attachments share one Binary after save");
+    expect(attachment(*database, 6)->data() == contents[0], "attachment saved once keeps its contents");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares loading a file with many compressed attachments and reading all
+// of them.
+static int benchmark(std::size_t count, std::size_t size){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    std::vector<SafeVector<uint8_t>> contents;
+    for (std::size_t i = 0; i < count; ++i)
+        contents.push_back(pattern(size, i));
+    std::string data = compressBinaries(newFile(contents));
+
+    Clock::time_point start = Clock::now();
+    Database::Ptr database = open(data).getDatabase(CompositeKey()).get();
+    std::cout << "Loading " << count << " attachments of " << size << " bytes: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    start = Clock::now();
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < count; ++i)
+        total += attachment(*database, i)->size();
+    std::cout << "Decompressing them: " << ms(Clock::now() - start) << " ms" << std::endl;
+    return total != count * size;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check")
+            return check();
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000,
+                             argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [count] [size]\n"
+    "\n"
+    "Checks that compressed attachments are decompressed only when accessed\n"
+    "and that identical attachments are pooled, or measures loading a file with many compressed attachments and reading\n"
+    "them (1000 attachments of 100000 bytes by default).\n"
+    << std::endl;
+    return 2;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: positions of groups, entries and versions"
+./childindex check || exit 1
@@ -0,0 +1,171 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace Kdbx;
+
+static Database::Entry::Ptr newEntry(){
+    return Database::Entry::Ptr(new Database::Entry(Database::Version::Ptr(new Database::Version())));
+}
+
+// Compares stored positions with positions found by scanning.
+static bool consistent(const Database::Group* group){
+    for (size_t i = 0; i < group->groups(); ++i){
+        if (group->group(i)->index() != i || group->index(group->group(i)) != i)
+            return false;
+        if (!consistent(group->group(i)))
+            return false;
+    }
+    for (size_t i = 0; i < group->entries(); ++i){
+        const Database::Entry* entry = group->entry(i);
+        if (entry->index() != i || group->index(entry) != i)
+            return false;
+        for (size_t v = 0; v < entry->versions(); ++v){
+            if (entry->version(v)->index() != v || entry->index(entry->version(v)) != v)
+                return false;
+        }
+    }
+    return true;
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    std::mt19937 random(1);
+    auto pick = [&random](size_t size){
+        return std::uniform_int_distribution<size_t>(0, size - 1)(random);
+    };
+
+    Database database;
+    Database::Group* root = database.root();
+    for (int i = 0; i < 4; ++i)
+        root->addGroup(Database::Group::Ptr(new Database::Group()), root->groups());
+
+    for (int i = 0; i < 2000; ++i){
+        Database::Group* group = root->group(pick(root->groups()));
+        Database::Group* other = root->group(pick(root->groups()));
+        switch (pick(6)){
+        case 0:
+        case 1:
+            group->addEntry(newEntry(), pick(group->entries() + 1));
+            break;
+        case 2:
+            if (group->entries())
+                group->removeEntry(pick(group->entries()));
+            break;
+        case 3:
+            if (group->entries()){
+                size_t index = pick(group->entries());
+                size_t newIndex = pick(other->entries() + 1);
+                if (group != other || (newIndex != index && newIndex != index + 1))
+                    group->moveEntry(index, other, newIndex);
+            }
+            break;
+        case 4:
+            if (group->entries()){
+                Database::Entry* entry = group->entry(pick(group->entries()));
+                entry->addVersion(Database::Version::Ptr(new Database::Version()), pick(entry->versions() + 1));
+            }
+            break;
+        case 5:
+            if (group->entries()){
+                Database::Entry* entry = group->entry(pick(group->entries()));
+                if (entry->versions() > 1)
+                    entry->removeVersion(pick(entry->versions()));
+            }
+            break;
+        }
+    }
+    expect(consistent(root), "positions after random entry operations");
+
+    Database::Group::Ptr copy(new Database::Group(*root->group(0)));
+    root->addGroup(std::move(copy), 1);
+    expect(consistent(root), "positions in a copied group");
+
+    root->moveGroup(0, root, root->groups());
+    root->moveGroup(0, root->group(1), 0);
+    root->removeGroup(root->groups() - 1);
+    expect(consistent(root), "positions after group operations");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Measures operations typical for tree models on a single group with many
+// entries.
+static int benchmark(size_t count){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    Database database;
+    Database::Group* group = database.root();
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < count; ++i)
+        group->addEntry(newEntry(), group->entries());
+    std::cout << "Appending " << count << " entries: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    start = Clock::now();
+    size_t sum = 0;
+    for (size_t i = 0; i < count; ++i)
+        sum += group->entry(i)->index();
+    std::cout << "index() of every entry: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    start = Clock::now();
+    for (size_t i = 0; i < 1000; ++i){
+        group->moveEntry(0, group, group->entries());
+        sum += group->entry(group->entries() - 1)->index();
+    }
+    std::cout << "1000 moves from front to back: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    return sum == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Checks positions of groups, entries and versions reported by index()\n"
+    "methods, or measures tree operations on a group with many entries\n"
+    "(50000 by default).\n"
+    << std::endl;
+    return 2;
+}
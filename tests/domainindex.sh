@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: URL lookups through SearchableModel"
+./domainindex check || exit 1
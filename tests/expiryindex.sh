@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: expiry queries through SearchableModel"
+./expiryindex check || exit 1
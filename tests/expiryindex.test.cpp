@@ -0,0 +1,208 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/search.h"
+#include "searchmodel.h"
+#include "testutil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+typedef std::vector<std::pair<std::time_t, const Database::Entry*>> Expiries;
+
+// Reference implementation: scans all entries of the database.
+static void bruteForce(const Database::Group* group, Expiries& result){
+    for (size_t i = 0; i < group->entries(); ++i){
+        const Database::Version* version = group->entry(i)->latest();
+        if (version->times.expires)
+            result.emplace_back(version->times.expiry, group->entry(i));
+    }
+    for (size_t i = 0; i < group->groups(); ++i)
+        bruteForce(group->group(i), result);
+}
+
+// Pairs entries with their expiry times, so that entries expiring at the
+// same time can be compared regardless of their order.
+static Expiries sorted(const ExpiryIndex::Entries& entries, bool& ordered){
+    Expiries result;
+    for (const Database::Entry* entry: entries)
+        result.emplace_back(entry->latest()->times.expiry, entry);
+    ordered = std::is_sorted(result.begin(), result.end(), [](const Expiries::value_type& a, const Expiries::value_type& b){
+        return a.first < b.first;
+    });
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    std::mt19937 random(1);
+    auto pick = [&random](size_t size){
+        return std::uniform_int_distribution<size_t>(0, size - 1)(random);
+    };
+    auto newVersion = [&](){
+        Database::Version::Ptr version(new Database::Version());
+        version->times.expires = pick(2);
+        version->times.expiry = std::time_t(pick(100));
+        return version;
+    };
+
+    SearchModel model;
+    DatabaseModel::Group root = model.root();
+    for (int i = 0; i < 4; ++i)
+        root.addGroup(Database::Group::Ptr(new Database::Group()), root.groups());
+
+    auto compare = [&](const std::string& message){
+        Expiries all;
+        bruteForce(model.root(), all);
+        std::sort(all.begin(), all.end());
+        const ExpiryIndex& index = model.expiryIndex();
+
+        expect(index.size() == all.size(), message + ": number of entries");
+        expect(index.nextExpiry() == (all.empty() ? std::numeric_limits<std::time_t>::max() : all.front().first),
+               message + ": next expiry time");
+        expect(all.empty() ? !index.nextExpiring() : index.nextExpiring()->latest()->times.expiry == all.front().first,
+               message + ": next expiring entry");
+
+        for (std::time_t time: {0, 1, 50, 99, 100}){
+            Expiries expected;
+            std::copy_if(all.begin(), all.end(), std::back_inserter(expected), [time](const Expiries::value_type& item){
+                return item.first < time;
+            });
+            bool ordered;
+            expect(sorted(model.expiringBefore(time), ordered) == expected && ordered,
+                   message + ": expiring before " + std::to_string(time));
+
+            expected.clear();
+            std::copy_if(all.begin(), all.end(), std::back_inserter(expected), [time](const Expiries::value_type& item){
+                return item.first >= 10 && item.first < time;
+            });
+            expect(sorted(index.expiringBetween(10, time), ordered) == expected && ordered,
+                   message + ": expiring between 10 and " + std::to_string(time));
+        }
+    };
+
+    for (int i = 0; i < 200; ++i){
+        DatabaseModel::Group group = root.group(pick(root.groups()));
+        group.addEntry(Database::Entry::Ptr(new Database::Entry(newVersion())), group.entries());
+    }
+    compare("initial index");
+
+    for (int i = 0; i < 1000; ++i){
+        DatabaseModel::Group group = root.group(pick(root.groups()));
+        switch (pick(4)){
+        case 0:
+            group.addEntry(Database::Entry::Ptr(new Database::Entry(newVersion())), pick(group.entries() + 1));
+            break;
+        case 1:
+            if (group.entries())
+                group.removeEntry(pick(group.entries()));
+            break;
+        case 2:
+            if (group.entries()){
+                DatabaseModel::Entry entry = group.entry(pick(group.entries()));
+                entry.addVersion(newVersion(), pick(2) ? entry.versions() : 0);
+            }
+            break;
+        case 3:
+            if (group.entries()){
+                DatabaseModel::Entry entry = group.entry(pick(group.entries()));
+                if (entry.versions() > 1)
+                    entry.removeVersion(entry.versions() - 1);
+            }
+            break;
+        }
+    }
+    compare("incremental updates");
+
+    root.group(0).remove();
+    compare("removed group");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Measures expiry queries on a database with many entries.
+static int benchmark(size_t count){
+    typedef std::chrono::steady_clock Clock;
+    auto us = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    };
+
+    std::mt19937 random(1);
+    SearchModel model;
+    DatabaseModel::Group group = model.root();
+    for (size_t i = 0; i < count; ++i){
+        Database::Version::Ptr version(new Database::Version());
+        version->times.expires = i % 2;
+        version->times.expiry = std::time_t(std::uniform_int_distribution<long>(0, 365 * 86400)(random));
+        group.addEntry(Database::Entry::Ptr(new Database::Entry(std::move(version))), group.entries());
+    }
+
+    Clock::time_point start = Clock::now();
+    model.expiryIndex();
+    std::cout << "Indexing " << count << " entries: " << us(Clock::now() - start) / 1000 << " ms" << std::endl;
+
+    const int repeat = 1000;
+    size_t found = 0;
+    start = Clock::now();
+    for (int i = 0; i < repeat; ++i)
+        found += model.expiringBefore(std::time_t(86400)).size();
+    std::cout << "Entries expiring on the first day: " << double(us(Clock::now() - start)) / repeat << " us" << std::endl;
+
+    start = Clock::now();
+    for (int i = 0; i < repeat; ++i)
+        found += model.expiryIndex().nextExpiry() != 0;
+    std::cout << "Next expiry time: " << double(us(Clock::now() - start)) / repeat << " us" << std::endl;
+
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Compares results of ExpiryIndex queries with a scan of all entries, or\n"
+    "measures expiry queries on a database with many entries (200000 by\n"
+    "default).\n"
+    << std::endl;
+    return 2;
+}
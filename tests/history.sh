@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: sharing fields between versions"
+./history check || exit 1
@@ -0,0 +1,165 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <malloc.h>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static std::string value(const XorredBuffer& buffer){
+    return buffer.plainString().c_str();
+}
+
+static bool shared(const XorredBuffer& a, const XorredBuffer& b){
+    return &a.buffer() == &b.buffer();
+}
+
+static Database::Version::Ptr newVersion(const std::string& title, uint8_t mask){
+    Database::Version::Ptr version(new Database::Version());
+    version->strings[Database::Version::titleString] = plain(title);
+    version->strings[Database::Version::userNameString] = plain("user");
+    version->strings[Database::Version::passwordString] = protect("secret password", mask);
+    version->strings[Database::Version::urlString] = plain("https://www.example.com/login");
+    version->strings[Database::Version::notesString] = plain(std::string(200, 'n'));
+    return version;
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    expect(protect("abc", 0x11) == protect("abc", 0x22) && protect("abc", 0x11) == plain("abc"),
+           "buffers with equal plain contents are equal");
+    expect(protect("abc", 0x11) != protect("abd", 0x11) && plain("abc") != plain("ab") && plain("") == XorredBuffer(),
+           "buffers with different plain contents differ");
+
+    Database::Version::Ptr version = newVersion("title", 0x5a);
+    Database::Version copy(*version);
+    const XorredBuffer& password = version->strings[Database::Version::passwordString];
+    expect(shared(copy.strings[Database::Version::passwordString], password)
+           && shared(copy.strings[Database::Version::notesString], version->strings[Database::Version::notesString]),
+           "copies share field contents");
+
+    copy.strings[Database::Version::titleString] = plain("changed");
+    expect(value(version->strings[Database::Version::titleString]) == "title", "assigning to a copy");
+
+    XorredBuffer rexored(password);
+    rexored.reXor(SafeVector<uint8_t>(rexored.size(), 0x33));
+    expect(value(rexored) == "secret password" && rexored.mask()[0] == 0x33, "rexoring a copy");
+    expect(value(password) == "secret password" && password.mask()[0] == 0x5a, "rexoring a copy keeps the original");
+
+    XorredBuffer unique(protect("unique", 0x01));
+    const uint8_t* data = unique.buffer().data();
+    unique.reXor(SafeVector<uint8_t>(unique.size(), 0x02));
+    expect(value(unique) == "unique" && unique.buffer().data() == data, "rexoring a buffer that is not shared");
+
+    Database::Version::Ptr other = newVersion("other title", 0x77);
+    other->strings["Custom"] = plain("custom");
+    other->share(*version);
+    expect(shared(other->strings[Database::Version::passwordString], password)
+           && shared(other->strings[Database::Version::urlString], version->strings[Database::Version::urlString]),
+           "equal fields are shared");
+    expect(!shared(other->strings[Database::Version::titleString], version->strings[Database::Version::titleString])
+           && value(other->strings[Database::Version::titleString]) == "other title"
+           && value(other->strings["Custom"]) == "custom",
+           "different fields are kept");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+static std::size_t allocated(){
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks;
+}
+
+enum class Method{
+    Separate,
+    Share,
+    Copy
+};
+
+// Measures memory used by entries with many history versions, whose versions
+// are either created separately (as when a database is deserialized), made
+// to share unchanged fields, or copied from the latest version.
+static int measure(const char* name, std::size_t count, std::size_t history, Method method){
+    typedef std::chrono::steady_clock Clock;
+
+    std::size_t before = allocated();
+    Clock::time_point start = Clock::now();
+    std::vector<Database::Entry::Ptr> entries;
+    for (std::size_t i = 0; i < count; ++i){
+        Database::Entry::Ptr entry(new Database::Entry(newVersion("title 0", i)));
+        for (std::size_t j = 1; j < history; ++j){
+            std::string title = "title " + std::to_string(j);
+            Database::Version::Ptr version;
+            if (method == Method::Copy){
+                version.reset(new Database::Version(*entry->latest()));
+                version->strings[Database::Version::titleString] = plain(title);
+            }else{
+                version = newVersion(title, i + j);
+                if (method == Method::Share)
+                    version->share(*entry->latest());
+            }
+            entry->addVersion(std::move(version), entry->versions());
+        }
+        entries.push_back(std::move(entry));
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    std::size_t memory = allocated() - before;
+
+    std::cout << name << ": " << memory / count << " bytes per entry, "
+              << double(us) / count << " us per entry" << std::endl;
+    return entries.empty();
+}
+
+static int benchmark(std::size_t count){
+    return measure("Separate versions", count, 30, Method::Separate)
+            | measure("Shared fields", count, 30, Method::Share)
+            | measure("Copied versions", count, 30, Method::Copy);
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Checks sharing of string fields between versions, or measures memory\n"
+    "used by entries with 30 history versions (10000 entries by default).\n"
+    << std::endl;
+    return 2;
+}
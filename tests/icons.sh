@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: custom icons"
+./icons check || exit 1
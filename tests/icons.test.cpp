@@ -0,0 +1,143 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace Kdbx;
+
+static CustomIcon::Ptr newIcon(const std::string& contents){
+    return std::make_shared<const CustomIcon>(Uuid::generate(), std::vector<uint8_t>(contents.begin(), contents.end()));
+}
+
+static Database::Entry::Ptr newEntry(const Icon& icon){
+    Database::Version::Ptr version(new Database::Version());
+    version->icon = icon;
+    return Database::Entry::Ptr(new Database::Entry(std::move(version)));
+}
+
+// Saves \p database and loads it back.
+static Database::Ptr reload(const Database& database){
+    std::unique_ptr<std::ostream> saved = database.saveToFile(std::unique_ptr<std::ostream>(new std::stringstream()));
+    std::unique_ptr<std::istream> file(static_cast<std::stringstream*>(saved.release()));
+    file->seekg(0);
+    return Database::loadFromStream(std::move(file)).getDatabase(CompositeKey()).get();
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    CustomIcons icons;
+    CustomIcon::Ptr a = newIcon("png a");
+    CustomIcon::Ptr b = newIcon("png a");
+    CustomIcon::Ptr c = newIcon("png c");
+    expect(icons.insert(a) == std::make_pair(std::size_t(0), true) && icons.insert(b).second && icons.insert(c).second,
+           "inserting icons");
+    expect(icons.insert(std::make_shared<const CustomIcon>(a->uuid(), *c)) == std::make_pair(std::size_t(0), false),
+           "icons with the same UUID are inserted once");
+    expect(icons.size() == 3 && icons.index(b->uuid()) == 1 && icons.index(c->uuid()) == 2 && icons.index(Uuid::generate()) == -1,
+           "finding icons by UUID");
+    expect(icons[1].first->sharesData(*a) && icons[1].first->uuid() == b->uuid() && !icons[2].first->sharesData(*a),
+           "icons with the same contents share data");
+    icons.erase(0);
+    expect(icons.size() == 2 && icons.index(a->uuid()) == -1 && icons.index(b->uuid()) == 0 && icons.index(c->uuid()) == 1,
+           "erasing an icon");
+
+    Database::init();
+    Database database;
+    Database::Group* root = database.root();
+    Icon used = database.addIcon(a);
+    database.addIcon(b);
+    Icon unused = database.addIcon(c);
+    root->addEntry(newEntry(used), 0);
+    root->addEntry(newEntry(used), 1);
+    expect(!database.removeIcon(used), "icons that are referenced are not removed");
+    root->removeEntry(std::size_t(0));
+    expect(!database.removeIcon(used), "icons that are still referenced are not removed");
+    root->removeEntry(std::size_t(0));
+    expect(database.removeIcon(used) && database.icons() == 2, "icons that are not referenced are removed");
+
+    root->addEntry(newEntry(unused), 0);
+    Database::Ptr loaded = reload(database);
+    expect(loaded->icons() == 2 && loaded->icon(b->uuid()) && loaded->icon(c->uuid()), "icons are loaded");
+    expect(loaded->root()->entry(0)->latest()->icon.custom() == loaded->icon(c->uuid()), "entries reference loaded icons");
+    expect(!loaded->removeIcon(loaded->icon(c->uuid())), "loaded icons are referenced");
+    expect(loaded->removeIcon(loaded->icon(b->uuid())), "loaded icons that are not referenced are removed");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Measures loading a database with many custom icons and entries that
+// reference them.
+static int benchmark(std::size_t iconCount, std::size_t entryCount){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    Database::init();
+    Database database;
+    std::vector<Icon> icons;
+    for (std::size_t i = 0; i < iconCount; ++i)
+        icons.push_back(database.addIcon(newIcon("png " + std::to_string(i % (iconCount / 2 + 1)))));
+    for (std::size_t i = 0; i < entryCount; ++i)
+        database.root()->addEntry(newEntry(icons[i % icons.size()]), i);
+
+    Clock::time_point start = Clock::now();
+    Database::Ptr loaded = reload(database);
+    std::cout << "Saving and loading " << iconCount << " icons and " << entryCount << " entries: "
+              << ms(Clock::now() - start) << " ms" << std::endl;
+
+    std::size_t shared = 0;
+    for (std::size_t i = 1; i < loaded->icons(); ++i)
+        shared += loaded->icon(i)->sharesData(*loaded->icon(i - iconCount / 2 - 1 < i ? i - iconCount / 2 - 1 : 0));
+    std::cout << "Icons sharing data: " << shared << std::endl;
+    return loaded->icons() != iconCount;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5000,
+                         argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 50000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [icons] [entries]\n"
+    "\n"
+    "Checks the registry of custom icons, or measures saving and loading a\n"
+    "database with many custom icons (5000 icons, half of them duplicates,\n"
+    "and 50000 entries by default).\n"
+    << std::endl;
+    return 2;
+}
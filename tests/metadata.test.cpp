@@ -0,0 +1,167 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+// Builds a database with \p icons custom icons, an attachment and \p entries
+// entries.
+static Database::Ptr newDatabase(std::size_t icons, std::size_t entries){
+    Database::Ptr database(new Database(passwordKey("secret")));
+    database->settings().setName("Vault");
+    database->settings().setDescription("Vault & <description>");
+    database->settings().setDefaultUsername("user");
+    database->settings().recycleBinEnabled = true;
+
+    std::vector<Icon> customIcons;
+    for (std::size_t i = 0; i < icons; ++i)
+        customIcons.push_back(database->addIcon(std::make_shared<const CustomIcon>(Uuid::generate(), std::vector<uint8_t>(i + 1, uint8_t(i)))));
+    Database::Binary::Ptr attachment = std::make_shared<Database::Binary>(SafeVector<uint8_t>(1000, 'a'));
+
+    Database::Group* root = database->root();
+    root->addGroup(Database::Group::Ptr(new Database::Group()), 0);
+    database->setRecycleBin(root->group(0));
+    for (std::size_t i = 0; i < entries; ++i){
+        Database::Version::Ptr version(new Database::Version());
+        version->strings[Database::Version::titleString] = XorredBuffer(SafeVector<uint8_t>(20, 't'));
+        version->binaries["file.txt"] = attachment;
+        if (!customIcons.empty())
+            version->icon = customIcons[i % customIcons.size()];
+        root->addEntry(Database::Entry::Ptr(new Database::Entry(std::move(version))), root->entries());
+    }
+    return database;
+}
+
+static int check(const char* fileName, const std::string& password, const char* keyFileName){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    Database::Ptr database = newDatabase(3, 50);
+    std::string data = save(*database);
+
+    Database::File::Metadata metadata = open(data).getMetadata(passwordKey("secret")).get();
+    expect(metadata.name == "Vault" && metadata.description == "Vault & <description>" && metadata.defaultUsername == "user",
+           "names");
+    expect(metadata.recycleBinEnabled && metadata.recycleBin == database->recycleBin()->uuid(), "recycle bin");
+    expect(metadata.customIconCount == 3 && metadata.customIcons.empty(), "skipped custom icons are counted");
+
+    metadata = open(data).getMetadata(passwordKey("secret"), 0).get();
+    expect(metadata.customIconCount == 3 && metadata.customIcons.size() == 3, "custom icons are decoded");
+    bool sameIcons = metadata.customIcons.size() == database->icons();
+    for (std::size_t i = 0; sameIcons && i < metadata.customIcons.size(); ++i)
+        sameIcons = metadata.customIcons[i]->uuid() == database->icon(i)->uuid() && metadata.customIcons[i]->data() == database->icon(i)->data();
+    expect(sameIcons, "decoded custom icons");
+
+    // Reading stops after Meta element, so damage further in the file goes
+    // unnoticed. The file has to be much larger than the amount of data
+    // that pipeline links buffer.
+    std::string truncated = save(*newDatabase(3, 20000));
+    truncated.resize(truncated.size() / 2);
+    expect(open(truncated).getMetadata(passwordKey("secret")).get().name == "Vault", "truncated file");
+
+    bool thrown = false;
+    try{
+        open(data).getMetadata(passwordKey("wrong")).get();
+    }catch(std::exception&){
+        thrown = true;
+    }
+    expect(thrown, "wrong key is reported");
+
+    auto makeKey = [&](){
+        CompositeKey key;
+        key.addKey(CompositeKey::Key::fromPassword(password.c_str()));
+        key.addKey(CompositeKey::Key::fromFile(keyFileName));
+        return key;
+    };
+    Database::Ptr test = Database::loadFromFile(fileName).getDatabase(makeKey()).get();
+    metadata = Database::loadFromFile(fileName).getMetadata(makeKey(), 0).get();
+    expect(metadata.name == test->settings().name() && metadata.description == test->settings().description()
+           && metadata.customIconCount == test->icons()
+           && metadata.recycleBin == (test->recycleBin() ? test->recycleBin()->uuid() : Uuid::nil()),
+           "metadata of test database");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares time of a complete load and of reading metadata only.
+static int benchmark(std::size_t entries){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    std::string data = save(*newDatabase(100, entries));
+    std::cout << "Database of " << entries << " entries, " << data.size() / 1024 << " kB" << std::endl;
+
+    std::size_t found = 0;
+    for (int i = 0; i < 3; ++i){
+        Clock::time_point start = Clock::now();
+        found += open(data).getDatabase(passwordKey("secret")).get()->icons();
+        std::cout << "Complete load: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+        start = Clock::now();
+        found += open(data).getMetadata(passwordKey("secret")).get().customIconCount;
+        std::cout << "Metadata: " << ms(Clock::now() - start) << " ms" << std::endl;
+    }
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check" && argc == 5){
+            std::ifstream passFile(argv[3]);
+            std::string password;
+            std::getline(passFile, password);
+            return check(argv[2], password, argv[4]);
+        }
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check <database> <password file> <key file>\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Checks metadata read without loading groups and entries, or compares\n"
+    "time of reading metadata with a complete load of a database (100000\n"
+    "entries by default).\n"
+    << std::endl;
+    return 2;
+}
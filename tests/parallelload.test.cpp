@@ -0,0 +1,148 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static int check(const char* fileName, const std::string& password, const char* keyFileName){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    struct Case{
+        const char* name;
+        RandomStream::Algorithm algorithm;
+        std::size_t groups;
+    } cases[] = {
+        {"Salsa20", RandomStream::Algorithm::Salsa20, 5},
+        {"Null", RandomStream::Algorithm::Null, 5},
+        {"ArcFourVariant", RandomStream::Algorithm::ArcFourVariant, 5},
+        {"one group", RandomStream::Algorithm::Salsa20, 1},
+        {"no groups", RandomStream::Algorithm::Salsa20, 0}
+    };
+
+    for (const Case& c: cases){
+        Database::Ptr database = newSampleDatabase(c.groups, 20, 3);
+        database->settings().fileSettings.crsAlgorithm = c.algorithm;
+        database->setRecycleBin(c.groups ? database->root()->group(c.groups - 1) : nullptr);
+        std::string data = save(*database);
+
+        std::string expected = describe(*open(data).getDatabase(CompositeKey()).get());
+        expect(expected == describe(*database), std::string(c.name) + ": serial load");
+        for (unsigned threads: {1, 3, 0}){
+            expect(describe(*open(data).getDatabaseParallel(CompositeKey(), threads).get()) == expected,
+                   std::string(c.name) + ": parallel load on " + std::to_string(threads) + " threads");
+        }
+    }
+
+    std::string truncated = save(*newSampleDatabase(5, 20, 3));
+    truncated.resize(truncated.size() / 2);
+    bool thrown = false;
+    try{
+        open(truncated).getDatabaseParallel().get();
+    }catch(std::exception&){
+        thrown = true;
+    }
+    expect(thrown, "errors are reported");
+
+    auto makeKey = [&](){
+        CompositeKey key;
+        key.addKey(CompositeKey::Key::fromPassword(password.c_str()));
+        key.addKey(CompositeKey::Key::fromFile(keyFileName));
+        return key;
+    };
+    Database::Ptr serial = Database::loadFromFile(fileName).getDatabase(makeKey()).get();
+    Database::Ptr parallel = Database::loadFromFile(fileName).getDatabaseParallel(makeKey(), 2).get();
+    expect(describe(*parallel) == describe(*serial), "parallel load of test database");
+    expect(parallel->compositeKey().getCompositeKey({}, 1) == serial->compositeKey().getCompositeKey({}, 1),
+           "composite key of test database");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares serial and parallel load time of a database with many top-level
+// groups.
+static int benchmark(std::size_t groups, std::size_t entries){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    std::string data = save(*newSampleDatabase(groups, entries / groups / 2, 3));
+    std::cout << "Database of " << groups << " groups and " << entries << " entries, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    std::size_t found = 0;
+    for (int i = 0; i < 3; ++i){
+        Clock::time_point start = Clock::now();
+        found += open(data).getDatabase(CompositeKey()).get()->root()->groups();
+        std::cout << "Serial load: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+        start = Clock::now();
+        found += open(data).getDatabaseParallel(CompositeKey()).get()->root()->groups();
+        std::cout << "Parallel load: " << ms(Clock::now() - start) << " ms" << std::endl;
+    }
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check" && argc == 5){
+            std::ifstream passFile(argv[3]);
+            std::string password;
+            std::getline(passFile, password);
+            return check(argv[2], password, argv[4]);
+        }
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 16,
+                             argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check <database> <password file> <key file>\n"
+    "       " << argv[0] << " benchmark [groups] [entries]\n"
+    "\n"
+    "Compares databases loaded by a single thread and by several threads, or\n"
+    "measures both ways of loading a database with many top-level groups\n"
+    "(16 groups and 100000 entries by default).\n"
+    << std::endl;
+    return 2;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: parallel save of databases"
+./parallelsave check || exit 1
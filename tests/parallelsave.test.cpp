@@ -0,0 +1,157 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static std::string save(const Database& database, unsigned threads){
+    std::unique_ptr<std::ostream> file(new std::stringstream());
+    if (threads == unsigned(-1))
+        file = database.saveToFile(std::move(file));
+    else
+        file = database.saveToFileParallel(std::move(file), threads);
+    return static_cast<std::stringstream*>(file.get())->str();
+}
+
+// Returns the XML document of an unencrypted and uncompressed file that fits
+// in a single hashed block, without the header hash, which depends on
+// random salts.
+static std::string document(const std::string& data){
+    std::size_t begin = data.find("<?xml");
+    std::size_t end = data.find("</KeePassFile>");
+    if (begin == std::string::npos || end == std::string::npos)
+        return std::string();
+    std::string result = data.substr(begin, end - begin);
+    std::size_t hash = result.find("<HeaderHash>");
+    std::size_t hashEnd = result.find("</HeaderHash>");
+    if (hash != std::string::npos && hashEnd != std::string::npos)
+        result.erase(hash, hashEnd - hash);
+    return result;
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    const unsigned serial = unsigned(-1);
+
+    struct Case{
+        const char* name;
+        RandomStream::Algorithm algorithm;
+        std::size_t groups;
+    } cases[] = {
+        {"Salsa20", RandomStream::Algorithm::Salsa20, 5},
+        {"Null", RandomStream::Algorithm::Null, 5},
+        {"ArcFourVariant", RandomStream::Algorithm::ArcFourVariant, 5},
+        {"one group", RandomStream::Algorithm::Salsa20, 1},
+        {"no groups", RandomStream::Algorithm::Salsa20, 0}
+    };
+
+    for (const Case& c: cases){
+        Database::Ptr database = newSampleDatabase(c.groups, 20, 3);
+        database->settings().fileSettings.crsAlgorithm = c.algorithm;
+        database->setRecycleBin(c.groups ? database->root()->group(c.groups - 1) : nullptr);
+        std::string expected = describe(*database);
+
+        for (unsigned threads: {serial, 1u, 3u, 0u}){
+            std::string name = std::string(c.name) + (threads == serial ? ": serial save" : ": parallel save on " + std::to_string(threads) + " threads");
+            expect(describe(*open(save(*database, threads)).getDatabase(CompositeKey()).get()) == expected, name);
+        }
+    }
+
+    // Without encryption and with Null random stream, serialized documents
+    // can be compared byte for byte.
+    Database::Ptr database = newSampleDatabase(7, 30, 2);
+    Database::File::Settings& settings = database->settings().fileSettings;
+    settings.crsAlgorithm = RandomStream::Algorithm::Null;
+    settings.encrypt = false;
+    settings.compress = false;
+    std::string expected = document(save(*database, serial));
+    expect(!expected.empty(), "unencrypted document");
+    for (unsigned threads: {1u, 2u, 4u})
+        expect(document(save(*database, threads)) == expected, "same document on " + std::to_string(threads) + " threads");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares serial and parallel save time of a database with many top-level
+// groups.
+static int benchmark(std::size_t groups, std::size_t entries){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    Database::Ptr database = newSampleDatabase(groups, entries / groups / 2, 3);
+    std::cout << "Database of " << groups << " groups and " << entries << " entries, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    std::size_t size = 0;
+    for (int i = 0; i < 3; ++i){
+        Clock::time_point start = Clock::now();
+        size += save(*database, unsigned(-1)).size();
+        std::cout << "Serial save: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+        start = Clock::now();
+        size += save(*database, 0).size();
+        std::cout << "Parallel save: " << ms(Clock::now() - start) << " ms" << std::endl;
+    }
+    return size == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check")
+            return check();
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 16,
+                             argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [groups] [entries]\n"
+    "\n"
+    "Compares databases saved by a single thread and by several threads, or\n"
+    "measures both ways of saving a database with many top-level groups\n"
+    "(16 groups and 100000 entries by default).\n"
+    << std::endl;
+    return 2;
+}
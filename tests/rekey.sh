@@ -0,0 +1,6 @@
+#!/bin/bash
+
+srcdir=$(dirname $0)
+
+echo "Test #1: changing composite key of a file"
+./rekey check "$srcdir/../tests/TestDatabase.kdbx" "$srcdir/../tests/TestDatabase.pass" "$srcdir/../tests/TestDatabase.key" || exit 1
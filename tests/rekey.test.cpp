@@ -0,0 +1,232 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "../include/libkeepass2pp/wrappers.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+// Builds a database with \p entries entries with protected passwords.
+static Database::Ptr newDatabase(std::size_t entries, bool compress){
+    Database::Ptr database(new Database(passwordKey("old")));
+    database->settings().setName("Vault");
+    database->settings().fileSettings.compress = compress;
+    database->settings().fileSettings.transformRounds = 1000;
+    Database::Group* root = database->root();
+    for (std::size_t i = 0; i < entries; ++i){
+        Database::Version::Ptr version(new Database::Version());
+        version->strings[Database::Version::titleString] = XorredBuffer(SafeVector<uint8_t>(20, 't'));
+        version->strings[Database::Version::passwordString] = protect("password " + std::to_string(i));
+        root->addEntry(Database::Entry::Ptr(new Database::Entry(std::move(version))), root->entries());
+    }
+    return database;
+}
+
+static std::string rekey(const std::string& data, CompositeKey oldKey, const CompositeKey& newKey, uint64_t transformRounds){
+    std::unique_ptr<std::ostream> saved = open(data).rekey(std::move(oldKey), newKey, transformRounds,
+                                                           std::unique_ptr<std::ostream>(new std::stringstream())).get();
+    return static_cast<std::stringstream*>(saved.get())->str();
+}
+
+static std::string password(const Database::Entry* entry){
+    return entry->latest()->strings.find(Database::Version::passwordString)->second.plainString().c_str();
+}
+
+// Decrypts an uncompressed file and returns the value of HeaderHash element,
+// along with the hash of the header that was actually written.
+static std::pair<std::string, std::string> headerHashes(const std::string& data, const CompositeKey& key){
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+    std::array<uint8_t, 32> masterSeed, transformSeed;
+    std::array<uint8_t, 16> iv;
+    uint64_t rounds = 0;
+    std::size_t at = 12;
+    while (true){
+        uint8_t id = bytes[at];
+        std::size_t size = bytes[at + 1] | (bytes[at + 2] << 8);
+        const uint8_t* field = bytes + at + 3;
+        at += 3 + size;
+        if (id == 0)
+            break;
+        if (id == 4)
+            std::copy_n(field, 32, masterSeed.begin());
+        if (id == 5)
+            std::copy_n(field, 32, transformSeed.begin());
+        if (id == 6)
+            for (int i = 7; i >= 0; --i)
+                rounds = rounds << 8 | field[i];
+        if (id == 7)
+            std::copy_n(field, 16, iv.begin());
+    }
+
+    std::array<uint8_t, 32> headerHash;
+    OSSL::Digest header(EVP_sha256());
+    header.update(bytes, at);
+    header.final(headerHash.data());
+
+    SafeVector<uint8_t> cipherKey(32);
+    OSSL::Digest keyHash(EVP_sha256());
+    keyHash.update(masterSeed);
+    keyHash.update(key.getCompositeKey(transformSeed, rounds));
+    keyHash.final(cipherKey.data());
+    OSSL::EvpCipher cipher(EVP_aes_256_cbc(), nullptr, cipherKey.data(), iv.data(), 0);
+    std::vector<uint8_t> payload(bytes + at, bytes + data.size());
+    std::vector<uint8_t> plain(payload.size() + 32);
+    std::size_t size = cipher.update(plain.data(), payload.data(), payload.size());
+    size += cipher.final(plain.data() + size);
+
+    // Skip stream start bytes and header of the first hashed block.
+    std::string xml(plain.begin() + 72, plain.begin() + size);
+    std::size_t start = xml.find("<HeaderHash>");
+    if (start == std::string::npos)
+        return std::make_pair(std::string(), encodeBase64(headerHash.data(), headerHash.size()));
+    start += 12;
+    return std::make_pair(xml.substr(start, xml.find('<', start) - start), encodeBase64(headerHash.data(), headerHash.size()));
+}
+
+static int check(const char* fileName, const std::string& testPassword, const char* keyFileName){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    auto throws = [](std::function<void()> f){
+        try{
+            f();
+        }catch(std::exception&){
+            return true;
+        }
+        return false;
+    };
+
+    for (bool compress: {false, true}){
+        std::string suffix = compress ? " (compressed)" : " (uncompressed)";
+        std::string data = save(*newDatabase(100, compress));
+        std::string rekeyed = rekey(data, passwordKey("old"), passwordKey("new"), 1234);
+
+        expect(throws([&](){ open(rekeyed).getDatabase(passwordKey("old")).get(); }), "old key is rejected" + suffix);
+        Database::Ptr database = open(rekeyed).getDatabase(passwordKey("new")).get();
+        const Database::File::Settings& settings = database->settings().fileSettings;
+        expect(settings.transformRounds == 1234 && settings.compress == compress, "settings of rekeyed file" + suffix);
+        bool same = database->settings().name() == "Vault" && database->root()->entries() == 100;
+        for (std::size_t i = 0; same && i < database->root()->entries(); ++i)
+            same = password(database->root()->entry(i)) == "password " + std::to_string(i);
+        expect(same, "protected values are kept" + suffix);
+        expect(open(rekey(rekeyed, passwordKey("new"), passwordKey("newer"), 1000)).getDatabase(passwordKey("newer")).get()->root()->entries() == 100,
+               "rekeyed file can be rekeyed again" + suffix);
+        expect(throws([&](){ rekey(data, passwordKey("wrong"), passwordKey("new"), 1000); }), "wrong key is reported" + suffix);
+
+        Database::File file = open(data);
+        std::stringbuf written;
+        expect(throws([&](){ file.rekey(passwordKey("wrong"), passwordKey("new"), 1000, std::unique_ptr<std::ostream>(new std::ostream(&written))); })
+               && written.str().empty(), "nothing is written with a wrong key" + suffix);
+        expect(file.valid(), "file stays valid after a wrong key" + suffix);
+        file.rekey(passwordKey("old"), passwordKey("new"), 1000, std::unique_ptr<std::ostream>(new std::ostream(&written))).get();
+        expect(open(written.str()).getDatabase(passwordKey("new")).get()->root()->entries() == 100,
+               "file is rekeyed after a wrong key was tried" + suffix);
+
+        if (!compress){
+            std::pair<std::string, std::string> hashes = headerHashes(rekeyed, passwordKey("new"));
+            expect(hashes.first.size() == 44 && hashes.first == hashes.second, "header hash is updated");
+        }
+    }
+
+    auto makeKey = [&](){
+        CompositeKey key;
+        key.addKey(CompositeKey::Key::fromPassword(testPassword.c_str()));
+        key.addKey(CompositeKey::Key::fromFile(keyFileName));
+        return key;
+    };
+    std::ifstream testFile(fileName, std::ios::binary);
+    std::string test((std::istreambuf_iterator<char>(testFile)), std::istreambuf_iterator<char>());
+    Database::Ptr expected = open(test).getDatabase(makeKey()).get();
+    Database::Ptr database = open(rekey(test, makeKey(), passwordKey("new"), 1000)).getDatabase(passwordKey("new")).get();
+    expect(database->settings().name() == expected->settings().name() && database->root()->entries() == expected->root()->entries()
+           && database->root()->groups() == expected->root()->groups(), "test database is rekeyed");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares time of changing the key by loading and saving a database, and by
+// rekeying the file.
+static int benchmark(std::size_t entries){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    std::size_t found = 0;
+    for (bool compress: {true, false}){
+        std::string data = save(*newDatabase(entries, compress));
+        std::cout << "Database with " << entries << " entries, " << (compress ? "compressed" : "uncompressed")
+                  << ", " << data.size() / 1024 << " KiB" << std::endl;
+
+        Clock::time_point start = Clock::now();
+        Database::Ptr database = open(data).getDatabase(passwordKey("old")).get();
+        database->setCompositeKey(passwordKey("new"));
+        found += save(*database).size();
+        database.reset();
+        std::cout << "Load and save: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+        start = Clock::now();
+        found += rekey(data, passwordKey("old"), passwordKey("new"), 1000).size();
+        std::cout << "Rekey: " << ms(Clock::now() - start) << " ms" << std::endl;
+    }
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check" && argc == 5){
+            std::ifstream passFile(argv[3]);
+            std::string password;
+            std::getline(passFile, password);
+            return check(argv[2], password, argv[4]);
+        }
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50000);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check <database> <password file> <key file>\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Checks databases encrypted with a new composite key without being\n"
+    "deserialized, or compares time of changing the key this way and by\n"
+    "loading and saving a database (50000 entries by default).\n"
+    << std::endl;
+    return 2;
+}
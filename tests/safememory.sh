@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: pool of locked memory for sensitive data"
+./safememory check || exit 1
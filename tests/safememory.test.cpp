@@ -0,0 +1,200 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/platform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace Kdbx;
+
+static bool zeroed(const void* ptr, std::size_t size){
+    const uint8_t* data = static_cast<const uint8_t*>(ptr);
+    return std::all_of(data, data + size, [](uint8_t c){ return c == 0; });
+}
+
+// Returns size of locked memory of the process, in kB.
+static long lockedMemory(){
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)){
+        if (line.compare(0, 6, "VmLck:") == 0)
+            return std::strtol(line.c_str() + 6, nullptr, 10);
+    }
+    return -1;
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    for (std::size_t size: {1, 15, 16, 17, 100, 2048, 2049, 10000}){
+        std::string name = std::to_string(size) + " bytes";
+        uint8_t* ptr = static_cast<uint8_t*>(SafeMemoryManager::allocate(size));
+        expect(std::uintptr_t(ptr) % alignof(std::max_align_t) == 0, name + ": alignment");
+        expect(zeroed(ptr, size), name + ": new memory is zeroed");
+        std::fill(ptr, ptr + size, 0xab);
+        SafeMemoryManager::deallocate(ptr, size);
+
+        uint8_t* again = static_cast<uint8_t*>(SafeMemoryManager::allocate(size));
+        if (size <= 2048)
+            expect(again == ptr, name + ": released block is reused");
+        expect(zeroed(again, size), name + ": reused memory is zeroed");
+        SafeMemoryManager::deallocate(again, size);
+    }
+
+    const uint32_t* data;
+    {
+        SafeVector<uint32_t> vector(100, 0xffffffff);
+        data = vector.data();
+    }
+    void* block = SafeMemoryManager::allocate(100 * sizeof(uint32_t));
+    expect(block == data && zeroed(block, 100 * sizeof(uint32_t)), "vectors of wider types are zeroed entirely");
+    SafeMemoryManager::deallocate(block, 100 * sizeof(uint32_t));
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY)
+        expect(lockedMemory() > 0, "pages are locked");
+
+    std::vector<std::thread> threads;
+    std::vector<std::vector<SafeVector<uint8_t>>> results(4);
+    bool corrupted = false;
+    for (std::size_t t = 0; t < results.size(); ++t){
+        threads.emplace_back([&results, &corrupted, t](){
+            std::mt19937 random(t);
+            std::vector<SafeVector<uint8_t>>& vectors = results[t];
+            for (int i = 0; i < 20000; ++i){
+                std::size_t size = std::uniform_int_distribution<std::size_t>(1, 3000)(random);
+                vectors.emplace_back(size, uint8_t(size));
+                if (i % 2)
+                    vectors.erase(vectors.begin() + std::uniform_int_distribution<std::size_t>(0, vectors.size() - 1)(random));
+            }
+            for (const SafeVector<uint8_t>& vector: vectors){
+                if (std::any_of(vector.begin(), vector.end(), [&vector](uint8_t c){ return c != uint8_t(vector.size()); }))
+                    corrupted = true;
+            }
+        });
+    }
+    for (std::thread& thread: threads)
+        thread.join();
+    expect(!corrupted, "concurrent allocations");
+    // Vectors allocated by finished threads are released here.
+    results.clear();
+
+    uint8_t* large = static_cast<uint8_t*>(SafeMemoryManager::allocate(10000));
+    pid_t child = fork();
+    if (child == 0){
+        large[sysconf(_SC_PAGESIZE) * 3] = 1;
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    expect(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV, "guard page after a large allocation");
+    SafeMemoryManager::deallocate(large, 10000);
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Baseline: what SafeMemoryManager used to do.
+struct Malloc{
+    static void* allocate(std::size_t size){
+        return malloc(size);
+    }
+
+    static void deallocate(void* ptr, std::size_t size){
+        SafeMemoryManager::zero(ptr, size);
+        free(ptr);
+    }
+};
+
+// Measures allocating and releasing blocks of random sizes up to \p maxSize
+// in \p threadCount threads.
+template <typename Manager>
+static double measure(std::size_t maxSize, std::size_t threadCount){
+    typedef std::chrono::steady_clock Clock;
+    const std::size_t count = 1000000;
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; ++t){
+        threads.emplace_back([maxSize, t, count](){
+            std::mt19937 random(t);
+            std::vector<std::pair<void*, std::size_t>> live(64);
+            for (std::size_t i = 0; i < count; ++i){
+                std::pair<void*, std::size_t>& slot = live[random() % live.size()];
+                if (slot.first)
+                    Manager::deallocate(slot.first, slot.second);
+                slot.second = 1 + random() % maxSize;
+                slot.first = Manager::allocate(slot.second);
+                static_cast<uint8_t*>(slot.first)[0] = 1;
+            }
+            for (std::pair<void*, std::size_t>& slot: live)
+                Manager::deallocate(slot.first, slot.second);
+        });
+    }
+    for (std::thread& thread: threads)
+        thread.join();
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()) / count;
+}
+
+static int benchmark(){
+    for (std::size_t maxSize: {64, 512, 2048}){
+        for (std::size_t threads: {1, 4}){
+            std::cout << "Blocks up to " << maxSize << " bytes, " << threads << " threads: SafeMemoryManager "
+                      << measure<SafeMemoryManager>(maxSize, threads) << " ns, malloc and zero "
+                      << measure<Malloc>(maxSize, threads) << " ns" << std::endl;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark();
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark\n"
+    "\n"
+    "Checks behaviour of SafeMemoryManager, or compares time of allocating\n"
+    "and releasing memory with malloc() and free().\n"
+    << std::endl;
+    return 2;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: searching entries through SearchableModel"
+./search check || exit 1
@@ -0,0 +1,248 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/search.h"
+#include "searchmodel.h"
+#include "testutil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static const char* const words[] = {
+    "Alpha", "bravo", "CHARLIE", "delta", "echo", "foxtrot", "golf", "Hotel",
+    "india", "juliett", "kilo", "lima", "mike", "november", "oscar", "papa"
+};
+
+static std::string lower(std::string text){
+    for (char& c: text)
+        c = (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+    return text;
+}
+
+// Reference implementation: scans all entries of the database.
+static void bruteForce(const Database::Group* group, bool enabled, const std::vector<std::string>& terms,
+                       std::vector<const Database::Entry*>& result){
+    enabled = enabled && group->properties().enableSearching;
+    for (size_t i = 0; enabled && i < group->entries(); ++i){
+        const Database::Version* version = group->entry(i)->latest();
+        std::vector<std::string> fields;
+        for (const char* name: {Database::Version::titleString, Database::Version::userNameString,
+                                Database::Version::urlString, Database::Version::notesString}){
+            auto it = version->strings.find(name);
+            if (it != version->strings.end() && !it->second.hasMask())
+                fields.push_back(lower(it->second.plainString().c_str()));
+        }
+        for (const std::string& tag: version->tags)
+            fields.push_back(lower(tag));
+        bool match = !terms.empty();
+        for (const std::string& term: terms){
+            match = match && std::any_of(fields.begin(), fields.end(), [&term](const std::string& field){
+                return field.find(lower(term)) != std::string::npos;
+            });
+        }
+        if (match)
+            result.push_back(group->entry(i));
+    }
+    for (size_t i = 0; i < group->groups(); ++i)
+        bruteForce(group->group(i), enabled, terms, result);
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    std::mt19937 random(1);
+    auto pick = [&random](size_t size){
+        return std::uniform_int_distribution<size_t>(0, size - 1)(random);
+    };
+    auto word = [&](){
+        return std::string(words[pick(sizeof(words) / sizeof(words[0]))]);
+    };
+    auto newVersion = [&](){
+        Database::Version::Ptr version(new Database::Version());
+        version->strings[Database::Version::titleString] = plain(word() + " " + word());
+        version->strings[Database::Version::userNameString] = plain(word());
+        version->strings[Database::Version::urlString] = plain("https://" + word() + ".example.com/");
+        version->strings[Database::Version::notesString] = pick(2) ? plain(word()) : protect(word());
+        version->strings[Database::Version::passwordString] = protect(word());
+        version->strings["Custom"] = plain(word());
+        if (pick(2))
+            version->tags.push_back(word());
+        return version;
+    };
+
+    SearchModel model;
+    DatabaseModel::Group root = model.root();
+    for (int i = 0; i < 4; ++i)
+        root.addGroup(Database::Group::Ptr(new Database::Group()), root.groups());
+
+    auto compare = [&](const std::string& message){
+        for (int i = 0; i < 20; ++i){
+            std::string query = word();
+            query = query.substr(pick(query.size() - 2));
+            if (pick(2))
+                query += " " + word().substr(0, 2);
+            std::vector<std::string> terms;
+            for (size_t pos = 0, next; pos < query.size(); pos = next + 1){
+                next = std::min(query.find(' ', pos), query.size());
+                terms.push_back(query.substr(pos, next - pos));
+            }
+            std::vector<const Database::Entry*> expected;
+            bruteForce(model.root(), true, terms, expected);
+            std::vector<const Database::Entry*> found = model.search(query);
+            std::sort(expected.begin(), expected.end());
+            std::sort(found.begin(), found.end());
+            expect(found == expected, message + ": query \"" + query + "\"");
+        }
+    };
+
+    for (int i = 0; i < 200; ++i){
+        DatabaseModel::Group group = root.group(pick(root.groups()));
+        group.addEntry(Database::Entry::Ptr(new Database::Entry(newVersion())), group.entries());
+    }
+    compare("initial index");
+
+    for (int i = 0; i < 1000; ++i){
+        DatabaseModel::Group group = root.group(pick(root.groups()));
+        switch (pick(5)){
+        case 0:
+            group.addEntry(Database::Entry::Ptr(new Database::Entry(newVersion())), pick(group.entries() + 1));
+            break;
+        case 1:
+            if (group.entries())
+                group.removeEntry(pick(group.entries()));
+            break;
+        case 2:
+            if (group.entries()){
+                DatabaseModel::Entry entry = group.entry(pick(group.entries()));
+                entry.addVersion(newVersion(), entry.versions());
+            }
+            break;
+        case 3:
+            if (group.entries()){
+                DatabaseModel::Entry entry = group.entry(pick(group.entries()));
+                if (entry.versions() > 1)
+                    entry.removeVersion(entry.versions() - 1);
+            }
+            break;
+        case 4:
+            if (pick(10) == 0){
+                Database::Group::Properties::Ptr properties(new Database::Group::Properties(group.properties()));
+                properties->enableSearching = !properties->enableSearching;
+                group.setProperties(std::move(properties));
+            }
+            break;
+        }
+    }
+    compare("incremental updates");
+
+    DatabaseModel::Group child = root.group(0).addGroup(Database::Group::Ptr(new Database::Group()), 0);
+    Database::Version::Ptr version(new Database::Version());
+    version->strings[Database::Version::titleString] = plain("Zulu");
+    version->strings[Database::Version::notesString] = protect("Whiskey");
+    child.addEntry(Database::Entry::Ptr(new Database::Entry(std::move(version))), 0);
+
+    bool enabled = root.group(0).properties().enableSearching;
+    expect(model.search("zul").size() == (enabled ? 1 : 0), "entry added to a new group");
+    expect(model.search("whiskey").empty(), "protected field is not indexed");
+
+    root.group(0).remove();
+    expect(model.search("zulu").empty(), "entries of a removed group");
+    compare("removed group");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Measures searching a database with many entries.
+static int benchmark(size_t count){
+    typedef std::chrono::steady_clock Clock;
+    auto us = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    };
+
+    std::mt19937 random(1);
+    auto word = [&random](){
+        return std::string(words[std::uniform_int_distribution<size_t>(0, sizeof(words) / sizeof(words[0]) - 1)(random)]);
+    };
+
+    SearchModel model;
+    DatabaseModel::Group group = model.root();
+    for (size_t i = 0; i < count; ++i){
+        std::string number = std::to_string(i);
+        Database::Version::Ptr version(new Database::Version());
+        version->strings[Database::Version::titleString] = plain(word() + " account " + number);
+        version->strings[Database::Version::userNameString] = plain(word() + "." + word());
+        version->strings[Database::Version::urlString] = plain("https://" + word() + number + ".example.com/login");
+        version->strings[Database::Version::notesString] = plain(word() + " " + word() + " " + word());
+        version->strings[Database::Version::passwordString] = protect(number);
+        group.addEntry(Database::Entry::Ptr(new Database::Entry(std::move(version))), group.entries());
+    }
+
+    Clock::time_point start = Clock::now();
+    model.searchIndex();
+    std::cout << "Indexing " << count << " entries: " << us(Clock::now() - start) / 1000 << " ms" << std::endl;
+
+    const char* queries[] = {"account 123456", "ALPHA7777", "foxtrot.golf 99", "zzz"};
+    size_t found = 0;
+    for (const char* query: queries){
+        const int repeat = 1000;
+        start = Clock::now();
+        for (int i = 0; i < repeat; ++i)
+            found += model.search(query).size();
+        std::cout << "Search \"" << query << "\": " << double(us(Clock::now() - start)) / repeat << " us" << std::endl;
+    }
+
+    start = Clock::now();
+    for (size_t i = 0; i < 1000; ++i)
+        group.entry(i).addVersion(Database::Version::Ptr(new Database::Version(*group.entry(i)->latest())), 1);
+    std::cout << "1000 index updates: " << us(Clock::now() - start) / 1000 << " ms" << std::endl;
+
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Compares results of SearchableModel::search() with a scan of all\n"
+    "entries, or measures searching a database with many entries\n"
+    "(200000 by default).\n"
+    << std::endl;
+    return 2;
+}
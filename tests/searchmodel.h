@@ -0,0 +1,46 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SEARCHMODEL_H
+#define SEARCHMODEL_H
+
+#include "../include/libkeepass2pp/search.h"
+
+namespace TestUtil{
+
+// Database model owning an empty database, for tests of the indexes kept by
+// SearchableModel.
+class Model: public Kdbx::DatabaseModel{
+private:
+    Kdbx::Database::Ptr fdatabase;
+
+protected:
+    Kdbx::Database* getDatabase() const noexcept override{
+        return fdatabase.get();
+    }
+
+public:
+    Model()
+        :fdatabase(new Kdbx::Database())
+    {}
+};
+
+typedef Kdbx::SearchableModel<Model> SearchModel;
+
+}
+
+#endif // SEARCHMODEL_H
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: random access to random streams"
+./seekstream check || exit 1
@@ -0,0 +1,175 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/cryptorandom.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace Kdbx;
+
+static SafeVector<uint8_t> key(const std::string& text){
+    return SafeVector<uint8_t>(text.begin(), text.end());
+}
+
+static SafeVector<uint8_t> slice(const SafeVector<uint8_t>& data, std::size_t offset, std::size_t size){
+    return SafeVector<uint8_t>(data.begin() + offset, data.begin() + offset + size);
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    std::mt19937 random(1);
+    auto pick = [&random](std::size_t size){
+        return std::uniform_int_distribution<std::size_t>(0, size - 1)(random);
+    };
+
+    const std::size_t size = 4096;
+    for (RandomStream::Algorithm algorithm: {RandomStream::Algorithm::Salsa20, RandomStream::Algorithm::Null}){
+        std::string name = algorithm == RandomStream::Algorithm::Salsa20 ? "Salsa20" : "Null";
+        SafeVector<uint8_t> expected = RandomStream::randomStream(algorithm, key("seek"))->read(size);
+        RandomStream::Ptr stream = RandomStream::randomStream(algorithm, key("seek"));
+        expect(stream->seekable() && stream->position() == 0, name + ": initial position");
+
+        for (int i = 0; i < 500; ++i){
+            std::size_t offset = pick(size);
+            std::size_t length = pick(std::min<std::size_t>(size - offset, 200) + 1);
+            if (i % 5 == 0)
+                offset -= offset % 64;
+
+            std::size_t before = stream->position();
+            expect(stream->keystreamAt(offset, length) == slice(expected, offset, length) && stream->position() == before,
+                   name + ": keystream at " + std::to_string(offset));
+
+            stream->seek(offset);
+            expect(stream->position() == offset, name + ": position after seek to " + std::to_string(offset));
+            SafeVector<uint8_t> data(length);
+            if (i % 2){
+                stream->readRaw(data.data(), data.data() + length);
+            }else{
+                data = stream->read(length);
+            }
+            expect(data == slice(expected, offset, length) && stream->position() == offset + length,
+                   name + ": read after seek to " + std::to_string(offset));
+        }
+
+        expect(stream->keystreamAt(uint64_t(1) << 40, 100).size() == 100, name + ": keystream at large offset");
+        stream->seek(uint64_t(1) << 40);
+        expect(stream->position() == uint64_t(1) << 40, name + ": seek to large offset");
+    }
+
+    SafeVector<uint8_t> expected = RandomStream::randomStream(RandomStream::Algorithm::ArcFourVariant, key("seek"))->read(size);
+    RandomStream::Ptr stream = RandomStream::randomStream(RandomStream::Algorithm::ArcFourVariant, key("seek"));
+    expect(!stream->seekable() && stream->position() == 0, "ArcFourVariant: initial position");
+    stream->read(100);
+    stream->seek(1000);
+    expect(stream->position() == 1000 && stream->read(100) == slice(expected, 1000, 100), "ArcFourVariant: seek forward");
+    bool thrown = false;
+    try{
+        stream->seek(10);
+    }catch(std::runtime_error&){
+        thrown = true;
+    }
+    expect(thrown && stream->position() == 1100, "ArcFourVariant: seek backwards");
+    thrown = false;
+    try{
+        stream->keystreamAt(0, 10);
+    }catch(std::runtime_error&){
+        thrown = true;
+    }
+    expect(thrown, "ArcFourVariant: keystream at an offset");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares unmasking protected values in document order, with a sequential
+// stream, and in random order, with keystreamAt().
+static int benchmark(std::size_t count){
+    typedef std::chrono::steady_clock Clock;
+    auto us = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    };
+
+    std::mt19937 random(1);
+    std::vector<std::pair<uint64_t, std::size_t>> values;
+    uint64_t offset = 0;
+    for (std::size_t i = 0; i < count; ++i){
+        std::size_t size = std::uniform_int_distribution<std::size_t>(8, 40)(random);
+        values.emplace_back(offset, size);
+        offset += size;
+    }
+
+    RandomStream::Ptr stream = RandomStream::randomStream(RandomStream::Algorithm::Salsa20, key("benchmark"));
+    std::vector<uint8_t> data(64);
+    unsigned int sum = 0;
+
+    Clock::time_point start = Clock::now();
+    for (const auto& value: values){
+        stream->readRaw(data.data(), data.data() + value.second);
+        sum += data[0];
+    }
+    std::cout << "Sequential: " << double(us(Clock::now() - start)) * 1000 / count << " ns per value" << std::endl;
+
+    std::shuffle(values.begin(), values.end(), random);
+    start = Clock::now();
+    for (const auto& value: values){
+        stream->keystreamAtRaw(value.first, data.data(), data.data() + value.second);
+        sum += data[0];
+    }
+    std::cout << "Random access: " << double(us(Clock::now() - start)) * 1000 / count << " ns per value" << std::endl;
+
+    start = Clock::now();
+    for (const auto& value: values){
+        stream->seek(value.first);
+        stream->readRaw(data.data(), data.data() + value.second);
+        sum += data[0];
+    }
+    std::cout << "Seek and read: " << double(us(Clock::now() - start)) * 1000 / count << " ns per value" << std::endl;
+
+    return sum == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [values]\n"
+    "\n"
+    "Compares seek() and keystreamAt() of random streams with sequential\n"
+    "reads, or measures unmasking protected values in random order\n"
+    "(1000000 values by default).\n"
+    << std::endl;
+    return 2;
+}
@@ -0,0 +1,356 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "../include/libkeepass2pp/wrappers.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <openssl/hmac.h>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static Database::Version::Ptr newVersion(std::size_t i, const Database::Binary::Ptr& binary){
+    Database::Version::Ptr version(new Database::Version());
+    version->strings[Database::Version::titleString] = XorredBuffer(SafeVector<uint8_t>(20, 't'));
+    version->strings[Database::Version::passwordString] = protect("password " + std::to_string(i));
+    version->tags = {Database::Tag("work"), Database::Tag("tag" + std::to_string(i % 10))};
+    version->times.expires = i % 2;
+    version->times.expiry = std::time_t(i);
+    version->autoType.items.push_back(Database::Version::AutoType::Association{"window", "{PASSWORD}"});
+    if (binary)
+        version->binaries["attachment"] = binary;
+    return version;
+}
+
+// Builds a database with \p entries entries spread over a few groups. Every
+// tenth entry has a history version and an attachment shared with others.
+static Database::Ptr newDatabase(std::size_t entries){
+    Database::Ptr database(new Database(passwordKey("password")));
+    database->settings().setName("Vault");
+    database->settings().setDescription("Snapshot test");
+    database->settings().fileSettings.transformRounds = 1000;
+    Database::Binary::Ptr binary = std::make_shared<Database::Binary>(SafeVector<uint8_t>(1000, 'b'));
+    Database::Group* root = database->root();
+    for (int i = 0; i < 4; ++i){
+        Database::Group::Ptr group(new Database::Group());
+        group->properties().name = "Group " + std::to_string(i);
+        root->addGroup(std::move(group), root->groups());
+    }
+    root->group(0)->addGroup(Database::Group::Ptr(new Database::Group()), 0);
+    root->group(1)->properties().icon = std::make_shared<const CustomIcon>(Uuid::generate(), std::vector<uint8_t>(100, 'i'));
+    database->setRecycleBin(root->group(3));
+
+    for (std::size_t i = 0; i < entries; ++i){
+        Database::Group* group = root->group(i % 3);
+        bool history = i % 10 == 0;
+        Database::Entry::Ptr entry(new Database::Entry(newVersion(i, history ? binary : nullptr)));
+        if (history)
+            entry->addVersion(newVersion(i + 1, binary), 1);
+        group->addEntry(std::move(entry), group->entries());
+    }
+    return database;
+}
+
+static std::string saveSnapshot(const Database& database, const Database::Fingerprint& fingerprint, const SafeVector<uint8_t>& transformedKey){
+    std::ostringstream result;
+    database.saveSnapshot(result, fingerprint, transformedKey);
+    return result.str();
+}
+
+static Database::Ptr loadSnapshot(const std::string& data, const Database::Fingerprint& fingerprint, CompositeKey key,
+                                  const SafeVector<uint8_t>& transformedKey){
+    std::istringstream file(data);
+    return Database::loadSnapshot(file, fingerprint, std::move(key), transformedKey);
+}
+
+static SafeVector<uint8_t> snapshotKey(const SafeVector<uint8_t>& transformedKey, const Database::Fingerprint& fingerprint, const char* purpose){
+    SafeVector<uint8_t> result(32);
+    OSSL::Digest d(EVP_sha256());
+    d.update(transformedKey);
+    d.update(fingerprint);
+    d.update(purpose, std::strlen(purpose));
+    d.final(result);
+    return result;
+}
+
+// Encrypts and authenticates the first half of the image of a snapshot again,
+// which gives a snapshot that passes all checks but can't be decoded.
+static std::string truncateImage(std::string snapshot, const Database::Fingerprint& fingerprint, const SafeVector<uint8_t>& transformedKey){
+    const std::size_t header = 8 + 4 + 32 + 16;
+    const std::size_t macSize = 32;
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(&snapshot[0]);
+    const uint8_t* iv = bytes + header - 16;
+    SafeVector<uint8_t> key = snapshotKey(transformedKey, fingerprint, "snapshot encryption");
+
+    OSSL::EvpCipher decrypt(EVP_aes_256_cbc(), nullptr, key.data(), iv, 0);
+    SafeVector<uint8_t> image(snapshot.size() - header - macSize + decrypt.block_size());
+    std::size_t size = decrypt.update(image.data(), bytes + header, int(snapshot.size() - header - macSize));
+    size += decrypt.final(image.data() + size);
+    image.resize(size / 2);
+
+    OSSL::EvpCipher encrypt(EVP_aes_256_cbc(), nullptr, key.data(), iv, 1);
+    std::vector<uint8_t> result(bytes, bytes + header);
+    result.resize(header + image.size() + encrypt.block_size());
+    size = header + encrypt.update(result.data() + header, image.data(), int(image.size()));
+    size += encrypt.final(result.data() + size);
+    result.resize(size);
+
+    SafeVector<uint8_t> macKey = snapshotKey(transformedKey, fingerprint, "snapshot authentication");
+    std::array<uint8_t, macSize> mac;
+    unsigned int written = 0;
+    HMAC(EVP_sha256(), macKey.data(), int(macKey.size()), result.data(), result.size(), mac.data(), &written);
+    result.insert(result.end(), mac.begin(), mac.end());
+    return std::string(result.begin(), result.end());
+}
+
+static Database::Fingerprint fingerprint(const std::string& data){
+    std::istringstream file(data);
+    return Database::fingerprint(file);
+}
+
+static bool sameTimes(const Times& a, const Times& b){
+    return a.creation == b.creation && a.lastModification == b.lastModification && a.lastAccess == b.lastAccess
+            && a.expiry == b.expiry && a.expires == b.expires && a.usageCount == b.usageCount
+            && a.locationChanged == b.locationChanged;
+}
+
+static bool sameVersion(const Database::Version* a, const Database::Version* b){
+    if (a->icon != b->icon || a->fgColor != b->fgColor || a->bgColor != b->bgColor || a->overrideUrl != b->overrideUrl
+            || a->tags != b->tags || !sameTimes(a->times, b->times) || a->strings.size() != b->strings.size()
+            || a->binaries.size() != b->binaries.size() || a->autoType.defaultSequence != b->autoType.defaultSequence
+            || a->autoType.items.size() != b->autoType.items.size() || a->autoType.enabled != b->autoType.enabled
+            || a->autoType.obfuscationOptions != b->autoType.obfuscationOptions)
+        return false;
+    for (auto i = a->strings.begin(), j = b->strings.begin(); i != a->strings.end(); ++i, ++j){
+        if (i->first != j->first || i->second != j->second || i->second.hasMask() != j->second.hasMask())
+            return false;
+    }
+    for (auto i = a->binaries.begin(), j = b->binaries.begin(); i != a->binaries.end(); ++i, ++j){
+        if (i->first != j->first || i->second->data() != j->second->data())
+            return false;
+    }
+    for (std::size_t i = 0; i < a->autoType.items.size(); ++i){
+        if (a->autoType.items[i].window != b->autoType.items[i].window
+                || a->autoType.items[i].sequence != b->autoType.items[i].sequence)
+            return false;
+    }
+    return true;
+}
+
+static bool sameGroup(const Database::Group* a, const Database::Group* b){
+    const Database::Group::Properties& p = a->properties();
+    const Database::Group::Properties& q = b->properties();
+    if (a->uuid() != b->uuid() || p.name != q.name || p.notes != q.notes || p.icon != q.icon || !sameTimes(p.times, q.times)
+            || p.isExpanded != q.isExpanded || a->groups() != b->groups() || a->entries() != b->entries())
+        return false;
+    for (std::size_t i = 0; i < a->groups(); ++i){
+        if (!sameGroup(a->group(i), b->group(i)) || b->group(i)->parent() != b || b->group(i)->index() != i)
+            return false;
+    }
+    for (std::size_t i = 0; i < a->entries(); ++i){
+        const Database::Entry* e = a->entry(i);
+        const Database::Entry* f = b->entry(i);
+        if (e->uuid() != f->uuid() || e->versions() != f->versions() || f->parent() != b || f->index() != i)
+            return false;
+        for (std::size_t j = 0; j < e->versions(); ++j){
+            if (!sameVersion(e->version(j), f->version(j)) || f->version(j)->parent() != f)
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool sameDatabase(const Database& a, const Database& b){
+    const Database::Settings& s = a.settings();
+    const Database::Settings& t = b.settings();
+    return s.name() == t.name() && s.description() == t.description() && s.defaultUsername() == t.defaultUsername()
+            && s.fileSettings.compress == t.fileSettings.compress && s.fileSettings.transformRounds == t.fileSettings.transformRounds
+            && s.memoryProtection == t.memoryProtection && s.historyMaxItems == t.historyMaxItems
+            && (a.recycleBin() ? b.recycleBin() && a.recycleBin()->uuid() == b.recycleBin()->uuid() : !b.recycleBin())
+            && sameGroup(a.root(), b.root());
+}
+
+static std::string readFile(const std::string& filename){
+    std::ifstream file(filename, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& filename, const std::string& data){
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file << data;
+}
+
+static int check(const char* fileName, const std::string& testPassword, const char* keyFileName){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    auto throws = [](std::function<void()> f){
+        try{
+            f();
+        }catch(std::exception&){
+            return true;
+        }
+        return false;
+    };
+
+    Database::Ptr database = newDatabase(100);
+    std::string data = save(*database);
+    Database::Fingerprint print = fingerprint(data);
+    SafeVector<uint8_t> transformedKey = open(data).verifyKey(passwordKey("password"));
+    database = open(data).getDatabase(passwordKey("password")).get();
+    std::string snapshot = saveSnapshot(*database, print, transformedKey);
+
+    Database::Ptr loaded = loadSnapshot(snapshot, print, passwordKey("password"), transformedKey);
+    expect(loaded && sameDatabase(*database, *loaded), "snapshot keeps the database");
+    if (loaded){
+        const Database::Group* group = loaded->root()->group(0);
+        expect(group->entry(0)->version(0)->binaries.at("attachment") == group->entry(0)->version(1)->binaries.at("attachment")
+               && group->entry(0)->version(0)->binaries.at("attachment") == loaded->root()->group(1)->entry(3)->latest()->binaries.at("attachment"),
+               "attachments are shared");
+        expect(loaded->entry(group->entry(5)->uuid()) == group->entry(5) && loaded->group(group->uuid()) == group,
+               "UUID index is built");
+        expect(save(*loaded).size() > 0 && open(save(*loaded)).getDatabase(passwordKey("password")).get()->root()->groups() == 4,
+               "database loaded from snapshot can be saved");
+    }
+
+    Database::Fingerprint other = print;
+    other[0] ^= 1;
+    expect(!loadSnapshot(snapshot, other, passwordKey("password"), transformedKey), "snapshot of another file is rejected");
+    expect(!loadSnapshot(snapshot, print, passwordKey("other"), SafeVector<uint8_t>(transformedKey.size(), 1)),
+           "snapshot with another key is rejected");
+    std::string tampered = snapshot;
+    tampered[tampered.size() / 2] ^= 1;
+    expect(!loadSnapshot(tampered, print, passwordKey("password"), transformedKey), "tampered snapshot is rejected");
+    expect(!loadSnapshot(snapshot.substr(0, snapshot.size() - 1), print, passwordKey("password"), transformedKey),
+           "truncated snapshot is rejected");
+    expect(!loadSnapshot(std::string(), print, passwordKey("password"), transformedKey), "empty snapshot is rejected");
+    CompositeKey key = passwordKey("password");
+    std::istringstream malformed(truncateImage(snapshot, print, transformedKey));
+    expect(!Database::loadSnapshot(malformed, print, std::move(key), transformedKey), "snapshot that can't be decoded is rejected");
+    expect(open(data).verifyKey(key) == transformedKey, "key is left untouched when a snapshot is rejected");
+    expect(throws([&](){ saveSnapshot(*database, print, SafeVector<uint8_t>()); }), "unencrypted snapshots are refused");
+
+    auto makeKey = [&](){
+        CompositeKey key;
+        key.addKey(CompositeKey::Key::fromPassword(testPassword.c_str()));
+        key.addKey(CompositeKey::Key::fromFile(keyFileName));
+        return key;
+    };
+    const std::string kdbxName = "snapshot.test.kdbx";
+    const std::string snapshotName = "snapshot.test.snapshot";
+    std::string test = readFile(fileName);
+    writeFile(kdbxName, test);
+    std::remove(snapshotName.c_str());
+    Database::Ptr expected = open(test).getDatabase(makeKey()).get();
+    expect(sameDatabase(*expected, *Database::loadFromFileCached(kdbxName, snapshotName, makeKey())), "test database is loaded");
+    expect(readFile(snapshotName).size() > 0 && Database::fingerprint(kdbxName) == fingerprint(test), "snapshot is written");
+    expect(sameDatabase(*expected, *Database::loadFromFileCached(kdbxName, snapshotName, makeKey())), "test database is loaded from snapshot");
+
+    // A snapshot of a different database, made for the same file and key,
+    // shows whether the snapshot is used or not.
+    SafeVector<uint8_t> testKey = open(test).verifyKey(makeKey());
+    writeFile(snapshotName, saveSnapshot(*database, fingerprint(test), testKey));
+    expect(Database::loadFromFileCached(kdbxName, snapshotName, makeKey())->settings().name() == "Vault", "matching snapshot is used");
+    expected->settings().setName("Changed");
+    expected->saveToFile(kdbxName);
+    expect(sameDatabase(*expected, *Database::loadFromFileCached(kdbxName, snapshotName, makeKey())), "changed file is loaded");
+    expect(readFile(snapshotName) != saveSnapshot(*database, fingerprint(test), testKey)
+           && Database::loadFromFileCached(kdbxName, snapshotName, makeKey())->settings().name() == "Changed", "snapshot is replaced");
+    expect(throws([&](){ Database::loadFromFileCached(kdbxName, snapshotName, passwordKey("wrong")); }), "wrong key is reported");
+
+    std::remove(kdbxName.c_str());
+    std::remove(snapshotName.c_str());
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares time of loading a database from a KDBX file and from a snapshot,
+// with key transformation done beforehand in both cases.
+static int benchmark(std::size_t entries){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+
+    std::string data = save(*newDatabase(entries));
+    SafeVector<uint8_t> transformedKey = open(data).verifyKey(passwordKey("password"));
+    Database::Ptr database = open(data).getDatabase(passwordKey("password"), transformedKey).get();
+    std::string snapshot = saveSnapshot(*database, fingerprint(data), transformedKey);
+    database.reset();
+    std::cout << "Database with " << entries << " entries, " << data.size() / 1024 << " KiB, snapshot "
+              << snapshot.size() / 1024 << " KiB" << std::endl;
+
+    std::size_t found = 0;
+    Clock::time_point start = Clock::now();
+    found += open(data).getDatabase(passwordKey("password"), transformedKey).get()->root()->groups();
+    std::cout << "KDBX file: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    start = Clock::now();
+    Database::Fingerprint print = fingerprint(data);
+    std::cout << "Fingerprint: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    start = Clock::now();
+    found += loadSnapshot(snapshot, print, passwordKey("password"), transformedKey)->root()->groups();
+    std::cout << "Snapshot: " << ms(Clock::now() - start) << " ms" << std::endl;
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check" && argc == 5){
+            std::ifstream passFile(argv[3]);
+            std::string password;
+            std::getline(passFile, password);
+            return check(argv[2], password, argv[4]);
+        }
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50000);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check <database> <password file> <key file>\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Checks that databases read from snapshots match their KDBX files, or\n"
+    "compares time of loading a database from a KDBX file and from\n"
+    "a snapshot (50000 entries by default).\n"
+    << std::endl;
+    return 2;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: string fields of versions"
+./strings check || exit 1
@@ -0,0 +1,161 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static std::string value(const XorredBuffer& buffer){
+    return buffer.plainString().c_str();
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    Database::Version version;
+    Database::Version::Strings& strings = version.strings;
+    strings[Database::Version::titleString] = plain("title");
+    strings[std::string("URL")] = plain("url");
+    strings[Database::Version::FieldName("Custom")] = plain("custom");
+    expect(strings.insert(std::make_pair(std::string("Notes"), plain("notes"))).second, "inserting a new field");
+    expect(!strings.insert(std::make_pair(std::string("Title"), plain("other"))).second, "inserting an existing field");
+    expect(strings.size() == 4, "number of fields");
+
+    std::string names;
+    for (const auto& item: strings)
+        names += item.first.name() + ";";
+    expect(names == "Custom;Notes;Title;URL;", "fields are ordered by name");
+
+    expect(value(strings.find("Title")->second) == "title", "find by C string");
+    expect(value(strings.find(std::string("URL"))->second) == "url", "find by string");
+    expect(value(strings.find(Database::Version::FieldName("Notes"))->second) == "notes", "find by field name");
+    expect(strings.find("Password") == strings.end() && !strings.count("Titl") && !strings.count("Titles"),
+           "find missing fields");
+    expect(strings.begin()->first == Database::Version::FieldName("Custom")
+           && &strings.begin()->first.name() == &Database::Version::FieldName(std::string("Cus") + "tom").name(),
+           "field names are interned");
+
+    // More names than per-thread caches hold, interned concurrently.
+    const std::size_t threadCount = 4;
+    std::vector<std::vector<const std::string*>> records(threadCount);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; ++t)
+        threads.emplace_back([t, &records](){
+            std::vector<const std::string*>& seen = records[t];
+            seen.resize(500);
+            for (int round = 0; round < 3; ++round)
+                for (std::size_t i = 0; i < 500; ++i){
+                    std::size_t name = (i * 7 + t * 131) % 500;
+                    const std::string* interned = &Database::Version::FieldName("Field " + std::to_string(name)).name();
+                    if (round == 0)
+                        seen[name] = interned;
+                    else if (seen[name] != interned)
+                        seen[name] = nullptr;
+                }
+        });
+    for (std::thread& thread: threads)
+        thread.join();
+    bool same = true;
+    for (std::size_t t = 0; t < threadCount; ++t)
+        for (std::size_t i = 0; i < 500; ++i)
+            same = same && records[t][i] == records[0][i] && records[t][i]
+                    && *records[t][i] == "Field " + std::to_string(i);
+    expect(same, "names interned by many threads share records");
+
+    Database::Version copy(version);
+    expect(copy.strings.size() == 4 && value(copy.strings["Custom"]) == "custom", "copying fields");
+    expect(strings.erase("Custom") == 1 && strings.erase("Custom") == 0 && strings.size() == 3, "erasing fields");
+    expect(copy.strings.size() == 4, "copies are independent");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+static std::size_t allocated(){
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks;
+}
+
+// Compares memory and lookup time of string fields stored in
+// Database::Version::Strings and std::map. Fields are left empty, so that
+// only memory used by containers is counted.
+template <typename Map>
+static int measure(const char* name, std::size_t count){
+    typedef std::chrono::steady_clock Clock;
+    const char* fields[] = {"Title", "UserName", "Password", "URL", "Notes"};
+
+    std::size_t before = allocated();
+    std::vector<Map> maps(count);
+    for (std::size_t i = 0; i < count; ++i){
+        for (const char* field: fields)
+            maps[i][field];
+    }
+    std::size_t memory = allocated() - before;
+
+    Clock::time_point start = Clock::now();
+    std::size_t found = 0;
+    for (const Map& map: maps){
+        for (const char* field: fields)
+            found += map.find(field) != map.end();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+    std::cout << name << ": " << memory / count << " bytes per version, "
+              << double(ns) / (count * 5) << " ns per lookup" << std::endl;
+    return found == 0;
+}
+
+static int benchmark(std::size_t count){
+    return measure<Database::Version::Strings>("Version::Strings", count)
+            | measure<std::map<std::string, XorredBuffer>>("std::map", count);
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [versions]\n"
+    "\n"
+    "Checks behaviour of Database::Version::Strings, or compares its memory\n"
+    "use and lookup time with std::map (200000 versions by default).\n"
+    << std::endl;
+    return 2;
+}
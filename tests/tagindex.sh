@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: tag queries through SearchableModel"
+./tagindex check || exit 1
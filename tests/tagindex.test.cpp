@@ -0,0 +1,246 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/search.h"
+#include "searchmodel.h"
+#include "testutil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static const char* const names[] = {
+    "work", "personal", "bank", "shared", "2fa", "old"
+};
+
+static bool hasTag(const Database::Entry* entry, const Database::Tag& tag){
+    const std::vector<Database::Tag>& tags = entry->latest()->tags;
+    return std::find(tags.begin(), tags.end(), tag) != tags.end();
+}
+
+// Reference implementation: scans all entries of the database.
+static void bruteForce(const Database::Group* group, const TagIndex::Tags& all, const TagIndex::Tags& any,
+                       const TagIndex::Tags& none, TagIndex::Entries& result){
+    for (size_t i = 0; i < group->entries(); ++i){
+        const Database::Entry* entry = group->entry(i);
+        auto has = [entry](const Database::Tag& tag){
+            return hasTag(entry, tag);
+        };
+        if (std::all_of(all.begin(), all.end(), has)
+                && (any.empty() || std::any_of(any.begin(), any.end(), has))
+                && std::none_of(none.begin(), none.end(), has))
+            result.push_back(entry);
+    }
+    for (size_t i = 0; i < group->groups(); ++i)
+        bruteForce(group->group(i), all, any, none, result);
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    Database::Tag work("work");
+    Database::Tag copy(std::string("wo") + "rk");
+    Database::Tag other("other");
+    std::ostringstream s;
+    s << work;
+    expect(work == copy && work.id() == copy.id() && &work.name() == &copy.name(), "tags with equal names are interned once");
+    expect(work != other && work.id() != other.id(), "tags with different names differ");
+    expect(s.str() == "work" && std::string(work) == "work", "tag name");
+    expect(explode("a;b,c", ",;:") == std::vector<std::string>({"a", "b", "c"}), "last tag of a list is kept");
+
+    std::mt19937 random(1);
+    auto pick = [&random](size_t size){
+        return std::uniform_int_distribution<size_t>(0, size - 1)(random);
+    };
+    const size_t count = sizeof(names) / sizeof(names[0]);
+    auto tags = [&](size_t max){
+        TagIndex::Tags result;
+        for (size_t i = pick(max + 1); i; --i)
+            result.push_back(names[pick(count)]);
+        return result;
+    };
+    auto newVersion = [&](){
+        Database::Version::Ptr version(new Database::Version());
+        version->tags = tags(3);
+        return version;
+    };
+
+    SearchModel model;
+    DatabaseModel::Group root = model.root();
+    for (int i = 0; i < 4; ++i)
+        root.addGroup(Database::Group::Ptr(new Database::Group()), root.groups());
+
+    // Entries indexed incrementally come in the order they were indexed,
+    // which is not the order of the tree.
+    auto sorted = [](TagIndex::Entries entries){
+        std::sort(entries.begin(), entries.end());
+        return entries;
+    };
+    auto compare = [&](const std::string& message){
+        for (int i = 0; i < 50; ++i){
+            TagIndex::Tags all = tags(2);
+            TagIndex::Tags any = tags(2);
+            TagIndex::Tags none = tags(1);
+            TagIndex::Entries expected;
+            bruteForce(model.root(), all, any, none, expected);
+            expect(sorted(model.queryTags(all, any, none)) == sorted(expected), message + ": query " + std::to_string(i));
+        }
+        for (const char* name: names){
+            TagIndex::Entries expected;
+            bruteForce(model.root(), {name}, {}, {}, expected);
+            expect(sorted(model.tagIndex().entries(name)) == sorted(expected), message + ": entries tagged " + name);
+        }
+    };
+
+    for (int i = 0; i < 200; ++i){
+        DatabaseModel::Group group = root.group(pick(root.groups()));
+        group.addEntry(Database::Entry::Ptr(new Database::Entry(newVersion())), group.entries());
+    }
+    compare("initial index");
+
+    for (int i = 0; i < 1000; ++i){
+        DatabaseModel::Group group = root.group(pick(root.groups()));
+        switch (pick(4)){
+        case 0:
+            group.addEntry(Database::Entry::Ptr(new Database::Entry(newVersion())), pick(group.entries() + 1));
+            break;
+        case 1:
+            if (group.entries())
+                group.removeEntry(pick(group.entries()));
+            break;
+        case 2:
+            if (group.entries()){
+                DatabaseModel::Entry entry = group.entry(pick(group.entries()));
+                entry.addVersion(newVersion(), entry.versions());
+            }
+            break;
+        case 3:
+            if (group.entries()){
+                DatabaseModel::Entry entry = group.entry(pick(group.entries()));
+                if (entry.versions() > 1)
+                    entry.removeVersion(entry.versions() - 1);
+            }
+            break;
+        }
+    }
+    compare("incremental updates");
+
+    root.group(0).remove();
+    compare("removed group");
+
+    TagIndex index(model.root());
+    for (int i = 0; i < 50; ++i){
+        TagIndex::Tags all = tags(2);
+        TagIndex::Tags any = tags(2);
+        TagIndex::Tags none = tags(1);
+        TagIndex::Entries expected;
+        bruteForce(model.root(), all, any, none, expected);
+        expect(index.query(all, any, none) == expected, "query " + std::to_string(i) + " of a new index in tree order");
+    }
+
+    // Removing most of the entries renumbers the remaining ones.
+    Database database;
+    Database::Group* group = database.root();
+    for (int i = 0; i < 3000; ++i)
+        group->addEntry(Database::Entry::Ptr(new Database::Entry(newVersion())), group->entries());
+    index = TagIndex(group);
+    for (std::size_t i = group->entries(); i-- > 0;)
+        if (i % 6)
+            index.removeEntry(group->entry(i));
+    TagIndex::Entries kept;
+    for (std::size_t i = 0; i < group->entries(); i += 6)
+        kept.push_back(group->entry(i));
+    expect(index.size() == kept.size() && index.query({}) == kept, "entries kept in order after compaction");
+    for (const char* name: names){
+        TagIndex::Entries expected;
+        for (const Database::Entry* entry: kept)
+            if (hasTag(entry, name))
+                expected.push_back(entry);
+        expect(index.entries(name) == expected, std::string("entries tagged ") + name + " after compaction");
+    }
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Measures tag queries on a database with many entries.
+static int benchmark(size_t count){
+    typedef std::chrono::steady_clock Clock;
+    auto us = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    };
+
+    SearchModel model;
+    DatabaseModel::Group group = model.root();
+    for (size_t i = 0; i < count; ++i){
+        Database::Version::Ptr version(new Database::Version());
+        version->tags.push_back(names[i % 6]);
+        version->tags.push_back("project" + std::to_string(i % 1000));
+        group.addEntry(Database::Entry::Ptr(new Database::Entry(std::move(version))), group.entries());
+    }
+
+    Clock::time_point start = Clock::now();
+    model.tagIndex();
+    std::cout << "Indexing " << count << " entries: " << us(Clock::now() - start) / 1000 << " ms" << std::endl;
+
+    const int repeat = 1000;
+    size_t found = 0;
+    start = Clock::now();
+    for (int i = 0; i < repeat; ++i)
+        found += model.queryTags({"project" + std::to_string(i % 1000), "work"}).size();
+    std::cout << "Query project AND work: " << double(us(Clock::now() - start)) / repeat << " us" << std::endl;
+
+    start = Clock::now();
+    for (int i = 0; i < repeat; ++i)
+        found += model.queryTags({"project" + std::to_string(i % 1000)}, {"work", "bank"}, {"old"}).size();
+    std::cout << "Query project AND (work OR bank) AND NOT old: " << double(us(Clock::now() - start)) / repeat << " us" << std::endl;
+
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "check")
+        return check();
+    if (mode == "benchmark")
+        return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000);
+
+    std::cout <<
+    "Usage: " << argv[0] << " check\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Checks tag interning and compares results of TagIndex queries with\n"
+    "a scan of all entries, or measures tag queries on a database with many\n"
+    "entries (200000 by default).\n"
+    << std::endl;
+    return 2;
+}
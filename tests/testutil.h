@@ -0,0 +1,205 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include "../include/libkeepass2pp/database.h"
+#include "../include/libkeepass2pp/wrappers.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+
+// Helpers shared by the tests that build, save and reload databases in
+// memory.
+namespace TestUtil{
+
+using namespace Kdbx;
+
+inline XorredBuffer plain(const std::string& text){
+    return XorredBuffer(SafeVector<uint8_t>(text.begin(), text.end()));
+}
+
+// Returns \p text as a protected value masked with \p mask bytes.
+inline XorredBuffer protect(const std::string& text, uint8_t mask){
+    SafeVector<uint8_t> xored(text.begin(), text.end());
+    for (uint8_t& c: xored)
+        c ^= mask;
+    return XorredBuffer(std::move(xored), SafeVector<uint8_t>(text.size(), mask));
+}
+
+// Returns \p text as a protected value masked with 0x5a bytes.
+inline XorredBuffer protect(const std::string& text){
+    return protect(text, 0x5a);
+}
+
+inline CompositeKey passwordKey(const std::string& password){
+    CompositeKey key;
+    key.addKey(CompositeKey::Key::fromPassword(password.c_str()));
+    return key;
+}
+
+inline std::string save(const Database& database){
+    std::unique_ptr<std::ostream> saved = database.saveToFile(std::unique_ptr<std::ostream>(new std::stringstream()));
+    return static_cast<std::stringstream*>(saved.get())->str();
+}
+
+inline Database::File open(const std::string& data){
+    return Database::loadFromStream(std::unique_ptr<std::istream>(new std::istringstream(data)));
+}
+
+// Splits an unencrypted and uncompressed file into its header, followed by
+// stream start bytes, and the XML document carried by its hashed blocks.
+inline std::pair<std::string, std::string> splitFile(const std::string& data){
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+    std::size_t at = 12;
+    while (true){
+        uint8_t id = bytes[at];
+        at += 3 + (bytes[at + 1] | (bytes[at + 2] << 8));
+        if (id == 0)
+            break;
+    }
+    at += 32;
+    std::pair<std::string, std::string> result(data.substr(0, at), std::string());
+    while (std::size_t size = fromLittleEndian<uint32_t>(bytes + at + 36)){
+        result.second.append(data, at + 40, size);
+        at += 40 + size;
+    }
+    return result;
+}
+
+// Joins a header returned by splitFile() with an XML document, which is
+// written in a single hashed block.
+inline std::string joinFile(const std::string& header, const std::string& document){
+    std::array<uint8_t, 40> block = {};
+    OSSL::Digest d(EVP_sha256());
+    d.update(document.data(), document.size());
+    d.final(block.data() + 4);
+    toLittleEndian<uint32_t>(uint32_t(document.size()), block.data() + 36);
+    std::string result = header;
+    result.append(reinterpret_cast<const char*>(block.data()), block.size());
+    result += document;
+    block.fill(0);
+    toLittleEndian<uint32_t>(1, block.data());
+    result.append(reinterpret_cast<const char*>(block.data()), block.size());
+    return result;
+}
+
+inline void describeIcon(std::ostream& s, const Icon& icon){
+    if (icon.type() == Icon::Type::Custom)
+        s << " icon=" << std::string(icon.custom()->uuid());
+    else if (icon.type() == Icon::Type::Standard)
+        s << " icon=" << int(icon.standard());
+}
+
+// Describes a group with all of its subgroups and entries, and checks that
+// they are linked to their parents and to the database.
+inline void describe(std::ostream& s, const Database* database, const Database::Group* group){
+    s << "group " << std::string(group->uuid()) << " " << group->properties().name << " " << group->properties().notes;
+    describeIcon(s, group->properties().icon);
+    if (group->database() != database)
+        s << " BAD DATABASE";
+    s << "\n";
+
+    for (std::size_t i = 0; i < group->entries(); ++i){
+        const Database::Entry* entry = group->entry(i);
+        s << "entry " << std::string(entry->uuid());
+        if (entry->parent() != group || entry->index() != i)
+            s << " BAD PARENT";
+        for (std::size_t j = 0; j < entry->versions(); ++j){
+            const Database::Version* version = entry->version(j);
+            s << "\n  version";
+            describeIcon(s, version->icon);
+            for (const Database::Tag& tag: version->tags)
+                s << " tag=" << tag;
+            for (const auto& item: version->strings)
+                s << " " << item.first << (item.second.mask().size() ? "*=" : "=") << item.second.plainString().c_str();
+            for (const auto& item: version->binaries)
+                s << " " << item.first << ":" << std::string(item.second->data().begin(), item.second->data().end());
+        }
+        s << "\n";
+    }
+
+    for (std::size_t i = 0; i < group->groups(); ++i){
+        if (group->group(i)->parent() != group || group->group(i)->index() != i)
+            s << "BAD PARENT\n";
+        describe(s, database, group->group(i));
+    }
+}
+
+inline std::string describe(const Database& database){
+    std::ostringstream s;
+    s << "icons=" << database.icons();
+    if (database.recycleBin())
+        s << " recycle bin=" << std::string(database.recycleBin()->uuid());
+    s << "\n";
+    describe(s, &database, database.root());
+    return s.str();
+}
+
+// Builds a database with \p groups top-level groups, each holding
+// \p entries entries with protected passwords and history.
+inline Database::Ptr newSampleDatabase(std::size_t groups, std::size_t entries, std::size_t history){
+    Database::Ptr database(new Database());
+    Icon icon = database->addIcon(std::make_shared<const CustomIcon>(Uuid::generate(), std::vector<uint8_t>{1, 2, 3}));
+    Database::Binary::Ptr attachment = std::make_shared<Database::Binary>(SafeVector<uint8_t>{'a', 't', 't'});
+
+    std::size_t counter = 0;
+    auto newVersion = [&](){
+        std::string id = std::to_string(counter++);
+        Database::Version::Ptr version(new Database::Version());
+        version->strings[Database::Version::titleString] = plain("title " + id);
+        version->strings[Database::Version::userNameString] = plain("user " + id);
+        version->strings[Database::Version::passwordString] = protect("password " + id);
+        if (counter % 3 == 0)
+            version->strings["Secret"] = protect(std::string(counter % 7, 's'));
+        if (counter % 5 == 0)
+            version->binaries["file.txt"] = attachment;
+        if (counter % 4 == 0)
+            version->icon = icon;
+        version->tags.push_back(counter % 2 ? "odd" : "even");
+        return version;
+    };
+    auto addEntries = [&](Database::Group* group){
+        for (std::size_t i = 0; i < entries; ++i){
+            group->addEntry(Database::Entry::Ptr(new Database::Entry(newVersion())), group->entries());
+            Database::Entry* entry = group->entry(group->entries() - 1);
+            for (std::size_t k = 1; k < history; ++k)
+                entry->addVersion(newVersion(), entry->versions());
+        }
+    };
+
+    Database::Group* root = database->root();
+    addEntries(root);
+    for (std::size_t i = 0; i < groups; ++i){
+        root->addGroup(Database::Group::Ptr(new Database::Group()), root->groups());
+        Database::Group* group = root->group(i);
+        group->properties().name = "group " + std::to_string(i);
+        if (i % 2)
+            group->properties().icon = icon;
+        addEntries(group);
+        group->addGroup(Database::Group::Ptr(new Database::Group()), 0);
+        addEntries(group->group(0));
+    }
+    return database;
+}
+
+}
+
+#endif // TESTUTIL_H
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: ISO-8601 and KDBX 4 timestamp conversions"
+./timeformat check || exit 1
@@ -0,0 +1,174 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <random>
+
+using namespace Kdbx;
+
+// Reference implementation that uses C library functions.
+static std::string referenceFormat(std::time_t time){
+    std::tm timeval;
+    gmtime_r(&time, &timeval);
+    char buffer[30];
+    int size = snprintf(buffer, 30, "%04d-%02d-%02dT%02d:%02d:%02dZ",
+                        timeval.tm_year + 1900, timeval.tm_mon + 1, timeval.tm_mday,
+                        timeval.tm_hour, timeval.tm_min, timeval.tm_sec);
+    return std::string(buffer, size);
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    expect(formatIsoTime(0) == "1970-01-01T00:00:00Z", "epoch");
+    expect(parseIsoTime("1970-01-01T00:00:00Z") == 0, "parse epoch");
+    expect(parseIsoTime("2000-02-29T12:34:56Z") == 951827696, "leap day");
+    expect(parseIsoTime("9999-12-31T23:59:59Z") == 253402300799, "max value");
+    expect(formatIsoTime(253402300799) == "9999-12-31T23:59:59Z", "format max value");
+    expect(formatIsoTime(std::numeric_limits<std::time_t>::max()) == "9999-12-31T23:59:59Z", "clamp max");
+    expect(formatIsoTime(std::numeric_limits<std::time_t>::min()) == "0001-01-01T00:00:00Z", "clamp min");
+    expect(daysFromCivil(1, 1, 1) * 86400 == -kdbx4TimeOffset, "kdbx4 offset");
+
+    const char* badDates[] = {
+        "", "1970-01-01T00:00:00", "1970-01-01 00:00:00Z", "1970-13-01T00:00:00Z",
+        "1970-00-01T00:00:00Z", "1970-01-32T00:00:00Z", "1970-01-00T00:00:00Z",
+        "1900-02-29T00:00:00Z", "1970-01-01T24:00:00Z", "1970-01-01T00:60:00Z",
+        "19x0-01-01T00:00:00Z", "1970-01-01T00:00:00Z0"
+    };
+    for (const char* date: badDates){
+        try{
+            parseIsoTime(date);
+            expect(false, std::string("accepted ") + date);
+        }catch(std::runtime_error&){}
+    }
+
+    std::mt19937_64 rng(1);
+    std::uniform_int_distribution<int64_t> dist(-62135596800, 253402300799);
+    for (int i=0; i< 1000000; ++i){
+        std::time_t t = dist(rng);
+        std::string s = formatIsoTime(t);
+        if (s != referenceFormat(t)){
+            expect(false, "format " + s + " != " + referenceFormat(t));
+            break;
+        }
+        if (parseIsoTime(s.c_str()) != t){
+            expect(false, "parse " + s);
+            break;
+        }
+        if (decodeKdbx4Time(encodeKdbx4Time(t)) != t){
+            expect(false, "kdbx4 round trip " + s);
+            break;
+        }
+    }
+
+    // 2020-01-01T00:00:00Z is 63713433600 seconds after 0001-01-01T00:00:00Z.
+    expect(encodeKdbx4Time(1577836800) == "ANid1Q4AAAA=", "kdbx4 encode");
+    expect(decodeKdbx4Time("ANid1Q4AAAA=") == 1577836800, "kdbx4 decode");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+static int benchmark(unsigned int count){
+    std::vector<std::time_t> times;
+    times.reserve(count);
+    std::mt19937_64 rng(1);
+    std::uniform_int_distribution<int64_t> dist(0, 4102444800);
+    for (unsigned int i=0; i< count; ++i)
+        times.push_back(dist(rng));
+
+    std::vector<std::string> strings;
+    strings.reserve(count);
+
+    typedef std::chrono::steady_clock Clock;
+    auto report = [count](const char* name, Clock::time_point start){
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        std::cout << name << ": " << double(ns)/count << " ns/timestamp" << std::endl;
+    };
+
+    Clock::time_point start = Clock::now();
+    for (std::time_t t: times)
+        strings.push_back(referenceFormat(t));
+    report("gmtime_r+snprintf", start);
+
+    strings.clear();
+    start = Clock::now();
+    for (std::time_t t: times)
+        strings.push_back(formatIsoTime(t));
+    report("formatIsoTime", start);
+
+    std::time_t sum = 0;
+    start = Clock::now();
+    for (const std::string& s: strings){
+        std::tm timeval;
+        memset(&timeval, 0, sizeof(timeval));
+        strptime(s.c_str(), "%Y-%m-%dT%TZ", &timeval);
+        sum += timegm(&timeval);
+    }
+    report("strptime+timegm", start);
+
+    start = Clock::now();
+    for (const std::string& s: strings)
+        sum -= parseIsoTime(s.data(), s.data() + s.size());
+    report("parseIsoTime", start);
+
+    start = Clock::now();
+    for (std::time_t t: times)
+        sum += decodeKdbx4Time(encodeKdbx4Time(t)) - t;
+    report("KDBX 4 encode+decode", start);
+
+    return sum == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]){
+    if (argc < 2){
+        std::cout <<
+        "Usage: " << argv[0] << " check\n"
+        "       " << argv[0] << " benchmark [count]\n"
+        "\n"
+        "check     - compares timestamp formatting against C library and exits\n"
+        "            with non-zero status on mismatch;\n"
+        "benchmark - measures timestamp parsing and formatting speed.\n"
+        << std::endl;
+        return 2;
+    }
+
+    try{
+        if (strcmp(argv[1], "check") == 0)
+            return check();
+        if (strcmp(argv[1], "benchmark") == 0)
+            return benchmark(argc > 2 ? std::stoul(argv[2]) : 1000000);
+        std::cerr << "Unknown command." << std::endl;
+        return 2;
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
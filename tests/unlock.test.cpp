@@ -0,0 +1,185 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static std::vector<CompositeKey> passwordKeys(std::initializer_list<const char*> passwords){
+    std::vector<CompositeKey> result;
+    for (const char* password: passwords)
+        result.push_back(passwordKey(password));
+    return result;
+}
+
+static std::string newDatabase(uint64_t transformRounds){
+    Database database(passwordKey("secret"));
+    database.settings().setName("Vault");
+    database.settings().fileSettings.transformRounds = transformRounds;
+    database.root()->addEntry(Database::Entry::Ptr(new Database::Entry(Database::Version::Ptr(new Database::Version()))), 0);
+    return save(database);
+}
+
+static int check(const char* fileName, const std::string& password, const char* keyFileName){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    auto throws = [](std::function<void()> f){
+        try{
+            f();
+        }catch(std::exception&){
+            return true;
+        }
+        return false;
+    };
+
+    std::array<uint8_t, 32> seed = {};
+    std::atomic<bool> cancel(false);
+    expect(passwordKey("secret").getCompositeKey(seed, 5000, cancel) == passwordKey("secret").getCompositeKey(seed, 5000),
+           "key transformation that is not cancelled");
+    cancel = true;
+    expect(passwordKey("secret").getCompositeKey(seed, 5000, cancel).empty(), "cancelled key transformation");
+
+    std::string data = newDatabase(1000);
+    SafeVector<uint8_t> secret = passwordKey("secret").getCompositeKey({}, 1);
+
+    for (unsigned threads: {1, 2, 0}){
+        std::string suffix = " with " + std::to_string(threads) + " threads";
+        for (std::size_t position = 0; position < 4; ++position){
+            std::vector<CompositeKey> candidates = passwordKeys({"a", "b", "c"});
+            candidates.insert(candidates.begin() + position, passwordKey("secret"));
+            Database::Ptr database = open(data).getDatabase(std::move(candidates), threads).get();
+            expect(database->settings().name() == "Vault" && database->root()->entries() == 1,
+                   "database is loaded with key " + std::to_string(position) + " of 4" + suffix);
+            expect(database->compositeKey().getCompositeKey({}, 1) == secret, "matching key is assigned to the database" + suffix);
+        }
+
+        Database::File file = open(data);
+        expect(throws([&](){ file.getDatabase(passwordKeys({"a", "b", "c"}), threads); }), "wrong keys are rejected" + suffix);
+        expect(file.valid(), "file remains valid after wrong keys" + suffix);
+        expect(file.getDatabase(passwordKeys({"b", "secret"}), threads).get()->root()->entries() == 1,
+               "database is loaded after wrong keys" + suffix);
+        expect(open(data).getDatabase(passwordKeys({"secret"}), threads).get()->root()->entries() == 1,
+               "database is loaded with a single key" + suffix);
+    }
+    expect(throws([&](){ open(data).getDatabase(std::vector<CompositeKey>()); }), "empty list of keys is rejected");
+
+    auto makeKey = [&](){
+        CompositeKey key;
+        key.addKey(CompositeKey::Key::fromPassword(password.c_str()));
+        key.addKey(CompositeKey::Key::fromFile(keyFileName));
+        return key;
+    };
+    std::vector<CompositeKey> candidates;
+    candidates.push_back(passwordKey(password));
+    candidates.push_back(makeKey());
+    candidates.push_back(CompositeKey());
+    Database::Ptr expected = Database::loadFromFile(fileName).getDatabase(makeKey()).get();
+    Database::Ptr database = Database::loadFromFile(fileName).getDatabase(std::move(candidates)).get();
+    expect(database->settings().name() == expected->settings().name() && database->root()->entries() == expected->root()->entries()
+           && database->root()->groups() == expected->root()->groups(), "test database is loaded with one of several keys");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares time of trying several keys one after another with verifyKey(),
+// and of trying them at once.
+static int benchmark(uint64_t transformRounds, unsigned count){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    std::string data = newDatabase(transformRounds);
+    std::cout << "Database with " << transformRounds << " transform rounds, " << count
+              << " candidate keys (right one is last), " << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    auto candidates = [count](){
+        std::vector<CompositeKey> result;
+        for (unsigned i = 1; i < count; ++i)
+            result.push_back(passwordKey("wrong" + std::to_string(i)));
+        result.push_back(passwordKey("secret"));
+        return result;
+    };
+
+    std::size_t found = 0;
+    Clock::time_point start = Clock::now();
+    Database::File file = open(data);
+    for (CompositeKey& key: candidates()){
+        try{
+            SafeVector<uint8_t> transformed = file.verifyKey(key);
+            found += file.getDatabase(std::move(key), transformed).get()->root()->entries();
+            break;
+        }catch(std::exception&){
+        }
+    }
+    std::cout << "One after another: " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    for (unsigned threads: {1u, 0u}){
+        start = Clock::now();
+        found += open(data).getDatabase(candidates(), threads).get()->root()->entries();
+        std::cout << "getDatabase() with " << (threads ? std::to_string(threads) : std::string("all")) << " threads: "
+                  << ms(Clock::now() - start) << " ms" << std::endl;
+    }
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check" && argc == 5){
+            std::ifstream passFile(argv[3]);
+            std::string password;
+            std::getline(passFile, password);
+            return check(argv[2], password, argv[4]);
+        }
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000,
+                             argc > 3 ? unsigned(std::strtoul(argv[3], nullptr, 10)) : 4);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check <database> <password file> <key file>\n"
+    "       " << argv[0] << " benchmark [transform rounds] [keys]\n"
+    "\n"
+    "Checks loading a database with one of several composite keys, or compares\n"
+    "time of trying keys one after another and at once (2000000 transform\n"
+    "rounds and 4 keys by default).\n"
+    << std::endl;
+    return 2;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+echo "Test #1: UUID lookups of groups and entries"
+./uuidindex check || exit 1
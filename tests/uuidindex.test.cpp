@@ -0,0 +1,113 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+
+#include <iostream>
+#include <string>
+
+using namespace Kdbx;
+
+static Database::Group* addGroup(Database::Group* parent){
+    Database::Group::Ptr group(new Database::Group());
+    Database::Group* result = group.get();
+    parent->addGroup(std::move(group), parent->groups());
+    return result;
+}
+
+static Database::Entry* addEntry(Database::Group* parent){
+    Database::Entry::Ptr entry(new Database::Entry(Database::Version::Ptr(new Database::Version())));
+    Database::Entry* result = entry.get();
+    parent->addEntry(std::move(entry), parent->entries());
+    return result;
+}
+
+static int check(){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    Database database;
+    Database::Group* root = database.root();
+    Database::Group* a = addGroup(root);
+    Database::Group* b = addGroup(root);
+    Database::Group* c = addGroup(a);
+    Database::Entry* e1 = addEntry(a);
+    Database::Entry* e2 = addEntry(b);
+    Database::Entry* e3 = addEntry(c);
+
+    expect(database.group(root->uuid()) == root, "root lookup");
+    expect(database.group(a->uuid()) == a && database.group(c->uuid()) == c, "group lookup");
+    expect(database.entry(e1->uuid()) == e1 && database.entry(e3->uuid()) == e3, "entry lookup");
+    expect(database.group(e1->uuid()) == nullptr && database.entry(a->uuid()) == nullptr, "lookup of wrong kind");
+    expect(database.group(Uuid::generate()) == nullptr && database.entry(Uuid::generate()) == nullptr, "lookup of unknown uuid");
+
+    expect(a->group(c->uuid()) == c && root->group(c->uuid()) == c, "subtree group lookup");
+    expect(b->group(c->uuid()) == nullptr && c->group(c->uuid()) == nullptr, "group lookup outside of subtree");
+    expect(root->entry(e3->uuid()) == e3 && b->entry(e3->uuid()) == nullptr, "subtree entry lookup");
+
+    a->moveGroup(a->index(c), b, 0);
+    expect(database.group(c->uuid()) == c && b->group(c->uuid()) == c && a->group(c->uuid()) == nullptr, "moved group lookup");
+    expect(b->entry(e3->uuid()) == e3 && a->entry(e3->uuid()) == nullptr, "entry of moved group lookup");
+
+    b->moveEntry(b->index(e2), a, 0);
+    expect(database.entry(e2->uuid()) == e2 && a->entry(e2->uuid()) == e2 && b->entry(e2->uuid()) == nullptr, "moved entry lookup");
+
+    Database::Group::Ptr taken = root->takeGroup(a);
+    expect(database.group(a->uuid()) == nullptr && database.entry(e1->uuid()) == nullptr && database.entry(e2->uuid()) == nullptr, "taken group lookup");
+    expect(taken->entry(e1->uuid()) == e1, "lookup in detached group");
+    root->addGroup(std::move(taken), 0);
+    expect(database.group(a->uuid()) == a && database.entry(e1->uuid()) == e1 && database.entry(e2->uuid()) == e2, "re-added group lookup");
+
+    Database::Entry::Ptr takenEntry = c->takeEntry(e3);
+    expect(database.entry(e3->uuid()) == nullptr && root->entry(e3->uuid()) == nullptr, "taken entry lookup");
+    c->addEntry(std::move(takenEntry), 0);
+    expect(database.entry(e3->uuid()) == e3, "re-added entry lookup");
+
+    Database::Group::Ptr twin(new Database::Group(c->uuid()));
+    Database::Group* d = twin.get();
+    d->addEntry(Database::Entry::Ptr(new Database::Entry(e3->uuid(), Database::Version::Ptr(new Database::Version()))), 0);
+    Database::Entry* e4 = d->entry(0);
+    root->addGroup(std::move(twin), root->groups());
+    taken = b->takeGroup(c);
+    expect(database.group(c->uuid()) == d && database.entry(e3->uuid()) == e4, "lookup of node sharing uuid with a taken one");
+    b->addGroup(std::move(taken), 0);
+    root->takeGroup(d);
+    expect(database.group(c->uuid()) == c && database.entry(e3->uuid()) == e3, "lookup of node sharing uuid with a taken one");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+int main(int argc, char* argv[]){
+    if (argc < 2 || std::string(argv[1]) != "check"){
+        std::cout <<
+        "Usage: " << argv[0] << " check\n"
+        "\n"
+        "Checks UUID lookups of groups and entries while a database is modified.\n"
+        << std::endl;
+        return 2;
+    }
+
+    return check();
+}
@@ -0,0 +1,183 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+static std::string newDatabase(uint64_t transformRounds){
+    Database database(passwordKey("secret"));
+    database.settings().setName("Vault");
+    database.settings().fileSettings.transformRounds = transformRounds;
+    database.root()->addEntry(Database::Entry::Ptr(new Database::Entry(Database::Version::Ptr(new Database::Version()))), 0);
+    return save(database);
+}
+
+static int check(const char* fileName, const std::string& password, const char* keyFileName){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    auto throws = [](std::function<void()> f){
+        try{
+            f();
+        }catch(std::exception&){
+            return true;
+        }
+        return false;
+    };
+
+    std::string data = newDatabase(1000);
+
+    Database::File file = open(data);
+    expect(throws([&](){ file.verifyKey(passwordKey("wrong")); }), "wrong key is rejected");
+    expect(file.valid(), "file remains valid after a wrong key");
+    SafeVector<uint8_t> transformed = file.verifyKey(passwordKey("secret"));
+    expect(transformed.size() == 32, "transformed key is returned");
+    Database::Ptr database = file.getDatabase(passwordKey("secret"), transformed).get();
+    expect(database->settings().name() == "Vault" && database->root()->entries() == 1, "database is loaded with transformed key");
+    expect(database->compositeKey().getCompositeKey({}, 1) == passwordKey("secret").getCompositeKey({}, 1),
+           "composite key is assigned to the database");
+
+    Database::File other = open(data);
+    expect(throws([&](){ other.getDatabase(passwordKey("secret"), SafeVector<uint8_t>(32, 0)).get(); }),
+           "wrong transformed key is rejected");
+
+    // Cuts the file in the middle of the first encrypted block.
+    std::size_t headerEnd = 12;
+    while (true){
+        uint8_t id = uint8_t(data[headerEnd]);
+        headerEnd += 3 + (uint8_t(data[headerEnd + 1]) | (uint8_t(data[headerEnd + 2]) << 8));
+        if (id == 0)
+            break;
+    }
+    Database::File truncated = open(data.substr(0, headerEnd + 16));
+    auto shortPayload = [&](){
+        try{
+            truncated.verifyKey(passwordKey("secret"));
+        }catch(std::ios_base::failure&){
+            return false;
+        }catch(std::runtime_error&){
+            return true;
+        }
+        return false;
+    };
+    expect(shortPayload(), "short payload is rejected");
+    expect(truncated.valid() && shortPayload(), "file remains usable after a short payload");
+
+    auto makeKey = [&](){
+        CompositeKey key;
+        key.addKey(CompositeKey::Key::fromPassword(password.c_str()));
+        key.addKey(CompositeKey::Key::fromFile(keyFileName));
+        return key;
+    };
+    Database::File test = Database::loadFromFile(fileName);
+    expect(throws([&](){ test.verifyKey(CompositeKey()); }), "empty key is rejected for test database");
+    transformed = test.verifyKey(makeKey());
+    Database::Ptr expected = Database::loadFromFile(fileName).getDatabase(makeKey()).get();
+    database = test.getDatabase(makeKey(), transformed).get();
+    expect(database->settings().name() == expected->settings().name() && database->root()->entries() == expected->root()->entries()
+           && database->root()->groups() == expected->root()->groups(), "test database is loaded with transformed key");
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Compares time of rejecting a wrong key and of loading a database with and
+// without a key checked in advance.
+static int benchmark(uint64_t transformRounds){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    std::string data = newDatabase(transformRounds);
+    std::cout << "Database with " << transformRounds << " transform rounds" << std::endl;
+
+    std::size_t found = 0;
+    Clock::time_point start = Clock::now();
+    try{
+        open(data).getDatabase(passwordKey("wrong")).get();
+    }catch(std::exception&){
+        ++found;
+    }
+    std::cout << "Wrong key, getDatabase(): " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    start = Clock::now();
+    try{
+        open(data).verifyKey(passwordKey("wrong"));
+    }catch(std::exception&){
+        ++found;
+    }
+    std::cout << "Wrong key, verifyKey(): " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    start = Clock::now();
+    Database::File file = open(data);
+    file.verifyKey(passwordKey("secret"));
+    found += file.getDatabase(passwordKey("secret")).get()->root()->entries();
+    std::cout << "Right key, verifyKey() and getDatabase(): " << ms(Clock::now() - start) << " ms" << std::endl;
+
+    start = Clock::now();
+    file = open(data);
+    SafeVector<uint8_t> transformed = file.verifyKey(passwordKey("secret"));
+    found += file.getDatabase(passwordKey("secret"), transformed).get()->root()->entries();
+    std::cout << "Right key, verifyKey() and getDatabase() with transformed key: " << ms(Clock::now() - start) << " ms" << std::endl;
+    return found == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check" && argc == 5){
+            std::ifstream passFile(argv[3]);
+            std::string password;
+            std::getline(passFile, password);
+            return check(argv[2], password, argv[4]);
+        }
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check <database> <password file> <key file>\n"
+    "       " << argv[0] << " benchmark [transform rounds]\n"
+    "\n"
+    "Checks composite keys verified before loading a database, or compares\n"
+    "time of rejecting a wrong key and of loading a database with a key\n"
+    "verified in advance (2000000 transform rounds by default).\n"
+    << std::endl;
+    return 2;
+}
@@ -0,0 +1,164 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+using namespace Kdbx;
+
+// Describes an entry the same way regardless of whether it comes from a
+// complete database or from a visitor.
+static std::string describe(const Database::Entry& entry, std::size_t versions, bool binaries){
+    std::ostringstream s;
+    s << std::string(entry.parent()->uuid()) << " versions=" << versions;
+    for (std::size_t i = entry.versions() - versions; i < entry.versions(); ++i){
+        const Database::Version* version = entry.version(i);
+        for (const auto& item: version->strings)
+            s << " " << item.first << "=" << item.second.plainString().c_str();
+        if (binaries){
+            for (const auto& item: version->binaries)
+                s << " " << item.first << ":" << item.second->size();
+        }
+    }
+    return s.str();
+}
+
+static void collect(const Database::Group* group, std::map<std::string, std::string>& result,
+                    const std::string& skipGroup, std::size_t versions, bool binaries){
+    if (group->properties().name == skipGroup)
+        return;
+    for (std::size_t i = 0; i < group->entries(); ++i){
+        const Database::Entry* entry = group->entry(i);
+        result[std::string(entry->uuid())] = describe(*entry, versions ? versions : entry->versions(), binaries);
+    }
+    for (std::size_t i = 0; i < group->groups(); ++i)
+        collect(group->group(i), result, skipGroup, versions, binaries);
+}
+
+class Collector: public Database::File::Visitor{
+public:
+    std::map<std::string, std::string> entries;
+    std::vector<const Database::Group*> path;
+    std::string skipGroup;
+    bool binaries;
+    int errors;
+
+    Collector(std::string skipGroup, bool binaries)
+        :skipGroup(std::move(skipGroup)),
+          binaries(binaries),
+          errors(0)
+    {}
+
+    bool enterGroup(const Database::Group& group) override{
+        if (group.parent() != (path.empty() ? nullptr : path.back()) || group.groups() || group.entries())
+            ++errors;
+        path.push_back(&group);
+        return group.properties().name != skipGroup;
+    }
+
+    void leaveGroup(const Database::Group& group) override{
+        if (path.empty() || path.back() != &group)
+            ++errors;
+        path.pop_back();
+    }
+
+    void entry(const Database::Entry& entry) override{
+        if (path.empty() || entry.parent() != path.back())
+            ++errors;
+        entries[std::string(entry.uuid())] = describe(entry, entry.versions(), binaries);
+    }
+};
+
+static Database::File open(const char* fileName){
+    Database::File file = Database::loadFromFile(fileName);
+    if (!file.valid())
+        throw std::runtime_error("Unable to open database file.");
+    return file;
+}
+
+static CompositeKey makeKey(const std::string& password, const char* keyFileName){
+    CompositeKey key;
+    key.addKey(CompositeKey::Key::fromPassword(password.c_str()));
+    key.addKey(CompositeKey::Key::fromFile(keyFileName));
+    return key;
+}
+
+static int check(const char* fileName, const std::string& password, const char* keyFileName){
+    int errors = 0;
+
+    Database::Ptr database = open(fileName).getDatabase(makeKey(password, keyFileName)).get();
+
+    struct Case{
+        const char* name;
+        unsigned skip;
+        const char* skipGroup;
+    } cases[] = {
+        {"full", 0, ""},
+        {"skip history and binaries", Database::File::Visitor::SkipHistory | Database::File::Visitor::SkipBinaries, ""},
+        {"skip subtree", Database::File::Visitor::SkipHistory, "SubGroup1"}
+    };
+
+    for (const Case& c: cases){
+        bool binaries = !(c.skip & Database::File::Visitor::SkipBinaries);
+        std::map<std::string, std::string> expected;
+        collect(database->root(), expected, c.skipGroup, (c.skip & Database::File::Visitor::SkipHistory) ? 1 : 0, binaries);
+
+        Collector collector(c.skipGroup, binaries);
+        open(fileName).visit(makeKey(password, keyFileName), collector, c.skip).get();
+
+        if (collector.errors || !collector.path.empty()){
+            std::cerr << "Failed: " << c.name << ": bad group nesting." << std::endl;
+            ++errors;
+        }
+        if (collector.entries != expected){
+            std::cerr << "Failed: " << c.name << ": visited entries differ." << std::endl;
+            ++errors;
+        }
+    }
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+int main(int argc, char* argv[]){
+    if (argc < 4){
+        std::cout <<
+        "Usage: " << argv[0] << " <database> <password file> <key file>\n"
+        "\n"
+        "Compares groups and entries handed to Database::File::Visitor with\n"
+        "contents of a completely loaded database.\n"
+        << std::endl;
+        return 2;
+    }
+
+    try{
+        Database::init();
+
+        std::ifstream passFile(argv[2]);
+        std::string password;
+        std::getline(passFile, password);
+
+        return check(argv[1], password, argv[3]);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+srcdir=$(dirname $0)
+
+echo "Test #1: serialized XML document"
+./xmlwriter check "$srcdir/xmlwriter.xml" || exit 1
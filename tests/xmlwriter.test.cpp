@@ -0,0 +1,136 @@
+/*Copyright (C) 2016 Jaroslaw Kubik
+ *
+   This file is part of libkeepass2pp library.
+
+libkeepass2pp is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+libkeepass2pp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with libkeepass2pp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../include/libkeepass2pp/database.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace Kdbx;
+using namespace TestUtil;
+
+// Returns a header of an unencrypted and uncompressed file with Null random
+// stream, in which protected values are written as plain base64.
+static std::string plainHeader(){
+    Database database;
+    Database::File::Settings& settings = database.settings().fileSettings;
+    settings.encrypt = false;
+    settings.compress = false;
+    settings.crsAlgorithm = RandomStream::Algorithm::Null;
+    return splitFile(save(database)).first;
+}
+
+// Removes the HeaderHash line, which depends on random seeds of the header.
+static std::string withoutHeaderHash(std::string document){
+    std::size_t begin = document.find("<HeaderHash>");
+    if (begin != std::string::npos){
+        begin = document.rfind('\n', begin) + 1;
+        document.erase(begin, document.find('\n', begin) + 1 - begin);
+    }
+    return document;
+}
+
+static int check(const char* documentFile){
+    int errors = 0;
+
+    auto expect = [&errors](bool value, const std::string& message){
+        if (!value){
+            std::cerr << "Failed: " << message << std::endl;
+            ++errors;
+        }
+    };
+
+    std::string expected;
+    {
+        std::ifstream file;
+        file.exceptions(std::istream::failbit | std::istream::badbit);
+        file.open(documentFile, std::ios::in | std::ios::binary);
+        std::ostringstream s;
+        s << file.rdbuf();
+        expected = s.str();
+    }
+
+    Database::Ptr database = open(joinFile(plainHeader(), expected)).getDatabase(CompositeKey()).get();
+    expect(database->settings().name() == "Vault & <friends>"
+           && database->settings().description() == "\"quoted\" 'text' > more\ttabbed\r\nlines", "escaped text is read");
+    const Database::Version* version = database->root()->group(0)->entry(0)->latest();
+    expect(version->strings.find(Database::Version::passwordString)->second.plainString().c_str() == std::string("p&ss<0>")
+           && version->strings.find("Custom \"field\"")->second.mask().size(), "protected values are read");
+
+    std::string document = withoutHeaderHash(splitFile(save(*database)).second);
+    expect(document == expected, "saved document matches " + std::string(documentFile));
+    if (document != expected){
+        std::ofstream("xmlwriter.output", std::ios::out | std::ios::binary) << document;
+        std::cerr << "Saved document was written to xmlwriter.output." << std::endl;
+    }
+
+    if (!errors)
+        std::cout << "OK" << std::endl;
+    return errors ? 1 : 0;
+}
+
+// Measures serialization of an unencrypted and uncompressed database, which
+// is dominated by the XML writer.
+static int benchmark(std::size_t entries){
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::duration d){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+
+    Database::Ptr database = newSampleDatabase(10, entries / 20, 2);
+    Database::File::Settings& settings = database->settings().fileSettings;
+    settings.encrypt = false;
+    settings.compress = false;
+
+    std::size_t size = 0;
+    for (int i = 0; i < 3; ++i){
+        Clock::time_point start = Clock::now();
+        size = save(*database).size();
+        std::cout << "Saving " << entries << " entries: " << ms(Clock::now() - start) << " ms, "
+                  << size / 1024 << " kB" << std::endl;
+    }
+    return size == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode(argc > 1 ? argv[1] : "");
+    try{
+        Database::init();
+        if (mode == "check" && argc > 2)
+            return check(argv[2]);
+        if (mode == "benchmark")
+            return benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000);
+    }catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout <<
+    "Usage: " << argv[0] << " check document.xml\n"
+    "       " << argv[0] << " benchmark [entries]\n"
+    "\n"
+    "Loads an XML document and checks that saving it gives the same document\n"
+    "back, byte for byte, or measures saving a database with many entries\n"
+    "(200000 by default).\n"
+    << std::endl;
+    return 2;
+}